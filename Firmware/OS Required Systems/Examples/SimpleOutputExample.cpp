@@ -7,6 +7,12 @@ unsigned char clearMemory = 1;
 
 using namespace std;
 
+// Runs as soon as the network changes MyRange, so the loop never has to poll it
+void OnRangeChanged(unsigned char controlID, int previousValue, int newValue)
+{
+	cout << "MyRange changed from " << previousValue << " to " << newValue << endl;
+}
+
 int main(void)
 {
 	cout << "Start Heep" << endl;
@@ -14,6 +20,7 @@ int main(void)
 	AddOnOffControl("Hello", HEEP_INPUT, 0);
   	AddOnOffControl("Bye", HEEP_OUTPUT, 1);
   	AddRangeControl("MyRange", HEEP_INPUT, 100, 20, 50);
+  	SetControlCallbackByName("MyRange", OnRangeChanged);
 
   	StartHeep("OS Device", HEEP_ICON_CUCKOO_CLOCK);
 
@@ -0,0 +1,545 @@
+// Heep Load Generator
+// Sends a configurable mix of COPs to one or more Heep Devices over UDP and
+// reports round trip latency percentiles, throughput and loss.
+//
+// Usage: HeepLoadGenerator.app -d <ip[:port]> [-d <ip[:port]> ...] [options]
+//   -n <count>    Total COPs to send (default 1000)
+//   -r <rate>     COPs per second across all devices. 0 sends as fast as the window allows (default 0)
+//   -w <window>   Outstanding COPs allowed per device (default 1)
+//   -t <ms>       Time to wait for a ROP before counting a COP as lost (default 500)
+//   -m <mix>      Weighted COP mix (default setval:70,isheep:20,setvertex:5,addmop:5)
+//   -c <control>  Control ID targeted by SetValue COPs (default 0)
+//   -l <port>     Port ROPs are received on (default 5000)
+//   -s <seed>     Seed for the COP mix (default 1)
+//   -j            Print the report as JSON
+//
+// Heep Devices reply to the sender's IP on port 5000, so by default the load
+// generator must run on a different host than the devices under test.
+//
+// ROPs carry no request identifier. Each ROP is matched to the oldest
+// outstanding COP for the device it came from. A window of 1 keeps latency
+// exact in the presence of loss.
+
+#include <Heep_API.h>
+#include <DeviceMemory.h>
+#include <MemoryUtilities.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Required by the Heep library
+heepByte deviceIDByte [STANDARD_ID_SIZE] = {0x4C, 0x4F, 0x41, 0x44};
+uint8_t mac[6] = {0x4C,0x4F,0x41,0x44,0x00,0x01};
+unsigned char clearMemory = 1;
+
+using namespace std;
+
+#define MAX_TARGETS 64
+#define MAX_WINDOW 64
+#define COP_BUFFER_SIZE 64
+#define ROP_BUFFER_SIZE 1500
+
+enum LoadCOPs {LoadSetValue = 0, LoadIsHeepDevice = 1, LoadSetVertex = 2, LoadAddMOP = 3, NUMBER_OF_LOAD_COPS = 4};
+const char* loadCOPNames [NUMBER_OF_LOAD_COPS] = {"setval", "isheep", "setvertex", "addmop"};
+
+struct OutstandingCOP
+{
+	uint64_t sendTime;
+	int COPType;
+};
+
+struct LoadTarget
+{
+	struct sockaddr_in address;
+	OutstandingCOP outstanding [MAX_WINDOW];
+	int firstOutstanding;
+	int numberOutstanding;
+};
+
+struct LoadSettings
+{
+	unsigned long totalCOPs;
+	unsigned long COPsPerSecond;
+	int window;
+	unsigned long timeoutMillis;
+	int mixWeights [NUMBER_OF_LOAD_COPS];
+	heepByte controlID;
+	int listenPort;
+	uint64_t seed;
+	heepByte printJSON;
+};
+
+struct LoadResults
+{
+	unsigned long sent [NUMBER_OF_LOAD_COPS];
+	unsigned long success [NUMBER_OF_LOAD_COPS];
+	unsigned long error [NUMBER_OF_LOAD_COPS];
+	unsigned long lost [NUMBER_OF_LOAD_COPS];
+	unsigned long unmatchedROPs;
+	uint64_t durationMicros;
+	vector<uint64_t> latencyMicros;
+};
+
+LoadTarget targets [MAX_TARGETS];
+int numberOfTargets = 0;
+
+uint64_t GetMicros()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// xorshift64*. Keeps the COP sequence reproducible for a given seed
+uint64_t mixState = 1;
+uint64_t GetMixRandom()
+{
+	mixState ^= mixState >> 12;
+	mixState ^= mixState << 25;
+	mixState ^= mixState >> 27;
+	return mixState * 2685821657736338717ULL;
+}
+
+int AddTarget(char* targetString)
+{
+	if(numberOfTargets >= MAX_TARGETS)
+		return 1;
+
+	char IP [32];
+	int port = 5000;
+
+	strncpy(IP, targetString, sizeof(IP) - 1);
+	IP[sizeof(IP) - 1] = '\0';
+
+	char* portString = strchr(IP, ':');
+	if(portString != NULL)
+	{
+		*portString = '\0';
+		port = atoi(portString + 1);
+	}
+
+	LoadTarget* newTarget = &targets[numberOfTargets];
+	memset(newTarget, 0, sizeof(LoadTarget));
+	newTarget->address.sin_family = AF_INET;
+	newTarget->address.sin_port = htons(port);
+
+	if(inet_aton(IP, &newTarget->address.sin_addr) == 0)
+		return 1;
+
+	numberOfTargets++;
+	return 0;
+}
+
+int ParseMix(char* mixString, int* mixWeights)
+{
+	for(int i = 0; i < NUMBER_OF_LOAD_COPS; i++)
+		mixWeights[i] = 0;
+
+	char* entry = strtok(mixString, ",");
+	while(entry != NULL)
+	{
+		char* weight = strchr(entry, ':');
+		if(weight == NULL)
+			return 1;
+
+		*weight = '\0';
+
+		int COPType = -1;
+		for(int i = 0; i < NUMBER_OF_LOAD_COPS; i++)
+		{
+			if(strcmp(entry, loadCOPNames[i]) == 0)
+				COPType = i;
+		}
+
+		if(COPType < 0)
+			return 1;
+
+		mixWeights[COPType] = atoi(weight + 1);
+		entry = strtok(NULL, ",");
+	}
+
+	return 0;
+}
+
+int ChooseCOPType(int* mixWeights)
+{
+	int totalWeight = 0;
+	for(int i = 0; i < NUMBER_OF_LOAD_COPS; i++)
+		totalWeight += mixWeights[i];
+
+	int choice = GetMixRandom() % totalWeight;
+	for(int i = 0; i < NUMBER_OF_LOAD_COPS; i++)
+	{
+		if(choice < mixWeights[i])
+			return i;
+
+		choice -= mixWeights[i];
+	}
+
+	return LoadSetValue;
+}
+
+// Builds a COP in the same layout the firmware expects. Vertices and MOPs
+// are attributed to the load generator's own ID and point at a control
+// that does not exist, so the device never acts on them
+unsigned long FillCOPBuffer(heepByte* buffer, int COPType, LoadSettings* settings, unsigned long sequence)
+{
+	unsigned long counter = 0;
+
+	if(COPType == LoadSetValue)
+	{
+		counter = AddCharToBuffer(buffer, counter, SetValueOpCode);
+		counter = AddCharToBuffer(buffer, counter, 2);
+		counter = AddCharToBuffer(buffer, counter, settings->controlID);
+		counter = AddCharToBuffer(buffer, counter, sequence % 2);
+	}
+	else if(COPType == LoadIsHeepDevice)
+	{
+		counter = AddCharToBuffer(buffer, counter, IsHeepDeviceOpCode);
+		counter = AddCharToBuffer(buffer, counter, 0);
+	}
+	else if(COPType == LoadSetVertex)
+	{
+		heepByte rxID [STANDARD_ID_SIZE] = {0x4C, 0x4F, 0x41, 0x45};
+
+		counter = AddCharToBuffer(buffer, counter, SetVertexOpCode);
+		counter = AddCharToBuffer(buffer, counter, 2*STANDARD_ID_SIZE + 6);
+		counter = AddDeviceIDToBuffer_Byte(buffer, deviceIDByte, counter);
+		counter = AddDeviceIDToBuffer_Byte(buffer, rxID, counter);
+		counter = AddCharToBuffer(buffer, counter, 0xFF);
+		counter = AddCharToBuffer(buffer, counter, 0xFF);
+		counter = AddCharToBuffer(buffer, counter, 127);
+		counter = AddCharToBuffer(buffer, counter, 0);
+		counter = AddCharToBuffer(buffer, counter, 0);
+		counter = AddCharToBuffer(buffer, counter, 1);
+	}
+	else if(COPType == LoadAddMOP)
+	{
+		counter = AddCharToBuffer(buffer, counter, AddMOPOpCode);
+		counter = AddCharToBuffer(buffer, counter, 1 + STANDARD_ID_SIZE + 1 + 4);
+		counter = AddCharToBuffer(buffer, counter, FrontEndPositionOpCode);
+		counter = AddDeviceIDToBuffer_Byte(buffer, deviceIDByte, counter);
+		counter = AddCharToBuffer(buffer, counter, 4);
+		counter = AddNumberToBufferWithSpecifiedBytes(buffer, sequence % 1000, counter, 2);
+		counter = AddNumberToBufferWithSpecifiedBytes(buffer, sequence % 1000, counter, 2);
+	}
+
+	return counter;
+}
+
+int FindTargetByAddress(struct sockaddr_in* address)
+{
+	for(int i = 0; i < numberOfTargets; i++)
+	{
+		if(targets[i].address.sin_addr.s_addr == address->sin_addr.s_addr)
+			return i;
+	}
+
+	return -1;
+}
+
+void ExpireOutstandingCOPs(uint64_t now, LoadSettings* settings, LoadResults* results)
+{
+	for(int i = 0; i < numberOfTargets; i++)
+	{
+		LoadTarget* target = &targets[i];
+
+		while(target->numberOutstanding > 0)
+		{
+			OutstandingCOP* oldest = &target->outstanding[target->firstOutstanding];
+			if(now - oldest->sendTime < settings->timeoutMillis * 1000)
+				break;
+
+			results->lost[oldest->COPType]++;
+			target->firstOutstanding = (target->firstOutstanding + 1) % MAX_WINDOW;
+			target->numberOutstanding--;
+		}
+	}
+}
+
+void HandleROP(heepByte* ROP, int ROPLength, struct sockaddr_in* sender, LoadResults* results)
+{
+	int targetIndex = FindTargetByAddress(sender);
+	if(targetIndex < 0 || ROPLength < 1 || targets[targetIndex].numberOutstanding == 0)
+	{
+		results->unmatchedROPs++;
+		return;
+	}
+
+	LoadTarget* target = &targets[targetIndex];
+	OutstandingCOP* oldest = &target->outstanding[target->firstOutstanding];
+	target->firstOutstanding = (target->firstOutstanding + 1) % MAX_WINDOW;
+	target->numberOutstanding--;
+
+	results->latencyMicros.push_back(GetMicros() - oldest->sendTime);
+
+	if(ROP[0] == ErrorOpCode)
+		results->error[oldest->COPType]++;
+	else
+		results->success[oldest->COPType]++;
+}
+
+void RunLoad(int socketFd, LoadSettings* settings, LoadResults* results)
+{
+	heepByte COPBuffer [COP_BUFFER_SIZE];
+	heepByte ROPBuffer [ROP_BUFFER_SIZE];
+
+	unsigned long COPsSent = 0;
+	int nextTarget = 0;
+
+	uint64_t startTime = GetMicros();
+	uint64_t nextSendTime = startTime;
+	uint64_t sendInterval = 0;
+	if(settings->COPsPerSecond > 0)
+		sendInterval = 1000000 / settings->COPsPerSecond;
+
+	while(1)
+	{
+		uint64_t now = GetMicros();
+		ExpireOutstandingCOPs(now, settings, results);
+
+		int totalOutstanding = 0;
+		for(int i = 0; i < numberOfTargets; i++)
+			totalOutstanding += targets[i].numberOutstanding;
+
+		if(COPsSent >= settings->totalCOPs && totalOutstanding == 0)
+			break;
+
+		// Send to the next device with room in its window
+		if(COPsSent < settings->totalCOPs && now >= nextSendTime)
+		{
+			for(int i = 0; i < numberOfTargets; i++)
+			{
+				LoadTarget* target = &targets[nextTarget];
+				nextTarget = (nextTarget + 1) % numberOfTargets;
+
+				if(target->numberOutstanding >= settings->window)
+					continue;
+
+				int COPType = ChooseCOPType(settings->mixWeights);
+				unsigned long COPLength = FillCOPBuffer(COPBuffer, COPType, settings, COPsSent);
+
+				OutstandingCOP* newCOP = &target->outstanding[(target->firstOutstanding + target->numberOutstanding) % MAX_WINDOW];
+				newCOP->sendTime = GetMicros();
+				newCOP->COPType = COPType;
+				target->numberOutstanding++;
+
+				sendto(socketFd, COPBuffer, COPLength, 0, (struct sockaddr*)&target->address, sizeof(target->address));
+
+				results->sent[COPType]++;
+				COPsSent++;
+				nextSendTime += sendInterval;
+				break;
+			}
+		}
+
+		// Wait for a ROP until the next COP is due
+		int waitMillis = 1;
+		if(COPsSent < settings->totalCOPs && sendInterval > 0 && nextSendTime > now)
+			waitMillis = (nextSendTime - now) / 1000;
+
+		struct pollfd ROPSocket = {socketFd, POLLIN, 0};
+		if(poll(&ROPSocket, 1, waitMillis) > 0)
+		{
+			struct sockaddr_in sender;
+			socklen_t senderLength = sizeof(sender);
+			int ROPLength = recvfrom(socketFd, ROPBuffer, ROP_BUFFER_SIZE, 0, (struct sockaddr*)&sender, &senderLength);
+
+			if(ROPLength > 0)
+				HandleROP(ROPBuffer, ROPLength, &sender, results);
+		}
+	}
+
+	results->durationMicros = GetMicros() - startTime;
+}
+
+uint64_t GetLatencyPercentile(vector<uint64_t>& sortedLatencies, double percentile)
+{
+	if(sortedLatencies.empty())
+		return 0;
+
+	size_t index = (size_t)(percentile / 100.0 * (sortedLatencies.size() - 1) + 0.5);
+	return sortedLatencies[index];
+}
+
+#define NUM_PERCENTILES 5
+double percentiles [NUM_PERCENTILES] = {50, 90, 99, 99.9, 100};
+const char* percentileNames [NUM_PERCENTILES] = {"p50", "p90", "p99", "p99_9", "max"};
+
+void PrintReport(LoadSettings* settings, LoadResults* results)
+{
+	sort(results->latencyMicros.begin(), results->latencyMicros.end());
+
+	unsigned long totalSent = 0;
+	unsigned long totalReceived = 0;
+	unsigned long totalLost = 0;
+	for(int i = 0; i < NUMBER_OF_LOAD_COPS; i++)
+	{
+		totalSent += results->sent[i];
+		totalReceived += results->success[i] + results->error[i];
+		totalLost += results->lost[i];
+	}
+
+	double seconds = results->durationMicros / 1000000.0;
+	double throughput = seconds > 0 ? totalReceived / seconds : 0;
+	double lossPercent = totalSent > 0 ? 100.0 * totalLost / totalSent : 0;
+
+	if(settings->printJSON)
+	{
+		cout << "{" << endl;
+		cout << "  \"devices\": " << numberOfTargets << "," << endl;
+		cout << "  \"window\": " << settings->window << "," << endl;
+		cout << "  \"offered_rate\": " << settings->COPsPerSecond << "," << endl;
+		cout << "  \"duration_seconds\": " << seconds << "," << endl;
+		cout << "  \"sent\": " << totalSent << "," << endl;
+		cout << "  \"received\": " << totalReceived << "," << endl;
+		cout << "  \"lost\": " << totalLost << "," << endl;
+		cout << "  \"unmatched\": " << results->unmatchedROPs << "," << endl;
+		cout << "  \"loss_percent\": " << lossPercent << "," << endl;
+		cout << "  \"throughput_per_second\": " << throughput << "," << endl;
+		cout << "  \"latency_micros\": {";
+		for(int i = 0; i < NUM_PERCENTILES; i++)
+		{
+			if(i > 0)
+				cout << ", ";
+
+			cout << "\"" << percentileNames[i] << "\": " << GetLatencyPercentile(results->latencyMicros, percentiles[i]);
+		}
+		cout << "}," << endl;
+		cout << "  \"cops\": {";
+		for(int i = 0; i < NUMBER_OF_LOAD_COPS; i++)
+		{
+			if(i > 0)
+				cout << ", ";
+
+			cout << "\"" << loadCOPNames[i] << "\": {\"sent\": " << results->sent[i] << ", \"success\": " << results->success[i];
+			cout << ", \"error\": " << results->error[i] << ", \"lost\": " << results->lost[i] << "}";
+		}
+		cout << "}" << endl;
+		cout << "}" << endl;
+		return;
+	}
+
+	cout << "Devices: " << numberOfTargets << "  Window: " << settings->window << "  Offered rate: ";
+	if(settings->COPsPerSecond > 0)
+		cout << settings->COPsPerSecond << "/s" << endl;
+	else
+		cout << "unlimited" << endl;
+
+	cout << "Sent: " << totalSent << "  Received: " << totalReceived << "  Lost: " << totalLost << " (" << lossPercent << "%)";
+	cout << "  Unmatched: " << results->unmatchedROPs << endl;
+	cout << "Duration: " << seconds << " s  Throughput: " << throughput << " ROPs/s" << endl;
+
+	cout << "Latency (us):";
+	for(int i = 0; i < NUM_PERCENTILES; i++)
+		cout << " " << percentileNames[i] << "=" << GetLatencyPercentile(results->latencyMicros, percentiles[i]);
+	cout << endl;
+
+	for(int i = 0; i < NUMBER_OF_LOAD_COPS; i++)
+	{
+		cout << "  " << loadCOPNames[i] << ": sent " << results->sent[i] << ", success " << results->success[i];
+		cout << ", error " << results->error[i] << ", lost " << results->lost[i] << endl;
+	}
+}
+
+void PrintUsage()
+{
+	cout << "Usage: HeepLoadGenerator.app -d <ip[:port]> [-d <ip[:port]> ...] [-n count] [-r rate] [-w window]" << endl;
+	cout << "                             [-t timeoutMs] [-m setval:70,isheep:20,setvertex:5,addmop:5]" << endl;
+	cout << "                             [-c controlID] [-l listenPort] [-s seed] [-j]" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	LoadSettings settings;
+	settings.totalCOPs = 1000;
+	settings.COPsPerSecond = 0;
+	settings.window = 1;
+	settings.timeoutMillis = 500;
+	settings.mixWeights[LoadSetValue] = 70;
+	settings.mixWeights[LoadIsHeepDevice] = 20;
+	settings.mixWeights[LoadSetVertex] = 5;
+	settings.mixWeights[LoadAddMOP] = 5;
+	settings.controlID = 0;
+	settings.listenPort = 5000;
+	settings.seed = 1;
+	settings.printJSON = 0;
+
+	int option;
+	while((option = getopt(argc, argv, "d:n:r:w:t:m:c:l:s:j")) != -1)
+	{
+		if(option == 'd' && AddTarget(optarg) == 0) continue;
+		else if(option == 'n') settings.totalCOPs = strtoul(optarg, NULL, 10);
+		else if(option == 'r') settings.COPsPerSecond = strtoul(optarg, NULL, 10);
+		else if(option == 'w') settings.window = atoi(optarg);
+		else if(option == 't') settings.timeoutMillis = strtoul(optarg, NULL, 10);
+		else if(option == 'm' && ParseMix(optarg, settings.mixWeights) == 0) continue;
+		else if(option == 'c') settings.controlID = atoi(optarg);
+		else if(option == 'l') settings.listenPort = atoi(optarg);
+		else if(option == 's') settings.seed = strtoull(optarg, NULL, 10);
+		else if(option == 'j') settings.printJSON = 1;
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	int totalWeight = 0;
+	for(int i = 0; i < NUMBER_OF_LOAD_COPS; i++)
+		totalWeight += settings.mixWeights[i];
+
+	if(numberOfTargets == 0 || totalWeight <= 0 || settings.window < 1 || settings.window > MAX_WINDOW)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	mixState = settings.seed * 2 + 1; // xorshift state must never be 0
+
+	int socketFd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if(socketFd == -1)
+	{
+		perror("socket");
+		return 1;
+	}
+
+	// ROPs are sent back to port 5000 rather than to the COP's source port,
+	// so one socket on the listen port both sends and receives
+	struct sockaddr_in listenAddress;
+	memset(&listenAddress, 0, sizeof(listenAddress));
+	listenAddress.sin_family = AF_INET;
+	listenAddress.sin_port = htons(settings.listenPort);
+	listenAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if(bind(socketFd, (struct sockaddr*)&listenAddress, sizeof(listenAddress)))
+	{
+		perror("bind");
+		return 1;
+	}
+
+	LoadResults results;
+	memset(results.sent, 0, sizeof(results.sent));
+	memset(results.success, 0, sizeof(results.success));
+	memset(results.error, 0, sizeof(results.error));
+	memset(results.lost, 0, sizeof(results.lost));
+	results.unmatchedROPs = 0;
+	results.durationMicros = 0;
+	results.latencyMicros.reserve(settings.totalCOPs);
+
+	RunLoad(socketFd, &settings, &results);
+	close(socketFd);
+
+	PrintReport(&settings, &results);
+
+	return 0;
+}
@@ -5,10 +5,12 @@
 #include "Device.h"
 #include "Heep_API.h"
 #include "DeviceSpecificMemory.h"
+#include "ReliableDelivery.h"
 
 void ClearOutputBuffer()
 {
 	outputBufferLastByte = 0;
+	outputBufferOverflowed = 0;
 }
 
 void ClearInputBuffer()
@@ -16,23 +18,46 @@ void ClearInputBuffer()
 	inputBufferLastByte = 0;
 }
 
+heepByte WillOutputBufferOverflow(unsigned int numBytesToBeAdded)
+{
+	return outputBufferLastByte + numBytesToBeAdded > OUTPUT_BUFFER_SIZE;
+}
+
+void AddBufferToOutputBuffer(heepByte* buffer, unsigned int numBytes)
+{
+	if(WillOutputBufferOverflow(numBytes))
+	{
+		outputBufferOverflowed = 1;
+		return;
+	}
+
+	memcpy(&outputBuffer[outputBufferLastByte], buffer, numBytes);
+	outputBufferLastByte += numBytes;
+}
+
 void AddNewCharToOutputBuffer(unsigned char newMem)
 {
-	outputBufferLastByte = AddCharToBuffer(outputBuffer, outputBufferLastByte, newMem);
+	AddBufferToOutputBuffer(&newMem, 1);
+}
+
+void AddNumberToOutputBuffer(unsigned long number, int numBytes)
+{
+	heepByte buffer [sizeof(unsigned long)];
+	AddNumberToBufferWithSpecifiedBytes(buffer, number, 0, numBytes);
+	AddBufferToOutputBuffer(buffer, numBytes);
 }
 
 void AddDeviceIDToOutputBuffer_Byte(heepByte* deviceID)
 {
-	outputBufferLastByte = AddDeviceIDToBuffer_Byte(outputBuffer, deviceID, outputBufferLastByte);
+	AddBufferToOutputBuffer(deviceID, STANDARD_ID_SIZE);
 }
 
 void AddDeviceIDOrIndexToOutputBuffer_Byte(heepByte* deviceID)
 {
-	unsigned int counter = 0;
 	heepByte copyDeviceID [STANDARD_ID_SIZE];
 	CopyDeviceID(deviceID, copyDeviceID);
 	GetIndexedDeviceID_Byte(copyDeviceID);
-	AddBufferToBuffer(outputBuffer, copyDeviceID, ID_SIZE, &outputBufferLastByte, &counter);
+	AddBufferToOutputBuffer(copyDeviceID, ID_SIZE);
 }
 
 #ifdef USE_ANALYTICS
@@ -48,15 +73,15 @@ void AddAnalyticsStringToOutputBufferAndDeleteMOPs()
       {
         int numBytes = deviceMemory[AnalyticsPointer + ID_SIZE + 1];
 
+        // Data that does not fit stays in memory for the next string
+        if(WillOutputBufferOverflow(1 + STANDARD_ID_SIZE + 1 + numBytes))
+          return;
+
         AddNewCharToOutputBuffer(deviceMemory[AnalyticsPointer]);
         AddDeviceIDToOutputBuffer_Byte(deviceIDByte);
-        
-        for(int i = AnalyticsPointer + ID_SIZE + 1; i < AnalyticsPointer + numBytes + ID_SIZE + 2; i++)
-        {
-          AddNewCharToOutputBuffer(deviceMemory[i]);
-        }
+        AddBufferToOutputBuffer(&deviceMemory[AnalyticsPointer + ID_SIZE + 1], numBytes + 1);
 
-        deviceMemory[AnalyticsPointer] = FragmentOpCode;
+        FragmentMOPAtPointer(AnalyticsPointer);
       }
 
   }while(AnalyticsPointer != -1);
@@ -65,15 +90,6 @@ void AddAnalyticsStringToOutputBufferAndDeleteMOPs()
 
 unsigned long CalculateControlDataSize()
 {
-	unsigned long controlDataSize = 0;
-
-	int i;
-	for(i = 0; i < numberOfControls; i++)
-	{
-		controlDataSize += 12;
-		controlDataSize += strlen(controlList[i].controlName);
-	}
-
 	return controlDataSize;
 }
 
@@ -123,23 +139,50 @@ void FillOutputBufferWithSetValCOPBuffer(unsigned char controlID, heepByte* buff
 	AddNewCharToOutputBuffer(SetValueOpCode);
 	AddNewCharToOutputBuffer(bufferLength + 1);
 	AddNewCharToOutputBuffer(controlID);
+	AddBufferToOutputBuffer(buffer, bufferLength);
+}
 
-	int i;
-	for(i = 0; i < bufferLength; i++)
-	{
-		AddNewCharToOutputBuffer(buffer[i]);
-	}
+// The control ID follows the op code and the byte count
+void SetControlIDOfSetValCOP(unsigned char controlID)
+{
+	outputBuffer[2] = controlID;
+}
+
+void FillOutputBufferWithControlSummaryHeader()
+{
+	ClearOutputBuffer();
+	AddNewCharToOutputBuffer(ControlSummaryOpCode);
+	AddNewCharToOutputBuffer(0);
+}
+
+// The receiver must hold the whole COP in its input buffer
+#if INPUT_BUFFER_SIZE - 2 < 255
+#define CONTROL_SUMMARY_MAX_BYTES (INPUT_BUFFER_SIZE - 2)
+#else
+#define CONTROL_SUMMARY_MAX_BYTES 255
+#endif
+
+heepByte AddControlToControlSummaryCOP(unsigned char controlID, unsigned char value)
+{
+	if(outputBuffer[1] + 2 > CONTROL_SUMMARY_MAX_BYTES)
+		return 1;
+
+	AddNewCharToOutputBuffer(controlID);
+	AddNewCharToOutputBuffer(value);
+	outputBuffer[1] += 2;
+
+	return 0;
 }
 
 // Updated
 void FillOutputBufferWithControlData()
 {
-	int i;
+	unsigned int i;
 	for(i = 0; i < numberOfControls; i++)
 	{
 		AddNewCharToOutputBuffer(ControlOpCode);
 		AddDeviceIDOrIndexToOutputBuffer_Byte(deviceIDByte);
-		unsigned int byteSize = strlen(controlList[i].controlName) + 6;
+		unsigned int byteSize = controlList[i].controlNameLength + 6;
 		AddNewCharToOutputBuffer(byteSize);
 		AddNewCharToOutputBuffer(controlList[i].controlID);
 		AddNewCharToOutputBuffer(controlList[i].controlType);
@@ -147,12 +190,7 @@ void FillOutputBufferWithControlData()
 		AddNewCharToOutputBuffer(controlList[i].lowValue);
 		AddNewCharToOutputBuffer(controlList[i].highValue);
 		AddNewCharToOutputBuffer(controlList[i].curValue);
-
-		int j;
-		for(j = 0; j < strlen(controlList[i].controlName); j++)
-		{
-			AddNewCharToOutputBuffer(controlList[i].controlName[j]);
-		}
+		AddBufferToOutputBuffer((heepByte*)controlList[i].controlName, byteSize - 6);
 	}
 }
 
@@ -175,9 +213,14 @@ void AddVersionToOutputBuffer()
 	AddNewCharToOutputBuffer(SetValueOpCode);
 	AddNewCharToOutputBuffer(SetPositionOpCode);
 	AddNewCharToOutputBuffer(SetVertexOpCode);
+	AddNewCharToOutputBuffer(SetVerticesOpCode);
 	AddNewCharToOutputBuffer(DeleteVertexOpCode);
 	AddNewCharToOutputBuffer(AddMOPOpCode);
 	AddNewCharToOutputBuffer(DeleteMOPOpCode);
+	AddNewCharToOutputBuffer(ExportMemoryImageOpCode);
+#ifdef USE_MEMORY_IMAGE_IMPORT
+	AddNewCharToOutputBuffer(ImportMemoryImageOpCode);
+#endif
 #ifdef DEVICE_USES_WIFI
 	AddNewCharToOutputBuffer(SetWiFiDataOpCode);
 #endif
@@ -188,6 +231,16 @@ void AddVersionToOutputBuffer()
 // Updated
 void FillOutputBufferWithMemoryDump()
 {
+	// Every ROP below carries this device's local ID
+	heepByte localID [STANDARD_ID_SIZE];
+	CopyDeviceID(deviceIDByte, localID);
+	if(GetIndexedDeviceID_Byte(localID) == 0)
+	{
+		char errorMessage [] = "Memory Full";
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
+		return;
+	}
+
 	ClearOutputBuffer();
 	
 	AddNewCharToOutputBuffer(MemoryDumpOpCode);
@@ -208,50 +261,54 @@ void FillOutputBufferWithMemoryDump()
 	// Add Dynamic Memory Size
 	FillOutputBufferWithDynamicMemorySize();
 
-	// Add Dynamic Memory
-	int i;
-	for(i = 0; i<curFilledMemory; i++)
+	// Add Dynamic Memory. A dump that does not fit ends at the last whole MOP
+	if(WillOutputBufferOverflow(curFilledMemory))
 	{
-		AddNewCharToOutputBuffer(deviceMemory[i]);
+		unsigned int counter = 0;
+		unsigned int nextCounter = SkipOpCode(counter);
+		while(nextCounter <= curFilledMemory && WillOutputBufferOverflow(nextCounter) == 0)
+		{
+			counter = nextCounter;
+			nextCounter = SkipOpCode(counter);
+		}
+
+		AddBufferToOutputBuffer(deviceMemory, counter);
+		outputBufferOverflowed = 1;
+	}
+	else
+	{
+		AddBufferToOutputBuffer(deviceMemory, curFilledMemory);
 	}
 }
 
-// Updated
-void FillOutputBufferWithSuccess(char* message, int stringLength)
+// [ROP][Device ID][Num Bytes][Message] in a single write
+void FillOutputBufferWithMessageROP(unsigned char opCode, char* message, int stringLength)
 {
 	ClearOutputBuffer();
 
-	AddNewCharToOutputBuffer(SuccessOpCode);
-	AddDeviceIDToOutputBuffer_Byte(deviceIDByte);
-
-	unsigned long totalMemory = strlen(message);
-
-	AddNewCharToOutputBuffer(totalMemory);
-
-	int i;
-	for(i = 0; i < totalMemory; i++)
+	if(stringLength > 255 || WillOutputBufferOverflow(STANDARD_ID_SIZE + 2 + stringLength))
 	{
-		AddNewCharToOutputBuffer(message[i]);
+		outputBufferOverflowed = 1;
+		return;
 	}
+
+	outputBuffer[0] = opCode;
+	memcpy(&outputBuffer[1], deviceIDByte, STANDARD_ID_SIZE);
+	outputBuffer[STANDARD_ID_SIZE + 1] = stringLength;
+	memcpy(&outputBuffer[STANDARD_ID_SIZE + 2], message, stringLength);
+	outputBufferLastByte = STANDARD_ID_SIZE + 2 + stringLength;
 }
 
 // Updated
-void FillOutputBufferWithError(char* message, int stringLength)
+void FillOutputBufferWithSuccess(char* message, int stringLength)
 {
-	ClearOutputBuffer();
-
-	AddNewCharToOutputBuffer(ErrorOpCode);
-	AddDeviceIDToOutputBuffer_Byte(deviceIDByte);
-
-	unsigned long totalMemory = strlen(message);
-
-	AddNewCharToOutputBuffer(totalMemory);
+	FillOutputBufferWithMessageROP(SuccessOpCode, message, stringLength);
+}
 
-	int i;
-	for(i = 0; i < totalMemory; i++)
-	{
-		AddNewCharToOutputBuffer(message[i]);
-	}
+// Updated
+void FillOutputBufferWithError(char* message, int stringLength)
+{
+	FillOutputBufferWithMessageROP(ErrorOpCode, message, stringLength);
 }
 
 void ExecuteMemoryDumpOpCode()
@@ -283,12 +340,12 @@ void ExecuteSetValOpCode()
 	if(success == 0)
 	{
 		char SuccessMessage [] = "Value Set";
-		FillOutputBufferWithSuccess(SuccessMessage, strlen(SuccessMessage));
+		FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
 	}
 	else 
 	{
 		char ErrorMessage [] = "Failed to Set";
-		FillOutputBufferWithError(ErrorMessage, strlen(ErrorMessage));
+		FillOutputBufferWithError(ErrorMessage, sizeof(ErrorMessage) - 1);
 	}
 }
 
@@ -303,12 +360,12 @@ void ExecuteSetPositionOpCode()
 	if(UpdateXYInMemory_Byte(xValue, yValue, deviceIDByte) == 0)
 	{
 		char SuccessMessage [] = "Value Set";
-		FillOutputBufferWithSuccess(SuccessMessage, strlen(SuccessMessage));
+		FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
 	}
 	else
 	{
 		char ErrorMessage [] = "Failed to set. Memory Full";
-		FillOutputBufferWithError(ErrorMessage, strlen(ErrorMessage));
+		FillOutputBufferWithError(ErrorMessage, sizeof(ErrorMessage) - 1);
 	}
 }
 
@@ -339,18 +396,174 @@ void ExecuteSetVertexOpCode()
 	{
 		ClearOutputBuffer();
 		char SuccessMessage [] = "Vertex Set";
-		FillOutputBufferWithSuccess(SuccessMessage, strlen(SuccessMessage));
+		FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
 	}
 	else
 	{
 		ClearOutputBuffer();
 		char errorMessage [] = "Vertex Not Set. Memory Overflow";
-		FillOutputBufferWithError(errorMessage, strlen(errorMessage));
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
 	}
 
 	
 }
 
+int AddNumberToString(char* string, int position, unsigned int number)
+{
+	char digits [10];
+	int numberOfDigits = 0;
+
+	do
+	{
+		digits[numberOfDigits++] = '0' + number%10;
+		number /= 10;
+	}while(number > 0);
+
+	while(numberOfDigits > 0)
+	{
+		string[position++] = digits[--numberOfDigits];
+	}
+
+	return position;
+}
+
+// Each vertex is laid out as in a Set Vertex COP
+void ExecuteSetVerticesOpCode()
+{
+	unsigned int counter = 1;
+	unsigned char numBytes = GetNumberFromBuffer(inputBuffer, &counter, 1);
+
+	int vertexBytes = 2*STANDARD_ID_SIZE + 6;
+	int numberOfNewVertices = numBytes / vertexBytes;
+
+	if(numberOfNewVertices == 0 || numberOfNewVertices > VERTICES_PER_BATCH || numBytes % vertexBytes != 0 || numBytes + 2 > INPUT_BUFFER_SIZE)
+	{
+		char errorMessage [] = "Invalid Vertices";
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
+		return;
+	}
+
+	struct Vertex_Byte vertices [VERTICES_PER_BATCH];
+
+	for(int i = 0; i < numberOfNewVertices; i++)
+	{
+		unsigned int localCounter = 0;
+		AddBufferToBuffer(vertices[i].txID, inputBuffer, STANDARD_ID_SIZE, &localCounter, &counter);
+		localCounter = 0;
+		AddBufferToBuffer(vertices[i].rxID, inputBuffer, STANDARD_ID_SIZE, &localCounter, &counter);
+		vertices[i].txControlID = GetNumberFromBuffer(inputBuffer, &counter, 1);
+		vertices[i].rxControlID = GetNumberFromBuffer(inputBuffer, &counter, 1);
+		vertices[i].rxIPAddress.Octet4 = GetNumberFromBuffer(inputBuffer, &counter, 1);
+		vertices[i].rxIPAddress.Octet3 = GetNumberFromBuffer(inputBuffer, &counter, 1);
+		vertices[i].rxIPAddress.Octet2 = GetNumberFromBuffer(inputBuffer, &counter, 1);
+		vertices[i].rxIPAddress.Octet1 = GetNumberFromBuffer(inputBuffer, &counter, 1);
+	}
+
+	int verticesAdded = 0;
+	if(AddVertices(vertices, numberOfNewVertices, &verticesAdded) == 0)
+	{
+		// "<added> of <received> Vertices Set". The rest were already set
+		char successMessage [32];
+		int messageLength = AddNumberToString(successMessage, 0, verticesAdded);
+		strcpy(&successMessage[messageLength], " of ");
+		messageLength = AddNumberToString(successMessage, messageLength + 4, numberOfNewVertices);
+		strcpy(&successMessage[messageLength], " Vertices Set");
+		FillOutputBufferWithSuccess(successMessage, strlen(successMessage));
+	}
+	else
+	{
+		char errorMessage [] = "Vertices Not Set. Memory Overflow";
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
+	}
+}
+
+// Replies with the chunk of the memory image that starts at the requested offset
+void ExecuteExportMemoryImageOpCode()
+{
+	unsigned int counter = 2;
+	unsigned int offset = GetNumberFromBuffer(inputBuffer, &counter, 2);
+
+	if(inputBuffer[1] < 2 || offset > curFilledMemory)
+	{
+		char errorMessage [] = "Invalid Memory Image Offset";
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
+		return;
+	}
+
+	unsigned int chunkLength = curFilledMemory - offset;
+	if(chunkLength > MEMORY_IMAGE_CHUNK_SIZE)
+		chunkLength = MEMORY_IMAGE_CHUNK_SIZE;
+
+	ClearOutputBuffer();
+	AddNewCharToOutputBuffer(MemoryImageOpCode);
+	AddDeviceIDToOutputBuffer_Byte(deviceIDByte);
+	AddNewCharToOutputBuffer(7 + chunkLength);
+	AddNewCharToOutputBuffer(controlRegister);
+	AddNumberToOutputBuffer(curFilledMemory, 2);
+	AddNumberToOutputBuffer(CalculateMemoryImageChecksum(deviceMemory, curFilledMemory), 2);
+	AddNumberToOutputBuffer(offset, 2);
+	AddBufferToOutputBuffer(&deviceMemory[offset], chunkLength);
+}
+
+#ifdef USE_MEMORY_IMAGE_IMPORT
+// [op][numBytes][controlRegister][sourceID][imageSize 2][checksum 2][offset 2][chunk]
+void ExecuteImportMemoryImageOpCode()
+{
+	unsigned int counter = 1;
+	unsigned char numBytes = GetNumberFromBuffer(inputBuffer, &counter, 1);
+
+	int headerBytes = 1 + STANDARD_ID_SIZE + 6;
+	if(numBytes < headerBytes || numBytes + 2 > INPUT_BUFFER_SIZE)
+	{
+		char errorMessage [] = "Invalid Memory Image";
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
+		return;
+	}
+
+	unsigned char imageControlRegister = GetNumberFromBuffer(inputBuffer, &counter, 1);
+	heepByte sourceID [STANDARD_ID_SIZE];
+	unsigned int localCounter = 0;
+	AddBufferToBuffer(sourceID, inputBuffer, STANDARD_ID_SIZE, &localCounter, &counter);
+	unsigned int imageSize = GetNumberFromBuffer(inputBuffer, &counter, 2);
+	unsigned short checksum = GetNumberFromBuffer(inputBuffer, &counter, 2);
+	unsigned int offset = GetNumberFromBuffer(inputBuffer, &counter, 2);
+
+	// Indexed IDs and ID sizes change how every MOP is laid out
+	if(imageControlRegister != controlRegister)
+	{
+		char errorMessage [] = "Memory Image Format Differs";
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
+		return;
+	}
+
+	if(AddMemoryImageChunk(imageSize, checksum, offset, &inputBuffer[counter], numBytes - headerBytes) != 0)
+	{
+		char errorMessage [] = "Memory Image Chunk Rejected";
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
+		return;
+	}
+
+	if(IsMemoryImageComplete() == 0)
+	{
+		char SuccessMessage [] = "Memory Image Chunk Received";
+		FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
+		return;
+	}
+
+	if(CommitMemoryImage(sourceID) != 0)
+	{
+		char errorMessage [] = "Invalid Memory Image";
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
+		return;
+	}
+
+	FillVertexListFromMemory();
+
+	char SuccessMessage [] = "Memory Image Restored";
+	FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
+}
+#endif
+
 // Updated
 void ExecuteDeleteVertexOpCode()
 {
@@ -378,13 +591,13 @@ void ExecuteDeleteVertexOpCode()
 	{
 		ClearOutputBuffer();
 		char errorMessage [] = "Failed to delete Vertex!";
-		FillOutputBufferWithError(errorMessage, strlen(errorMessage));
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
 	}
 	else
 	{
 		ClearOutputBuffer();
 		char SuccessMessage [] = "Vertex Deleted!";
-		FillOutputBufferWithSuccess(SuccessMessage, strlen(SuccessMessage));
+		FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
 	}
 }
 
@@ -403,7 +616,10 @@ int ValidateAndRestructureIncomingMOP(unsigned int MOPStartAddr, unsigned int* n
 	unsigned int localCounter = 0;
 	AddBufferToBuffer(curID, inputBuffer, STANDARD_ID_SIZE, &localCounter, &MOPStartAddr);
 	unsigned char bytesOfData = GetNumberFromBuffer(inputBuffer, &MOPStartAddr, 1);
-	GetIndexedDeviceID_Byte(curID);
+
+	// A device that was never indexed cannot match a stored MOP
+	if(FindIndexedDeviceID_Byte(curID) == 0)
+		return 1;
 
 	int memDiff = STANDARD_ID_SIZE - ID_SIZE;
 	*numBytes = *numBytes - memDiff;
@@ -428,54 +644,32 @@ void ExecuteDeleteMOPOpCode()
 	unsigned int numBytes = GetNumberFromBuffer(inputBuffer, &counter, 1);
 	int dataError = ValidateAndRestructureIncomingMOP(counter, &numBytes);
 
+	// The MOP's own length must account for every byte sent
+	if(dataError == 0 && numBytes != ID_SIZE + 2 + (unsigned int)inputBuffer[counter + ID_SIZE + 1])
+		dataError = 1;
+
 	if(dataError == 0)
 	{
-		unsigned int theFoundCode = 0;
-		unsigned int deviceMemCounter = 0;
-		int MOPSDeleted = 0;
-
-		while(deviceMemCounter < curFilledMemory)
-		{
-			int i;
-			for(i = 0; i < numBytes; i++)
-			{
-				if(deviceMemory[deviceMemCounter+i] != inputBuffer[counter+i])
-				{
-					break;
-				}
-
-				theFoundCode++;
-			}
-
-			if(theFoundCode == numBytes)
-			{
-				deviceMemory[deviceMemCounter] = FragmentOpCode;
-				deviceMemory[deviceMemCounter + 5] = numBytes;
-				MOPSDeleted++;
-			}
-			theFoundCode = 0;
-
-			deviceMemCounter = SkipOpCode(deviceMemCounter);
-		}
+		unsigned int MOPSDeleted = DeleteMOPsEqualTo(&inputBuffer[counter], numBytes);
 
 		if(MOPSDeleted > 0)
 		{
 			ClearOutputBuffer();
 			char SuccessMessage [] = "MOP Deleted!";
-			FillOutputBufferWithSuccess(SuccessMessage, strlen(SuccessMessage));
+			FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
 		}
 		else
 		{
 			ClearOutputBuffer();
 			char MyerrorMessage [] = "Cannot Delete: MOP not found";
-			FillOutputBufferWithError(MyerrorMessage, strlen(MyerrorMessage));
+			FillOutputBufferWithError(MyerrorMessage, sizeof(MyerrorMessage) - 1);
 		}
 	}
 	else
 	{
 		ClearOutputBuffer();
 		char errorMessage [] = "Cannot Delete: Generic MOP was invalid!";
-		FillOutputBufferWithError(errorMessage, strlen(errorMessage));
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
 	}
 }
 
@@ -485,26 +679,36 @@ void ExecuteAddMOPOpCode()
 
 	unsigned int numBytes = GetNumberFromBuffer(inputBuffer, &counter, 1);
 
-	int dataError = ValidateAndRestructureIncomingMOP(counter, &numBytes);
+	// [MOP][Full Device ID][Num Bytes][Data], and the MOP's own length must
+	// account for every byte sent
+	heepByte* MOP = &inputBuffer[counter];
+	int dataError = numBytes < STANDARD_ID_SIZE + 2 || counter + numBytes > INPUT_BUFFER_SIZE;
+	if(dataError == 0 && numBytes != STANDARD_ID_SIZE + 2 + (unsigned int)MOP[STANDARD_ID_SIZE + 1])
+		dataError = 1;
 
-	if(dataError == 0)
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
+
+	if(dataError == 0 && ReserveMOP(&builder, MOP[0], &MOP[1], MOP[STANDARD_ID_SIZE + 1]))
+	{
+		ClearOutputBuffer();
+		char errorMessage [] = "Cannot Add: Memory Full";
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
+	}
+	else if(dataError == 0)
 	{	
-		int i;
-		for(i = 0; i < numBytes; i++)
-		{
-			AddNewCharToMemory(inputBuffer[counter]);
-			counter++;
-		}
+		AddBytesToMOP(&builder, &MOP[STANDARD_ID_SIZE + 2], MOP[STANDARD_ID_SIZE + 1]);
+		CommitMOPs(&builder);
 
 		ClearOutputBuffer();
 		char SuccessMessage [] = "MOP Added!";
-		FillOutputBufferWithSuccess(SuccessMessage, strlen(SuccessMessage));
+		FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
 	}
 	else
 	{
 		ClearOutputBuffer();
 		char errorMessage [] = "Cannot Add: Delivered Generic MOP was determined to be invalid!";
-		FillOutputBufferWithError(errorMessage, strlen(errorMessage));
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
 	}
 
 }
@@ -516,13 +720,13 @@ void ExecuteSetWiFiDataOpCode()
 	{
 		ClearOutputBuffer();
 		char SuccessMessage [] = "WiFi Added!";
-		FillOutputBufferWithSuccess(SuccessMessage, strlen(SuccessMessage));
+		FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
 	}
 	else
 	{
 		ClearOutputBuffer();
 		char errorMessage [] = "Cannot Add Wifi: Out of memory!";
-		FillOutputBufferWithError(errorMessage, strlen(errorMessage));
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
 	}
 	
 }
@@ -533,13 +737,13 @@ void ExecuteSetDeviceNameOpCode()
 	{
 		ClearOutputBuffer();
 		char SuccessMessage [] = "Name Set!";
-		FillOutputBufferWithSuccess(SuccessMessage, strlen(SuccessMessage));
+		FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
 	}
 	else
 	{
 		ClearOutputBuffer();
 		char errorMessage [] = "Cannot Add Name. Not enough memory!";
-		FillOutputBufferWithError(errorMessage, strlen(errorMessage));
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
 	}
 }
 
@@ -549,11 +753,27 @@ void ExecuteResetDeviceNetwork()
 
 	ClearOutputBuffer();
 	char SuccessMessage [] = "Reset Initiated!";
-	FillOutputBufferWithSuccess(SuccessMessage, strlen(SuccessMessage));
+	FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
 }
 
 void ExecuteMyIPChangedOpCode()
 {
+#ifdef USE_IP_DIRECTORY
+	struct HeepIPAddress newIP;
+	newIP.Octet4 = inputBuffer[2 + STANDARD_ID_SIZE];
+	newIP.Octet3 = inputBuffer[3 + STANDARD_ID_SIZE];
+	newIP.Octet2 = inputBuffer[4 + STANDARD_ID_SIZE];
+	newIP.Octet1 = inputBuffer[5 + STANDARD_ID_SIZE];
+
+	// Every vertex to the device reads its IP from this one entry
+	if(UpdateIPInDirectory(&inputBuffer[2], newIP) == 0)
+	{
+		char SuccessMessage [] = "Changed IP";
+		FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
+		return;
+	}
+#endif
+
 	// Search through Vertices... Replace destination IP Addresses
 	struct Vertex_Byte newVertex;
 
@@ -563,24 +783,100 @@ void ExecuteMyIPChangedOpCode()
 	{
 		GetVertexAtPointer_Byte(vertexPointerList[i], &newVertex);
 
+		// Skip vertices without an IP of their own
+		if(deviceMemory[vertexPointerList[i] + ID_SIZE + 1] < ID_SIZE + 6)
+			continue;
+
 		if(CheckBufferEquality(newVertex.rxID, &inputBuffer[2], STANDARD_ID_SIZE))
 		{
+			UnindexMOP(vertexPointerList[i]);
 			deviceMemory[vertexPointerList[i] + ID_SIZE + ID_SIZE + 4] = inputBuffer[2 + STANDARD_ID_SIZE];
 			deviceMemory[vertexPointerList[i] + ID_SIZE + ID_SIZE + 5] = inputBuffer[3 + STANDARD_ID_SIZE];
 			deviceMemory[vertexPointerList[i] + ID_SIZE + ID_SIZE + 6] = inputBuffer[4 + STANDARD_ID_SIZE];
 			deviceMemory[vertexPointerList[i] + ID_SIZE + ID_SIZE + 7] = inputBuffer[5 + STANDARD_ID_SIZE];
+			ReindexMOP(vertexPointerList[i]);
+			memoryChanged = 1;
 		}
 	}
 
 	char SuccessMessage [] = "Changed IP";
-	FillOutputBufferWithSuccess(SuccessMessage, strlen(SuccessMessage));
+	FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
+}
+
+// Reply with the IDs of the controls whose values differ from the summary
+void ExecuteControlSummaryOpCode()
+{
+	unsigned int counter = 1;
+	unsigned char numBytes = inputBuffer[counter++];
+
+	if(numBytes + 2 > INPUT_BUFFER_SIZE)
+	{
+		char errorMessage [] = "Invalid Control Summary";
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
+		return;
+	}
+
+	ClearOutputBuffer();
+	AddNewCharToOutputBuffer(StaleControlsOpCode);
+	AddDeviceIDToOutputBuffer_Byte(deviceIDByte);
+	unsigned int staleCountPosition = outputBufferLastByte;
+	AddNewCharToOutputBuffer(0);
+
+	int i;
+	for(i = 0; i + 1 < numBytes; i += 2)
+	{
+		unsigned char controlID = inputBuffer[counter++];
+		unsigned char value = inputBuffer[counter++];
+
+		int controlIndex = GetControlIndexByID(controlID);
+		if(controlIndex < 0 || controlList[controlIndex].controlType == HEEP_BUFFER || controlList[controlIndex].controlType == HEEP_MOMENTARY)
+			continue;
+
+		if(controlList[controlIndex].curValue != value)
+		{
+			AddNewCharToOutputBuffer(controlID);
+			outputBuffer[staleCountPosition]++;
+		}
+	}
+
+	if(outputBuffer[staleCountPosition] == 0)
+	{
+		char SuccessMessage [] = "Controls Current";
+		FillOutputBufferWithSuccess(SuccessMessage, sizeof(SuccessMessage) - 1);
+	}
+}
+
+void ExecuteStaleControlsOpCode()
+{
+	heepByte rxID [STANDARD_ID_SIZE];
+	unsigned int localCounter = 0;
+	unsigned int counter = 1;
+	AddBufferToBuffer(rxID, inputBuffer, STANDARD_ID_SIZE, &localCounter, &counter);
+	unsigned char numberOfStaleControls = GetNumberFromBuffer(inputBuffer, &counter, 1);
+
+	// A ROP gets no reply, so a malformed one is dropped. Transports that
+	// report the datagram length bound it further
+	if(numberOfStaleControls > INPUT_BUFFER_SIZE - counter)
+		return;
+
+	if(inputBufferLastByte != 0 && counter + numberOfStaleControls > inputBufferLastByte)
+		return;
+
+	int i;
+	for(i = 0; i < numberOfStaleControls; i++)
+	{
+		ResendControlToDevice(rxID, inputBuffer[counter++]);
+	}
 }
 
 unsigned char IsROP()
 {
 	if(inputBuffer[0] == MemoryDumpOpCode 
 		|| inputBuffer[0] == SuccessOpCode
-		|| inputBuffer[0] == ErrorOpCode)
+		|| inputBuffer[0] == ErrorOpCode
+		|| inputBuffer[0] == StaleControlsOpCode
+		|| inputBuffer[0] == ReliableAckOpCode
+		|| inputBuffer[0] == MemoryImageOpCode)
 	{
 		return 1;
 	}
@@ -607,10 +903,24 @@ void ExecuteControlOpCodes()
 	{
 		ExecuteSetVertexOpCode();
 	}
+	else if(ReceivedOpCode == SetVerticesOpCode)
+	{
+		ExecuteSetVerticesOpCode();
+	}
 	else if(ReceivedOpCode == DeleteVertexOpCode)
 	{
 		ExecuteDeleteVertexOpCode();
 	}
+	else if(ReceivedOpCode == ExportMemoryImageOpCode)
+	{
+		ExecuteExportMemoryImageOpCode();
+	}
+#ifdef USE_MEMORY_IMAGE_IMPORT
+	else if(ReceivedOpCode == ImportMemoryImageOpCode)
+	{
+		ExecuteImportMemoryImageOpCode();
+	}
+#endif
 	else if(ReceivedOpCode == AddMOPOpCode)
 	{
 		ExecuteAddMOPOpCode();
@@ -637,9 +947,17 @@ void ExecuteControlOpCodes()
 	{
 		ExecuteMyIPChangedOpCode();
 	}
+	else if(ReceivedOpCode == ControlSummaryOpCode)
+	{
+		ExecuteControlSummaryOpCode();
+	}
+	else if(ReceivedOpCode == ReliableSetValueOpCode)
+	{
+		ExecuteReliableSetValOpCode();
+	}
 	else
 	{
 		char errorMessage [] = "Invalid COP Received";
-		FillOutputBufferWithError(errorMessage, strlen(errorMessage));
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
 	}
 }
\ No newline at end of file
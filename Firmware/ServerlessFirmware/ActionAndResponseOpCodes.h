@@ -3,7 +3,13 @@
 void ClearOutputBuffer();
 
 void ClearInputBuffer();
+
+// Nothing is written past OUTPUT_BUFFER_SIZE. An append that does not fit
+// writes nothing and sets outputBufferOverflowed
+heepByte WillOutputBufferOverflow(unsigned int numBytesToBeAdded);
+void AddBufferToOutputBuffer(heepByte* buffer, unsigned int numBytes);
 void AddNewCharToOutputBuffer(unsigned char newMem);
+void AddNumberToOutputBuffer(unsigned long number, int numBytes);
 
 void AddDeviceIDToOutputBuffer_Byte(heepByte* deviceID);
 
@@ -23,6 +29,14 @@ void FillOutputBufferWithSetValCOP(unsigned char controlID, unsigned char value)
 
 void FillOutputBufferWithSetValCOPBuffer(unsigned char controlID, heepByte* buffer, int bufferLength);
 
+// Points the SetVal COP already in the output buffer at another control
+void SetControlIDOfSetValCOP(unsigned char controlID);
+
+// A control summary lists control ID and value pairs. Adding a pair fails
+// with 1 once the COP is full
+void FillOutputBufferWithControlSummaryHeader();
+heepByte AddControlToControlSummaryCOP(unsigned char controlID, unsigned char value);
+
 // Updated
 void FillOutputBufferWithControlData();
 // Updated
@@ -31,6 +45,10 @@ void FillOutputBufferWithDynamicMemorySize();
 // Updated
 void FillOutputBufferWithMemoryDump();
 
+// The message is not null terminated in the ROP, so stringLength is all
+// that is read of its length
+void FillOutputBufferWithMessageROP(unsigned char opCode, char* message, int stringLength);
+
 // Updated
 void FillOutputBufferWithSuccess(char* message, int stringLength);
 
@@ -47,9 +65,18 @@ void ExecuteSetPositionOpCode();
 // Updated
 void ExecuteSetVertexOpCode();
 
+// Replies with one ROP for the whole batch
+void ExecuteSetVerticesOpCode();
+
 // Updated
 void ExecuteDeleteVertexOpCode();
 
+// A front end copies a device by exporting its memory image chunk by chunk
+// and importing the chunks into the replacement. Import is built with
+// USE_MEMORY_IMAGE_IMPORT
+void ExecuteExportMemoryImageOpCode();
+void ExecuteImportMemoryImageOpCode();
+
 void ExecuteSetWiFiDataOpCode();
 
 void ExecuteSetDeviceNameOpCode();
@@ -66,6 +93,11 @@ void ExecuteDeleteMOPOpCode();
 
 void ExecuteAddMOPOpCode();
 
+void ExecuteControlSummaryOpCode();
+
+// Received by the device that sent the control summary
+void ExecuteStaleControlsOpCode();
+
 unsigned char IsROP();
 
 void ExecuteControlOpCodes();
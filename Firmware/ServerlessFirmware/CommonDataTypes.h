@@ -41,6 +41,65 @@ struct Control
 	unsigned char curValue;
 	unsigned char controlFlags;
 	char* controlName;
+	unsigned char controlNameLength; // Set by AddControl
 
 	heepByte* controlBuffer; // The memory must be allocated by the user, and assigned to the buffer
-};
\ No newline at end of file
+};
+
+// One control of a table declared at compile time. See AddControlTable
+struct ControlDeclaration
+{
+	const char* controlName;
+	unsigned char controlType;
+	unsigned char controlDirection;
+	unsigned char highValue;
+	unsigned char lowValue;
+	unsigned char startingValue;
+};
+
+// Send limit of an output control. See SetControlSendLimitByHandle
+struct ControlSendLimit
+{
+	unsigned long minimumInterval; // Milliseconds
+	unsigned long lastSendTime;
+	unsigned long lastChangeTime;  // Last value held back
+	unsigned char deadband;
+	unsigned char lastSentValue;
+};
+
+// Hash table entry for a vertex. See AddVertex
+struct VertexIndexEntry
+{
+	unsigned int pointer;	// Vertex MOP pointer plus one, so that 0 marks an empty entry
+	unsigned short hash;
+};
+
+// Hash table entry for a MOP in device memory. See DeleteMOPsEqualTo
+struct MOPIndexEntry
+{
+	unsigned short pointer;	// MOP pointer plus one, so that 0 marks an empty entry
+	unsigned short fingerprint;
+};
+
+// MOPs being written past the end of device memory. See StartMOPs
+struct MOPBuilder
+{
+	unsigned int start;
+	unsigned int counter;
+	unsigned int end;		// End of the reserved bytes
+	unsigned char failed;
+};
+
+// An imported memory image that is still arriving. See AddMemoryImageChunk
+struct MemoryImageImport
+{
+	unsigned int size;
+	unsigned int received;
+	unsigned short checksum;
+	heepByte inProgress;
+};
+
+// Notified when the network writes a control. For buffer controls the new
+// contents are in the control's buffer. Both values are curValue, which is
+// the length of the contents for a double buffered control
+typedef void (*HeepControlCallback)(unsigned char controlID, int previousValue, int newValue);
\ No newline at end of file
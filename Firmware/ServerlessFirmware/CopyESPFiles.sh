@@ -16,6 +16,8 @@ cp Heep_API.cpp ./ESPFiles
 cp Heep_API.h ./ESPFiles
 cp MemoryUtilities.cpp ./ESPFiles
 cp MemoryUtilities.h ./ESPFiles
+cp ReliableDelivery.cpp ./ESPFiles
+cp ReliableDelivery.h ./ESPFiles
 cp ESP8266_HeepComms.cpp ./ESPFiles
 cp ESP8266_HeepComms.h ./ESPFiles
 cp Scheduler.cpp ./ESPFiles
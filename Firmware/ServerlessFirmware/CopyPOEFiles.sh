@@ -16,6 +16,8 @@ cp Heep_API.cpp ./POEFiles
 cp Heep_API.h ./POEFiles
 cp MemoryUtilities.cpp ./POEFiles
 cp MemoryUtilities.h ./POEFiles
+cp ReliableDelivery.cpp ./POEFiles
+cp ReliableDelivery.h ./POEFiles
 cp POE32u4W5500_HeepComms.cpp ./POEFiles
 cp POE32u4W5500_HeepComms.h ./POEFiles
 cp Scheduler.cpp ./POEFiles
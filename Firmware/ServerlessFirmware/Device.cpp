@@ -9,28 +9,198 @@ unsigned int firmwareVersion = FIRMWARE_VERSION;
 
 struct Control controlList [NUM_CONTROLS];
 unsigned int numberOfControls = 0;
+unsigned long controlDataSize = 0;
+
+// Control lookups by ID and by name. Both tables hold the control's index
+// in controlList plus one, so that 0 marks an empty entry
+unsigned short controlIndexByID [256];
+unsigned short controlIndexByName [CONTROL_NAME_TABLE_SIZE];
+
+// One bit per control set from the network and waiting for the Control
+// Daemon, so that an idle daemon does not have to look at every control
+#define CONTROL_BITMAP_SIZE ((NUM_CONTROLS + 7) / 8)
+heepByte pendingControls [CONTROL_BITMAP_SIZE];
+unsigned int numberOfPendingControls = 0;
+
+// Indexed like controlList. A control's value before the first network
+// write that is still pending is kept for its callback
+HeepControlCallback controlCallbacks [NUM_CONTROLS];
+unsigned char pendingPreviousValues [NUM_CONTROLS];
+
+// Second buffer of a double buffered buffer control, or 0 if it has none
+heepByte* controlBackBuffers [NUM_CONTROLS];
+
+struct ControlSendLimit controlSendLimits [NUM_CONTROLS];
+unsigned int numberOfHeldControls = 0;
 
 unsigned int vertexPointerList[NUM_VERTICES];
 unsigned int numberOfVertices = 0;
 
+// Vertices hashed by txID, txControlID, rxID and rxControlID, so that
+// duplicates are found without decoding every vertex
+struct VertexIndexEntry vertexIndex [VERTEX_INDEX_SIZE];
+
 heepByte resetHeepNetwork = 0;
 
 void ClearControls()
 {
 	numberOfControls = 0;
+	controlDataSize = 0;
+	memset(controlIndexByID, 0, sizeof(controlIndexByID));
+	memset(controlIndexByName, 0, sizeof(controlIndexByName));
+	memset(pendingControls, 0, sizeof(pendingControls));
+	numberOfPendingControls = 0;
+	numberOfHeldControls = 0;
 }
 
 void ClearVertices()
 {
 	numberOfVertices = 0;
+	memset(vertexIndex, 0, sizeof(vertexIndex));
+}
+
+unsigned long HashControlName(char* controlName)
+{
+	return HashBuffer((heepByte*)controlName, strlen(controlName));
+}
+
+// When IDs or names repeat, lookups find the first control added, as the
+// linear search used to
+void IndexControl(unsigned int controlIndex)
+{
+	controlDataSize += 12 + controlList[controlIndex].controlNameLength;
+
+	if(controlList[controlIndex].controlFlags & CONTROL_SEND_FLAG)
+	{
+		pendingControls[controlIndex / 8] |= 1 << (controlIndex % 8);
+		numberOfPendingControls++;
+	}
+
+	if(controlList[controlIndex].controlFlags & CONTROL_HELD_FLAG)
+		numberOfHeldControls++;
+
+	if(controlIndexByID[controlList[controlIndex].controlID] == 0)
+		controlIndexByID[controlList[controlIndex].controlID] = controlIndex + 1;
+
+	if(controlList[controlIndex].controlName == 0)
+		return;
+
+	unsigned long bucket = HashControlName(controlList[controlIndex].controlName) & (CONTROL_NAME_TABLE_SIZE - 1);
+
+	for(int i = 0; i < CONTROL_NAME_TABLE_SIZE; i++)
+	{
+		if(controlIndexByName[bucket] == 0)
+		{
+			controlIndexByName[bucket] = controlIndex + 1;
+			return;
+		}
+
+		if(strcmp(controlList[controlIndexByName[bucket] - 1].controlName, controlList[controlIndex].controlName) == 0)
+			return;
+
+		bucket = (bucket + 1) & (CONTROL_NAME_TABLE_SIZE - 1);
+	}
+}
+
+// For code that replaces controlList wholesale, such as the virtual network
+void RebuildControlIndex()
+{
+	memset(controlIndexByID, 0, sizeof(controlIndexByID));
+	memset(controlIndexByName, 0, sizeof(controlIndexByName));
+	memset(pendingControls, 0, sizeof(pendingControls));
+	numberOfPendingControls = 0;
+	numberOfHeldControls = 0;
+	controlDataSize = 0;
+
+	for(unsigned int i = 0; i < numberOfControls; i++)
+	{
+		IndexControl(i);
+	}
 }
 
 void AddControl(struct Control myControl)
 {
+	if(numberOfControls >= NUM_CONTROLS)
+		return;
+
 	controlList[numberOfControls] = myControl;
+	controlList[numberOfControls].controlNameLength = myControl.controlName == 0 ? 0 : strlen(myControl.controlName);
+	controlCallbacks[numberOfControls] = 0;
+	controlBackBuffers[numberOfControls] = 0;
+	memset(&controlSendLimits[numberOfControls], 0, sizeof(struct ControlSendLimit));
+	pendingPreviousValues[numberOfControls] = myControl.curValue;
+	IndexControl(numberOfControls);
 	numberOfControls++;
 }
 
+void MarkControlPending(int controlIndex, unsigned char previousValue)
+{
+	if(controlList[controlIndex].controlFlags & CONTROL_SEND_FLAG)
+		return;
+
+	pendingPreviousValues[controlIndex] = previousValue;
+	controlList[controlIndex].controlFlags |= CONTROL_SEND_FLAG;
+	pendingControls[controlIndex / 8] |= 1 << (controlIndex % 8);
+	numberOfPendingControls++;
+}
+
+int TakeNextPendingControl()
+{
+	if(numberOfPendingControls == 0)
+		return -1;
+
+	for(int i = 0; i < CONTROL_BITMAP_SIZE; i++)
+	{
+		if(pendingControls[i] == 0)
+			continue;
+
+		int bit = 0;
+		while((pendingControls[i] & (1 << bit)) == 0)
+			bit++;
+
+		int controlIndex = i*8 + bit;
+
+		pendingControls[i] &= ~(1 << bit);
+		numberOfPendingControls--;
+		controlList[controlIndex].controlFlags &= ~CONTROL_SEND_FLAG;
+
+		return controlIndex;
+	}
+
+	return -1;
+}
+
+void NotifyControlCallback(int controlIndex)
+{
+	if(controlCallbacks[controlIndex] == 0)
+		return;
+
+	controlCallbacks[controlIndex](controlList[controlIndex].controlID, pendingPreviousValues[controlIndex], controlList[controlIndex].curValue);
+}
+
+int GetControlIndexByID(unsigned char controlID)
+{
+	return (int)controlIndexByID[controlID] - 1;
+}
+
+int GetControlIndexByName(char* controlName)
+{
+	unsigned long bucket = HashControlName(controlName) & (CONTROL_NAME_TABLE_SIZE - 1);
+
+	for(int i = 0; i < CONTROL_NAME_TABLE_SIZE; i++)
+	{
+		if(controlIndexByName[bucket] == 0)
+			return -1;
+
+		if(strcmp(controlList[controlIndexByName[bucket] - 1].controlName, controlName) == 0)
+			return controlIndexByName[bucket] - 1;
+
+		bucket = (bucket + 1) & (CONTROL_NAME_TABLE_SIZE - 1);
+	}
+
+	return -1;
+}
+
 unsigned char isVertexEqual(struct Vertex_Byte* vertex1, struct Vertex_Byte* vertex2)
 {
 	unsigned char vertexIsEqual = 1;
@@ -50,18 +220,97 @@ unsigned char isVertexEqual(struct Vertex_Byte* vertex1, struct Vertex_Byte* ver
 	return vertexIsEqual;
 }
 
+// Hashes the fields compared by isVertexEqual
+unsigned short HashVertex(struct Vertex_Byte* vertex)
+{
+	heepByte fields [2*STANDARD_ID_SIZE + 2];
+	memcpy(fields, (*vertex).txID, STANDARD_ID_SIZE);
+	memcpy(&fields[STANDARD_ID_SIZE], (*vertex).rxID, STANDARD_ID_SIZE);
+	fields[2*STANDARD_ID_SIZE] = (*vertex).txControlID;
+	fields[2*STANDARD_ID_SIZE + 1] = (*vertex).rxControlID;
+
+	unsigned long hash = HashBuffer(fields, sizeof(fields));
+	return (hash ^ (hash >> 16)) & 0xFFFF;
+}
+
+// Returns the vertexIndex entry of an equal vertex, or -1 if there is none
+int FindVertexIndexEntry(struct Vertex_Byte* vertex, unsigned short hash)
+{
+	unsigned int bucket = hash & (VERTEX_INDEX_SIZE - 1);
+
+	for(int i = 0; i < VERTEX_INDEX_SIZE; i++)
+	{
+		if(vertexIndex[bucket].pointer == 0)
+			return -1;
+
+		struct Vertex_Byte storedVertex;
+		if(vertexIndex[bucket].hash == hash 
+			&& vertexIndex[bucket].pointer <= curFilledMemory
+			&& GetVertexAtPointer_Byte(vertexIndex[bucket].pointer - 1, &storedVertex) == 0 
+			&& isVertexEqual(vertex, &storedVertex))
+		{
+			return bucket;
+		}
+
+		bucket = (bucket + 1) & (VERTEX_INDEX_SIZE - 1);
+	}
+
+	return -1;
+}
+
+void IndexVertex(unsigned int pointer, unsigned short hash)
+{
+	unsigned int bucket = hash & (VERTEX_INDEX_SIZE - 1);
+
+	for(int i = 0; i < VERTEX_INDEX_SIZE; i++)
+	{
+		if(vertexIndex[bucket].pointer == 0)
+		{
+			vertexIndex[bucket].pointer = pointer + 1;
+			vertexIndex[bucket].hash = hash;
+			return;
+		}
+
+		bucket = (bucket + 1) & (VERTEX_INDEX_SIZE - 1);
+	}
+}
+
+int GetVertexIndexHomeBucket(heepByte* entry)
+{
+	struct VertexIndexEntry* indexEntry = (struct VertexIndexEntry*)entry;
+	if(indexEntry->pointer == 0)
+		return -1;
+
+	return indexEntry->hash & (VERTEX_INDEX_SIZE - 1);
+}
+
+void RemoveVertexIndexEntry(unsigned int entry)
+{
+	RemoveHashTableEntry((heepByte*)vertexIndex, sizeof(struct VertexIndexEntry), VERTEX_INDEX_SIZE, entry, GetVertexIndexHomeBucket);
+}
+
 void AddVertexPointer(unsigned int pointer)
 {
 	vertexPointerList[numberOfVertices] = pointer;
 	numberOfVertices++;
 }
 
+// Front ends resend their vertices when they reconnect. A vertex that is
+// already stored is not added again, and that counts as success
 heepByte AddVertex(struct Vertex_Byte myVertex)
 {
+	unsigned short hash = HashVertex(&myVertex);
+	if(FindVertexIndexEntry(&myVertex, hash) >= 0)
+		return 0;
+
+	if(numberOfVertices >= NUM_VERTICES)
+		return 1;
+
 	unsigned int pointerToVertex = 0;
 	if(SetVertexInMemory_Byte(myVertex, &pointerToVertex) == 0)
 	{	
 		AddVertexPointer(pointerToVertex);
+		IndexVertex(pointerToVertex, hash);
 		return 0;
 	}
 	else
@@ -70,6 +319,59 @@ heepByte AddVertex(struct Vertex_Byte myVertex)
 	}
 }
 
+// Vertices that are already stored, or repeated in the batch, are skipped.
+// The new ones are moved to the front of the array
+heepByte AddVertices(struct Vertex_Byte* vertices, int numberOfNewVertices, int* verticesAdded)
+{
+	*verticesAdded = 0;
+
+	if(numberOfNewVertices > VERTICES_PER_BATCH)
+		return 1;
+
+	unsigned short hashes [VERTICES_PER_BATCH];
+	int verticesToAdd = 0;
+
+	for(int i = 0; i < numberOfNewVertices; i++)
+	{
+		unsigned short hash = HashVertex(&vertices[i]);
+		if(FindVertexIndexEntry(&vertices[i], hash) >= 0)
+			continue;
+
+		heepByte isRepeated = 0;
+		for(int j = 0; j < verticesToAdd; j++)
+		{
+			if(hashes[j] == hash && isVertexEqual(&vertices[j], &vertices[i]))
+				isRepeated = 1;
+		}
+
+		if(isRepeated)
+			continue;
+
+		vertices[verticesToAdd] = vertices[i];
+		hashes[verticesToAdd] = hash;
+		verticesToAdd++;
+	}
+
+	if(verticesToAdd == 0)
+		return 0;
+
+	if(numberOfVertices + verticesToAdd > NUM_VERTICES)
+		return 1;
+
+	unsigned int pointers [VERTICES_PER_BATCH];
+	if(SetVerticesInMemory_Byte(vertices, verticesToAdd, pointers) != 0)
+		return 1;
+
+	for(int i = 0; i < verticesToAdd; i++)
+	{
+		AddVertexPointer(pointers[i]);
+		IndexVertex(pointers[i], hashes[i]);
+	}
+
+	*verticesAdded = verticesToAdd;
+	return 0;
+}
+
 void RemoveVertexListEntry(unsigned int pointer)
 {
 	int i;
@@ -83,34 +385,54 @@ void RemoveVertexListEntry(unsigned int pointer)
 
 int DeleteVertex(struct Vertex_Byte myVertex)
 {
+	int entry = FindVertexIndexEntry(&myVertex, HashVertex(&myVertex));
+	if(entry < 0)
+		return 1;
+
+	unsigned int pointer = vertexIndex[entry].pointer - 1;
+	RemoveVertexIndexEntry(entry);
+	DeleteVertexAtPointer(pointer);
+
 	int i;
 	for(i = 0; i < numberOfVertices; i++)
 	{
-		struct Vertex_Byte newVertex;
-		if(GetVertexAtPointer_Byte(vertexPointerList[i], &newVertex) == 0)
+		if(vertexPointerList[i] == pointer)
 		{
-			if(isVertexEqual(&myVertex, &newVertex))
-			{
-				DeleteVertexAtPointer(vertexPointerList[i]);
-				RemoveVertexListEntry(i);
-				return 0;
-			}
+			RemoveVertexListEntry(i);
+			break;
 		}
 	}
 
-	return 1;
+	return 0;
 }
 
 void FillVertexListFromMemory()
 {
 	numberOfVertices = 0;
+	memset(vertexIndex, 0, sizeof(vertexIndex));
+
+#ifdef USE_IP_DIRECTORY
+	RebuildIPDirectory();
+#endif
 
 	unsigned int pointer = 0;
 	unsigned int counter = 0;
 
-	while(GetNextVertexPointer(&pointer, &counter) == 0)
+	while(numberOfVertices < NUM_VERTICES && GetNextVertexPointer(&pointer, &counter) == 0)
 	{
+		struct Vertex_Byte vertex;
+		GetVertexAtPointer_Byte(pointer, &vertex);
+		unsigned short hash = HashVertex(&vertex);
+
+		// Duplicates stored before AddVertex rejected them
+		if(FindVertexIndexEntry(&vertex, hash) >= 0)
+		{
+			DeleteVertexAtPointer(pointer);
+			continue;
+		}
+
 		AddVertexPointer(pointer);
+		IndexVertex(pointer, hash);
 	}
 }
 
@@ -127,58 +449,61 @@ void SetDeviceIcon(char deviceIcon)
 
 int SetControlValueByID(unsigned char controlID, unsigned int value, unsigned char setFromNetwork)
 {
-	int i;
-	for(i = 0; i < numberOfControls; i++)
-	{
-		if(controlList[i].controlID == controlID)
-		{
-			controlList[i].curValue = value;
+	int controlIndex = GetControlIndexByID(controlID);
+	if(controlIndex < 0)
+		return 1;
 
-			if(setFromNetwork)
-				controlList[i].controlFlags = 0x01;
+	unsigned char previousValue = controlList[controlIndex].curValue;
+	controlList[controlIndex].curValue = value;
 
-			return 0;
-		}
-	}
+	if(setFromNetwork)
+		MarkControlPending(controlIndex, previousValue);
 
-	return 1;
+	return 0;
 }	
 
 heepByte GetControlTypeFromControlID(heepByte controlID)
 {
-	int i;
-	for(i = 0; i < numberOfControls; i++)
-	{
-		if(controlList[i].controlID == controlID)
-		{
-			return controlList[i].controlType;
-		}
-	}
+	int controlIndex = GetControlIndexByID(controlID);
+	if(controlIndex < 0)
+		return 0; // ToDo: Make return something invalid
 
-	return 0; // ToDo: Make return something invalid
+	return controlList[controlIndex].controlType;
+}
+
+void SwapControlBuffers(int controlIndex, unsigned char bufferLength)
+{
+	heepByte* backBuffer = controlBackBuffers[controlIndex];
+	controlBackBuffers[controlIndex] = controlList[controlIndex].controlBuffer;
+	controlList[controlIndex].controlBuffer = backBuffer;
+	controlList[controlIndex].curValue = bufferLength;
 }
 
 int SetControlValueByIDBuffer(unsigned char controlID, heepByte* buffer, int bufferStartPoint, int bufferLength, unsigned char setFromNetwork)
 {
-	int i;
-	for(i = 0; i < numberOfControls; i++)
-	{
-		if(controlList[i].controlID == controlID)
-		{
-			int j;
-			for(j = 0; j < bufferLength; j++)
-			{
-				controlList[i].controlBuffer[j] = buffer[j + bufferStartPoint];
-			}
+	int controlIndex = GetControlIndexByID(controlID);
+	if(controlIndex < 0)
+		return 1;
 
-			if(setFromNetwork)
-				controlList[i].controlFlags = 0x01;
+	if(bufferLength < 0 || bufferLength > controlList[controlIndex].highValue + 1)
+		return 1;
 
-			return 0;
-		}
+	unsigned char previousValue = controlList[controlIndex].curValue;
+
+	if(controlBackBuffers[controlIndex] != 0)
+	{
+		memcpy(controlBackBuffers[controlIndex], &buffer[bufferStartPoint], bufferLength);
+		SwapControlBuffers(controlIndex, bufferLength);
 	}
+	else
+	{
+		memcpy(controlList[controlIndex].controlBuffer, &buffer[bufferStartPoint], bufferLength);
+	}
+
+	if(setFromNetwork)
+		MarkControlPending(controlIndex, previousValue);
 
-	return 1;
+	return 0;
 }
 
 int SetControlValueByIDFromNetwork(unsigned char controlID, unsigned int value)
@@ -193,14 +518,12 @@ int SetControlValueByIDFromNetworkBuffer(unsigned char controlID, heepByte* buff
 
 int GetControlValueByID(unsigned controlID)
 {
-	int i;
-	for(i = 0; i < numberOfControls; i++)
-	{
-		if(controlList[i].controlID == controlID)
-		{
-			return controlList[i].curValue;
-		}
-	}
+	if(controlID > 255)
+		return 0;
 
-	return 0;
+	int controlIndex = GetControlIndexByID(controlID);
+	if(controlIndex < 0)
+		return 0;
+
+	return controlList[controlIndex].curValue;
 }
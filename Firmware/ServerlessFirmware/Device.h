@@ -1,18 +1,46 @@
 #include "AutoGeneratedInfo.h"
+#include "CommonDataTypes.h"
 
 extern unsigned int firmwareVersion;
 
 extern struct Control controlList [];
 extern unsigned int numberOfControls;
 
+extern HeepControlCallback controlCallbacks [];
+extern unsigned char pendingPreviousValues [];
+extern heepByte* controlBackBuffers [];
+extern struct ControlSendLimit controlSendLimits [];
+extern unsigned int numberOfHeldControls;
+
+// Bytes the controls add to a memory dump, kept as controls are added
+extern unsigned long controlDataSize;
+
 extern unsigned int vertexPointerList[];
 extern unsigned int numberOfVertices;
+extern struct VertexIndexEntry vertexIndex [];
 
 extern heepByte resetHeepNetwork;
 
 void ClearControls();
 void ClearVertices();
 
+#define CONTROL_SEND_FLAG 0x01 // Set from the network and not yet sent on by the Control Daemon
+#define CONTROL_HELD_FLAG 0x02 // Value held back by the control's send limit
+#define CONTROL_HELD_ANALYTICS_FLAG 0x04 // The held value is captured by analytics when sent
+
+void RebuildControlIndex();
+
+void MarkControlPending(int controlIndex, unsigned char previousValue);
+
+// Clears and returns the lowest pending control index, or -1 if none are pending
+int TakeNextPendingControl();
+
+void NotifyControlCallback(int controlIndex);
+
+// Index into controlList or -1 if there is no such control
+int GetControlIndexByID(unsigned char controlID);
+int GetControlIndexByName(char* controlName);
+
 unsigned char isVertexEqual(struct Vertex_Byte* vertex1, struct Vertex_Byte* vertex2);
 
 void AddVertexPointer(unsigned int pointer);
@@ -21,6 +49,7 @@ void RemoveVertexListEntry(unsigned int pointer);
 
 int DeleteVertex(struct Vertex_Byte myVertex);
 
+// Also drops vertices that repeat one already listed
 void FillVertexListFromMemory();
 
 void SetDeviceName(char* deviceName);
@@ -31,6 +60,11 @@ int SetControlValueByID(unsigned char controlID, unsigned int value, unsigned ch
 
 heepByte GetControlTypeFromControlID(heepByte controlID);
 
+// Makes the back buffer the control's buffer and records its length in curValue
+void SwapControlBuffers(int controlIndex, unsigned char bufferLength);
+
+// Fails if the buffer does not fit in the control. Double buffered controls
+// are written to the back buffer, which is then swapped in
 int SetControlValueByIDBuffer(unsigned char controlID, heepByte* buffer, int bufferStartPoint, int bufferLength, unsigned char setFromNetwork);
 
 int SetControlValueByIDFromNetwork(unsigned char controlID, unsigned int value);
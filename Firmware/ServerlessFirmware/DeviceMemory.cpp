@@ -1,6 +1,12 @@
 #include "DeviceMemory.h"
 #include "DeviceSpecificMemory.h"
 #include "MemoryUtilities.h"
+#include "Device.h"
+#include <string.h>
+
+#if defined(USE_MOP_OPCODE_TABLE) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 unsigned char deviceMemory [MAX_MEMORY];
 unsigned int curFilledMemory = 0; // Indicate the curent filled memory. 
@@ -10,6 +16,10 @@ unsigned char memoryChanged = 0;
 
 unsigned char controlRegister = 0;
 
+unsigned int fragmentedMemory = 0;
+unsigned long numberOfDefragmentations = 0;
+unsigned char defragmentThreshold = DEFRAGMENT_THRESHOLD_PERCENT;
+
 void PerformPreOpCodeProcessing_Byte(heepByte* deviceID)
 {
 	// CopyDevice ID Into throw away buffer so that we don't corrupt original pointer
@@ -43,9 +53,282 @@ unsigned int SkipOpCode(unsigned int counter)
 	return counter;
 }
 
+#ifdef USE_IP_DIRECTORY
+struct IPDirectoryEntry
+{
+	heepByte inUse;
+	heepByte deviceID [STANDARD_ID_SIZE];
+	unsigned int pointer;
+};
+
+struct IPDirectoryEntry ipDirectory [IP_DIRECTORY_SIZE];
+#endif
+
+// A MOP is only ever this many slots past its fingerprint's bucket, so a
+// lookup reads a fixed window however full the index is
+#if MOP_INDEX_SIZE < 16
+#define MOP_INDEX_PROBES MOP_INDEX_SIZE
+#else
+#define MOP_INDEX_PROBES 16
+#endif
+
+// Marks the slot of an unindexed MOP, so that lookups still stop at the
+// first empty slot. No MOP starts in the last byte of memory
+#define MOP_INDEX_REMOVED 0xFFFF
+
+struct MOPIndexEntry MOPIndex [MOP_INDEX_SIZE];
+unsigned int MOPIndexedMemory = 0; // MOPs before this have been indexed
+heepByte MOPIndexFull = 0; // A MOP did not fit. Deletes scan memory until the index is invalidated
+
+#ifdef USE_MOP_OPCODE_TABLE
+// Every MOP is at least ID_SIZE + 2 bytes
+#define MOP_OPCODE_TABLE_SIZE (MAX_MEMORY / (ID_SIZE + 2) + 1)
+
+// The opcode and pointer of every MOP before MOPOpCodeTableMemory, in memory
+// order. The opcodes are a column of their own so that they can be compared
+// sixteen at a time
+heepByte MOPOpCodes [MOP_OPCODE_TABLE_SIZE];
+unsigned short MOPOpCodePointers [MOP_OPCODE_TABLE_SIZE];
+unsigned int numberOfTabledMOPs = 0;
+unsigned int MOPOpCodeTableMemory = 0;
+#endif
+
+void InvalidateMOPIndex()
+{
+	memset(MOPIndex, 0, sizeof(MOPIndex));
+	MOPIndexedMemory = 0;
+	MOPIndexFull = 0;
+
+#ifdef USE_MOP_OPCODE_TABLE
+	numberOfTabledMOPs = 0;
+	MOPOpCodeTableMemory = 0;
+#endif
+}
+
+// Hashes the opcode, ID, length and data, folded to 16 bits
+unsigned short FingerprintMOP(heepByte* MOP, unsigned int numBytes)
+{
+	unsigned long hash = HashBuffer(MOP, numBytes);
+	return (hash ^ (hash >> 16)) & 0xFFFF;
+}
+
+void IndexMOP(unsigned int pointer)
+{
+	if(deviceMemory[pointer] == FragmentOpCode)
+		return;
+
+	unsigned short fingerprint = FingerprintMOP(&deviceMemory[pointer], SkipOpCode(pointer) - pointer);
+	unsigned int bucket = fingerprint & (MOP_INDEX_SIZE - 1);
+
+	for(int i = 0; i < MOP_INDEX_PROBES; i++)
+	{
+		if(MOPIndex[bucket].pointer == 0 || MOPIndex[bucket].pointer == MOP_INDEX_REMOVED)
+		{
+			MOPIndex[bucket].pointer = pointer + 1;
+			MOPIndex[bucket].fingerprint = fingerprint;
+			return;
+		}
+
+		bucket = (bucket + 1) & (MOP_INDEX_SIZE - 1);
+	}
+
+	MOPIndexFull = 1;
+}
+
+void UnindexMOP(unsigned int pointer)
+{
+	if(MOPIndexFull || pointer >= MOPIndexedMemory || deviceMemory[pointer] == FragmentOpCode)
+		return;
+
+	unsigned short fingerprint = FingerprintMOP(&deviceMemory[pointer], SkipOpCode(pointer) - pointer);
+	unsigned int bucket = fingerprint & (MOP_INDEX_SIZE - 1);
+
+	for(int i = 0; i < MOP_INDEX_PROBES && MOPIndex[bucket].pointer != 0; i++)
+	{
+		if(MOPIndex[bucket].pointer == pointer + 1)
+		{
+			MOPIndex[bucket].pointer = MOP_INDEX_REMOVED;
+			return;
+		}
+
+		bucket = (bucket + 1) & (MOP_INDEX_SIZE - 1);
+	}
+}
+
+void ReindexMOP(unsigned int pointer)
+{
+	if(MOPIndexFull == 0 && pointer < MOPIndexedMemory)
+		IndexMOP(pointer);
+}
+
+// Indexes the MOPs added since the index was last used. A full index stays
+// full until memory shrinks or is compacted, so that deletes do not rebuild
+// it only to overflow again
+void UpdateMOPIndex()
+{
+	if(MOPIndexedMemory > curFilledMemory)
+		InvalidateMOPIndex();
+
+	while(MOPIndexFull == 0 && MOPIndexedMemory < curFilledMemory)
+	{
+		IndexMOP(MOPIndexedMemory);
+		MOPIndexedMemory = SkipOpCode(MOPIndexedMemory);
+	}
+}
+
+#ifdef USE_MOP_OPCODE_TABLE
+// Tables the MOPs added since the table was last used, like UpdateMOPIndex
+void UpdateMOPOpCodeTable()
+{
+	if(MOPOpCodeTableMemory > curFilledMemory)
+	{
+		numberOfTabledMOPs = 0;
+		MOPOpCodeTableMemory = 0;
+	}
+
+	while(MOPOpCodeTableMemory < curFilledMemory && numberOfTabledMOPs < MOP_OPCODE_TABLE_SIZE)
+	{
+		MOPOpCodes[numberOfTabledMOPs] = deviceMemory[MOPOpCodeTableMemory];
+		MOPOpCodePointers[numberOfTabledMOPs] = MOPOpCodeTableMemory;
+		numberOfTabledMOPs++;
+		MOPOpCodeTableMemory = SkipOpCode(MOPOpCodeTableMemory);
+	}
+}
+
+// The table is in memory order, so the MOP is found by binary search
+void FragmentInMOPOpCodeTable(unsigned int pointer)
+{
+	if(pointer >= MOPOpCodeTableMemory)
+		return;
+
+	unsigned int low = 0;
+	unsigned int high = numberOfTabledMOPs;
+	while(low < high)
+	{
+		unsigned int middle = (low + high) / 2;
+
+		if(MOPOpCodePointers[middle] < pointer)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	if(low < numberOfTabledMOPs && MOPOpCodePointers[low] == pointer)
+		MOPOpCodes[low] = FragmentOpCode;
+}
+
+// Returns the first table entry from entry on with the opcode, or
+// numberOfTabledMOPs if there is none
+unsigned int FindNextTabledMOP(heepByte opCode, unsigned int entry)
+{
+#ifdef __SSE2__
+	__m128i wantedOpCodes = _mm_set1_epi8((char)opCode);
+
+	while(entry + 16 <= numberOfTabledMOPs)
+	{
+		__m128i opCodes = _mm_loadu_si128((__m128i*)&MOPOpCodes[entry]);
+		int matches = _mm_movemask_epi8(_mm_cmpeq_epi8(opCodes, wantedOpCodes));
+
+		if(matches != 0)
+			return entry + __builtin_ctz(matches);
+
+		entry += 16;
+	}
+#endif
+
+	while(entry < numberOfTabledMOPs && MOPOpCodes[entry] != opCode)
+		entry++;
+
+	return entry;
+}
+#endif
+
+unsigned int FindMOPsWithOpCode(heepByte opCode, unsigned int* pointers, unsigned int maxPointers)
+{
+	unsigned int numberFound = 0;
+
+#ifdef USE_MOP_OPCODE_TABLE
+	UpdateMOPOpCodeTable();
+
+	unsigned int entry = FindNextTabledMOP(opCode, 0);
+	while(entry < numberOfTabledMOPs && numberFound < maxPointers)
+	{
+		pointers[numberFound++] = MOPOpCodePointers[entry];
+		entry = FindNextTabledMOP(opCode, entry + 1);
+	}
+#else
+	unsigned int counter = 0;
+	while(counter < curFilledMemory && numberFound < maxPointers)
+	{
+		if(deviceMemory[counter] == opCode)
+			pointers[numberFound++] = counter;
+
+		counter = SkipOpCode(counter);
+	}
+#endif
+
+	return numberFound;
+}
+
+heepByte FragmentMOPIfEqual(unsigned int pointer, heepByte* MOP, unsigned int numBytes)
+{
+	if(pointer + numBytes > curFilledMemory || memcmp(&deviceMemory[pointer], MOP, numBytes) != 0)
+		return 0;
+
+	// The fragment keeps the MOP's own length so that SkipOpCode still steps over it
+	FragmentMOPAtPointer(pointer);
+	return 1;
+}
+
+unsigned int DeleteMOPsEqualTo(heepByte* MOP, unsigned int numBytes)
+{
+	if(MOP[0] == FragmentOpCode)
+		return 0;
+
+	UpdateMOPIndex();
+
+	unsigned int MOPsDeleted = 0;
+
+	if(MOPIndexFull)
+	{
+		// More MOPs than the index can hold
+		unsigned int counter = 0;
+		while(counter < curFilledMemory)
+		{
+			MOPsDeleted += FragmentMOPIfEqual(counter, MOP, numBytes);
+			counter = SkipOpCode(counter);
+		}
+	}
+	else
+	{
+		// Equal MOPs share a fingerprint, so every one of them is in this probe window
+		unsigned short fingerprint = FingerprintMOP(MOP, numBytes);
+		unsigned int bucket = fingerprint & (MOP_INDEX_SIZE - 1);
+
+		for(int i = 0; i < MOP_INDEX_PROBES && MOPIndex[bucket].pointer != 0; i++)
+		{
+			if(MOPIndex[bucket].pointer != MOP_INDEX_REMOVED && MOPIndex[bucket].fingerprint == fingerprint)
+				MOPsDeleted += FragmentMOPIfEqual(MOPIndex[bucket].pointer - 1, MOP, numBytes);
+
+			bucket = (bucket + 1) & (MOP_INDEX_SIZE - 1);
+		}
+	}
+
+	if(MOPsDeleted > 0)
+		memoryChanged = 1;
+
+	return MOPsDeleted;
+}
+
 void ClearDeviceMemory()
 {
 	curFilledMemory = 0;
+	fragmentedMemory = 0;
+	InvalidateMOPIndex();
+
+#ifdef USE_IP_DIRECTORY
+	memset(ipDirectory, 0, sizeof(ipDirectory));
+#endif
 }
 
 void AddNewCharToMemory(unsigned char newMem)
@@ -80,7 +363,9 @@ void AddIndexOrDeviceIDToMemory_Byte(heepByte* deviceID)
 	heepByte copyID [STANDARD_ID_SIZE];
 	CopyDeviceID(deviceID, copyID);
 
-	GetIndexedDeviceID_Byte(copyID);
+	if(GetIndexedDeviceID_Byte(copyID) == 0)
+		return;
+
 	AddBufferToMemory(copyID, ID_SIZE);
 }
 
@@ -92,54 +377,176 @@ void AddIPToMemory(struct HeepIPAddress theIP)
 	AddNewCharToMemory(theIP.Octet1);
 }
 
-heepByte SetDeviceNameInMemory_Byte(char* deviceName, int numCharacters, heepByte* deviceID)
+void StartMOPs(struct MOPBuilder* builder)
+{
+	builder->start = curFilledMemory;
+	builder->counter = curFilledMemory;
+	builder->end = curFilledMemory;
+	builder->failed = 0;
+}
+
+heepByte ReserveMOPBytes(struct MOPBuilder* builder, unsigned int numBytes)
 {
-	int numBytesNeeded = 1 + ID_SIZE + 1 + numCharacters;
-	if(WillMemoryOverflow(numBytesNeeded))
+	// Whatever was reserved before must be written before more is reserved
+	if(builder->failed || builder->counter != builder->end)
+	{
+		builder->failed = 1;
 		return 1;
+	}
 
-	int counter = 0;
-	
-	FragmentAllOfMOP(DeviceNameOpCode);
+	unsigned int numPendingBytes = builder->end - builder->start;
+	if(MakeRoomInMemory(numPendingBytes + numBytes))
+	{
+		builder->failed = 1;
+		return 1;
+	}
 
-	PerformPreOpCodeProcessing_Byte(deviceID);
+	// Compacting moved the end of memory, so the pending MOPs follow it
+	if(builder->start != curFilledMemory)
+	{
+		memmove(&deviceMemory[curFilledMemory], &deviceMemory[builder->start], numPendingBytes);
+		builder->start = curFilledMemory;
+		builder->counter = curFilledMemory + numPendingBytes;
+	}
 
-	AddNewCharToMemory(DeviceNameOpCode);
-	AddIndexOrDeviceIDToMemory_Byte(deviceID);
-	AddNewCharToMemory((char)numCharacters);
+	builder->end = builder->counter + numBytes;
 
-	int i;
-	for(i = 0; i < numCharacters; i++)
+	return 0;
+}
+
+void AddBytesToMOP(struct MOPBuilder* builder, heepByte* bytes, unsigned int numBytes)
+{
+	if(builder->counter + numBytes > builder->end)
 	{
-		AddNewCharToMemory(deviceName[i]);
+		builder->failed = 1;
+		return;
 	}
 
-	return 0;
+	memcpy(&deviceMemory[builder->counter], bytes, numBytes);
+	builder->counter += numBytes;
+}
+
+void AddByteToMOP(struct MOPBuilder* builder, heepByte value)
+{
+	AddBytesToMOP(builder, &value, 1);
 }
 
-void SetIconIDInMemory_Byte(char iconID, heepByte* deviceID)
+void AddNumberToMOP(struct MOPBuilder* builder, unsigned long number, int numBytes)
 {
-	PerformPreOpCodeProcessing_Byte(deviceID);
+	heepByte buffer [sizeof(unsigned long)];
+	CreateBufferFromNumber(buffer, number, numBytes);
+	AddBytesToMOP(builder, buffer, numBytes);
+}
 
-	AddNewCharToMemory(IconIDOpCode);
-	AddIndexOrDeviceIDToMemory_Byte(deviceID);
-	AddNewCharToMemory(1);
-	AddNewCharToMemory(iconID);
+void AddIPToMOP(struct MOPBuilder* builder, struct HeepIPAddress theIP)
+{
+	heepByte octets [4] = {theIP.Octet4, theIP.Octet3, theIP.Octet2, theIP.Octet1};
+	AddBytesToMOP(builder, octets, 4);
 }
 
-void SetIconDataInMemory_Byte(char* iconData, int numCharacters, heepByte* deviceID)
+heepByte ReserveLocalDeviceID(struct MOPBuilder* builder, heepByte* deviceID, heepByte* localID)
 {
-	PerformPreOpCodeProcessing_Byte(deviceID);
+#ifdef USE_INDEXED_IDS
+	if(builder->failed || builder->counter != builder->end)
+	{
+		builder->failed = 1;
+		return 1;
+	}
 
-	AddNewCharToMemory(CustomIconDrawingOpCode); 
-	AddIndexOrDeviceIDToMemory_Byte(deviceID);
-	AddNewCharToMemory((char)numCharacters);
+	// Devices indexed earlier in this builder are found too
+	if(FindLocalDeviceID(deviceID, localID, builder->end) == 0)
+		return 0;
 
-	int i;
-	for(i = 0; i < numCharacters; i++)
+	if(ReserveMOPBytes(builder, 1 + ID_SIZE + 1 + STANDARD_ID_SIZE))
+		return 1;
+
+	AddByteToMOP(builder, LocalDeviceIDOpCode);
+	AddBytesToMOP(builder, localID, ID_SIZE);
+	AddByteToMOP(builder, STANDARD_ID_SIZE);
+	AddBytesToMOP(builder, deviceID, STANDARD_ID_SIZE);
+#else
+	(void)builder;
+	CopyDeviceID(deviceID, localID);
+#endif
+
+	return 0;
+}
+
+heepByte ReserveMOPWithLocalID(struct MOPBuilder* builder, heepByte opCode, heepByte* localID, unsigned int numDataBytes)
+{
+	if(numDataBytes > 255 || ReserveMOPBytes(builder, 1 + ID_SIZE + 1 + numDataBytes))
 	{
-		AddNewCharToMemory(iconData[i]);
+		builder->failed = 1;
+		return 1;
 	}
+
+	AddByteToMOP(builder, opCode);
+	AddBytesToMOP(builder, localID, ID_SIZE);
+	AddByteToMOP(builder, numDataBytes);
+
+	return 0;
+}
+
+heepByte ReserveMOP(struct MOPBuilder* builder, heepByte opCode, heepByte* deviceID, unsigned int numDataBytes)
+{
+	heepByte localID [STANDARD_ID_SIZE];
+	if(ReserveLocalDeviceID(builder, deviceID, localID))
+		return 1;
+
+	return ReserveMOPWithLocalID(builder, opCode, localID, numDataBytes);
+}
+
+heepByte CommitMOPs(struct MOPBuilder* builder)
+{
+	if(builder->failed || builder->counter != builder->end || builder->start != curFilledMemory)
+		return 1;
+
+	curFilledMemory = builder->end;
+	memoryChanged = 1;
+
+	return 0;
+}
+
+heepByte SetDeviceNameInMemory_Byte(char* deviceName, int numCharacters, heepByte* deviceID)
+{
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
+
+	// The old name is only fragmented once the new one is known to fit
+	if(ReserveMOP(&builder, DeviceNameOpCode, deviceID, numCharacters))
+		return 1;
+
+	FragmentAllOfMOP(DeviceNameOpCode);
+
+	AddBytesToMOP(&builder, (heepByte*)deviceName, numCharacters);
+
+	return CommitMOPs(&builder);
+}
+
+heepByte SetIconIDInMemory_Byte(char iconID, heepByte* deviceID)
+{
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
+
+	if(ReserveMOP(&builder, IconIDOpCode, deviceID, 1))
+		return 1;
+
+	AddByteToMOP(&builder, iconID);
+
+	return CommitMOPs(&builder);
+}
+
+heepByte SetIconDataInMemory_Byte(char* iconData, int numCharacters, heepByte* deviceID)
+{
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
+
+	if(ReserveMOP(&builder, CustomIconDrawingOpCode, deviceID, numCharacters))
+		return 1;
+
+	AddBytesToMOP(&builder, (heepByte*)iconData, numCharacters);
+
+	return CommitMOPs(&builder);
 }
 
 heepByte GetWiFiFromMemory(char* WiFiSSID, char* WiFiPassword, int priority)
@@ -189,14 +596,14 @@ heepByte DeleteWiFiSetting(int priority, heepByte* deviceID)
 		{
 			if(deviceMemory[counter + ID_SIZE + 2] == priority)
 			{
-				deviceMemory[counter] = FragmentOpCode;
+				FragmentMOPAtPointer(counter);
 			}
 		}
 		else if(deviceMemory[counter] == WiFiPasswordOpCode)
 		{
 			if(deviceMemory[counter + ID_SIZE + 2] == priority)
 			{
-				deviceMemory[counter] = FragmentOpCode;
+				FragmentMOPAtPointer(counter);
 			}
 		}
 
@@ -212,36 +619,31 @@ heepByte DeleteWiFiSetting(int priority, heepByte* deviceID)
 
 heepByte AddWiFiSettingsToMemory(char* WiFiSSID, int numCharSSID, char* WiFiPassword, int numCharPassword, heepByte* deviceID, heepByte IDPriority)
 {
+	// Deleting first lets the old setting be compacted away to make room
 	DeleteWiFiSetting(IDPriority, deviceID);
 
-	int numberOfBytesNeeded = 1 + ID_SIZE + 1 + 1 + numCharSSID;
-	numberOfBytesNeeded += 1 + ID_SIZE + 1 + 1 + numCharPassword;
-	if(WillMemoryOverflow(numberOfBytesNeeded))
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
+
+	heepByte localID [STANDARD_ID_SIZE];
+	if(ReserveLocalDeviceID(&builder, deviceID, localID))
 		return 1;
-	
-	PerformPreOpCodeProcessing_Byte(deviceID);
 
 	// WiFi
-	AddNewCharToMemory(WiFiSSIDOpCode);
-	AddIndexOrDeviceIDToMemory_Byte(deviceID);
-	AddNewCharToMemory(1 + numCharSSID);
-	AddNewCharToMemory(IDPriority);
-	for(int i = 0; i < numCharSSID; i++)
-	{
-		AddNewCharToMemory(WiFiSSID[i]);
-	}
+	if(ReserveMOPWithLocalID(&builder, WiFiSSIDOpCode, localID, 1 + numCharSSID))
+		return 1;
+
+	AddByteToMOP(&builder, IDPriority);
+	AddBytesToMOP(&builder, (heepByte*)WiFiSSID, numCharSSID);
 
 	// Password
-	AddNewCharToMemory(WiFiPasswordOpCode);
-	AddIndexOrDeviceIDToMemory_Byte(deviceID);
-	AddNewCharToMemory(1 + numCharPassword);
-	AddNewCharToMemory(IDPriority);
-	for(int i = 0; i < numCharPassword; i++)
-	{
-		AddNewCharToMemory(WiFiPassword[i]);
-	}
+	if(ReserveMOPWithLocalID(&builder, WiFiPasswordOpCode, localID, 1 + numCharPassword))
+		return 1;
 
-	return 0;
+	AddByteToMOP(&builder, IDPriority);
+	AddBytesToMOP(&builder, (heepByte*)WiFiPassword, numCharPassword);
+
+	return CommitMOPs(&builder);
 }
 
 #ifdef USE_ANALYTICS
@@ -255,14 +657,13 @@ void SetAnalyticsDataControlValueInMemory_Byte(heepByte controlID, int controlVa
 
 	heepByte totalBytesForAnalyticsMOP = 1 + ID_SIZE + 1 + numBytesForTime + 5;
 	
-	while(WillMemoryOverflow(totalBytesForAnalyticsMOP))
+	while(MakeRoomInMemory(totalBytesForAnalyticsMOP))
 	{
 		int firstAnalyticsData = GetNextAnalyticsDataPointer(0);
 		if(firstAnalyticsData >= 0)
 		{
-			// Delete Analytics Data in FIFO Manner
-			deviceMemory[firstAnalyticsData] = FragmentOpCode;
-			DefragmentMemory();
+			// Delete Analytics Data in FIFO Manner. The next check compacts it away
+			FragmentMOPAtPointer(firstAnalyticsData);
 		}
 		else
 		{
@@ -271,17 +672,23 @@ void SetAnalyticsDataControlValueInMemory_Byte(heepByte controlID, int controlVa
 		}
 	}
 
-	PerformPreOpCodeProcessing_Byte(deviceID);
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
 
-	AddNewCharToMemory(AnalyticsOpCode);
-	AddIndexOrDeviceIDToMemory_Byte(deviceID);
-	AddNewCharToMemory(numBytesForTime + 5);
-	AddNewCharToMemory(controlID);
-	AddNewCharToMemory(1); // 1 byte control values
-	AddNewCharToMemory((heepByte)controlValue);
-	AddNewCharToMemory(IsAbsoluteTime());
-	AddNewCharToMemory(numBytesForTime);
-	curFilledMemory = AddNumberToBufferWithSpecifiedBytes64Bit(deviceMemory, GetAnalyticsTime(), curFilledMemory, numBytesForTime);
+	if(ReserveMOP(&builder, AnalyticsOpCode, deviceID, numBytesForTime + 5))
+		return;
+
+	heepByte analyticsTime [8];
+	AddNumberToBufferWithSpecifiedBytes64Bit(analyticsTime, GetAnalyticsTime(), 0, numBytesForTime);
+
+	AddByteToMOP(&builder, controlID);
+	AddByteToMOP(&builder, 1); // 1 byte control values
+	AddByteToMOP(&builder, (heepByte)controlValue);
+	AddByteToMOP(&builder, IsAbsoluteTime());
+	AddByteToMOP(&builder, numBytesForTime);
+	AddBytesToMOP(&builder, analyticsTime, numBytesForTime);
+
+	CommitMOPs(&builder);
 }
 
 int GetNextAnalyticsDataPointer(int startingPointer)
@@ -328,7 +735,8 @@ unsigned int GetXYFromMemory_Byte(int *x, int *y, heepByte* deviceID, unsigned i
 {
 	unsigned int counter = 0;
 
-	GetIndexedDeviceID_Byte(deviceID);
+	// A device that was never indexed has no position
+	heepByte isIndexed = FindIndexedDeviceID_Byte(deviceID) != 0;
 
 	while(counter < curFilledMemory)
 	{
@@ -339,7 +747,7 @@ unsigned int GetXYFromMemory_Byte(int *x, int *y, heepByte* deviceID, unsigned i
 			heepByte tempID [ID_SIZE];
 			counter = ParseXYOpCode_Byte(x, y, tempID, counter);
 
-			if(CheckBufferEquality(deviceID, tempID, ID_SIZE))
+			if(isIndexed && CheckBufferEquality(deviceID, tempID, ID_SIZE))
 			{
 				return 0;
 			}
@@ -353,15 +761,18 @@ unsigned int GetXYFromMemory_Byte(int *x, int *y, heepByte* deviceID, unsigned i
 	return 1;
 }
 
-void SetXYInMemory_Byte(int x, int y, heepByte* deviceID)
+heepByte SetXYInMemory_Byte(int x, int y, heepByte* deviceID)
 {
-	PerformPreOpCodeProcessing_Byte(deviceID);
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
+
+	if(ReserveMOP(&builder, FrontEndPositionOpCode, deviceID, 4))
+		return 1;
+
+	AddNumberToMOP(&builder, x, 2);
+	AddNumberToMOP(&builder, y, 2);
 
-	AddNewCharToMemory(FrontEndPositionOpCode);
-	AddIndexOrDeviceIDToMemory_Byte(deviceID);
-	AddNewCharToMemory((char)4);
-	AddNumberToMemoryWithSpecifiedBytes(x, 2);
-	AddNumberToMemoryWithSpecifiedBytes(y, 2);
+	return CommitMOPs(&builder);
 }
 
 heepByte UpdateXYInMemory_Byte(int x, int y, heepByte* deviceID)
@@ -375,17 +786,17 @@ heepByte UpdateXYInMemory_Byte(int x, int y, heepByte* deviceID)
 
 	if(success == 0)
 	{
+		UnindexMOP(XYMemPosition);
 		deviceMemory[XYMemPosition + ID_SIZE + 2] = (x >> 8)%256;
 		deviceMemory[XYMemPosition + ID_SIZE + 3] = (x%256);
 		deviceMemory[XYMemPosition + ID_SIZE + 4] = (y >> 8)%256;
 		deviceMemory[XYMemPosition + ID_SIZE + 5] = (y%256);
+		ReindexMOP(XYMemPosition);
 	}
 	else
 	{
-		if(WillMemoryOverflow(ID_SIZE+6))
+		if(SetXYInMemory_Byte(x, y, deviceID))
 			return 1;
-
-		SetXYInMemory_Byte(x, y, deviceID);
 	}
 
 	memoryChanged = 1;
@@ -410,83 +821,529 @@ heepByte GetIPFromMemory(struct HeepIPAddress* theIP)
 	return 0;
 }
 
-void SetIPInMemory_Byte(struct HeepIPAddress theIP, heepByte* deviceID)
+heepByte SetIPInMemory_Byte(struct HeepIPAddress theIP, heepByte* deviceID)
 {
-	PerformPreOpCodeProcessing_Byte(deviceID);
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
+
+	if(ReserveMOP(&builder, DeviceIPOpCode, deviceID, 4))
+		return 1;
+
+	AddIPToMOP(&builder, theIP);
 
-	AddNewCharToMemory(DeviceIPOpCode);
-	AddIndexOrDeviceIDToMemory_Byte(deviceID);
-	AddNewCharToMemory((char)4);
-	AddIPToMemory(theIP);
+	return CommitMOPs(&builder);
 }
 
-void DeleteVertexAtPointer(unsigned long pointer)
+#ifdef USE_IP_DIRECTORY
+
+unsigned long HashDeviceID(heepByte* deviceID)
 {
-	deviceMemory[pointer] = FragmentOpCode;
-	memoryChanged = 1;
+	return HashBuffer(deviceID, STANDARD_ID_SIZE);
 }
 
-int GetVertexAtPointer_Byte(unsigned long pointer, struct Vertex_Byte* returnedVertex)
+// Returns the entry for the device, or the empty entry it would go in, or 0
+// if the directory is full
+struct IPDirectoryEntry* FindIPDirectoryEntry(heepByte* deviceID)
 {
-	if(deviceMemory[pointer] != VertexOpCode)
-		return 1;
-
-	heepByte receiveIDLocal [ID_SIZE];
-	heepByte sendIDLocal [ID_SIZE];
-	heepByte receiveIDGlobal [STANDARD_ID_SIZE];
-	heepByte sendIDGlobal [STANDARD_ID_SIZE];
-
-	unsigned int counter = pointer + 1;
+	unsigned long bucket = HashDeviceID(deviceID) & (IP_DIRECTORY_SIZE - 1);
 
-	counter = GetDeviceIDOrLocalIDFromBuffer(deviceMemory, sendIDLocal, counter);
-	GetDeviceIDFromIndex_Byte(sendIDLocal, sendIDGlobal);
-	CopyDeviceID(sendIDGlobal, (*returnedVertex).txID);
-
-	int numBytes = GetNumberFromBuffer(deviceMemory, &counter, 1);
-
-	counter = GetDeviceIDOrLocalIDFromBuffer(deviceMemory, receiveIDLocal, counter);
-	GetDeviceIDFromIndex_Byte(receiveIDLocal, receiveIDGlobal);
-	CopyDeviceID(receiveIDGlobal, (*returnedVertex).rxID);
+	for(int i = 0; i < IP_DIRECTORY_SIZE; i++)
+	{
+		if(ipDirectory[bucket].inUse == 0 || CheckBufferEquality(ipDirectory[bucket].deviceID, deviceID, STANDARD_ID_SIZE))
+			return &ipDirectory[bucket];
 
-	(*returnedVertex).txControlID = GetNumberFromBuffer(deviceMemory, &counter, 1);
-	(*returnedVertex).rxControlID = GetNumberFromBuffer(deviceMemory, &counter, 1);
-	(*returnedVertex).rxIPAddress.Octet4 = GetNumberFromBuffer(deviceMemory, &counter, 1);
-	(*returnedVertex).rxIPAddress.Octet3 = GetNumberFromBuffer(deviceMemory, &counter, 1);
-	(*returnedVertex).rxIPAddress.Octet2 = GetNumberFromBuffer(deviceMemory, &counter, 1);
-	(*returnedVertex).rxIPAddress.Octet1 = GetNumberFromBuffer(deviceMemory, &counter, 1);
+		bucket = (bucket + 1) & (IP_DIRECTORY_SIZE - 1);
+	}
 
 	return 0;
 }
 
-heepByte SetVertexInMemory_Byte(struct Vertex_Byte theVertex, unsigned int* vertexPointer)
+void RebuildIPDirectory()
 {
-	int numBytesNeeded = 1 + ID_SIZE + ID_SIZE + 7;
-	if(WillMemoryOverflow(numBytesNeeded))
-		return 1;
+	memset(ipDirectory, 0, sizeof(ipDirectory));
 
-	PerformPreOpCodeProcessing_Byte(theVertex.txID);
-	PerformPreOpCodeProcessing_Byte(theVertex.rxID);
-	
-	heepByte copyIDTx[STANDARD_ID_SIZE];
-	CopyDeviceID(theVertex.txID, copyIDTx);
-	heepByte copyIDRx[STANDARD_ID_SIZE];
-	CopyDeviceID(theVertex.rxID, copyIDRx);
+	unsigned int counter = 0;
+	while(counter < curFilledMemory)
+	{
+		if(deviceMemory[counter] == RemoteDeviceIPOpCode)
+		{
+			heepByte localID [ID_SIZE];
+			heepByte deviceID [STANDARD_ID_SIZE];
+			GetDeviceIDOrLocalIDFromBuffer(deviceMemory, localID, counter + 1);
+			GetDeviceIDFromIndex_Byte(localID, deviceID);
 
-	*vertexPointer = curFilledMemory;
+			struct IPDirectoryEntry* entry = FindIPDirectoryEntry(deviceID);
+			if(entry != 0 && entry->inUse == 0)
+			{
+				entry->inUse = 1;
+				CopyDeviceID(deviceID, entry->deviceID);
+				entry->pointer = counter;
+			}
+		}
 
-	AddNewCharToMemory(VertexOpCode);
-	AddIndexOrDeviceIDToMemory_Byte(copyIDTx);
-	AddNewCharToMemory((char)ID_SIZE+6);
-	AddIndexOrDeviceIDToMemory_Byte(copyIDRx);
-	AddNewCharToMemory(theVertex.txControlID);
-	AddNewCharToMemory(theVertex.rxControlID);
-	AddIPToMemory(theVertex.rxIPAddress);
+		counter = SkipOpCode(counter);
+	}
+}
+
+// Rebuilds first if the entry no longer points at its MOP
+struct IPDirectoryEntry* GetIPDirectoryEntry(heepByte* deviceID)
+{
+	struct IPDirectoryEntry* entry = FindIPDirectoryEntry(deviceID);
+	if(entry == 0 || entry->inUse == 0)
+		return 0;
+
+	if(entry->pointer >= curFilledMemory || deviceMemory[entry->pointer] != RemoteDeviceIPOpCode)
+	{
+		RebuildIPDirectory();
+		entry = FindIPDirectoryEntry(deviceID);
+		if(entry == 0 || entry->inUse == 0)
+			return 0;
+	}
+
+	return entry;
+}
+
+heepByte GetIPFromDirectory(heepByte* deviceID, struct HeepIPAddress* theIP)
+{
+	struct IPDirectoryEntry* entry = GetIPDirectoryEntry(deviceID);
+	if(entry == 0)
+		return 1;
+
+	unsigned int deviceMemCounter = entry->pointer + ID_SIZE + 2;
+	theIP->Octet4 = deviceMemory[deviceMemCounter++];
+	theIP->Octet3 = deviceMemory[deviceMemCounter++];
+	theIP->Octet2 = deviceMemory[deviceMemCounter++];
+	theIP->Octet1 = deviceMemory[deviceMemCounter++];
+
+	return 0;
+}
+
+heepByte UpdateIPInDirectory(heepByte* deviceID, struct HeepIPAddress theIP)
+{
+	struct IPDirectoryEntry* entry = GetIPDirectoryEntry(deviceID);
+	if(entry == 0)
+		return 1;
+
+	UnindexMOP(entry->pointer);
+	unsigned int deviceMemCounter = entry->pointer + ID_SIZE + 2;
+	deviceMemory[deviceMemCounter++] = theIP.Octet4;
+	deviceMemory[deviceMemCounter++] = theIP.Octet3;
+	deviceMemory[deviceMemCounter++] = theIP.Octet2;
+	deviceMemory[deviceMemCounter++] = theIP.Octet1;
+	ReindexMOP(entry->pointer);
 
 	memoryChanged = 1;
 
 	return 0;
 }
 
+int GetIPDirectoryHomeBucket(heepByte* entry)
+{
+	struct IPDirectoryEntry* directoryEntry = (struct IPDirectoryEntry*)entry;
+	if(directoryEntry->inUse == 0)
+		return -1;
+
+	return HashDeviceID(directoryEntry->deviceID) & (IP_DIRECTORY_SIZE - 1);
+}
+
+void RemoveIPDirectoryEntry(unsigned int entry)
+{
+	RemoveHashTableEntry((heepByte*)ipDirectory, sizeof(struct IPDirectoryEntry), IP_DIRECTORY_SIZE, entry, GetIPDirectoryHomeBucket);
+}
+
+// Drops the device's IP once no vertex is sent to it. Takes the rx ID as it
+// is stored in a vertex
+void DeleteUnusedIPFromDirectory(heepByte* storedRxID)
+{
+	unsigned int counter = 0;
+	while(counter < curFilledMemory)
+	{
+		if(deviceMemory[counter] == VertexOpCode && CheckBufferEquality(GetStoredRxIDOfVertex(counter), storedRxID, ID_SIZE))
+			return;
+
+		counter = SkipOpCode(counter);
+	}
+
+	heepByte deviceID [STANDARD_ID_SIZE];
+	GetDeviceIDFromIndex_Byte(storedRxID, deviceID);
+
+	struct IPDirectoryEntry* entry = GetIPDirectoryEntry(deviceID);
+	if(entry == 0)
+		return;
+
+	FragmentMOPAtPointer(entry->pointer);
+	RemoveIPDirectoryEntry(entry - ipDirectory);
+}
+
+// Takes a Remote Device IP MOP that has been committed
+void AddIPDirectoryEntry(heepByte* deviceID, unsigned int pointer)
+{
+	struct IPDirectoryEntry* entry = FindIPDirectoryEntry(deviceID);
+	if(entry == 0)
+		return;
+
+	entry->inUse = 1;
+	CopyDeviceID(deviceID, entry->deviceID);
+	entry->pointer = pointer;
+}
+
+heepByte SetIPInDirectory(heepByte* deviceID, struct HeepIPAddress theIP)
+{
+	if(UpdateIPInDirectory(deviceID, theIP) == 0)
+		return 0;
+
+	if(FindIPDirectoryEntry(deviceID) == 0)
+		return 1;
+
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
+
+	if(ReserveMOP(&builder, RemoteDeviceIPOpCode, deviceID, 4))
+		return 1;
+
+	// Reserving may compact memory, so the MOP is found from the builder's start
+	unsigned int IPOffset = builder.counter - builder.start - ID_SIZE - 2;
+	AddIPToMOP(&builder, theIP);
+
+	if(CommitMOPs(&builder))
+		return 1;
+
+	AddIPDirectoryEntry(deviceID, builder.start + IPOffset);
+
+	return 0;
+}
+
+#endif
+
+void DeleteVertexAtPointer(unsigned long pointer)
+{
+#ifdef USE_IP_DIRECTORY
+	heepByte storedRxID [ID_SIZE];
+	memcpy(storedRxID, GetStoredRxIDOfVertex(pointer), ID_SIZE);
+#endif
+
+	FragmentMOPAtPointer(pointer);
+	memoryChanged = 1;
+
+#ifdef USE_IP_DIRECTORY
+	DeleteUnusedIPFromDirectory(storedRxID);
+#endif
+}
+
+int GetVertexAtPointer_Byte(unsigned long pointer, struct Vertex_Byte* returnedVertex)
+{
+	if(deviceMemory[pointer] != VertexOpCode)
+		return 1;
+
+	heepByte receiveIDLocal [ID_SIZE];
+	heepByte sendIDLocal [ID_SIZE];
+	heepByte receiveIDGlobal [STANDARD_ID_SIZE];
+	heepByte sendIDGlobal [STANDARD_ID_SIZE];
+
+	unsigned int counter = pointer + 1;
+
+	counter = GetDeviceIDOrLocalIDFromBuffer(deviceMemory, sendIDLocal, counter);
+	GetDeviceIDFromIndex_Byte(sendIDLocal, sendIDGlobal);
+	CopyDeviceID(sendIDGlobal, (*returnedVertex).txID);
+
+	int numBytes = GetNumberFromBuffer(deviceMemory, &counter, 1);
+
+	counter = GetDeviceIDOrLocalIDFromBuffer(deviceMemory, receiveIDLocal, counter);
+	GetDeviceIDFromIndex_Byte(receiveIDLocal, receiveIDGlobal);
+	CopyDeviceID(receiveIDGlobal, (*returnedVertex).rxID);
+
+	(*returnedVertex).txControlID = GetNumberFromBuffer(deviceMemory, &counter, 1);
+	(*returnedVertex).rxControlID = GetNumberFromBuffer(deviceMemory, &counter, 1);
+
+	// Vertices that use the IP directory end here
+	if(numBytes >= ID_SIZE + 6)
+	{
+		(*returnedVertex).rxIPAddress.Octet4 = GetNumberFromBuffer(deviceMemory, &counter, 1);
+		(*returnedVertex).rxIPAddress.Octet3 = GetNumberFromBuffer(deviceMemory, &counter, 1);
+		(*returnedVertex).rxIPAddress.Octet2 = GetNumberFromBuffer(deviceMemory, &counter, 1);
+		(*returnedVertex).rxIPAddress.Octet1 = GetNumberFromBuffer(deviceMemory, &counter, 1);
+	}
+
+#ifdef USE_IP_DIRECTORY
+	// The directory has the latest IP, even for vertices that carry their own
+	GetIPFromDirectory((*returnedVertex).rxID, &(*returnedVertex).rxIPAddress);
+#endif
+
+	return 0;
+}
+
+heepByte* GetStoredRxIDOfVertex(unsigned long pointer)
+{
+	return &deviceMemory[pointer + 1 + ID_SIZE + 1];
+}
+
+heepByte SetVertexInMemory_Byte(struct Vertex_Byte theVertex, unsigned int* vertexPointer)
+{
+	heepByte storeIP = 1;
+#ifdef USE_IP_DIRECTORY
+	// A new directory MOP is committed with the vertex or not at all. A full
+	// directory leaves the IP in the vertex
+	heepByte hasIPEntry = GetIPDirectoryEntry(theVertex.rxID) != 0;
+	heepByte addIPEntry = hasIPEntry == 0 && FindIPDirectoryEntry(theVertex.rxID) != 0;
+	storeIP = hasIPEntry == 0 && addIPEntry == 0;
+	unsigned int IPOffset = 0;
+#endif
+
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
+
+	heepByte txLocalID [STANDARD_ID_SIZE];
+	heepByte rxLocalID [STANDARD_ID_SIZE];
+	if(ReserveLocalDeviceID(&builder, theVertex.txID, txLocalID) || ReserveLocalDeviceID(&builder, theVertex.rxID, rxLocalID))
+		return 1;
+
+#ifdef USE_IP_DIRECTORY
+	if(addIPEntry)
+	{
+		if(ReserveMOPWithLocalID(&builder, RemoteDeviceIPOpCode, rxLocalID, 4))
+			return 1;
+
+		IPOffset = builder.counter - builder.start - ID_SIZE - 2;
+		AddIPToMOP(&builder, theVertex.rxIPAddress);
+	}
+#endif
+
+	if(ReserveMOPWithLocalID(&builder, VertexOpCode, txLocalID, ID_SIZE + (storeIP ? 6 : 2)))
+		return 1;
+
+	// Reserving may compact memory, so MOPs are found from the builder's start
+	unsigned int vertexOffset = builder.counter - builder.start - ID_SIZE - 2;
+
+	AddBytesToMOP(&builder, rxLocalID, ID_SIZE);
+	AddByteToMOP(&builder, theVertex.txControlID);
+	AddByteToMOP(&builder, theVertex.rxControlID);
+
+	if(storeIP)
+		AddIPToMOP(&builder, theVertex.rxIPAddress);
+
+	if(CommitMOPs(&builder))
+		return 1;
+
+	*vertexPointer = builder.start + vertexOffset;
+
+#ifdef USE_IP_DIRECTORY
+	if(hasIPEntry)
+		UpdateIPInDirectory(theVertex.rxID, theVertex.rxIPAddress);
+	else if(addIPEntry)
+		AddIPDirectoryEntry(theVertex.rxID, builder.start + IPOffset);
+#endif
+
+	return 0;
+}
+
+// Returns the device's place in the batch's device list, adding it if it is new
+int GetBatchDevice(heepByte deviceIDs [][STANDARD_ID_SIZE], int* numberOfDevices, heepByte* deviceID)
+{
+	for(int i = 0; i < *numberOfDevices; i++)
+	{
+		if(CheckBufferEquality(deviceIDs[i], deviceID, STANDARD_ID_SIZE))
+			return i;
+	}
+
+	CopyDeviceID(deviceID, deviceIDs[*numberOfDevices]);
+	return (*numberOfDevices)++;
+}
+
+heepByte SetVerticesInMemory_Byte(struct Vertex_Byte* vertices, int numberOfNewVertices, unsigned int* vertexPointers)
+{
+	int vertexBytes = 1 + ID_SIZE + ID_SIZE + 7;
+
+	heepByte deviceIDs [2*VERTICES_PER_BATCH][STANDARD_ID_SIZE];
+	heepByte localIDs [2*VERTICES_PER_BATCH][ID_SIZE];
+	int txDevices [VERTICES_PER_BATCH];
+	int rxDevices [VERTICES_PER_BATCH];
+	int numberOfDevices = 0;
+
+	if(numberOfNewVertices > VERTICES_PER_BATCH)
+		return 1;
+
+	for(int i = 0; i < numberOfNewVertices; i++)
+	{
+		txDevices[i] = GetBatchDevice(deviceIDs, &numberOfDevices, vertices[i].txID);
+		rxDevices[i] = GetBatchDevice(deviceIDs, &numberOfDevices, vertices[i].rxID);
+	}
+
+	int numBytesNeeded = numberOfNewVertices * vertexBytes;
+
+#ifdef USE_INDEXED_IDS
+	// One pass finds every device that is already indexed, as
+	// GetIndexedDeviceID_Byte would
+	heepByte isIndexed [2*VERTICES_PER_BATCH];
+	memset(isIndexed, 0, sizeof(isIndexed));
+	unsigned long topIndex = 0;
+	unsigned int counter = 0;
+
+	while(counter < curFilledMemory)
+	{
+		if(deviceMemory[counter] == LocalDeviceIDOpCode)
+		{
+			counter++;
+			unsigned long indexedValue = GetNumberFromBuffer(deviceMemory, &counter, ID_SIZE);
+			counter++;
+
+			heepByte foundID [STANDARD_ID_SIZE];
+			counter = GetFullDeviceIDFromBuffer(deviceMemory, foundID, counter);
+
+			if(indexedValue == topIndex)
+			{
+				topIndex = indexedValue + 1;
+			}
+
+			for(int i = 0; i < numberOfDevices; i++)
+			{
+				if(isIndexed[i] == 0 && CheckBufferEquality(deviceIDs[i], foundID, STANDARD_ID_SIZE))
+				{
+					CreateBufferFromNumber(localIDs[i], indexedValue, ID_SIZE);
+					isIndexed[i] = 1;
+				}
+			}
+		}
+		else
+		{
+			counter = SkipOpCode(counter);
+		}
+	}
+
+	for(int i = 0; i < numberOfDevices; i++)
+	{
+		if(isIndexed[i] == 0)
+			numBytesNeeded += 1 + ID_SIZE + 1 + STANDARD_ID_SIZE;
+	}
+#else
+	for(int i = 0; i < numberOfDevices; i++)
+	{
+		CopyDeviceID(deviceIDs[i], localIDs[i]);
+	}
+#endif
+
+	heepByte storeIP [2*VERTICES_PER_BATCH];
+	memset(storeIP, 1, sizeof(storeIP));
+#ifdef USE_IP_DIRECTORY
+	// Each receiving device takes the IP of its last vertex, as adding the
+	// vertices one by one would. The directory only changes once the whole
+	// batch is committed, and a full directory leaves the IP in the vertex
+	heepByte hasIPEntry [2*VERTICES_PER_BATCH];
+	heepByte addIPEntry [2*VERTICES_PER_BATCH];
+	int IPVertex [2*VERTICES_PER_BATCH];
+	unsigned int IPPointers [2*VERTICES_PER_BATCH];
+	memset(hasIPEntry, 0, sizeof(hasIPEntry));
+	memset(addIPEntry, 0, sizeof(addIPEntry));
+
+	// Receiving devices are looked up the first time they are seen
+	for(int i = 0; i < numberOfNewVertices; i++)
+	{
+		int rx = rxDevices[i];
+		if(storeIP[rx])
+			hasIPEntry[rx] = GetIPDirectoryEntry(deviceIDs[rx]) != 0;
+
+		storeIP[rx] = 0;
+		IPVertex[rx] = i;
+	}
+
+	int freeEntries = 0;
+	for(int i = 0; i < IP_DIRECTORY_SIZE; i++)
+	{
+		if(ipDirectory[i].inUse == 0)
+			freeEntries++;
+	}
+
+	for(int i = 0; i < numberOfDevices; i++)
+	{
+		if(storeIP[i] || hasIPEntry[i])
+			continue;
+
+		if(freeEntries > 0)
+		{
+			addIPEntry[i] = 1;
+			freeEntries--;
+			numBytesNeeded += 1 + ID_SIZE + 1 + 4;
+		}
+		else
+		{
+			storeIP[i] = 1;
+		}
+	}
+
+	for(int i = 0; i < numberOfNewVertices; i++)
+	{
+		if(storeIP[rxDevices[i]] == 0)
+			numBytesNeeded -= 4;
+	}
+#endif
+
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
+
+	if(ReserveMOPBytes(&builder, numBytesNeeded))
+		return 1;
+
+#ifdef USE_INDEXED_IDS
+	for(int i = 0; i < numberOfDevices; i++)
+	{
+		if(isIndexed[i])
+			continue;
+
+		CreateBufferFromNumber(localIDs[i], topIndex++, ID_SIZE);
+
+		AddByteToMOP(&builder, LocalDeviceIDOpCode);
+		AddBytesToMOP(&builder, localIDs[i], ID_SIZE);
+		AddByteToMOP(&builder, STANDARD_ID_SIZE);
+		AddBytesToMOP(&builder, deviceIDs[i], STANDARD_ID_SIZE);
+	}
+#endif
+
+#ifdef USE_IP_DIRECTORY
+	for(int i = 0; i < numberOfDevices; i++)
+	{
+		if(addIPEntry[i] == 0)
+			continue;
+
+		IPPointers[i] = builder.counter;
+
+		AddByteToMOP(&builder, RemoteDeviceIPOpCode);
+		AddBytesToMOP(&builder, localIDs[i], ID_SIZE);
+		AddByteToMOP(&builder, 4);
+		AddIPToMOP(&builder, vertices[IPVertex[i]].rxIPAddress);
+	}
+#endif
+
+	for(int i = 0; i < numberOfNewVertices; i++)
+	{
+		heepByte hasIP = storeIP[rxDevices[i]];
+		vertexPointers[i] = builder.counter;
+
+		AddByteToMOP(&builder, VertexOpCode);
+		AddBytesToMOP(&builder, localIDs[txDevices[i]], ID_SIZE);
+		AddByteToMOP(&builder, ID_SIZE + (hasIP ? 6 : 2));
+		AddBytesToMOP(&builder, localIDs[rxDevices[i]], ID_SIZE);
+		AddByteToMOP(&builder, vertices[i].txControlID);
+		AddByteToMOP(&builder, vertices[i].rxControlID);
+
+		if(hasIP)
+			AddIPToMOP(&builder, vertices[i].rxIPAddress);
+	}
+
+	if(CommitMOPs(&builder))
+		return 1;
+
+#ifdef USE_IP_DIRECTORY
+	for(int i = 0; i < numberOfDevices; i++)
+	{
+		if(hasIPEntry[i])
+			UpdateIPInDirectory(deviceIDs[i], vertices[IPVertex[i]].rxIPAddress);
+		else if(addIPEntry[i])
+			AddIPDirectoryEntry(deviceIDs[i], IPPointers[i]);
+	}
+#endif
+
+	return 0;
+}
+
 int GetNextVertexPointer(unsigned int* pointer,unsigned int* counter)
 {
 	while(*counter < curFilledMemory)
@@ -507,6 +1364,129 @@ int GetNextVertexPointer(unsigned int* pointer,unsigned int* counter)
 	return 1;
 }
 
+unsigned short CalculateMemoryImageChecksum(heepByte* image, unsigned int imageSize)
+{
+	unsigned short sum1 = 0;
+	unsigned short sum2 = 0;
+
+	for(unsigned int i = 0; i < imageSize; i++)
+	{
+		sum1 = (sum1 + image[i]) % 255;
+		sum2 = (sum2 + sum1) % 255;
+	}
+
+	return (sum2 << 8) | sum1;
+}
+
+#ifdef USE_MEMORY_IMAGE_IMPORT
+
+heepByte memoryImage [MAX_MEMORY];
+struct MemoryImageImport memoryImageImport;
+
+heepByte AddMemoryImageChunk(unsigned int imageSize, unsigned short checksum, unsigned int offset, heepByte* chunk, unsigned int chunkLength)
+{
+	if(offset == 0)
+	{
+		memoryImageImport.size = imageSize;
+		memoryImageImport.checksum = checksum;
+		memoryImageImport.received = 0;
+		memoryImageImport.inProgress = 1;
+	}
+
+	if(memoryImageImport.inProgress == 0 || imageSize != memoryImageImport.size || checksum != memoryImageImport.checksum)
+		return 1;
+
+	if(imageSize > MAX_MEMORY || offset != memoryImageImport.received || offset + chunkLength > imageSize)
+	{
+		memoryImageImport.inProgress = 0;
+		return 1;
+	}
+
+	memcpy(&memoryImage[offset], chunk, chunkLength);
+	memoryImageImport.received += chunkLength;
+
+	return 0;
+}
+
+heepByte IsMemoryImageComplete()
+{
+	return memoryImageImport.inProgress && memoryImageImport.received == memoryImageImport.size;
+}
+
+// Every MOP must end inside the image, stepping through it as SkipOpCode does
+heepByte ValidateMemoryImage()
+{
+	unsigned int counter = 0;
+
+	while(counter < memoryImageImport.size)
+	{
+		if(counter + ID_SIZE + 1 >= memoryImageImport.size)
+			return 1;
+
+		counter += ID_SIZE + 1;
+		counter += memoryImage[counter] + 1;
+	}
+
+	if(counter != memoryImageImport.size)
+		return 1;
+
+	return 0;
+}
+
+void ReplaceSourceDeviceID(heepByte* deviceID, heepByte* sourceID)
+{
+	if(CheckBufferEquality(deviceID, sourceID, STANDARD_ID_SIZE))
+		CopyDeviceID(deviceIDByte, deviceID);
+}
+
+void MoveMemoryImageToThisDevice(heepByte* sourceID)
+{
+	unsigned int counter = 0;
+
+	while(counter < memoryImageImport.size)
+	{
+#ifdef USE_INDEXED_IDS
+		// Other MOPs hold local IDs, which follow the full ID they index
+		if(memoryImage[counter] == LocalDeviceIDOpCode && memoryImage[counter + ID_SIZE + 1] >= STANDARD_ID_SIZE)
+			ReplaceSourceDeviceID(&memoryImage[counter + ID_SIZE + 2], sourceID);
+#else
+		ReplaceSourceDeviceID(&memoryImage[counter + 1], sourceID);
+
+		if(memoryImage[counter] == VertexOpCode && memoryImage[counter + ID_SIZE + 1] >= ID_SIZE)
+			ReplaceSourceDeviceID(&memoryImage[counter + ID_SIZE + 2], sourceID);
+#endif
+
+		counter += ID_SIZE + 1;
+		counter += memoryImage[counter] + 1;
+	}
+}
+
+heepByte CommitMemoryImage(heepByte* sourceID)
+{
+	if(IsMemoryImageComplete() == 0)
+		return 1;
+
+	memoryImageImport.inProgress = 0;
+
+	if(CalculateMemoryImageChecksum(memoryImage, memoryImageImport.size) != memoryImageImport.checksum)
+		return 1;
+
+	if(ValidateMemoryImage() != 0)
+		return 1;
+
+	MoveMemoryImageToThisDevice(sourceID);
+
+	memcpy(deviceMemory, memoryImage, memoryImageImport.size);
+	curFilledMemory = memoryImageImport.size;
+	memoryChanged = 1;
+	InvalidateMOPIndex();
+	RecountFragmentedMemory();
+
+	return 0;
+}
+
+#endif
+
 unsigned int GetFragmentFromMemory(int *pointerToFragment, int *numFragementBytes)
 {
 	unsigned int counter = 0;
@@ -539,11 +1519,13 @@ void RemoveUnusedBytesAtPointer(int pointer, int numBytes)
 	}
 
 	curFilledMemory -= numBytes;
+	InvalidateMOPIndex();
 }
 
 void DefragmentMemory()
 {
 	int isFragmentFound = 0;
+	heepByte memoryMoved = 0;
 	do
 	{
 		int pointerToFragment = 0; int numFragementBytes = 0;
@@ -553,22 +1535,74 @@ void DefragmentMemory()
 		{
 			RemoveUnusedBytesAtPointer(pointerToFragment, numFragementBytes);
 			memoryChanged = 1;
+			memoryMoved = 1;
 		}
 
 	}while(isFragmentFound == 0);
+
+	fragmentedMemory = 0;
+
+	if(memoryMoved)
+	{
+		numberOfDefragmentations++;
+
+		// Vertex pointers must follow the MOPs that moved
+		FillVertexListFromMemory();
+	}
 }
 
-// Returns size of returned buffer
-heepByte GetIndexedDeviceID_Byte(heepByte* deviceID)
+void FragmentMOPAtPointer(unsigned int pointer)
+{
+	if(deviceMemory[pointer] == FragmentOpCode)
+		return;
+
+	UnindexMOP(pointer);
+
+	deviceMemory[pointer] = FragmentOpCode;
+	fragmentedMemory += SkipOpCode(pointer) - pointer;
+
+#ifdef USE_MOP_OPCODE_TABLE
+	FragmentInMOPOpCodeTable(pointer);
+#endif
+}
+
+void RecountFragmentedMemory()
+{
+	fragmentedMemory = 0;
+
+	unsigned int counter = 0;
+	while(counter < curFilledMemory)
+	{
+		unsigned int nextMOP = SkipOpCode(counter);
+
+		if(deviceMemory[counter] == FragmentOpCode)
+			fragmentedMemory += nextMOP - counter;
+
+		counter = nextMOP;
+	}
+}
+
+void SetDefragmentThreshold(unsigned char thresholdPercent)
 {
+	defragmentThreshold = thresholdPercent;
+}
+
+void DefragmentMemoryIfFragmented()
+{
+	if(fragmentedMemory == 0 || defragmentThreshold > 100)
+		return;
+
+	if((unsigned long)fragmentedMemory * 100 >= (unsigned long)curFilledMemory * defragmentThreshold)
+		DefragmentMemory();
+}
+
 #ifdef USE_INDEXED_IDS
+heepByte FindLocalDeviceID(heepByte* deviceID, heepByte* localID, unsigned int searchEnd)
+{
 	unsigned int counter = 0;
 	unsigned long topIndex = 0;
 
-	heepByte localID [ID_SIZE];
-
-	// Find Indexed ID
-	while(counter < curFilledMemory)
+	while(counter < searchEnd)
 	{
 		if(deviceMemory[counter] == LocalDeviceIDOpCode)
 		{
@@ -587,10 +1621,7 @@ heepByte GetIndexedDeviceID_Byte(heepByte* deviceID)
 			if(CheckBufferEquality(deviceID, foundID, STANDARD_ID_SIZE))
 			{
 				CreateBufferFromNumber(localID, indexedValue, ID_SIZE);
-				unsigned int rxCounter = 0;
-				unsigned int txCounter = 0;
-				AddBufferToBuffer(deviceID, localID, ID_SIZE, &rxCounter, &txCounter);
-				return ID_SIZE;
+				return 0;
 			}
 		}
 		else
@@ -600,16 +1631,30 @@ heepByte GetIndexedDeviceID_Byte(heepByte* deviceID)
 	}
 
 	CreateBufferFromNumber(localID, topIndex, ID_SIZE);
+	return 1;
+}
+#endif
+
+// Returns size of returned buffer
+heepByte GetIndexedDeviceID_Byte(heepByte* deviceID)
+{
+#ifdef USE_INDEXED_IDS
+	heepByte localID [ID_SIZE];
+
+	if(FindLocalDeviceID(deviceID, localID, curFilledMemory) == 0)
+	{
+		memcpy(deviceID, localID, ID_SIZE);
+		return ID_SIZE;
+	}
 
 	// If Not Indexed, then index it!
-	AddNewCharToMemory(LocalDeviceIDOpCode);
-	AddBufferToMemory(localID, ID_SIZE);
-	AddNewCharToMemory(STANDARD_ID_SIZE);
-	AddDeviceIDToMemory_Byte(deviceID);
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
 
-	unsigned int rxCounter = 0;
-	unsigned int txCounter = 0;
-	AddBufferToBuffer(deviceID, localID, ID_SIZE, &rxCounter, &txCounter);
+	if(ReserveLocalDeviceID(&builder, deviceID, localID) || CommitMOPs(&builder))
+		return 0;
+
+	memcpy(deviceID, localID, ID_SIZE);
 
 	return ID_SIZE;
 #else 
@@ -617,6 +1662,22 @@ heepByte GetIndexedDeviceID_Byte(heepByte* deviceID)
 #endif
 }
 
+heepByte FindIndexedDeviceID_Byte(heepByte* deviceID)
+{
+#ifdef USE_INDEXED_IDS
+	heepByte localID [ID_SIZE];
+
+	if(FindLocalDeviceID(deviceID, localID, curFilledMemory))
+		return 0;
+
+	memcpy(deviceID, localID, ID_SIZE);
+
+	return ID_SIZE;
+#else
+	return STANDARD_ID_SIZE;
+#endif
+}
+
 heepByte GetDeviceIDFromIndex_Byte(heepByte* index, heepByte* returnedID)
 {
 #ifdef USE_INDEXED_IDS
@@ -664,16 +1725,31 @@ heepByte WillMemoryOverflow(int numBytesToBeAdded)
 	return 0;
 }
 
+heepByte MakeRoomInMemory(int numBytesToBeAdded)
+{
+	if(WillMemoryOverflow(numBytesToBeAdded) && numBytesToBeAdded + curFilledMemory - fragmentedMemory < MAX_MEMORY)
+		DefragmentMemory();
+
+	return WillMemoryOverflow(numBytesToBeAdded);
+}
+
 void FragmentAllOfMOP(heepByte inputMOP)
 {
+#ifdef USE_MOP_OPCODE_TABLE
+	UpdateMOPOpCodeTable();
+
+	for(unsigned int entry = FindNextTabledMOP(inputMOP, 0); entry < numberOfTabledMOPs; entry = FindNextTabledMOP(inputMOP, entry + 1))
+		FragmentMOPAtPointer(MOPOpCodePointers[entry]);
+#else
 	unsigned int counter = 0;
 	while(counter < curFilledMemory)
 	{
 		if(deviceMemory[counter] == inputMOP)
-			deviceMemory[counter] = FragmentOpCode;
+			FragmentMOPAtPointer(counter);
 
 		counter = SkipOpCode(counter);
 	}
+#endif
 }
 
 void ImmediatelyClearAllOfMOP(heepByte inputMOP)
@@ -714,18 +1790,15 @@ heepByte AddUserMOP(heepByte userMOPNumber, heepByte* buffer, int bufferLength,
 	if(MOPNumber > USER_MOP_END_ID) // Outside of User MOP Zone. Return error
 		return 1;
 
-	if(WillMemoryOverflow( 1 + ID_SIZE + 1 + bufferLength)) // Memory will overflow, so return error
-		return 1;
-
-	PerformPreOpCodeProcessing_Byte(deviceID);
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
 
-	AddNewCharToMemory(MOPNumber);
-	AddIndexOrDeviceIDToMemory_Byte(deviceID);
-	AddNewCharToMemory((char)bufferLength);
+	if(ReserveMOP(&builder, MOPNumber, deviceID, bufferLength)) // Memory will overflow, so return error
+		return 1;
 
-	AddBufferToMemory(buffer, bufferLength);
+	AddBytesToMOP(&builder, buffer, bufferLength);
 
-	return 0;
+	return CommitMOPs(&builder);
 }
 
 heepByte GetUserMOP(heepByte userMOPNumber, heepByte* buffer, int* bytesReturned)
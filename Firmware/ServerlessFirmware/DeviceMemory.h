@@ -2,10 +2,11 @@
 
 #include "AutoGeneratedInfo.h"
 
+// Import is counted where DeviceSpecificMemory.h is included
 #ifdef DEVICE_USES_WIFI
-	#define NUM_COPS_UNDERSTOOD 		10
+	#define NUM_COPS_UNDERSTOOD 		(12 + MEMORY_IMAGE_IMPORT_COPS)
 #else
-	#define NUM_COPS_UNDERSTOOD 		9
+	#define NUM_COPS_UNDERSTOOD 		(11 + MEMORY_IMAGE_IMPORT_COPS)
 #endif
 
 // OPCodes
@@ -35,6 +36,7 @@
 #define DynamicMemorySizeOpCode 	0x14
 #define DeleteMOPOpCode 			0x15
 #define LocalDeviceIDOpCode 		0x16
+#define RemoteDeviceIPOpCode		0x17
 
 #define AnalyticsOpCode				0x1F
 
@@ -48,6 +50,18 @@
 
 #define MyIPChangedOpCode			0x25
 
+#define ControlSummaryOpCode		0x26
+#define StaleControlsOpCode			0x27
+
+#define ReliableSetValueOpCode		0x28
+#define ReliableAckOpCode			0x29
+
+#define SetVerticesOpCode			0x2A
+
+#define ExportMemoryImageOpCode		0x2B
+#define MemoryImageOpCode			0x2C
+#define ImportMemoryImageOpCode		0x2D
+
 #define USER_MOP_START_ID			0x50
 #define USER_MOP_END_ID				0x5A
 
@@ -59,6 +73,19 @@ extern unsigned char memoryChanged;
 
 extern unsigned char controlRegister;
 
+// Bytes of curFilledMemory held by fragments, and how many times memory
+// has been compacted
+extern unsigned int fragmentedMemory;
+extern unsigned long numberOfDefragmentations;
+
+// Set through SetDefragmentThreshold
+extern unsigned char defragmentThreshold;
+
+// Built with USE_MEMORY_IMAGE_IMPORT. The image being imported, of which
+// the first memoryImageImport.received bytes have arrived
+extern heepByte memoryImage[];
+extern struct MemoryImageImport memoryImageImport;
+
 int GetNumBytesToReadForMOP(unsigned int pointer);
 heepByte GetMOPPointer(heepByte MOP, unsigned int *pointer, unsigned int *counter);
 
@@ -71,6 +98,25 @@ void SetControlRegister();
 unsigned int SkipOpCode(unsigned int counter);
 void ClearDeviceMemory();
 
+// The MOP index hashes every MOP by its fingerprint so that a MOP can be
+// found without comparing against all of memory. MOPs added at the end of
+// memory are indexed when it is next used. Anything that moves MOPs or
+// replaces memory must invalidate it, and anything that rewrites a MOP in
+// place must unindex that MOP before and reindex it after. Fragmenting
+// unindexes the MOP
+void InvalidateMOPIndex();
+void UpdateMOPIndex();
+void UnindexMOP(unsigned int pointer);
+void ReindexMOP(unsigned int pointer);
+
+// Fills pointers with the MOPs that have the opcode, in memory order, and
+// returns how many it found. Built with USE_MOP_OPCODE_TABLE, this scans a
+// table of opcodes that is kept with the MOP index instead of memory
+unsigned int FindMOPsWithOpCode(heepByte opCode, unsigned int* pointers, unsigned int maxPointers);
+
+// Fragments every MOP equal to the given one and returns how many there were
+unsigned int DeleteMOPsEqualTo(heepByte* MOP, unsigned int numBytes);
+
 void AddNewCharToMemory(unsigned char newMem);
 
 void AddBufferToMemory(heepByte* buffer, heepByte size);
@@ -84,10 +130,32 @@ void AddIndexOrDeviceIDToMemory_Byte(heepByte* deviceID);
 
 void AddIPToMemory(struct HeepIPAddress theIP);
 
+// MOPs are built past curFilledMemory and only become part of memory when
+// committed, so a MOP that does not fit leaves memory as it was. Space is
+// checked once per reservation, and nothing else may add to memory between
+// StartMOPs and CommitMOPs. Reserving may compact memory. Each Reserve
+// returns 1 if there is no room, as does CommitMOPs if anything failed or
+// was left unwritten
+void StartMOPs(struct MOPBuilder* builder);
+heepByte ReserveMOPBytes(struct MOPBuilder* builder, unsigned int numBytes);
+
+// Reserves the MOP header and writes it. The caller writes the data bytes
+heepByte ReserveMOP(struct MOPBuilder* builder, heepByte opCode, heepByte* deviceID, unsigned int numDataBytes);
+heepByte ReserveMOPWithLocalID(struct MOPBuilder* builder, heepByte opCode, heepByte* localID, unsigned int numDataBytes);
+
+// Indexes the device first if that is needed
+heepByte ReserveLocalDeviceID(struct MOPBuilder* builder, heepByte* deviceID, heepByte* localID);
+
+void AddBytesToMOP(struct MOPBuilder* builder, heepByte* bytes, unsigned int numBytes);
+void AddByteToMOP(struct MOPBuilder* builder, heepByte value);
+void AddNumberToMOP(struct MOPBuilder* builder, unsigned long number, int numBytes);
+void AddIPToMOP(struct MOPBuilder* builder, struct HeepIPAddress theIP);
+heepByte CommitMOPs(struct MOPBuilder* builder);
+
 heepByte SetDeviceNameInMemory_Byte(char* deviceName, int numCharacters, heepByte* deviceID);
-void SetIconIDInMemory_Byte(char iconID, heepByte* deviceID);
+heepByte SetIconIDInMemory_Byte(char iconID, heepByte* deviceID);
 
-void SetIconDataInMemory_Byte(char* iconData, int numCharacters, heepByte* deviceID);
+heepByte SetIconDataInMemory_Byte(char* iconData, int numCharacters, heepByte* deviceID);
 
 #ifdef USE_ANALYTICS
 
@@ -101,30 +169,88 @@ unsigned int ParseXYOpCode_Byte(int *x, int *y, heepByte* deviceID, unsigned int
 
 unsigned int GetXYFromMemory_Byte(int *x, int *y, heepByte* deviceID, unsigned int* XYMemPosition);
 
-void SetXYInMemory_Byte(int x, int y, heepByte* deviceID);
+heepByte SetXYInMemory_Byte(int x, int y, heepByte* deviceID);
 
 heepByte UpdateXYInMemory_Byte(int x, int y, heepByte* deviceID);
 
 heepByte GetIPFromMemory(struct HeepIPAddress* theIP);
-void SetIPInMemory_Byte(struct HeepIPAddress theIP, heepByte* deviceID);
+heepByte SetIPInMemory_Byte(struct HeepIPAddress theIP, heepByte* deviceID);
 void DeleteVertexAtPointer(unsigned long pointer);
 int GetVertexAtPointer_Byte(unsigned long pointer, struct Vertex_Byte* returnedVertex);
 
+// The vertex's rx ID as stored, ID_SIZE bytes. Equal stored IDs are the same
+// device, without looking up the full ID
+heepByte* GetStoredRxIDOfVertex(unsigned long pointer);
+
 heepByte SetVertexInMemory_Byte(struct Vertex_Byte theVertex, unsigned int* vertexPointer);
 
+// Stores all of the vertices or none of them. Device IDs are resolved once
+// for the whole batch
+heepByte SetVerticesInMemory_Byte(struct Vertex_Byte* vertices, int numberOfNewVertices, unsigned int* vertexPointers);
+
+// Built with USE_IP_DIRECTORY. The directory keeps one Remote Device IP MOP
+// per receiving device and hashes them by device ID in RAM. Deleting the
+// last vertex to a device deletes its MOP. Each returns 1 on failure
+heepByte GetIPFromDirectory(heepByte* deviceID, struct HeepIPAddress* theIP);
+heepByte UpdateIPInDirectory(heepByte* deviceID, struct HeepIPAddress theIP);
+heepByte SetIPInDirectory(heepByte* deviceID, struct HeepIPAddress theIP);
+
+// For when MOPs move, such as after defragmenting
+void RebuildIPDirectory();
+
 int GetNextVertexPointer(unsigned int* pointer,unsigned int* counter);
 
+// Fletcher-16, so that a memory image torn by changes between chunks is caught
+unsigned short CalculateMemoryImageChecksum(heepByte* image, unsigned int imageSize);
+
+// Built with USE_MEMORY_IMAGE_IMPORT. An imported memory image is held aside
+// until all of it has arrived. A chunk at offset 0 starts a new image, and
+// the rest must follow in order. Chunks do not say who sent them, so a
+// chunk at offset 0 from anyone abandons an import that is under way
+heepByte AddMemoryImageChunk(unsigned int imageSize, unsigned short checksum, unsigned int offset, heepByte* chunk, unsigned int chunkLength);
+heepByte IsMemoryImageComplete();
+
+// Checks every MOP of the image and replaces deviceMemory with it. MOPs
+// that belonged to the source device are moved to this device. Returns 1
+// and leaves deviceMemory alone if the image is invalid
+heepByte CommitMemoryImage(heepByte* sourceID);
+
 unsigned int GetFragmentFromMemory(int *pointerToFragment, int *numFragementBytes);
 void RemoveUnusedBytesAtPointer(int pointer, int numBytes);
 void DefragmentMemory();
 
+// Every MOP is fragmented through this, so that fragmentedMemory stays current
+void FragmentMOPAtPointer(unsigned int pointer);
+
+// For when memory is replaced wholesale
+void RecountFragmentedMemory();
+
+// Compacts memory if the fragments have crossed the defragment threshold
+void SetDefragmentThreshold(unsigned char thresholdPercent);
+void DefragmentMemoryIfFragmented();
+
 heepByte DeleteWiFiSetting(int priority, heepByte* deviceID);
 
-// Returns size of returned buffer
+#ifdef USE_INDEXED_IDS
+// Returns 0 and the device's local ID if it is indexed before searchEnd.
+// Otherwise returns 1 and the local ID it would be given
+heepByte FindLocalDeviceID(heepByte* deviceID, heepByte* localID, unsigned int searchEnd);
+#endif
+
+// Returns size of returned buffer. Indexes the device if it is not indexed
+// yet, and returns 0 if there is no room to
 heepByte GetIndexedDeviceID_Byte(heepByte* deviceID);
 
+// As GetIndexedDeviceID_Byte, but never adds to memory. Returns 0 if the
+// device is not indexed
+heepByte FindIndexedDeviceID_Byte(heepByte* deviceID);
+
 heepByte GetDeviceIDFromIndex_Byte(heepByte* index, heepByte* returnedID);
 
 heepByte WillMemoryOverflow(int numBytesToBeAdded);
+
+// Compacts memory first if that would make the room, then returns as
+// WillMemoryOverflow does. Pointers into memory do not survive a call
+heepByte MakeRoomInMemory(int numBytesToBeAdded);
 void FragmentAllOfMOP(heepByte inputMOP);
 void ImmediatelyClearAllOfMOP(heepByte inputMOP);
@@ -12,18 +12,136 @@
 
 // Memory Allocation. These numbers are actually device specific, 
 // but they require more research to nail down the exact numbers
-// for each device
+// for each device. A build can pick other sizes with -D, so that a host
+// can test or benchmark the profile of a smaller device
+#ifndef MAX_MEMORY
 #define MAX_MEMORY 1500			// Bytes
+#endif
+#ifndef NUM_VERTICES
 #define NUM_VERTICES 200		// Vertex Pointers
+#endif
+#ifndef VERTEX_INDEX_SIZE
+#define VERTEX_INDEX_SIZE 256		// Vertex hash slots. A power of two larger than NUM_VERTICES
+#endif
+#ifndef VERTICES_PER_BATCH
+#define VERTICES_PER_BATCH 16		// Most vertices in one Set Vertices COP
+#endif
+#ifndef SUMMARY_DESTINATIONS_PER_PASS
+#define SUMMARY_DESTINATIONS_PER_PASS 8	// Devices sent control summaries per pass over the vertices
+#endif
+#ifndef NUM_CONTROLS
 #define NUM_CONTROLS 100		// Control Pointers
+#endif
+#ifndef CONTROL_NAME_TABLE_SIZE
+#define CONTROL_NAME_TABLE_SIZE 256	// Control name hash slots. A power of two at least twice NUM_CONTROLS
+#endif
+#ifndef OUTPUT_BUFFER_SIZE
 #define OUTPUT_BUFFER_SIZE 1500	// Bytes
+#endif
+#ifndef INPUT_BUFFER_SIZE
 #define INPUT_BUFFER_SIZE 200	// Bytes
+#endif
+#ifndef MEMORY_IMAGE_CHUNK_SIZE
+#define MEMORY_IMAGE_CHUNK_SIZE 160	// Bytes of a memory image per ROP or COP. Import COPs must fit the input buffer
+#endif
+
+#if MAX_MEMORY > 65535
+#error "Memory images give sizes and offsets in 2 bytes"
+#endif
+
+// MOP fingerprint hash slots, one for every 8 bytes of memory rounded up to
+// a power of two. Deletes scan memory while there are more MOPs than fit
+#ifndef MOP_INDEX_SIZE
+#if MAX_MEMORY <= 256
+#define MOP_INDEX_SIZE 32
+#elif MAX_MEMORY <= 512
+#define MOP_INDEX_SIZE 64
+#elif MAX_MEMORY <= 1024
+#define MOP_INDEX_SIZE 128
+#elif MAX_MEMORY <= 2048
+#define MOP_INDEX_SIZE 256
+#elif MAX_MEMORY <= 4096
+#define MOP_INDEX_SIZE 512
+#elif MAX_MEMORY <= 8192
+#define MOP_INDEX_SIZE 1024
+#elif MAX_MEMORY <= 16384
+#define MOP_INDEX_SIZE 2048
+#else
+#define MOP_INDEX_SIZE 4096
+#endif
+#endif
+
+#if (VERTEX_INDEX_SIZE & (VERTEX_INDEX_SIZE - 1)) != 0 || VERTEX_INDEX_SIZE <= NUM_VERTICES
+#error "VERTEX_INDEX_SIZE must be a power of two larger than NUM_VERTICES"
+#endif
+
+#if SUMMARY_DESTINATIONS_PER_PASS < 1 || SUMMARY_DESTINATIONS_PER_PASS > 255
+#error "SUMMARY_DESTINATIONS_PER_PASS must be from 1 to 255"
+#endif
+
+#if VERTICES_PER_BATCH > NUM_VERTICES
+#error "VERTICES_PER_BATCH cannot be more than NUM_VERTICES"
+#endif
+
+#if (MOP_INDEX_SIZE & (MOP_INDEX_SIZE - 1)) != 0
+#error "MOP_INDEX_SIZE must be a power of two"
+#endif
+
+#if (CONTROL_NAME_TABLE_SIZE & (CONTROL_NAME_TABLE_SIZE - 1)) != 0 || CONTROL_NAME_TABLE_SIZE < 2*NUM_CONTROLS
+#error "CONTROL_NAME_TABLE_SIZE must be a power of two at least twice NUM_CONTROLS"
+#endif
+
+// The Defragment task only compacts memory once fragments make up this
+// percentage of filled memory. 0 compacts whenever there is a fragment,
+// and above 100 memory is only compacted when an allocation needs the space
+#define DEFRAGMENT_THRESHOLD_PERCENT 25
 
 // Heep OS Task Scheduling System
 // Determine how frequently a task is run and how many tasks can be made
 #define SYSTEM_TASK_INTERVAL 1000 // Time in ms
 #define NUMBER_OF_TASKS 4
 
+// Reliable SetVal delivery. Timeouts are in ms
+#define RELIABLE_SEND_SLOTS 8			// SetVals waiting on an ack
+#define RELIABLE_DESTINATIONS 8			// Devices sent to, each with its own timeout
+#define RELIABLE_PEERS 8				// Devices received from, checked for duplicates
+#define RELIABLE_INITIAL_TIMEOUT 200
+#define RELIABLE_MIN_TIMEOUT 20
+#define RELIABLE_MAX_TIMEOUT 3000
+#define RELIABLE_MAX_RETRANSMISSIONS 6
+
+// Vertices can leave out the receiver's IP and share one directory
+// entry per receiving device instead, so that an IP change rewrites a
+// single entry. This changes the vertex MOP that front ends read
+//#define USE_IP_DIRECTORY
+#ifndef IP_DIRECTORY_SIZE
+#define IP_DIRECTORY_SIZE 32	// Directory hash slots. A power of two at least twice the number of receiving devices
+#endif
+
+#if (IP_DIRECTORY_SIZE & (IP_DIRECTORY_SIZE - 1)) != 0
+#error "IP_DIRECTORY_SIZE must be a power of two"
+#endif
+
+// Host builds keep the opcode of every MOP in a table of their own, so that
+// finding the MOPs with one opcode does not walk memory. The table costs
+// three bytes for every MOP that fits in MAX_MEMORY
+#if defined(ON_PC) || defined(SIMULATION)
+#define USE_MOP_OPCODE_TABLE
+#endif
+
+// Importing a memory image holds a second copy of memory, MAX_MEMORY bytes,
+// until its last chunk arrives. Host builds have the RAM for it. Exporting
+// needs none and is always built
+#if (defined(ON_PC) || defined(SIMULATION)) && !defined(USE_MEMORY_IMAGE_IMPORT)
+#define USE_MEMORY_IMAGE_IMPORT
+#endif
+
+#ifdef USE_MEMORY_IMAGE_IMPORT
+#define MEMORY_IMAGE_IMPORT_COPS 1
+#else
+#define MEMORY_IMAGE_IMPORT_COPS 0
+#endif
+
 // Indexed IDs are a form of compression that can be used
 // on memory limited devices. These are particularly useful
 // When using IDs that are very long strings
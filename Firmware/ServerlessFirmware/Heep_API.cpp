@@ -3,6 +3,8 @@
 #include "DeviceMemory.h"
 #include "Device.h"
 #include "Scheduler.h"
+#include "ReliableDelivery.h"
+#include "DeviceSpecificMemory.h"
 #include <string.h>
 
 void SetupHeepDevice(char* deviceName, char deviceIcon)
@@ -21,6 +23,8 @@ void SetupHeepDevice(char* deviceName, char deviceIcon)
 	else
 	{
 		ReadMemory(&controlRegister, deviceMemory, &curFilledMemory);
+		InvalidateMOPIndex();
+		RecountFragmentedMemory();
 		FillVertexListFromMemory();
 	}
 }
@@ -32,13 +36,21 @@ void FactoryReset(char* deviceName, char iconEnum)
 	clearMemory = 0;
 }
 
-void SendOutputByIDNoAnalytics(unsigned char controlID, unsigned int value)
+void SendSetValToVertex(struct Vertex_Byte* vertex, unsigned char value)
 {
-	SetControlValueByID(controlID, value, 0);
+	if(SendReliableSetVal(vertex->rxID, vertex->rxIPAddress, vertex->rxControlID, value) == 0)
+		return;
+
+	FillOutputBufferWithSetValCOP(vertex->rxControlID, value);
+	SendOutputBufferToIP(vertex->rxIPAddress);
+}
 
+// Sends to every vertex of the control, whatever its send limit
+void SendOutputToVertices(unsigned char controlID, unsigned int value)
+{
 	struct Vertex_Byte newVertex;
 
-	int i;
+	unsigned int i;
 	for(i = 0; i < numberOfVertices; i++)
 	{
 		GetVertexAtPointer_Byte(vertexPointerList[i], &newVertex);
@@ -51,29 +63,165 @@ void SendOutputByIDNoAnalytics(unsigned char controlID, unsigned int value)
 			}
 			else
 			{
-				FillOutputBufferWithSetValCOP(newVertex.rxControlID, value);
-				SendOutputBufferToIP(newVertex.rxIPAddress);
+				SendSetValToVertex(&newVertex, value);
 			}
 		}
 	}
 }
 
-void SendOutputByID(unsigned char controlID, unsigned int value)
+void CaptureOutputAnalytics(unsigned char controlID, unsigned int value)
 {
-	SendOutputByIDNoAnalytics(controlID, value);
-
 #ifdef USE_ANALYTICS
 	SetAnalyticsDataControlValueInMemory_Byte(controlID, value, deviceIDByte);
+#else
+	(void)controlID;
+	(void)value;
 #endif
 }
 
-void SendOutputByIDBuffer(unsigned char controlID, heepByte* buffer, int bufferLength)
+void RecordOutputSent(int controlIndex, unsigned long sendTime)
+{
+	controlSendLimits[controlIndex].lastSentValue = controlList[controlIndex].curValue;
+	controlSendLimits[controlIndex].lastSendTime = sendTime;
+
+	if(controlList[controlIndex].controlFlags & CONTROL_HELD_FLAG)
+	{
+		controlList[controlIndex].controlFlags &= ~(CONTROL_HELD_FLAG | CONTROL_HELD_ANALYTICS_FLAG);
+		numberOfHeldControls--;
+	}
+}
+
+unsigned char GetChangeSinceLastSend(int controlIndex)
+{
+	if(controlList[controlIndex].curValue > controlSendLimits[controlIndex].lastSentValue)
+		return controlList[controlIndex].curValue - controlSendLimits[controlIndex].lastSentValue;
+
+	return controlSendLimits[controlIndex].lastSentValue - controlList[controlIndex].curValue;
+}
+
+// Returns 1 if the control's send limit holds the value back. Only the
+// latest held value is kept, in curValue
+heepByte HoldOutputForSendLimit(unsigned char controlID, unsigned char captureAnalytics)
+{
+	int controlIndex = GetControlIndexByID(controlID);
+	if(controlIndex < 0)
+		return 0;
+
+	struct ControlSendLimit* limit = &controlSendLimits[controlIndex];
+	if(limit->minimumInterval == 0 && limit->deadband == 0)
+		return 0;
+
+	unsigned long now = GetMillis();
+
+	if(GetChangeSinceLastSend(controlIndex) >= limit->deadband && now - limit->lastSendTime >= limit->minimumInterval)
+	{
+		RecordOutputSent(controlIndex, now);
+		return 0;
+	}
+
+	limit->lastChangeTime = now;
+
+	if((controlList[controlIndex].controlFlags & CONTROL_HELD_FLAG) == 0)
+	{
+		controlList[controlIndex].controlFlags |= CONTROL_HELD_FLAG;
+		numberOfHeldControls++;
+	}
+
+	if(captureAnalytics)
+		controlList[controlIndex].controlFlags |= CONTROL_HELD_ANALYTICS_FLAG;
+
+	return 1;
+}
+
+void SendOutputByIDNoAnalytics(unsigned char controlID, unsigned int value)
+{
+	SetControlValueByID(controlID, value, 0);
+
+	if(HoldOutputForSendLimit(controlID, 0))
+		return;
+
+	SendOutputToVertices(controlID, value);
+}
+
+void SendOutputByID(unsigned char controlID, unsigned int value)
+{
+	SetControlValueByID(controlID, value, 0);
+
+	if(HoldOutputForSendLimit(controlID, 1))
+		return;
+
+	SendOutputToVertices(controlID, value);
+	CaptureOutputAnalytics(controlID, value);
+}
+
+void FlushHeldOutputs()
+{
+	if(numberOfHeldControls == 0)
+		return;
+
+	unsigned long now = GetMillis();
+
+	for(unsigned int i = 0; i < numberOfControls && numberOfHeldControls > 0; i++)
+	{
+		if((controlList[i].controlFlags & CONTROL_HELD_FLAG) == 0)
+			continue;
+
+		struct ControlSendLimit* limit = &controlSendLimits[i];
+
+		if(now - limit->lastSendTime < limit->minimumInterval)
+			continue;
+
+		// Small changes wait until the control has been still for an interval
+		unsigned char change = GetChangeSinceLastSend(i);
+		if(change < limit->deadband && now - limit->lastChangeTime < limit->minimumInterval)
+			continue;
+
+		unsigned char captureAnalytics = controlList[i].controlFlags & CONTROL_HELD_ANALYTICS_FLAG;
+
+		if(change == 0)
+		{
+			// Receivers already have this value
+			controlList[i].controlFlags &= ~(CONTROL_HELD_FLAG | CONTROL_HELD_ANALYTICS_FLAG);
+			numberOfHeldControls--;
+			continue;
+		}
+
+		RecordOutputSent(i, now);
+		SendOutputToVertices(controlList[i].controlID, controlList[i].curValue);
+
+		if(captureAnalytics)
+			CaptureOutputAnalytics(controlList[i].controlID, controlList[i].curValue);
+	}
+}
+
+heepByte SetControlSendLimitByHandle(int controlHandle, unsigned long minimumInterval, unsigned char deadband)
+{
+	if(controlHandle < 0 || (unsigned int)controlHandle >= numberOfControls)
+		return 1;
+
+	controlSendLimits[controlHandle].minimumInterval = minimumInterval;
+	controlSendLimits[controlHandle].deadband = deadband;
+
+	// The value last sent is only tracked while a limit is set
+	if((controlList[controlHandle].controlFlags & CONTROL_HELD_FLAG) == 0)
+		controlSendLimits[controlHandle].lastSentValue = controlList[controlHandle].curValue;
+
+	return 0;
+}
+
+heepByte SetControlSendLimitByName(char* controlName, unsigned long minimumInterval, unsigned char deadband)
 {
-	SetControlValueByIDBuffer(controlID, buffer, 0, bufferLength, 0);
+	return SetControlSendLimitByHandle(GetControlIndexByName(controlName), minimumInterval, deadband);
+}
 
+// The SetVal COP is built once and only its control ID changes between
+// remote vertices
+void SendBufferToVertices(unsigned char controlID, heepByte* buffer, int bufferLength)
+{
 	struct Vertex_Byte newVertex;
+	unsigned char builtSetValCOP = 0;
 
-	int i;
+	unsigned int i;
 	for(i = 0; i < numberOfVertices; i++)
 	{
 		GetVertexAtPointer_Byte(vertexPointerList[i], &newVertex);
@@ -86,13 +234,30 @@ void SendOutputByIDBuffer(unsigned char controlID, heepByte* buffer, int bufferL
 			}
 			else
 			{
-				FillOutputBufferWithSetValCOPBuffer(newVertex.rxControlID, buffer, bufferLength);
+				if(builtSetValCOP)
+				{
+					SetControlIDOfSetValCOP(newVertex.rxControlID);
+				}
+				else
+				{
+					FillOutputBufferWithSetValCOPBuffer(newVertex.rxControlID, buffer, bufferLength);
+					builtSetValCOP = 1;
+				}
+
 				SendOutputBufferToIP(newVertex.rxIPAddress);
 			}
 		}
 	}
 }
 
+void SendOutputByIDBuffer(unsigned char controlID, heepByte* buffer, int bufferLength)
+{
+	if(SetControlValueByIDBuffer(controlID, buffer, 0, bufferLength, 0))
+		return;
+
+	SendBufferToVertices(controlID, buffer, bufferLength);
+}
+
 void HandlePointersOnMemoryChange()
 {
 	FillVertexListFromMemory();
@@ -160,14 +325,11 @@ void HandleIPChanges()
 // Control Daemon is untimed
 void ControlDaemon()
 {
-	int i;
-	for(i = 0; i < numberOfControls; i++)
+	int controlIndex;
+	while((controlIndex = TakeNextPendingControl()) >= 0)
 	{
-		if(controlList[i].controlFlags & 0x01)
-		{
-			SendOutputByID(controlList[i].controlID, controlList[i].curValue);
-			controlList[i].controlFlags ^= 1 << 0; // Toggle Send to 0
-		}
+		SendOutputByID(controlList[controlIndex].controlID, controlList[controlIndex].curValue);
+		NotifyControlCallback(controlIndex);
 	}
 }
 
@@ -185,7 +347,7 @@ void PerformHeepTasks()
 
 		if(curTask == Defragment)
 		{
-			DefragmentMemory();
+			DefragmentMemoryIfFragmented();
 		}
 		else if(curTask == saveMemory)
 		{
@@ -207,12 +369,15 @@ void PerformHeepTasks()
 
 	CheckServerForInputs();
 	ControlDaemon();
+	FlushHeldOutputs();
+	RetransmitReliableSetVals();
 }
 
 void AddRangeControl(char* controlName, int inputOutput, int highValue, int lowValue, int startingValue)
 {
 	Control newControl;
 	newControl.controlName = controlName;
+	newControl.controlFlags = 0;
 	newControl.controlID = numberOfControls;
 	newControl.controlDirection = inputOutput;
 	newControl.controlType = HEEP_RANGE;
@@ -226,6 +391,7 @@ void AddOnOffControl(char* controlName, int inputOutput, int startingValue)
 {
 	Control newControl;
 	newControl.controlName = controlName;
+	newControl.controlFlags = 0;
 	newControl.controlID = numberOfControls;
 	newControl.controlDirection = inputOutput;
 	newControl.controlType = HEEP_ONOFF;
@@ -239,6 +405,7 @@ void AddMomentaryControl(char* controlName, int inputOutput)
 {
 	Control newControl;
 	newControl.controlName = controlName;
+	newControl.controlFlags = 0;
 	newControl.controlID = numberOfControls;
 	newControl.controlDirection = inputOutput;
 	newControl.controlType = HEEP_MOMENTARY;
@@ -248,37 +415,89 @@ void AddMomentaryControl(char* controlName, int inputOutput)
 	AddControl(newControl);
 }
 
-int GetControlValueByName(char* controlName)
+void AddControlTable(const struct ControlDeclaration* controls, int numberOfDeclarations)
 {
-	for(int i = 0; i < numberOfControls; i++)
+	for(int i = 0; i < numberOfDeclarations; i++)
 	{
-		if(strcmp(controlName, controlList[i].controlName) == 0)
-		{
-			int retVal = controlList[i].curValue;
+		Control newControl;
+		newControl.controlName = (char*)controls[i].controlName;
+		newControl.controlFlags = 0;
+		newControl.controlID = numberOfControls;
+		newControl.controlDirection = controls[i].controlDirection;
+		newControl.controlType = controls[i].controlType;
+		newControl.highValue = controls[i].highValue;
+		newControl.lowValue = controls[i].lowValue;
+		newControl.curValue = controls[i].startingValue;
+		AddControl(newControl);
+	}
+}
 
-			if(controlList[i].controlType == HEEP_MOMENTARY)
-			{
-				controlList[i].curValue = 0;
-			}
+void AddDoubleBufferedControl(char* controlName, int inputOutput, heepByte* frontBuffer, heepByte* backBuffer, unsigned char bufferSize)
+{
+	// A Set Value COP counts the control ID and the frame in one length byte
+	if(numberOfControls >= NUM_CONTROLS || bufferSize == 0 || bufferSize > 254)
+		return;
 
-			return retVal;
-		}
-	}
+	Control newControl;
+	newControl.controlName = controlName;
+	newControl.controlFlags = 0;
+	newControl.controlID = numberOfControls;
+	newControl.controlDirection = inputOutput;
+	newControl.controlType = HEEP_BUFFER;
+	newControl.highValue = bufferSize - 1;
+	newControl.lowValue = 0;
+	newControl.curValue = 0;
+	newControl.controlBuffer = frontBuffer;
+	AddControl(newControl);
+
+	controlBackBuffers[numberOfControls - 1] = backBuffer;
+}
+
+heepByte* GetControlBackBuffer(int controlHandle)
+{
+	if(controlHandle < 0 || (unsigned int)controlHandle >= numberOfControls)
+		return 0;
+
+	return controlBackBuffers[controlHandle];
+}
+
+heepByte SwapAndSendControlBuffer(int controlHandle, int bufferLength)
+{
+	if(controlHandle < 0 || (unsigned int)controlHandle >= numberOfControls || controlBackBuffers[controlHandle] == 0)
+		return 1;
+
+	if(bufferLength < 0 || bufferLength > controlList[controlHandle].highValue + 1)
+		return 1;
+
+	SwapControlBuffers(controlHandle, bufferLength);
+	SendBufferToVertices(controlList[controlHandle].controlID, controlList[controlHandle].controlBuffer, bufferLength);
 
 	return 0;
 }
 
-int GetControlIndexByName(char* controlName)
+int GetControlHandleByName(char* controlName)
 {
-	for(int i = 0; i < numberOfControls; i++)
+	return GetControlIndexByName(controlName);
+}
+
+int GetControlValueByHandle(int controlHandle)
+{
+	if(controlHandle < 0 || (unsigned int)controlHandle >= numberOfControls)
+		return 0;
+
+	int retVal = controlList[controlHandle].curValue;
+
+	if(controlList[controlHandle].controlType == HEEP_MOMENTARY)
 	{
-		if(strcmp(controlName, controlList[i].controlName) == 0)
-		{
-			return i;
-		}
+		controlList[controlHandle].curValue = 0;
 	}
 
-	return -1;
+	return retVal;
+}
+
+int GetControlValueByName(char* controlName)
+{
+	return GetControlValueByHandle(GetControlIndexByName(controlName));
 }
 
 void HandleMomentaryOutputs(int controlIndex)
@@ -287,19 +506,36 @@ void HandleMomentaryOutputs(int controlIndex)
 		controlList[controlIndex].curValue = 0;
 }
 
-void SetControlValueByName(char* controlName, int newValue)
+void SetControlValueByHandle(int controlHandle, int newValue)
 {
-	int controlIndex = GetControlIndexByName(controlName);
+	if(controlHandle < 0 || (unsigned int)controlHandle >= numberOfControls)
+		return;
 
-	if(controlIndex != -1)
+	if(controlList[controlHandle].curValue != newValue)
 	{
-		if(controlList[controlIndex].curValue != newValue)
-		{
-			controlList[controlIndex].curValue = newValue;
-			SendOutputByID(controlList[controlIndex].controlID, controlList[controlIndex].curValue);
-		}
-		HandleMomentaryOutputs(controlIndex);
+		controlList[controlHandle].curValue = newValue;
+		SendOutputByID(controlList[controlHandle].controlID, controlList[controlHandle].curValue);
 	}
+	HandleMomentaryOutputs(controlHandle);
+}
+
+heepByte SetControlCallbackByHandle(int controlHandle, HeepControlCallback callback)
+{
+	if(controlHandle < 0 || (unsigned int)controlHandle >= numberOfControls)
+		return 1;
+
+	controlCallbacks[controlHandle] = callback;
+	return 0;
+}
+
+heepByte SetControlCallbackByName(char* controlName, HeepControlCallback callback)
+{
+	return SetControlCallbackByHandle(GetControlIndexByName(controlName), callback);
+}
+
+void SetControlValueByName(char* controlName, int newValue)
+{
+	SetControlValueByHandle(GetControlIndexByName(controlName), newValue);
 }
 
 void SetControlValueByNameAlwaysSend(char* controlName, int newValue)
@@ -394,7 +630,14 @@ void StartHeep(char* deviceName, heepByte deviceIcon)
 heepByte HandleHeepCommunications()
 {
 	if(IsROP()) 
+	{
+		if(inputBuffer[0] == StaleControlsOpCode)
+			ExecuteStaleControlsOpCode();
+		else if(inputBuffer[0] == ReliableAckOpCode)
+			ExecuteReliableAckOpCode();
+
 		return 1;
+	}
 
 	ExecuteControlOpCodes();
 	return 0;
@@ -405,17 +648,161 @@ void SendControlsOnHeartBeat(unsigned long controlSendPeriod)
 {
 	if(GetMillis() - lastHeartBeat > controlSendPeriod)
 	{
-		for(int i = 0; i < numberOfControls; i++)
+		for(unsigned int i = 0; i < numberOfControls; i++)
 		{
 			if(controlList[i].controlDirection == HEEP_OUTPUT)
 			{
-				SendOutputByID(controlList[i].controlID, controlList[i].curValue);
+				// The heartbeat is not held back, and it carries any held value
+				RecordOutputSent(i, GetMillis());
+				SendOutputToVertices(controlList[i].controlID, controlList[i].curValue);
 			}
 		}
 		lastHeartBeat = GetMillis(); 
 	}
 }
 
+// Index of the vertex's tx control if its value belongs in a control
+// summary, or -1
+int GetSummarizedControlIndex(struct Vertex_Byte* vertex)
+{
+	if(CheckBufferEquality(vertex->txID, deviceIDByte, STANDARD_ID_SIZE) == 0 || CheckBufferEquality(vertex->txID, vertex->rxID, STANDARD_ID_SIZE))
+		return -1;
+
+	int controlIndex = GetControlIndexByID(vertex->txControlID);
+	if(controlIndex < 0 || controlList[controlIndex].controlType == HEEP_BUFFER || controlList[controlIndex].controlType == HEEP_MOMENTARY)
+		return -1;
+
+	return controlIndex;
+}
+
+struct SummaryDestination
+{
+	heepByte storedRxID [ID_SIZE];
+	struct HeepIPAddress rxIPAddress;
+};
+
+struct SummaryEntry
+{
+	unsigned char destination;
+	unsigned char rxControlID;
+	unsigned char value;
+};
+
+// Scratch space for one pass, kept off the stack like vertexPointerList.
+// Nothing in it outlives a call
+struct SummaryEntry summaryEntries [NUM_VERTICES];
+
+// A pass gathers the controls of up to SUMMARY_DESTINATIONS_PER_PASS
+// destinations, in the order of their first vertex. Vertices of other
+// destinations are left for a later pass by their stored rx ID alone, so
+// each vertex is decoded once
+void SendControlSummaries()
+{
+	struct SummaryDestination destinations [SUMMARY_DESTINATIONS_PER_PASS];
+	unsigned char usedVertices [(NUM_VERTICES + 7)/8];
+	struct Vertex_Byte newVertex;
+
+	memset(usedVertices, 0, sizeof(usedVertices));
+
+	unsigned int firstVertex = 0;
+	while(firstVertex < numberOfVertices)
+	{
+		int numberOfDestinations = 0;
+		int numberOfEntries = 0;
+		unsigned int nextPassVertex = numberOfVertices;
+
+		for(unsigned int i = firstVertex; i < numberOfVertices; i++)
+		{
+			if(usedVertices[i/8] & (1 << (i%8)))
+				continue;
+
+			heepByte* storedRxID = GetStoredRxIDOfVertex(vertexPointerList[i]);
+
+			int destination = 0;
+			while(destination < numberOfDestinations && CheckBufferEquality(destinations[destination].storedRxID, storedRxID, ID_SIZE) == 0)
+				destination++;
+
+			if(destination == SUMMARY_DESTINATIONS_PER_PASS)
+			{
+				if(nextPassVertex == numberOfVertices)
+					nextPassVertex = i;
+
+				continue;
+			}
+
+			usedVertices[i/8] |= 1 << (i%8);
+
+			GetVertexAtPointer_Byte(vertexPointerList[i], &newVertex);
+
+			int controlIndex = GetSummarizedControlIndex(&newVertex);
+			if(controlIndex < 0)
+				continue;
+
+			if(destination == numberOfDestinations)
+			{
+				memcpy(destinations[destination].storedRxID, storedRxID, ID_SIZE);
+				destinations[destination].rxIPAddress = newVertex.rxIPAddress;
+				numberOfDestinations++;
+			}
+
+			summaryEntries[numberOfEntries].destination = destination;
+			summaryEntries[numberOfEntries].rxControlID = newVertex.rxControlID;
+			summaryEntries[numberOfEntries].value = controlList[controlIndex].curValue;
+			numberOfEntries++;
+		}
+
+		for(int destination = 0; destination < numberOfDestinations; destination++)
+		{
+			FillOutputBufferWithControlSummaryHeader();
+
+			for(int j = 0; j < numberOfEntries; j++)
+			{
+				if(summaryEntries[j].destination != destination)
+					continue;
+
+				if(AddControlToControlSummaryCOP(summaryEntries[j].rxControlID, summaryEntries[j].value))
+				{
+					SendOutputBufferToIP(destinations[destination].rxIPAddress);
+					FillOutputBufferWithControlSummaryHeader();
+					AddControlToControlSummaryCOP(summaryEntries[j].rxControlID, summaryEntries[j].value);
+				}
+			}
+
+			SendOutputBufferToIP(destinations[destination].rxIPAddress);
+		}
+
+		firstVertex = nextPassVertex;
+	}
+}
+
+void SendControlSummariesOnHeartBeat(unsigned long controlSendPeriod)
+{
+	if(GetMillis() - lastHeartBeat > controlSendPeriod)
+	{
+		SendControlSummaries();
+		lastHeartBeat = GetMillis();
+	}
+}
+
+void ResendControlToDevice(heepByte* rxID, unsigned char rxControlID)
+{
+	struct Vertex_Byte newVertex;
+
+	for(unsigned int i = 0; i < numberOfVertices; i++)
+	{
+		GetVertexAtPointer_Byte(vertexPointerList[i], &newVertex);
+
+		if(newVertex.rxControlID != rxControlID || CheckBufferEquality(newVertex.rxID, rxID, STANDARD_ID_SIZE) == 0)
+			continue;
+
+		int controlIndex = GetSummarizedControlIndex(&newVertex);
+		if(controlIndex < 0)
+			continue;
+
+		SendSetValToVertex(&newVertex, controlList[controlIndex].curValue);
+	}
+}
+
 heepByte AddUserMemory(heepByte userMemoryNumber, heepByte* buffer, int bufferLength)
 {
 	return AddUserMOP(userMemoryNumber, buffer, bufferLength, deviceIDByte);
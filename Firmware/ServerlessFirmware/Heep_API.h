@@ -24,6 +24,7 @@
 // Define the input and output buffers for global accessibility
 extern unsigned char outputBuffer [];
 extern unsigned int outputBufferLastByte;
+extern unsigned char outputBufferOverflowed; // Set when something did not fit. Cleared with the buffer
 
 extern unsigned char inputBuffer [];
 extern unsigned int inputBufferLastByte;
@@ -48,6 +49,9 @@ void AddControl(struct Control myControl);
 
 heepByte AddVertex(struct Vertex_Byte myVertex);
 
+// Adds up to VERTICES_PER_BATCH vertices, all or none of them
+heepByte AddVertices(struct Vertex_Byte* vertices, int numberOfNewVertices, int* verticesAdded);
+
 void SetupHeepTasks();
 
 void CommitMemory();
@@ -58,6 +62,8 @@ heepByte HandleHeepCommunications();
 void PostDataToFirebase();
 #endif
 
+void HandleIPChanges();
+
 void ControlDaemon();
 
 void PerformHeepTasks();
@@ -68,6 +74,22 @@ void AddRangeControl(char* controlName, int inputOutput, int highValue, int lowV
 void AddOnOffControl(char* controlName, int inputOutput, int startingValue);
 void AddMomentaryControl(char* controlName, int inputOutput);
 
+// Adds every control of a const table, in order. The table and its names
+// are never copied, so they can stay in read only memory
+void AddControlTable(const struct ControlDeclaration* controls, int numberOfDeclarations);
+
+// Both buffers are owned by the user and hold bufferSize bytes. Network
+// writes land in the back buffer and are swapped in whole, so the control's
+// buffer always holds a complete frame. curValue is the length of that frame.
+// A bufferSize of 0 or more than 254 adds no control
+void AddDoubleBufferedControl(char* controlName, int inputOutput, heepByte* frontBuffer, heepByte* backBuffer, unsigned char bufferSize);
+
+// Fill the back buffer, then swap it in and send it without copying it into
+// the control first. Returns 1 if the control is not double buffered or the
+// length does not fit
+heepByte* GetControlBackBuffer(int controlHandle);
+heepByte SwapAndSendControlBuffer(int controlHandle, int bufferLength);
+
 int GetControlValueByName(char* controlName);
 
 void SetControlValueByName(char* controlName, int newValue);
@@ -78,8 +100,46 @@ void SetControlValueByNameNoAnalytics(char *controlName, int newValue);
 void SetControlValueByNameNoAnalyticsNoSend(char *controlName, int newValue);
 void SetControlValueByNameNoAnalyticsAlwaysSend(char *controlName, int newValue);
 
+// Resolve a control name once, outside of a hot loop, and use the handle
+// from then on. Handles are -1 for unknown names and stay valid until
+// ClearControls is called
+int GetControlHandleByName(char* controlName);
+int GetControlValueByHandle(int controlHandle);
+void SetControlValueByHandle(int controlHandle, int newValue);
+
+// The callback runs from the Control Daemon, in the same pass of
+// PerformHeepTasks that received the value and after the reply was sent.
+// Writes that arrive before the daemon runs are reported once. Every
+// network write is reported, even one that leaves the value unchanged.
+// Pass 0 to remove a callback. Returns 1 if there is no such control
+heepByte SetControlCallbackByHandle(int controlHandle, HeepControlCallback callback);
+heepByte SetControlCallbackByName(char* controlName, HeepControlCallback callback);
+
+// Bounds how often an output control is sent. A value sent within
+// minimumInterval of the last send, or that differs from it by less than
+// deadband, is held back and only the latest held value is kept.
+// PerformHeepTasks sends it once the interval has passed, or for a change
+// inside the deadband once the control has been still for the interval,
+// so the final value always goes out. Zero for both removes the limit.
+// Returns 1 if there is no such control
+heepByte SetControlSendLimitByHandle(int controlHandle, unsigned long minimumInterval, unsigned char deadband);
+heepByte SetControlSendLimitByName(char* controlName, unsigned long minimumInterval, unsigned char deadband);
+
+void FlushHeldOutputs();
+
+// Resends every output value over every vertex
 void SendControlsOnHeartBeat(unsigned long controlSendPeriod);
 
+// Sends each remote device a single summary of the values this device's
+// vertices give it, instead of every value over every vertex. The device
+// replies with the controls that differ, and only those are sent in full.
+// Buffer and momentary controls are left out
+void SendControlSummaries();
+void SendControlSummariesOnHeartBeat(unsigned long controlSendPeriod);
+
+// Called when a device reports one of its controls as stale
+void ResendControlToDevice(heepByte* rxID, unsigned char rxControlID);
+
 heepByte AddUserMemory(heepByte userMemoryNumber, heepByte* buffer, int bufferLength);
 heepByte GetUserMemory(heepByte userMemoryNumber, heepByte* buffer, int* bytesReturned);
 
@@ -1,8 +1,10 @@
 #include "MemoryUtilities.h"
 #include "DeviceSpecificMemory.h"
+#include <string.h>
 
 unsigned char outputBuffer [OUTPUT_BUFFER_SIZE];
 unsigned int outputBufferLastByte = 0;
+unsigned char outputBufferOverflowed = 0;
 
 unsigned char inputBuffer [INPUT_BUFFER_SIZE];
 unsigned int inputBufferLastByte = 0;
@@ -10,28 +12,29 @@ unsigned int inputBufferSize = INPUT_BUFFER_SIZE;
 
 unsigned long GetDataFromBufferOfSpecifiedSize(heepByte* buffer, heepByte* data, unsigned long size, unsigned long counter)
 {
-	int i;
-	for(i = 0; i < size; i++)
-	{
-		data[i] = buffer[counter];
-		counter++;
-	}
-
-	return counter;
+	memcpy(data, &buffer[counter], size);
+	return counter + size;
 }
 
 unsigned long GetFullDeviceIDFromBuffer(unsigned char* buffer, heepByte* deviceID, unsigned long counter)
 {
-	return GetDataFromBufferOfSpecifiedSize(buffer, deviceID, STANDARD_ID_SIZE, counter);
+	memcpy(deviceID, &buffer[counter], STANDARD_ID_SIZE);
+	return counter + STANDARD_ID_SIZE;
 }
 
 unsigned long GetDeviceIDOrLocalIDFromBuffer(unsigned char* buffer, heepByte* deviceID, unsigned long counter)
 {
-	return GetDataFromBufferOfSpecifiedSize(buffer, deviceID, ID_SIZE, counter);
+	memcpy(deviceID, &buffer[counter], ID_SIZE);
+	return counter + ID_SIZE;
 }
 
 int CheckBufferEquality(heepByte* buffer1, heepByte* buffer2, int numBytes)
 {
+	// Nearly every comparison is of two device IDs. A memcmp of a constant
+	// size compiles to a single word compare that is safe at any alignment
+	if(numBytes == STANDARD_ID_SIZE)
+		return memcmp(buffer1, buffer2, STANDARD_ID_SIZE) == 0;
+
 	int i;
 	for(i = 0; i < numBytes; i++)
 	{
@@ -51,19 +54,13 @@ int CheckDeviceIDEquality(heepByte* deviceID1, heepByte* deviceID2)
 
 unsigned long AddDeviceIDToBuffer_Byte(unsigned char* buffer, heepByte* deviceID, unsigned long counter)
 {
-	int i;
-	for(i = 0; i < STANDARD_ID_SIZE; i++)
-	{
-		buffer[counter] = deviceID[i];
-		counter++;
-	}
-
-	return counter;
+	memcpy(&buffer[counter], deviceID, STANDARD_ID_SIZE);
+	return counter + STANDARD_ID_SIZE;
 }
 
 void CopyDeviceID(heepByte* idSend, heepByte* idReturn)
 {
-	AddDeviceIDToBuffer_Byte(idReturn, idSend, 0);
+	memcpy(idReturn, idSend, STANDARD_ID_SIZE);
 }
 
 unsigned long GetNumberFromBuffer(unsigned char* buffer, unsigned int* counter, unsigned char numBytes)
@@ -134,6 +131,40 @@ void AddBufferToBuffer(heepByte* rxBuffer, heepByte* txBuffer, heepByte size, un
 	}
 }
 
+unsigned long HashBuffer(heepByte* buffer, unsigned int numBytes)
+{
+	unsigned long hash = 2166136261UL;
+
+	for(unsigned int i = 0; i < numBytes; i++)
+	{
+		hash ^= buffer[i];
+		hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+	}
+
+	return hash;
+}
+
+void RemoveHashTableEntry(heepByte* table, unsigned int entrySize, unsigned int tableSize, unsigned int entry, HashTableHomeBucket GetHomeBucket)
+{
+	unsigned int emptyBucket = entry;
+	unsigned int bucket = (entry + 1) & (tableSize - 1);
+	int homeBucket = GetHomeBucket(&table[bucket * entrySize]);
+
+	while(homeBucket >= 0)
+	{
+		if(((bucket - (unsigned int)homeBucket) & (tableSize - 1)) >= ((bucket - emptyBucket) & (tableSize - 1)))
+		{
+			memcpy(&table[emptyBucket * entrySize], &table[bucket * entrySize], entrySize);
+			emptyBucket = bucket;
+		}
+
+		bucket = (bucket + 1) & (tableSize - 1);
+		homeBucket = GetHomeBucket(&table[bucket * entrySize]);
+	}
+
+	memset(&table[emptyBucket * entrySize], 0, entrySize);
+}
+
 #ifdef USE_ANALYTICS
 
 void base64_encode_Heep(heepByte* deviceID) {
@@ -29,9 +29,20 @@ heepByte GetNumBytes64Bit(uint64_t number);
 
 void AddBufferToBuffer(heepByte* rxBuffer, heepByte* txBuffer, heepByte size, unsigned int *rxCounter, unsigned int *txCounter);
 
+// 32-bit FNV-1a
+unsigned long HashBuffer(heepByte* buffer, unsigned int numBytes);
+
+// Returns an entry's home bucket, or -1 if the entry is empty
+typedef int (*HashTableHomeBucket)(heepByte* entry);
+
+// Removes an entry from an open-addressed table whose size is a power of two,
+// moving later entries back into the gap so that no search stops short of
+// them. The freed entry is zeroed
+void RemoveHashTableEntry(heepByte* table, unsigned int entrySize, unsigned int tableSize, unsigned int entry, HashTableHomeBucket GetHomeBucket);
+
 #ifdef USE_ANALYTICS
 
-static const char* base64_chars = 
+static const char base64_chars [] = 
              "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
              "abcdefghijklmnopqrstuvwxyz"
              "0123456789+/";
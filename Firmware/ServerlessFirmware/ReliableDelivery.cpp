@@ -0,0 +1,314 @@
+#include "ReliableDelivery.h"
+#include "Heep_API.h"
+#include "Device.h"
+#include "DeviceMemory.h"
+#include "MemoryUtilities.h"
+#include "ActionAndResponseOpCodes.h"
+#include <string.h>
+
+struct ReliableDeliveryState reliableDelivery;
+
+void SetReliableDelivery(heepByte enable)
+{
+	reliableDelivery.enabled = enable;
+}
+
+void ClearReliableDelivery()
+{
+	heepByte enabled = reliableDelivery.enabled;
+	memset(&reliableDelivery, 0, sizeof(reliableDelivery));
+	reliableDelivery.enabled = enabled;
+}
+
+unsigned int GetNumberOfWaitingSetVals()
+{
+	return reliableDelivery.numberOfWaitingSetVals;
+}
+
+// Serial number comparison, so that sequence numbers can wrap
+heepByte IsSequenceNumberNewer(unsigned short sequenceNumber, unsigned short lastSequenceNumber)
+{
+	return (short)(sequenceNumber - lastSequenceNumber) > 0;
+}
+
+// Returns 0 if the device has no destination
+struct ReliableDestination* FindReliableDestination(heepByte* rxID)
+{
+	for(int i = 0; i < RELIABLE_DESTINATIONS; i++)
+	{
+		if(reliableDelivery.destinations[i].inUse && CheckBufferEquality(reliableDelivery.destinations[i].rxID, rxID, STANDARD_ID_SIZE))
+			return &reliableDelivery.destinations[i];
+	}
+
+	return 0;
+}
+
+// Only sending may add a destination, since adding one can replace another
+struct ReliableDestination* GetReliableDestination(heepByte* rxID)
+{
+	struct ReliableDestination* existing = FindReliableDestination(rxID);
+	if(existing != 0)
+		return existing;
+
+	// Replacing a destination restarts its sequence numbers. The receiver's
+	// ack brings them back in line
+	struct ReliableDestination* destination = &reliableDelivery.destinations[reliableDelivery.nextDestinationToReplace];
+	reliableDelivery.nextDestinationToReplace = (reliableDelivery.nextDestinationToReplace + 1) % RELIABLE_DESTINATIONS;
+
+	memset(destination, 0, sizeof(struct ReliableDestination));
+	destination->inUse = 1;
+	CopyDeviceID(rxID, destination->rxID);
+	destination->nextSequenceNumber = 1;
+	destination->retransmissionTimeout = RELIABLE_INITIAL_TIMEOUT;
+
+	return destination;
+}
+
+unsigned long GetReliableRetransmissionTimeout(heepByte* rxID)
+{
+	struct ReliableDestination* destination = FindReliableDestination(rxID);
+	if(destination == 0)
+		return RELIABLE_INITIAL_TIMEOUT;
+
+	return destination->retransmissionTimeout;
+}
+
+// RFC 6298 with millisecond granularity
+void AddRTTSample(struct ReliableDestination* destination, unsigned long RTT)
+{
+	if(destination->hasRTTSample)
+	{
+		unsigned long difference = destination->smoothedRTT > RTT ? destination->smoothedRTT - RTT : RTT - destination->smoothedRTT;
+		destination->RTTVariation = (3*destination->RTTVariation + difference) / 4;
+		destination->smoothedRTT = (7*destination->smoothedRTT + RTT) / 8;
+	}
+	else
+	{
+		destination->smoothedRTT = RTT;
+		destination->RTTVariation = RTT / 2;
+		destination->hasRTTSample = 1;
+	}
+
+	unsigned long variationTerm = 4*destination->RTTVariation;
+	if(variationTerm < 1)
+		variationTerm = 1;
+
+	destination->retransmissionTimeout = destination->smoothedRTT + variationTerm;
+
+	if(destination->retransmissionTimeout < RELIABLE_MIN_TIMEOUT)
+		destination->retransmissionTimeout = RELIABLE_MIN_TIMEOUT;
+	else if(destination->retransmissionTimeout > RELIABLE_MAX_TIMEOUT)
+		destination->retransmissionTimeout = RELIABLE_MAX_TIMEOUT;
+}
+
+void FillOutputBufferWithReliableSetValCOP(unsigned short sequenceNumber, unsigned char controlID, unsigned char value)
+{
+	ClearOutputBuffer();
+	AddNewCharToOutputBuffer(ReliableSetValueOpCode);
+	AddNewCharToOutputBuffer(STANDARD_ID_SIZE + 4);
+	AddDeviceIDToOutputBuffer_Byte(deviceIDByte);
+	AddNumberToOutputBuffer(sequenceNumber, 2);
+	AddNewCharToOutputBuffer(controlID);
+	AddNewCharToOutputBuffer(value);
+}
+
+void FillOutputBufferWithReliableAck(unsigned short sequenceNumber, unsigned short lastSequenceNumber)
+{
+	ClearOutputBuffer();
+	AddNewCharToOutputBuffer(ReliableAckOpCode);
+	AddDeviceIDToOutputBuffer_Byte(deviceIDByte);
+	AddNewCharToOutputBuffer(4);
+	AddNumberToOutputBuffer(sequenceNumber, 2);
+	AddNumberToOutputBuffer(lastSequenceNumber, 2);
+}
+
+void TransmitReliableSetVal(struct ReliableSendSlot* slot)
+{
+	struct ReliableDestination* destination = GetReliableDestination(slot->rxID);
+	slot->sequenceNumber = destination->nextSequenceNumber++;
+	slot->sendTime = GetMillis();
+
+	FillOutputBufferWithReliableSetValCOP(slot->sequenceNumber, slot->rxControlID, slot->value);
+	SendOutputBufferToIP(slot->rxIPAddress);
+}
+
+heepByte SendReliableSetVal(heepByte* rxID, struct HeepIPAddress rxIPAddress, unsigned char rxControlID, unsigned char value)
+{
+	if(reliableDelivery.enabled == 0)
+		return 1;
+
+	struct ReliableSendSlot* freeSlot = 0;
+
+	for(int i = 0; i < RELIABLE_SEND_SLOTS; i++)
+	{
+		struct ReliableSendSlot* slot = &reliableDelivery.sendSlots[i];
+
+		if(slot->inUse == 0)
+		{
+			if(freeSlot == 0)
+				freeSlot = slot;
+
+			continue;
+		}
+
+		if(slot->rxControlID == rxControlID && CheckBufferEquality(slot->rxID, rxID, STANDARD_ID_SIZE))
+		{
+			slot->value = value;
+			slot->rxIPAddress = rxIPAddress;
+			slot->retransmissions = 0;
+			TransmitReliableSetVal(slot);
+			return 0;
+		}
+	}
+
+	if(freeSlot == 0)
+		return 1;
+
+	freeSlot->inUse = 1;
+	CopyDeviceID(rxID, freeSlot->rxID);
+	freeSlot->rxIPAddress = rxIPAddress;
+	freeSlot->rxControlID = rxControlID;
+	freeSlot->value = value;
+	freeSlot->retransmissions = 0;
+	reliableDelivery.numberOfWaitingSetVals++;
+
+	TransmitReliableSetVal(freeSlot);
+	return 0;
+}
+
+void ReleaseReliableSendSlot(struct ReliableSendSlot* slot)
+{
+	slot->inUse = 0;
+	reliableDelivery.numberOfWaitingSetVals--;
+}
+
+void RetransmitReliableSetVals()
+{
+	if(reliableDelivery.numberOfWaitingSetVals == 0)
+		return;
+
+	unsigned long now = GetMillis();
+
+	for(int i = 0; i < RELIABLE_SEND_SLOTS; i++)
+	{
+		struct ReliableSendSlot* slot = &reliableDelivery.sendSlots[i];
+		if(slot->inUse == 0)
+			continue;
+
+		unsigned long timeout = GetReliableRetransmissionTimeout(slot->rxID) << slot->retransmissions;
+		if(timeout > RELIABLE_MAX_TIMEOUT)
+			timeout = RELIABLE_MAX_TIMEOUT;
+
+		if(now - slot->sendTime < timeout)
+			continue;
+
+		if(slot->retransmissions >= RELIABLE_MAX_RETRANSMISSIONS)
+		{
+			ReleaseReliableSendSlot(slot);
+			reliableDelivery.abandonedSetVals++;
+			continue;
+		}
+
+		slot->retransmissions++;
+		reliableDelivery.retransmissions++;
+		TransmitReliableSetVal(slot);
+	}
+}
+
+struct ReliablePeer* GetReliablePeer(heepByte* txID)
+{
+	for(int i = 0; i < RELIABLE_PEERS; i++)
+	{
+		if(reliableDelivery.peers[i].inUse && CheckBufferEquality(reliableDelivery.peers[i].txID, txID, STANDARD_ID_SIZE))
+			return &reliableDelivery.peers[i];
+	}
+
+	return 0;
+}
+
+struct ReliablePeer* AddReliablePeer(heepByte* txID, unsigned short lastSequenceNumber)
+{
+	struct ReliablePeer* peer = &reliableDelivery.peers[reliableDelivery.nextPeerToReplace];
+	reliableDelivery.nextPeerToReplace = (reliableDelivery.nextPeerToReplace + 1) % RELIABLE_PEERS;
+
+	peer->inUse = 1;
+	CopyDeviceID(txID, peer->txID);
+	peer->lastSequenceNumber = lastSequenceNumber;
+
+	return peer;
+}
+
+void ExecuteReliableSetValOpCode()
+{
+	if(inputBuffer[1] != STANDARD_ID_SIZE + 4)
+	{
+		char errorMessage [] = "Invalid Reliable SetVal";
+		FillOutputBufferWithError(errorMessage, sizeof(errorMessage) - 1);
+		return;
+	}
+
+	heepByte txID [STANDARD_ID_SIZE];
+	unsigned int localCounter = 0;
+	unsigned int counter = 2;
+	AddBufferToBuffer(txID, inputBuffer, STANDARD_ID_SIZE, &localCounter, &counter);
+	unsigned short sequenceNumber = GetNumberFromBuffer(inputBuffer, &counter, 2);
+	unsigned char controlID = GetNumberFromBuffer(inputBuffer, &counter, 1);
+	unsigned char value = GetNumberFromBuffer(inputBuffer, &counter, 1);
+
+	// A sender seen for the first time starts wherever it is
+	struct ReliablePeer* peer = GetReliablePeer(txID);
+	if(peer == 0)
+		peer = AddReliablePeer(txID, sequenceNumber - 1);
+
+	if(IsSequenceNumberNewer(sequenceNumber, peer->lastSequenceNumber))
+	{
+		// A missing control is acked all the same. Retransmitting cannot fix it
+		SetControlValueByIDFromNetwork(controlID, value);
+		peer->lastSequenceNumber = sequenceNumber;
+	}
+
+	FillOutputBufferWithReliableAck(sequenceNumber, peer->lastSequenceNumber);
+}
+
+void ExecuteReliableAckOpCode()
+{
+	heepByte rxID [STANDARD_ID_SIZE];
+	unsigned int localCounter = 0;
+	unsigned int counter = 1;
+	AddBufferToBuffer(rxID, inputBuffer, STANDARD_ID_SIZE, &localCounter, &counter);
+	counter++;
+	unsigned short sequenceNumber = GetNumberFromBuffer(inputBuffer, &counter, 2);
+	unsigned short lastSequenceNumber = GetNumberFromBuffer(inputBuffer, &counter, 2);
+
+	// Acks from a device we never sent to, or whose destination has since
+	// been replaced, cannot match a waiting slot's sequence numbers
+	struct ReliableDestination* destination = FindReliableDestination(rxID);
+	if(destination == 0)
+		return;
+
+	heepByte applied = sequenceNumber == lastSequenceNumber;
+
+	if(!applied && !IsSequenceNumberNewer(destination->nextSequenceNumber, lastSequenceNumber))
+		destination->nextSequenceNumber = lastSequenceNumber + 1;
+
+	for(int i = 0; i < RELIABLE_SEND_SLOTS; i++)
+	{
+		struct ReliableSendSlot* slot = &reliableDelivery.sendSlots[i];
+
+		if(slot->inUse == 0 || slot->sequenceNumber != sequenceNumber || CheckBufferEquality(slot->rxID, rxID, STANDARD_ID_SIZE) == 0)
+			continue;
+
+		if(applied)
+		{
+			// Every transmission has its own sequence number, so the sample is never ambiguous
+			AddRTTSample(destination, GetMillis() - slot->sendTime);
+			ReleaseReliableSendSlot(slot);
+		}
+		else
+		{
+			TransmitReliableSetVal(slot);
+		}
+
+		return;
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "CommonDataTypes.h"
+#include "DeviceSpecificMemory.h"
+
+// Reliable SetVal delivery. A Reliable SetVal COP carries the sender's ID
+// and a sequence number that is new for every transmission, including
+// retransmissions. The receiver applies a sequence number only if it is
+// newer than the last one applied from that sender, so duplicates and late
+// arrivals are never applied twice or over a newer value. Every one is
+// acked with the sequence number received and the last one applied. An ack
+// where the two differ was not applied, and the sender retransmits with a
+// sequence number past the receiver's, which also resynchronises a sender
+// that has restarted.
+
+// A SetVal waiting for its ack
+struct ReliableSendSlot
+{
+	heepByte inUse;
+	heepByte rxID [STANDARD_ID_SIZE];
+	struct HeepIPAddress rxIPAddress;
+	unsigned char rxControlID;
+	unsigned char value;
+	unsigned short sequenceNumber;
+	unsigned long sendTime;
+	unsigned char retransmissions;
+};
+
+// Sequence numbers and retransmission timeout for one receiving device
+struct ReliableDestination
+{
+	heepByte inUse;
+	heepByte rxID [STANDARD_ID_SIZE];
+	unsigned short nextSequenceNumber;
+	heepByte hasRTTSample;
+	unsigned long smoothedRTT;		// ms
+	unsigned long RTTVariation;		// ms
+	unsigned long retransmissionTimeout;	// ms
+};
+
+// Last sequence number applied from one sending device
+struct ReliablePeer
+{
+	heepByte inUse;
+	heepByte txID [STANDARD_ID_SIZE];
+	unsigned short lastSequenceNumber;
+};
+
+struct ReliableDeliveryState
+{
+	heepByte enabled;
+	unsigned int numberOfWaitingSetVals;
+	struct ReliableSendSlot sendSlots [RELIABLE_SEND_SLOTS];
+	struct ReliableDestination destinations [RELIABLE_DESTINATIONS];
+	struct ReliablePeer peers [RELIABLE_PEERS];
+	unsigned char nextDestinationToReplace;
+	unsigned char nextPeerToReplace;
+	unsigned long retransmissions;
+	unsigned long abandonedSetVals;
+};
+
+extern struct ReliableDeliveryState reliableDelivery;
+
+// Off by default. Receiving Reliable SetVals works either way
+void SetReliableDelivery(heepByte enable);
+
+// Forget every waiting SetVal, destination and peer
+void ClearReliableDelivery();
+
+// Returns 1 if reliable delivery is off or every slot is waiting on an ack,
+// and the caller should send a plain SetVal instead. A newer value for a
+// control that is still waiting replaces the old one
+heepByte SendReliableSetVal(heepByte* rxID, struct HeepIPAddress rxIPAddress, unsigned char rxControlID, unsigned char value);
+
+// Retransmits SetVals whose timeout has passed, doubling the timeout each
+// time, and gives up after RELIABLE_MAX_RETRANSMISSIONS
+void RetransmitReliableSetVals();
+
+unsigned int GetNumberOfWaitingSetVals();
+// RELIABLE_INITIAL_TIMEOUT for a device with no destination
+unsigned long GetReliableRetransmissionTimeout(heepByte* rxID);
+
+void ExecuteReliableSetValOpCode();
+void ExecuteReliableAckOpCode();
@@ -1,4 +1,5 @@
 #include "Simulation_HeepComms.h"
+#include "Simulation_VirtualNetwork.h"
 #include "Heep_API.h"
 
 void CreateInterruptServer()
@@ -8,22 +9,26 @@ void CreateInterruptServer()
 
 void CheckServerForInputs()
 {
+	// The virtual network delivers datagrams itself as simulated time passes
+	if(IsVirtualNetworkActive()) return;
+
 	if(HandleHeepCommunications()) return;
 }
 
 void SendOutputBufferToIP(struct HeepIPAddress destIP)
 {
-
+	SendVirtualDatagram(destIP, outputBuffer, outputBufferLastByte);
 }
 
 void BroadcastOutputBuffer()
 {
-
+	BroadcastVirtualDatagram(outputBuffer, outputBufferLastByte);
 }
 
 void GetCurrentIP(struct HeepIPAddress* destIP)
 {
-	
+	if(IsVirtualNetworkActive())
+		GetVirtualDeviceIP(GetSelectedVirtualDevice(), destIP);
 }
 
 #ifdef USE_ANALYTICS
@@ -32,8 +37,10 @@ uint64_t GetRealTimeFromNetwork()
 	return 0;
 }
 
-void SendDataToFirebase(heepByte *buffer, int length, heepByte* base64IDBuffer, int base64IDLength)
+void SendDataToFirebase(heepByte *buffer, int length, heepByte* deviceID)
 {
-	
+	(void)buffer;
+	(void)length;
+	(void)deviceID;
 }
 #endif
\ No newline at end of file
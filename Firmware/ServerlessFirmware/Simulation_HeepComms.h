@@ -12,7 +12,6 @@ void GetCurrentIP(struct HeepIPAddress* destIP);
 
 #ifdef USE_ANALYTICS
 uint64_t GetRealTimeFromNetwork();
-void SendDataToFirebase(heepByte *buffer, int length, heepByte* base64IDBuffer, int base64IDLength);
-void SendContextToFirebase(char* deviceName, int nameLength, heepByte* deviceID, Control* controlList, int numberOfControls)
+void SendDataToFirebase(heepByte *buffer, int length, heepByte* deviceID);
 #endif
 
@@ -1,27 +1,137 @@
 #include "Simulation_Timer.h"
+#include "Scheduler.h"
+#include <chrono>
 
 uint64_t simMillis = 0;
+
+heepByte simulationClockMode = AutoIncrementClock;
+double simulationClockRatio = 1.0;
+uint64_t ratioStartSimMillis = 0;
+uint64_t ratioStartRealMicros = 0;
+
+uint64_t capturedRealTime = 0;
+uint64_t millisRealTimeWasCaptured = 0;
+
+uint64_t GetRealMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void StartSimulationClockRatio()
+{
+	ratioStartSimMillis = simMillis;
+	ratioStartRealMicros = GetRealMicros();
+}
+
+void UpdateRealTimeRatioClock()
+{
+	if(simulationClockMode == RealTimeRatioClock)
+	{
+		simMillis = ratioStartSimMillis + (uint64_t)((GetRealMicros() - ratioStartRealMicros) * simulationClockRatio / 1000);
+	}
+}
+
 unsigned long GetMillis()
 {
-	simMillis++;
+	if(simulationClockMode == AutoIncrementClock)
+		simMillis++;
+	else
+		UpdateRealTimeRatioClock();
+
 	return simMillis;
 }
 
-// No absolute time yet
 heepByte IsAbsoluteTime()
 {
+	if(capturedRealTime > 0)
+		return 1;
+
 	return 0;
 }
 
 uint64_t GetAnalyticsTime()
 {
+	UpdateRealTimeRatioClock();
+
 	if(IsAbsoluteTime())
 	{
-		// Calculate Analytics Time
-		return 0;
+		return capturedRealTime + (simMillis - millisRealTimeWasCaptured);
 	}
 	else
 	{
 		return simMillis;
 	}
 }
+
+void SetAnalyticsTime(uint64_t realTime)
+{
+	UpdateRealTimeRatioClock();
+
+	capturedRealTime = realTime;
+	millisRealTimeWasCaptured = simMillis;
+}
+
+void SetSimulationClockMode(heepByte mode)
+{
+	UpdateRealTimeRatioClock();
+
+	simulationClockMode = mode;
+	StartSimulationClockRatio();
+}
+
+heepByte GetSimulationClockMode()
+{
+	return simulationClockMode;
+}
+
+void SetSimulationClockRatio(double ratio)
+{
+	UpdateRealTimeRatioClock();
+
+	simulationClockRatio = ratio;
+	StartSimulationClockRatio();
+}
+
+void SetSimulationClock(uint64_t millis)
+{
+	simMillis = millis;
+	StartSimulationClockRatio();
+}
+
+void AdvanceSimulationClock(uint64_t millis)
+{
+	UpdateRealTimeRatioClock();
+	SetSimulationClock(simMillis + millis);
+}
+
+uint64_t JumpToNextSimulationDeadline(uint64_t maxMillis)
+{
+	UpdateRealTimeRatioClock();
+
+	uint64_t deadline = maxMillis;
+
+	// IsTaskTime fires once more than a full interval has passed
+	if(curNumberOfTasks > 0)
+	{
+		uint64_t nextTaskTime = (uint64_t)lastMillis + taskInterval + 1;
+		if(nextTaskTime < deadline)
+			deadline = nextTaskTime;
+	}
+
+	// The clock never runs backwards
+	if(deadline < simMillis)
+		deadline = simMillis;
+
+	SetSimulationClock(deadline);
+	return simMillis;
+}
+
+void ResetSimulationClock()
+{
+	simMillis = 0;
+	simulationClockMode = AutoIncrementClock;
+	simulationClockRatio = 1.0;
+	capturedRealTime = 0;
+	millisRealTimeWasCaptured = 0;
+	StartSimulationClockRatio();
+}
@@ -2,8 +2,33 @@
 #include "CommonDataTypes.h"
 #include <stdint.h>
 
+// AutoIncrementClock advances one millisecond every time the time is read.
+// ManualClock only moves when it is advanced or jumped to a deadline.
+// RealTimeRatioClock follows the wall clock scaled by a ratio
+enum SimulationClockModes {AutoIncrementClock = 0, ManualClock = 1, RealTimeRatioClock = 2};
+
 extern uint64_t simMillis;
 unsigned long GetMillis();
-// No absolute time yet
 heepByte IsAbsoluteTime();
-uint64_t GetAnalyticsTime();
\ No newline at end of file
+uint64_t GetAnalyticsTime();
+
+// Analytics timestamps become absolute from this moment on, as they do
+// on a device that has fetched the real time from the network
+void SetAnalyticsTime(uint64_t realTime);
+
+void SetSimulationClockMode(heepByte mode);
+heepByte GetSimulationClockMode();
+
+// Simulated milliseconds per real millisecond in RealTimeRatioClock mode
+void SetSimulationClockRatio(double ratio);
+
+void SetSimulationClock(uint64_t millis);
+void AdvanceSimulationClock(uint64_t millis);
+
+// Move straight to the next scheduler task time or maxMillis, whichever is
+// first, so that long uptimes can be replayed without idle polling.
+// Returns the new time
+uint64_t JumpToNextSimulationDeadline(uint64_t maxMillis);
+
+// Back to an auto incrementing clock at 0 with no absolute time
+void ResetSimulationClock();
@@ -0,0 +1,529 @@
+#include "Simulation_VirtualNetwork.h"
+#include "Heep_API.h"
+#include "Device.h"
+#include "MemoryUtilities.h"
+#include "DeviceMemory.h"
+#include "DeviceSpecificMemory.h"
+#include "Scheduler.h"
+#include "Simulation_Timer.h"
+#include "ReliableDelivery.h"
+#include <stdlib.h>
+#include <string.h>
+#include <queue>
+#include <vector>
+#include <unordered_map>
+
+extern unsigned long lastHeartBeat;
+
+struct VirtualDevice
+{
+	struct HeepIPAddress IP;
+	heepByte* state; // The device's copy of every global in virtualDeviceGlobals
+	uint64_t interfaceBusyUntil; // Serialisation on the outgoing interface
+};
+
+// A firmware global that belongs to one device. Arrays with a count copy
+// only their used part on a switch
+struct VirtualDeviceGlobal
+{
+	void* global;
+	unsigned int size;
+	unsigned int* usedCount; // 0 copies the whole global
+	unsigned int elementSize;
+};
+
+#define VIRTUAL_DEVICE_GLOBAL(global, size) {(void*)(global), (unsigned int)(size), 0, 0}
+#define VIRTUAL_DEVICE_ARRAY(global, elementSize, maxCount, usedCount) {(void*)(global), (unsigned int)((elementSize) * (maxCount)), (usedCount), (unsigned int)(elementSize)}
+
+// Every firmware global that is saved and loaded with a device. A global
+// that is neither listed here nor rebuilt by LoadVirtualDeviceState is
+// shared by every virtual device. Counts come before the arrays they size,
+// and deviceIDByte comes first so that AddVirtualDevice can set it
+VirtualDeviceGlobal virtualDeviceGlobals [] =
+{
+	VIRTUAL_DEVICE_GLOBAL(deviceIDByte, STANDARD_ID_SIZE),
+
+	VIRTUAL_DEVICE_GLOBAL(&curFilledMemory, sizeof(curFilledMemory)),
+	VIRTUAL_DEVICE_GLOBAL(&fragmentedMemory, sizeof(fragmentedMemory)),
+	VIRTUAL_DEVICE_GLOBAL(&defragmentThreshold, sizeof(defragmentThreshold)),
+	VIRTUAL_DEVICE_GLOBAL(&numberOfDefragmentations, sizeof(numberOfDefragmentations)),
+	VIRTUAL_DEVICE_GLOBAL(&memoryChanged, sizeof(memoryChanged)),
+	VIRTUAL_DEVICE_GLOBAL(&controlRegister, sizeof(controlRegister)),
+	VIRTUAL_DEVICE_ARRAY(deviceMemory, 1, MAX_MEMORY, &curFilledMemory),
+
+	VIRTUAL_DEVICE_GLOBAL(&numberOfControls, sizeof(numberOfControls)),
+	VIRTUAL_DEVICE_ARRAY(controlList, sizeof(struct Control), NUM_CONTROLS, &numberOfControls),
+	VIRTUAL_DEVICE_ARRAY(controlCallbacks, sizeof(HeepControlCallback), NUM_CONTROLS, &numberOfControls),
+	VIRTUAL_DEVICE_ARRAY(pendingPreviousValues, 1, NUM_CONTROLS, &numberOfControls),
+	VIRTUAL_DEVICE_ARRAY(controlBackBuffers, sizeof(heepByte*), NUM_CONTROLS, &numberOfControls),
+	VIRTUAL_DEVICE_ARRAY(controlSendLimits, sizeof(struct ControlSendLimit), NUM_CONTROLS, &numberOfControls),
+
+	VIRTUAL_DEVICE_GLOBAL(&numberOfVertices, sizeof(numberOfVertices)),
+	VIRTUAL_DEVICE_ARRAY(vertexPointerList, sizeof(unsigned int), NUM_VERTICES, &numberOfVertices),
+	VIRTUAL_DEVICE_GLOBAL(vertexIndex, sizeof(struct VertexIndexEntry) * VERTEX_INDEX_SIZE),
+
+	VIRTUAL_DEVICE_GLOBAL(&resetHeepNetwork, sizeof(resetHeepNetwork)),
+
+	VIRTUAL_DEVICE_GLOBAL(&lastMillis, sizeof(lastMillis)),
+	VIRTUAL_DEVICE_GLOBAL(tasks, NUMBER_OF_TASKS),
+	VIRTUAL_DEVICE_GLOBAL(&curNumberOfTasks, sizeof(curNumberOfTasks)),
+	VIRTUAL_DEVICE_GLOBAL(&curTaskCounter, sizeof(curTaskCounter)),
+	VIRTUAL_DEVICE_GLOBAL(&taskInterval, sizeof(taskInterval)),
+	VIRTUAL_DEVICE_GLOBAL(&lastHeartBeat, sizeof(lastHeartBeat)),
+
+	VIRTUAL_DEVICE_GLOBAL(&reliableDelivery, sizeof(reliableDelivery)),
+
+#ifdef USE_MEMORY_IMAGE_IMPORT
+	VIRTUAL_DEVICE_GLOBAL(&memoryImageImport, sizeof(memoryImageImport)),
+	VIRTUAL_DEVICE_ARRAY(memoryImage, 1, MAX_MEMORY, &memoryImageImport.received),
+#endif
+};
+
+#define NUMBER_OF_VIRTUAL_DEVICE_GLOBALS (sizeof(virtualDeviceGlobals) / sizeof(virtualDeviceGlobals[0]))
+
+struct VirtualDatagram
+{
+	uint64_t deliveryTime;
+	unsigned long sequence; // Orders datagrams that arrive at the same time
+	int fromDevice;
+	int toDevice;
+	unsigned int length;
+	heepByte* payload;
+};
+
+struct LaterDatagram
+{
+	bool operator()(const VirtualDatagram& a, const VirtualDatagram& b) const
+	{
+		if(a.deliveryTime != b.deliveryTime)
+			return a.deliveryTime > b.deliveryTime;
+
+		return a.sequence > b.sequence;
+	}
+};
+
+uint64_t virtualNetworkTimeMicros = 0;
+
+VirtualDevice* virtualDevices = 0;
+heepByte* virtualDeviceStates = 0;
+unsigned long virtualDeviceStateSize = 0;
+int maxVirtualDevices = 0;
+int numberOfVirtualDevices = 0;
+int selectedVirtualDevice = -1;
+
+VirtualLink defaultVirtualLink = {0, 0, 0, 0};
+std::unordered_map<uint64_t, VirtualLink> virtualLinks;
+std::unordered_map<uint32_t, int> virtualRoutes;
+std::priority_queue<VirtualDatagram, std::vector<VirtualDatagram>, LaterDatagram> virtualDatagrams;
+
+unsigned long virtualDatagramSequence = 0;
+heepByte virtualNetworkReplies = 1;
+VirtualTransport virtualNetworkTransport = 0;
+uint64_t virtualNetworkRandomState = 1;
+VirtualNetworkStats virtualNetworkStats;
+
+uint32_t GetVirtualRouteKey(struct HeepIPAddress IP)
+{
+	return ((uint32_t)IP.Octet4 << 24) | ((uint32_t)IP.Octet3 << 16) | ((uint32_t)IP.Octet2 << 8) | IP.Octet1;
+}
+
+uint64_t GetVirtualLinkKey(int fromDevice, int toDevice)
+{
+	return ((uint64_t)(uint32_t)fromDevice << 32) | (uint32_t)toDevice;
+}
+
+// xorshift64*. Small, fast and reproducible on every platform
+uint64_t GetVirtualNetworkRandom()
+{
+	virtualNetworkRandomState ^= virtualNetworkRandomState >> 12;
+	virtualNetworkRandomState ^= virtualNetworkRandomState << 25;
+	virtualNetworkRandomState ^= virtualNetworkRandomState >> 27;
+	return virtualNetworkRandomState * 2685821657736338717ULL;
+}
+
+void ClearVirtualDatagrams()
+{
+	while(!virtualDatagrams.empty())
+	{
+		free(virtualDatagrams.top().payload);
+		virtualDatagrams.pop();
+	}
+}
+
+void CreateVirtualNetwork(int maxDevices, unsigned long seed)
+{
+	DestroyVirtualNetwork();
+
+	virtualDeviceStateSize = 0;
+	for(unsigned int i = 0; i < NUMBER_OF_VIRTUAL_DEVICE_GLOBALS; i++)
+		virtualDeviceStateSize += virtualDeviceGlobals[i].size;
+
+	virtualDevices = (VirtualDevice*)malloc(sizeof(VirtualDevice) * maxDevices);
+	virtualDeviceStates = (heepByte*)malloc(virtualDeviceStateSize * maxDevices);
+	maxVirtualDevices = maxDevices;
+	virtualNetworkRandomState = seed * 2 + 1; // xorshift state must never be 0
+}
+
+void DestroyVirtualNetwork()
+{
+	ClearVirtualDatagrams();
+	virtualLinks.clear();
+	virtualRoutes.clear();
+
+	free(virtualDevices);
+	virtualDevices = 0;
+	free(virtualDeviceStates);
+	virtualDeviceStates = 0;
+	maxVirtualDevices = 0;
+	numberOfVirtualDevices = 0;
+	selectedVirtualDevice = -1;
+
+	struct VirtualLink noDelayLink = {0, 0, 0, 0};
+	defaultVirtualLink = noDelayLink;
+	virtualNetworkReplies = 1;
+	virtualNetworkTransport = 0;
+	virtualNetworkTimeMicros = 0;
+	virtualDatagramSequence = 0;
+	ClearVirtualNetworkStats();
+}
+
+heepByte IsVirtualNetworkActive()
+{
+	return virtualDevices != 0;
+}
+
+// Returns where the device keeps its copy of a global
+heepByte* GetVirtualDeviceGlobalState(VirtualDevice* device, void* global)
+{
+	heepByte* state = device->state;
+	for(unsigned int i = 0; i < NUMBER_OF_VIRTUAL_DEVICE_GLOBALS; i++)
+	{
+		if(virtualDeviceGlobals[i].global == global)
+			return state;
+
+		state += virtualDeviceGlobals[i].size;
+	}
+
+	return 0;
+}
+
+int AddVirtualDevice(heepByte* deviceID, struct HeepIPAddress IP)
+{
+	if(numberOfVirtualDevices >= maxVirtualDevices)
+		return -1;
+
+	VirtualDevice* newDevice = &virtualDevices[numberOfVirtualDevices];
+	newDevice->IP = IP;
+	newDevice->state = &virtualDeviceStates[virtualDeviceStateSize * numberOfVirtualDevices];
+	newDevice->interfaceBusyUntil = 0;
+
+	// Every count is 0, so the new device starts with nothing in use
+	memset(newDevice->state, 0, virtualDeviceStateSize);
+	CopyDeviceID(deviceID, newDevice->state);
+	*GetVirtualDeviceGlobalState(newDevice, &defragmentThreshold) = DEFRAGMENT_THRESHOLD_PERCENT;
+
+	virtualRoutes[GetVirtualRouteKey(IP)] = numberOfVirtualDevices;
+
+	numberOfVirtualDevices++;
+	return numberOfVirtualDevices - 1;
+}
+
+int GetNumberOfVirtualDevices()
+{
+	return numberOfVirtualDevices;
+}
+
+unsigned int GetVirtualDeviceGlobalUsedSize(VirtualDeviceGlobal* global)
+{
+	if(global->usedCount == 0)
+		return global->size;
+
+	unsigned int usedSize = *global->usedCount * global->elementSize;
+	return usedSize < global->size ? usedSize : global->size;
+}
+
+void SaveVirtualDeviceState(VirtualDevice* device)
+{
+	heepByte* state = device->state;
+	for(unsigned int i = 0; i < NUMBER_OF_VIRTUAL_DEVICE_GLOBALS; i++)
+	{
+		memcpy(state, virtualDeviceGlobals[i].global, GetVirtualDeviceGlobalUsedSize(&virtualDeviceGlobals[i]));
+		state += virtualDeviceGlobals[i].size;
+	}
+}
+
+void LoadVirtualDeviceState(VirtualDevice* device)
+{
+	// A count is loaded before the arrays it sizes
+	heepByte* state = device->state;
+	for(unsigned int i = 0; i < NUMBER_OF_VIRTUAL_DEVICE_GLOBALS; i++)
+	{
+		memcpy(virtualDeviceGlobals[i].global, state, GetVirtualDeviceGlobalUsedSize(&virtualDeviceGlobals[i]));
+		state += virtualDeviceGlobals[i].size;
+	}
+
+	// Derived state is rebuilt rather than saved
+	InvalidateMOPIndex();
+	RebuildControlIndex();
+
+#ifdef USE_IP_DIRECTORY
+	RebuildIPDirectory();
+#endif
+}
+
+void SelectVirtualDevice(int device)
+{
+	if(device == selectedVirtualDevice || device < 0 || device >= numberOfVirtualDevices)
+		return;
+
+	if(selectedVirtualDevice >= 0)
+		SaveVirtualDeviceState(&virtualDevices[selectedVirtualDevice]);
+
+	LoadVirtualDeviceState(&virtualDevices[device]);
+	selectedVirtualDevice = device;
+}
+
+int GetSelectedVirtualDevice()
+{
+	return selectedVirtualDevice;
+}
+
+void SetVirtualDeviceIP(int device, struct HeepIPAddress IP)
+{
+	if(device < 0 || device >= numberOfVirtualDevices)
+		return;
+
+	virtualRoutes.erase(GetVirtualRouteKey(virtualDevices[device].IP));
+	virtualDevices[device].IP = IP;
+	virtualRoutes[GetVirtualRouteKey(IP)] = device;
+}
+
+void GetVirtualDeviceIP(int device, struct HeepIPAddress* IP)
+{
+	if(device < 0 || device >= numberOfVirtualDevices)
+		return;
+
+	*IP = virtualDevices[device].IP;
+}
+
+void SetDefaultVirtualLink(struct VirtualLink link)
+{
+	defaultVirtualLink = link;
+}
+
+void SetVirtualLink(int fromDevice, int toDevice, struct VirtualLink link)
+{
+	virtualLinks[GetVirtualLinkKey(fromDevice, toDevice)] = link;
+}
+
+void SetVirtualNetworkReplies(heepByte sendReplies)
+{
+	virtualNetworkReplies = sendReplies;
+}
+
+void SetVirtualNetworkTransport(VirtualTransport transport)
+{
+	virtualNetworkTransport = transport;
+}
+
+struct VirtualLink* GetVirtualLink(int fromDevice, int toDevice)
+{
+	if(virtualLinks.empty())
+		return &defaultVirtualLink;
+
+	std::unordered_map<uint64_t, VirtualLink>::iterator link = virtualLinks.find(GetVirtualLinkKey(fromDevice, toDevice));
+	if(link == virtualLinks.end())
+		return &defaultVirtualLink;
+
+	return &link->second;
+}
+
+// A controllable simulation clock may have been moved past the network's
+// own time. Datagrams are sent from the later of the two
+void SyncVirtualNetworkTime()
+{
+	if(GetSimulationClockMode() == AutoIncrementClock)
+		return;
+
+	if(simMillis * 1000 > virtualNetworkTimeMicros)
+		virtualNetworkTimeMicros = simMillis * 1000;
+}
+
+void QueueVirtualDatagram(int fromDevice, int toDevice, heepByte* buffer, unsigned int length)
+{
+	SyncVirtualNetworkTime();
+
+	virtualNetworkStats.datagramsSent++;
+	virtualNetworkStats.bytesSent += length;
+
+	struct VirtualLink* link = GetVirtualLink(fromDevice, toDevice);
+
+	if(link->lossPerMillion > 0 && GetVirtualNetworkRandom() % 1000000 < link->lossPerMillion)
+	{
+		virtualNetworkStats.datagramsLost++;
+		return;
+	}
+
+	// Datagrams leave an interface one after another at the link's rate
+	uint64_t departureTime = virtualNetworkTimeMicros;
+	if(link->bytesPerSecond > 0)
+	{
+		VirtualDevice* sender = &virtualDevices[fromDevice];
+		if(sender->interfaceBusyUntil > departureTime)
+			departureTime = sender->interfaceBusyUntil;
+
+		departureTime += ((uint64_t)length * 1000000) / link->bytesPerSecond;
+		sender->interfaceBusyUntil = departureTime;
+	}
+
+	VirtualDatagram datagram;
+	datagram.deliveryTime = departureTime + link->latencyMicros;
+	if(link->jitterMicros > 0)
+		datagram.deliveryTime += GetVirtualNetworkRandom() % (link->jitterMicros + 1);
+
+	datagram.sequence = virtualDatagramSequence++;
+	datagram.fromDevice = fromDevice;
+	datagram.toDevice = toDevice;
+	datagram.length = length;
+	datagram.payload = (heepByte*)malloc(length);
+	memcpy(datagram.payload, buffer, length);
+
+	if(virtualNetworkTransport != 0 && virtualNetworkTransport(datagram.payload, length))
+	{
+		virtualNetworkStats.datagramsLost++;
+		free(datagram.payload);
+		return;
+	}
+
+	virtualDatagrams.push(datagram);
+}
+
+void SendVirtualDatagram(struct HeepIPAddress destIP, heepByte* buffer, unsigned int length)
+{
+	if(!IsVirtualNetworkActive() || selectedVirtualDevice < 0)
+		return;
+
+	std::unordered_map<uint32_t, int>::iterator route = virtualRoutes.find(GetVirtualRouteKey(destIP));
+	if(route == virtualRoutes.end())
+	{
+		virtualNetworkStats.datagramsSent++;
+		virtualNetworkStats.datagramsUnroutable++;
+		return;
+	}
+
+	QueueVirtualDatagram(selectedVirtualDevice, route->second, buffer, length);
+}
+
+void BroadcastVirtualDatagram(heepByte* buffer, unsigned int length)
+{
+	if(!IsVirtualNetworkActive() || selectedVirtualDevice < 0)
+		return;
+
+	int sender = selectedVirtualDevice;
+	for(int i = 0; i < numberOfVirtualDevices; i++)
+	{
+		if(i != sender)
+			QueueVirtualDatagram(sender, i, buffer, length);
+	}
+}
+
+// A datagram arriving at a device is one pass of its main loop:
+// handle the input, reply to the sender, then let the Control Daemon
+// forward anything the network changed
+heepByte ProcessNextVirtualDatagram()
+{
+	if(virtualDatagrams.empty())
+		return 1;
+
+	VirtualDatagram datagram = virtualDatagrams.top();
+	virtualDatagrams.pop();
+
+	if(datagram.deliveryTime > virtualNetworkTimeMicros)
+		virtualNetworkTimeMicros = datagram.deliveryTime;
+
+	SetSimulationClock(virtualNetworkTimeMicros / 1000);
+
+	SelectVirtualDevice(datagram.toDevice);
+
+	unsigned int bytesToCopy = datagram.length;
+	if(bytesToCopy > inputBufferSize)
+		bytesToCopy = inputBufferSize;
+
+	memcpy(inputBuffer, datagram.payload, bytesToCopy);
+	inputBufferLastByte = bytesToCopy;
+	free(datagram.payload);
+
+	virtualNetworkStats.datagramsDelivered++;
+
+	if(HandleHeepCommunications() == 0 && virtualNetworkReplies)
+	{
+		QueueVirtualDatagram(datagram.toDevice, datagram.fromDevice, outputBuffer, outputBufferLastByte);
+	}
+
+	ControlDaemon();
+
+	return 0;
+}
+
+unsigned long RunVirtualNetworkUntil(uint64_t timeMicros)
+{
+	unsigned long datagramsProcessed = 0;
+
+	while(!virtualDatagrams.empty() && virtualDatagrams.top().deliveryTime <= timeMicros)
+	{
+		ProcessNextVirtualDatagram();
+		datagramsProcessed++;
+	}
+
+	if(timeMicros > virtualNetworkTimeMicros)
+		virtualNetworkTimeMicros = timeMicros;
+
+	SetSimulationClock(virtualNetworkTimeMicros / 1000);
+
+	return datagramsProcessed;
+}
+
+unsigned long RunVirtualNetworkUntilIdle(unsigned long maxDatagrams)
+{
+	unsigned long datagramsProcessed = 0;
+
+	while(datagramsProcessed < maxDatagrams && ProcessNextVirtualDatagram() == 0)
+	{
+		datagramsProcessed++;
+	}
+
+	return datagramsProcessed;
+}
+
+heepByte GetNextVirtualDatagramTime(uint64_t* timeMicros)
+{
+	if(virtualDatagrams.empty())
+		return 1;
+
+	*timeMicros = virtualDatagrams.top().deliveryTime;
+	return 0;
+}
+
+uint64_t RunVirtualNetworkToNextDeadline(uint64_t maxMillis)
+{
+	uint64_t deadline = maxMillis;
+
+	uint64_t nextDatagramTime;
+	if(GetNextVirtualDatagramTime(&nextDatagramTime) == 0 && (nextDatagramTime + 999) / 1000 < deadline)
+		deadline = (nextDatagramTime + 999) / 1000;
+
+	deadline = JumpToNextSimulationDeadline(deadline);
+	RunVirtualNetworkUntil(deadline * 1000);
+
+	return deadline;
+}
+
+void GetVirtualNetworkStats(struct VirtualNetworkStats* stats)
+{
+	*stats = virtualNetworkStats;
+}
+
+void ClearVirtualNetworkStats()
+{
+	memset(&virtualNetworkStats, 0, sizeof(virtualNetworkStats));
+}
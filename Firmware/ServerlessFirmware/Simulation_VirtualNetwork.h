@@ -0,0 +1,77 @@
+#pragma once
+#include "CommonDataTypes.h"
+#include "AutoGeneratedInfo.h"
+#include <stdint.h>
+
+// The Virtual Network lets many simulated Heep Devices live in one process.
+// Each device's firmware state is swapped in and out of the global firmware
+// state when it is selected. Datagrams carry real COP/ROP bytes and are
+// delivered by a discrete event loop that also drives the simulated clock.
+// Everything is deterministic for a given seed.
+
+struct VirtualLink
+{
+	unsigned long latencyMicros;
+	unsigned long jitterMicros;		// Uniformly distributed extra delay
+	unsigned long lossPerMillion;	// Chance that a datagram is dropped
+	unsigned long bytesPerSecond;	// Serialisation rate on the sender. 0 is unlimited
+};
+
+struct VirtualNetworkStats
+{
+	unsigned long datagramsSent;
+	unsigned long datagramsDelivered;
+	unsigned long datagramsLost;
+	unsigned long datagramsUnroutable;
+	uint64_t bytesSent;
+};
+
+extern uint64_t virtualNetworkTimeMicros;
+
+void CreateVirtualNetwork(int maxDevices, unsigned long seed);
+void DestroyVirtualNetwork();
+heepByte IsVirtualNetworkActive();
+
+// Returns the new device number or -1 if the network is full
+int AddVirtualDevice(heepByte* deviceID, struct HeepIPAddress IP);
+int GetNumberOfVirtualDevices();
+
+// Load a device's state into the firmware globals. All Heep API calls
+// then act on that device until another device is selected
+void SelectVirtualDevice(int device);
+int GetSelectedVirtualDevice();
+
+void SetVirtualDeviceIP(int device, struct HeepIPAddress IP);
+void GetVirtualDeviceIP(int device, struct HeepIPAddress* IP);
+
+void SetDefaultVirtualLink(struct VirtualLink link);
+void SetVirtualLink(int fromDevice, int toDevice, struct VirtualLink link);
+
+// Reply to every COP with its ROP like a real device does. On by default
+void SetVirtualNetworkReplies(heepByte sendReplies);
+
+// Carries each datagram's payload over a real transport, such as a loopback
+// socket, as it is sent. The payload is received back into the same buffer.
+// Returning 1 drops the datagram. 0 (the default) keeps datagrams in memory
+typedef heepByte (*VirtualTransport)(heepByte* payload, unsigned int length);
+void SetVirtualNetworkTransport(VirtualTransport transport);
+
+// Called by Simulation_HeepComms on behalf of the selected device
+void SendVirtualDatagram(struct HeepIPAddress destIP, heepByte* buffer, unsigned int length);
+void BroadcastVirtualDatagram(heepByte* buffer, unsigned int length);
+
+// Deliver the next datagram. Returns 1 if there was nothing to deliver
+heepByte ProcessNextVirtualDatagram();
+unsigned long RunVirtualNetworkUntil(uint64_t timeMicros);
+unsigned long RunVirtualNetworkUntilIdle(unsigned long maxDatagrams);
+
+// Returns 1 if no datagram is in flight
+heepByte GetNextVirtualDatagramTime(uint64_t* timeMicros);
+
+// JumpToNextSimulationDeadline that also stops at the next datagram and
+// delivers everything due by then. The selected device's scheduler sets
+// the task deadline. Returns the new time in milliseconds
+uint64_t RunVirtualNetworkToNextDeadline(uint64_t maxMillis);
+
+void GetVirtualNetworkStats(struct VirtualNetworkStats* stats);
+void ClearVirtualNetworkStats();
@@ -11,8 +11,10 @@
 
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <ifaddrs.h>
 
 #include "Heep_API.h"
+#include "DeviceSpecificMemory.h"
 
 #include <iostream>
 // using namespace std;
@@ -20,7 +22,8 @@
 struct sockaddr_in si_me, si_other;
 int lastConnectFd = -1;
 char recvBuffer[1500];
-char respondedToLastConnect = 1;
+int recvLength = 0;
+volatile char respondedToLastConnect = 1;
 
 #define BUFLEN 512  //Max length of buffer
 
@@ -30,7 +33,7 @@ void error(const char *msg)
     exit(1);
 }
 
-void die(char *s)
+void die(const char *s)
 {
     perror(s);
     exit(1);
@@ -76,6 +79,8 @@ void CreateServer(int portno)
         {
             die("recvfrom()");
         }
+
+        recvLength = recv_len;
          
 
         respondedToLastConnect = 0;
@@ -126,14 +131,21 @@ void CheckServerForInputs()
 
         int n = 0;
 
-        for(int i = 0; i < 200; i++)
+        for(int i = 0; i < INPUT_BUFFER_SIZE; i++)
         {
           inputBuffer[i] = recvBuffer[i];
         }
 
+        inputBufferLastByte = recvLength < INPUT_BUFFER_SIZE ? recvLength : INPUT_BUFFER_SIZE;
+
+        // Release the receive slot before replying. A sender that waits for
+        // the reply will otherwise have its next COP flagged by the server
+        // thread and then cleared here, dropping it
+        struct sockaddr_in replyAddress = si_other;
+        respondedToLastConnect = 1;
+
         if(HandleHeepCommunications())
         {
-            respondedToLastConnect = 1;
             return;
         }
 
@@ -155,7 +167,7 @@ void CheckServerForInputs()
 #endif
 
         //now reply the client with the same data
-        if (sendto(s, outputBuffer, outputBufferLastByte, 0, (struct sockaddr*) &si_other, slen) == -1)
+        if (sendto(s, outputBuffer, outputBufferLastByte, 0, (struct sockaddr*) &replyAddress, slen) == -1)
         {
             die("sendto()");
         }
@@ -163,7 +175,6 @@ void CheckServerForInputs()
         close(s);
 
         lastConnectFd = -1;
-        respondedToLastConnect = 1;
     }
     
 }
@@ -267,4 +278,61 @@ void SendOutputBufferToIP(HeepIPAddress destIP)
     }
 
     close(s);
-}
\ No newline at end of file
+}
+
+void BroadcastOutputBuffer()
+{
+    int s;
+    struct sockaddr_in broadcast_addr;
+
+    if ((s=socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
+    {
+        die("socket");
+    }
+
+    int broadcastEnable = 1;
+    setsockopt(s, SOL_SOCKET, SO_BROADCAST, &broadcastEnable, sizeof(broadcastEnable));
+
+    memset((char *) &broadcast_addr, 0, sizeof(broadcast_addr));
+    broadcast_addr.sin_family = AF_INET;
+    broadcast_addr.sin_port = htons(TCP_PORT);
+    broadcast_addr.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+
+    sendto(s, outputBuffer, outputBufferLastByte, 0, (struct sockaddr*) &broadcast_addr, sizeof(broadcast_addr));
+
+    close(s);
+}
+
+// Report the first IPv4 address that is not loopback. Falls back to
+// loopback when no network is up
+void GetCurrentIP(struct HeepIPAddress* destIP)
+{
+    destIP->Octet4 = 127;
+    destIP->Octet3 = 0;
+    destIP->Octet2 = 0;
+    destIP->Octet1 = 1;
+
+    struct ifaddrs* interfaceList;
+
+    if(getifaddrs(&interfaceList) == -1)
+        return;
+
+    for(struct ifaddrs* curInterface = interfaceList; curInterface != NULL; curInterface = curInterface->ifa_next)
+    {
+        if(curInterface->ifa_addr == NULL || curInterface->ifa_addr->sa_family != AF_INET)
+            continue;
+
+        unsigned long address = ntohl(((struct sockaddr_in*)curInterface->ifa_addr)->sin_addr.s_addr);
+
+        if((address >> 24) == 127)
+            continue;
+
+        destIP->Octet4 = (address >> 24) & 0xFF;
+        destIP->Octet3 = (address >> 16) & 0xFF;
+        destIP->Octet2 = (address >> 8) & 0xFF;
+        destIP->Octet1 = address & 0xFF;
+        break;
+    }
+
+    freeifaddrs(interfaceList);
+}
@@ -6,3 +6,6 @@ void CreateInterruptServer();
 void CheckServerForInputs();
 
 void SendOutputBufferToIP(struct HeepIPAddress destIP);
+
+void BroadcastOutputBuffer();
+void GetCurrentIP(struct HeepIPAddress* destIP);
@@ -0,0 +1,241 @@
+#include "BenchmarkSystem.h"
+#include "../Heep_API.h"
+#include "../Device.h"
+#include "../DeviceMemory.h"
+#include <stdio.h>
+
+#define NUM_VERTEX_COUNTS 5
+int vertexCounts [NUM_VERTEX_COUNTS] = {0, 1, 8, 32, 64};
+
+#define NUM_CONTROL_COUNTS 4
+int controlCounts [NUM_CONTROL_COUNTS] = {4, 16, 64, NUM_CONTROLS};
+
+char benchmarkControlNames [NUM_CONTROLS][16];
+
+void BenchmarkSendOutputByIDOperation()
+{
+	SendOutputByID(0, benchmarkParameter);
+	benchmarkParameter = !benchmarkParameter;
+}
+
+void BenchmarkSendOutputByID()
+{
+	ClearControls();
+	AddOnOffControl("Switch", HEEP_OUTPUT, 0);
+
+	for(int i = 0; i < NUM_VERTEX_COUNTS; i++)
+	{
+		ClearVertices();
+		ClearDeviceMemory();
+		SetDeviceName("Benchmark");
+
+		for(int j = 0; j < vertexCounts[i]; j++)
+		{
+			if(AddBenchmarkVertex(j + 1, 0) != 0)
+				break;
+		}
+
+		FillVertexListFromMemory();
+
+		BenchmarkParameter parameterList [2];
+		parameterList[0].parameterName = "vertices";
+		parameterList[0].value = numberOfVertices;
+		parameterList[1].parameterName = "filled_bytes";
+		parameterList[1].value = curFilledMemory;
+
+		benchmarkParameter = 0;
+		RunBenchmark("SendOutputByID", parameterList, 2, 0, BenchmarkSendOutputByIDOperation);
+	}
+}
+
+void BenchmarkGetControlValueByNameOperation()
+{
+	GetControlValueByName(benchmarkControlNames[benchmarkParameter]);
+}
+
+void BenchmarkGetControlValueByName()
+{
+	for(int i = 0; i < NUM_CONTROL_COUNTS; i++)
+	{
+		ClearControls();
+
+		for(int j = 0; j < controlCounts[i]; j++)
+		{
+			sprintf(benchmarkControlNames[j], "Control %d", j);
+			AddRangeControl(benchmarkControlNames[j], HEEP_INPUT, 100, 0, j%100);
+		}
+
+		// Looking up the last control is the worst case for a linear search
+		benchmarkParameter = controlCounts[i] - 1;
+
+		BenchmarkParameter parameterList [1];
+		parameterList[0].parameterName = "controls";
+		parameterList[0].value = controlCounts[i];
+
+		RunBenchmark("GetControlValueByName", parameterList, 1, 0, BenchmarkGetControlValueByNameOperation);
+	}
+}
+
+void BenchmarkGetControlValueByHandleOperation()
+{
+	GetControlValueByHandle(benchmarkParameter);
+}
+
+void BenchmarkGetControlValueByHandle()
+{
+	for(int i = 0; i < NUM_CONTROL_COUNTS; i++)
+	{
+		ClearControls();
+
+		for(int j = 0; j < controlCounts[i]; j++)
+		{
+			sprintf(benchmarkControlNames[j], "Control %d", j);
+			AddRangeControl(benchmarkControlNames[j], HEEP_INPUT, 100, 0, j%100);
+		}
+
+		benchmarkParameter = GetControlHandleByName(benchmarkControlNames[controlCounts[i] - 1]);
+
+		BenchmarkParameter parameterList [1];
+		parameterList[0].parameterName = "controls";
+		parameterList[0].value = controlCounts[i];
+
+		RunBenchmark("GetControlValueByHandle", parameterList, 1, 0, BenchmarkGetControlValueByHandleOperation);
+	}
+}
+
+void BenchmarkControlDaemonIdleOperation()
+{
+	ControlDaemon();
+}
+
+// The Control Daemon runs on every pass of the main loop, almost always with nothing to send
+void BenchmarkControlDaemonIdle()
+{
+	ClearVertices();
+	ClearDeviceMemory();
+
+	for(int i = 0; i < NUM_CONTROL_COUNTS; i++)
+	{
+		ClearControls();
+
+		for(int j = 0; j < controlCounts[i]; j++)
+		{
+			sprintf(benchmarkControlNames[j], "Control %d", j);
+			AddOnOffControl(benchmarkControlNames[j], HEEP_INPUT, 0);
+		}
+
+		BenchmarkParameter parameterList [1];
+		parameterList[0].parameterName = "controls";
+		parameterList[0].value = controlCounts[i];
+
+		RunBenchmark("ControlDaemonIdle", parameterList, 1, 0, BenchmarkControlDaemonIdleOperation);
+	}
+}
+
+#define NUM_FRAME_SIZES 2
+int frameSizes [NUM_FRAME_SIZES] = {16, 240};
+
+heepByte benchmarkFrameFront [256];
+heepByte benchmarkFrameBack [256];
+
+void BenchmarkSwapAndSendControlBufferOperation()
+{
+	heepByte* nextFrame = GetControlBackBuffer(0);
+	nextFrame[0]++;
+	SwapAndSendControlBuffer(0, benchmarkParameter);
+}
+
+// An LED strip sending one frame per call to every vertex
+void BenchmarkSwapAndSendControlBuffer()
+{
+	for(int i = 0; i < NUM_FRAME_SIZES; i++)
+	{
+		ClearControls();
+		AddDoubleBufferedControl("Frame", HEEP_OUTPUT, benchmarkFrameFront, benchmarkFrameBack, frameSizes[i]);
+
+		for(int j = 0; j < NUM_VERTEX_COUNTS; j++)
+		{
+			ClearVertices();
+			ClearDeviceMemory();
+			SetDeviceName("Benchmark");
+
+			for(int k = 0; k < vertexCounts[j]; k++)
+			{
+				if(AddBenchmarkVertex(k + 1, 0) != 0)
+					break;
+			}
+
+			FillVertexListFromMemory();
+
+			BenchmarkParameter parameterList [2];
+			parameterList[0].parameterName = "vertices";
+			parameterList[0].value = numberOfVertices;
+			parameterList[1].parameterName = "frame_bytes";
+			parameterList[1].value = frameSizes[i];
+
+			benchmarkParameter = frameSizes[i];
+			RunBenchmark("SwapAndSendControlBuffer", parameterList, 2, 0, BenchmarkSwapAndSendControlBufferOperation);
+		}
+	}
+}
+
+void BenchmarkSendControlSummariesOperation()
+{
+	SendControlSummaries();
+}
+
+// The heartbeat summary, with every vertex going to one device or each to its own
+void BenchmarkSendControlSummaries()
+{
+	ClearControls();
+	AddOnOffControl("Switch", HEEP_OUTPUT, 0);
+
+	for(int i = 0; i < NUM_VERTEX_COUNTS; i++)
+	{
+		for(int destinationsPerVertex = 0; destinationsPerVertex < 2; destinationsPerVertex++)
+		{
+			if(destinationsPerVertex && vertexCounts[i] <= 1)
+				continue;
+
+			ClearVertices();
+			ClearDeviceMemory();
+			SetDeviceName("Benchmark");
+
+			for(int j = 0; j < vertexCounts[i]; j++)
+			{
+				struct Vertex_Byte newVertex;
+				CopyDeviceID(deviceIDByte, newVertex.txID);
+				CreateBenchmarkDeviceID(newVertex.rxID, destinationsPerVertex ? j + 1 : 1);
+				newVertex.txControlID = 0;
+				newVertex.rxControlID = j;
+				newVertex.rxIPAddress.Octet4 = 10;
+				newVertex.rxIPAddress.Octet3 = 0;
+				newVertex.rxIPAddress.Octet2 = 0;
+				newVertex.rxIPAddress.Octet1 = destinationsPerVertex ? j + 1 : 1;
+
+				if(AddVertex(newVertex) != 0)
+					break;
+			}
+
+			FillVertexListFromMemory();
+
+			BenchmarkParameter parameterList [2];
+			parameterList[0].parameterName = "vertices";
+			parameterList[0].value = numberOfVertices;
+			parameterList[1].parameterName = "destinations";
+			parameterList[1].value = destinationsPerVertex ? numberOfVertices : numberOfVertices > 0;
+
+			RunBenchmark("SendControlSummaries", parameterList, 2, 0, BenchmarkSendControlSummariesOperation);
+		}
+	}
+}
+
+void BenchmarkHeepAPI()
+{
+	BenchmarkSendOutputByID();
+	BenchmarkGetControlValueByName();
+	BenchmarkGetControlValueByHandle();
+	BenchmarkControlDaemonIdle();
+	BenchmarkSwapAndSendControlBuffer();
+	BenchmarkSendControlSummaries();
+}
@@ -0,0 +1,277 @@
+#include "BenchmarkSystem.h"
+#include "../ActionAndResponseOpCodes.h"
+#include "../DeviceMemory.h"
+#include "../MemoryUtilities.h"
+#include "../AutoGeneratedInfo.h"
+#include "../DeviceSpecificMemory.h"
+#include "../Device.h"
+#include "../Heep_API.h"
+
+void BenchmarkMemoryDumpOperation()
+{
+	FillOutputBufferWithMemoryDump();
+}
+
+void BenchmarkMemoryDump()
+{
+	ClearControls();
+	AddOnOffControl("Switch", HEEP_INPUT, 0);
+	AddOnOffControl("Light", HEEP_OUTPUT, 0);
+	AddRangeControl("Dimmer", HEEP_INPUT, 100, 0, 50);
+	AddRangeControl("Sensor", HEEP_OUTPUT, 255, 0, 0);
+
+	for(int i = 0; i < NUM_FILL_LEVELS; i++)
+	{
+		FillMemoryToLevel(fillLevels[i]);
+
+		// A dump that does not fit is cut short, so only measure levels that fit in the output buffer
+		if(curFilledMemory + CalculateCoreMemorySize() + STANDARD_ID_SIZE + 2 > OUTPUT_BUFFER_SIZE)
+			continue;
+
+		BenchmarkParameter parameterList [2];
+		parameterList[0].parameterName = "fill_percent";
+		parameterList[0].value = fillLevels[i];
+		parameterList[1].parameterName = "filled_bytes";
+		parameterList[1].value = curFilledMemory;
+
+		RunBenchmark("FillOutputBufferWithMemoryDump", parameterList, 2, 0, BenchmarkMemoryDumpOperation);
+	}
+}
+
+void FillInputBufferWithSetVertexCOP(int remoteDeviceNumber)
+{
+	unsigned int counter = 0;
+	counter = AddCharToBuffer(inputBuffer, counter, SetVertexOpCode);
+	counter = AddCharToBuffer(inputBuffer, counter, 2*STANDARD_ID_SIZE + 6);
+	counter = AddDeviceIDToBuffer_Byte(inputBuffer, deviceIDByte, counter);
+
+	heepByte rxID [STANDARD_ID_SIZE];
+	CreateBenchmarkDeviceID(rxID, remoteDeviceNumber);
+	counter = AddDeviceIDToBuffer_Byte(inputBuffer, rxID, counter);
+
+	counter = AddCharToBuffer(inputBuffer, counter, 0);
+	counter = AddCharToBuffer(inputBuffer, counter, 1);
+	counter = AddCharToBuffer(inputBuffer, counter, 10);
+	counter = AddCharToBuffer(inputBuffer, counter, 0);
+	counter = AddCharToBuffer(inputBuffer, counter, 0);
+	counter = AddCharToBuffer(inputBuffer, counter, 1);
+}
+
+void SetupSetVertexCOP()
+{
+	RestoreMemorySnapshot();
+	FillInputBufferWithSetVertexCOP(benchmarkParameter);
+}
+
+void BenchmarkSetVertexOperation()
+{
+	ExecuteSetVertexOpCode();
+}
+
+void BenchmarkSetVertexOpCode()
+{
+	for(int i = 0; i < NUM_FILL_LEVELS; i++)
+	{
+		FillMemoryToLevel(fillLevels[i]);
+		TakeMemorySnapshot();
+
+		// A brand new remote device, so indexed builds must also create its index
+		benchmarkParameter = GetNumberOfBenchmarkRemoteDevices() + 1;
+
+		BenchmarkParameter parameterList [2];
+		parameterList[0].parameterName = "fill_percent";
+		parameterList[0].value = fillLevels[i];
+		parameterList[1].parameterName = "filled_bytes";
+		parameterList[1].value = curFilledMemory;
+
+		RunBenchmark("ExecuteSetVertexOpCode", parameterList, 2, SetupSetVertexCOP, BenchmarkSetVertexOperation);
+	}
+}
+
+#define PROVISIONING_BATCH_SIZE 8
+
+void FillInputBufferWithSetVerticesCOP(int firstRemoteDeviceNumber)
+{
+	unsigned int counter = 0;
+	counter = AddCharToBuffer(inputBuffer, counter, SetVerticesOpCode);
+	counter = AddCharToBuffer(inputBuffer, counter, PROVISIONING_BATCH_SIZE*(2*STANDARD_ID_SIZE + 6));
+
+	for(int i = 0; i < PROVISIONING_BATCH_SIZE; i++)
+	{
+		counter = AddDeviceIDToBuffer_Byte(inputBuffer, deviceIDByte, counter);
+
+		heepByte rxID [STANDARD_ID_SIZE];
+		CreateBenchmarkDeviceID(rxID, firstRemoteDeviceNumber + i);
+		counter = AddDeviceIDToBuffer_Byte(inputBuffer, rxID, counter);
+
+		counter = AddCharToBuffer(inputBuffer, counter, 0);
+		counter = AddCharToBuffer(inputBuffer, counter, 1);
+		counter = AddCharToBuffer(inputBuffer, counter, 10);
+		counter = AddCharToBuffer(inputBuffer, counter, 0);
+		counter = AddCharToBuffer(inputBuffer, counter, 0);
+		counter = AddCharToBuffer(inputBuffer, counter, 1);
+	}
+}
+
+void SetupProvisionVertices()
+{
+	RestoreMemorySnapshot();
+}
+
+// A Set Vertex COP and its ROP for each vertex
+void BenchmarkProvisionVerticesOneAtATime()
+{
+	int firstRemoteDeviceNumber = GetNumberOfBenchmarkRemoteDevices() + 1;
+
+	for(int i = 0; i < PROVISIONING_BATCH_SIZE; i++)
+	{
+		FillInputBufferWithSetVertexCOP(firstRemoteDeviceNumber + i);
+		ExecuteSetVertexOpCode();
+	}
+}
+
+void BenchmarkProvisionVerticesBatched()
+{
+	FillInputBufferWithSetVerticesCOP(GetNumberOfBenchmarkRemoteDevices() + 1);
+	ExecuteSetVerticesOpCode();
+}
+
+void BenchmarkProvisionVertices()
+{
+	for(int i = 0; i < NUM_FILL_LEVELS - 1; i++)
+	{
+		FillMemoryToLevel(fillLevels[i]);
+		TakeMemorySnapshot();
+
+		BenchmarkParameter parameterList [4];
+		parameterList[0].parameterName = "fill_percent";
+		parameterList[0].value = fillLevels[i];
+		parameterList[1].parameterName = "filled_bytes";
+		parameterList[1].value = curFilledMemory;
+		parameterList[2].parameterName = "vertices";
+		parameterList[2].value = PROVISIONING_BATCH_SIZE;
+
+		parameterList[3].parameterName = "batched";
+		parameterList[3].value = 0;
+		RunBenchmark("ProvisionVertices", parameterList, 4, SetupProvisionVertices, BenchmarkProvisionVerticesOneAtATime);
+
+		parameterList[3].value = 1;
+		RunBenchmark("ProvisionVertices", parameterList, 4, SetupProvisionVertices, BenchmarkProvisionVerticesBatched);
+	}
+}
+
+void SetupDeleteVertexCOP()
+{
+	RestoreMemorySnapshot();
+	FillInputBufferWithSetVertexCOP(benchmarkParameter);
+	inputBuffer[0] = DeleteVertexOpCode;
+}
+
+void BenchmarkDeleteVertexOperation()
+{
+	ExecuteDeleteVertexOpCode();
+}
+
+void BenchmarkDeleteVertexOpCode()
+{
+	for(int i = 1; i < NUM_FILL_LEVELS; i++)
+	{
+		FillMemoryToLevel(fillLevels[i]);
+		TakeMemorySnapshot();
+
+		// The last vertex added, which a search from the front reaches last
+		benchmarkParameter = GetNumberOfBenchmarkRemoteDevices();
+
+		BenchmarkParameter parameterList [2];
+		parameterList[0].parameterName = "fill_percent";
+		parameterList[0].value = fillLevels[i];
+		parameterList[1].parameterName = "filled_bytes";
+		parameterList[1].value = curFilledMemory;
+
+		RunBenchmark("ExecuteDeleteVertexOpCode", parameterList, 2, SetupDeleteVertexCOP, BenchmarkDeleteVertexOperation);
+	}
+}
+
+void FillInputBufferWithDeleteNameMOPCOP()
+{
+	char deviceName [] = "Benchmark";
+	int nameLength = strlen(deviceName);
+
+	unsigned int counter = 0;
+	counter = AddCharToBuffer(inputBuffer, counter, DeleteMOPOpCode);
+	counter = AddCharToBuffer(inputBuffer, counter, 1 + STANDARD_ID_SIZE + 1 + nameLength);
+	counter = AddCharToBuffer(inputBuffer, counter, DeviceNameOpCode);
+	counter = AddDeviceIDToBuffer_Byte(inputBuffer, deviceIDByte, counter);
+	counter = AddCharToBuffer(inputBuffer, counter, nameLength);
+
+	for(int i = 0; i < nameLength; i++)
+	{
+		counter = AddCharToBuffer(inputBuffer, counter, deviceName[i]);
+	}
+}
+
+void SetupDeleteMOPCOP()
+{
+	RestoreMemorySnapshot();
+	FillInputBufferWithDeleteNameMOPCOP();
+}
+
+void BenchmarkDeleteMOPOperation()
+{
+	ExecuteDeleteMOPOpCode();
+}
+
+void BenchmarkDeleteMOPOpCode()
+{
+	for(int i = 0; i < NUM_FILL_LEVELS; i++)
+	{
+		FillMemoryToLevel(fillLevels[i]);
+		TakeMemorySnapshot();
+
+		BenchmarkParameter parameterList [2];
+		parameterList[0].parameterName = "fill_percent";
+		parameterList[0].value = fillLevels[i];
+		parameterList[1].parameterName = "filled_bytes";
+		parameterList[1].value = curFilledMemory;
+
+		RunBenchmark("ExecuteDeleteMOPOpCode", parameterList, 2, SetupDeleteMOPCOP, BenchmarkDeleteMOPOperation);
+	}
+}
+
+void FillInputBufferWithSetValCOP()
+{
+	unsigned int counter = 0;
+	counter = AddCharToBuffer(inputBuffer, counter, SetValueOpCode);
+	counter = AddCharToBuffer(inputBuffer, counter, 2);
+	counter = AddCharToBuffer(inputBuffer, counter, controlList[0].controlID);
+	counter = AddCharToBuffer(inputBuffer, counter, 1);
+}
+
+void BenchmarkSetValOperation()
+{
+	ExecuteSetValOpCode();
+}
+
+// The reply to a SetVal is a success ROP, so this is mostly response building
+void BenchmarkSetValOpCode()
+{
+	ClearControls();
+	AddOnOffControl("Light", HEEP_OUTPUT, 0);
+	FillInputBufferWithSetValCOP();
+
+	BenchmarkParameter parameterList [1];
+	parameterList[0].parameterName = "controls";
+	parameterList[0].value = numberOfControls;
+
+	RunBenchmark("ExecuteSetValOpCode", parameterList, 1, 0, BenchmarkSetValOperation);
+}
+
+void BenchmarkActionAndResponseOpCodes()
+{
+	BenchmarkMemoryDump();
+	BenchmarkSetValOpCode();
+	BenchmarkSetVertexOpCode();
+	BenchmarkDeleteVertexOpCode();
+	BenchmarkProvisionVertices();
+	BenchmarkDeleteMOPOpCode();
+}
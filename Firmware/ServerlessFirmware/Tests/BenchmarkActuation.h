@@ -0,0 +1,256 @@
+#include "BenchmarkSystem.h"
+#include "../Heep_API.h"
+#include "../Device.h"
+#include "../DeviceMemory.h"
+#include "../Scheduler.h"
+#include "../Simulation_Timer.h"
+#include "../Simulation_VirtualNetwork.h"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+// Press a switch on one device and time how long it takes for the light on
+// another device to turn on: SetControlValueByName -> SendOutputByID ->
+// transport -> ExecuteSetValOpCode -> ControlDaemon. Both devices live on a
+// virtual network, so the time spent switching between their states is part
+// of every sample.
+
+#define NUM_ACTUATION_VERTEX_COUNTS 3
+int actuationVertexCounts [NUM_ACTUATION_VERTEX_COUNTS] = {1, 8, 32};
+
+#define NUM_ACTUATION_FILL_LEVELS 2
+int actuationFillLevels [NUM_ACTUATION_FILL_LEVELS] = {50, 90}; // Percent of MAX_MEMORY
+
+// Percent of actuations that arrive on a main loop pass with a task due
+#define NUM_ACTUATION_SCHEDULER_LOADS 3
+int actuationSchedulerLoads [NUM_ACTUATION_SCHEDULER_LOADS] = {0, 10, 100};
+
+#define ACTUATION_SENDER 0
+#define ACTUATION_RECEIVER 1
+#define ACTUATION_SWITCH_ID 0
+#define ACTUATION_SPARE_ID 1
+#define ACTUATION_LIGHT_ID 0
+#define ACTUATION_PAD_SIZE 32
+
+int actuationSchedulerLoad = 0;
+int actuationLoadAccumulator = 0;
+int actuationValue = 0;
+
+// Socket transport. Socket_HeepComms holds a single device per process, so
+// the pair shares one loopback UDP socket that every datagram is sent
+// through and read back from
+int actuationSocket = -1;
+struct sockaddr_in actuationSocketAddress;
+
+heepByte SendOverLoopbackSocket(heepByte* payload, unsigned int length)
+{
+	if(sendto(actuationSocket, payload, length, 0, (struct sockaddr*)&actuationSocketAddress, sizeof(actuationSocketAddress)) != (ssize_t)length)
+		return 1;
+
+	if(recv(actuationSocket, payload, length, 0) != (ssize_t)length)
+		return 1;
+
+	return 0;
+}
+
+heepByte OpenLoopbackSocket()
+{
+	actuationSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if(actuationSocket == -1)
+		return 1;
+
+	memset(&actuationSocketAddress, 0, sizeof(actuationSocketAddress));
+	actuationSocketAddress.sin_family = AF_INET;
+	actuationSocketAddress.sin_port = 0;
+	actuationSocketAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	socklen_t addressLength = sizeof(actuationSocketAddress);
+	if(bind(actuationSocket, (struct sockaddr*)&actuationSocketAddress, addressLength)
+		|| getsockname(actuationSocket, (struct sockaddr*)&actuationSocketAddress, &addressLength))
+	{
+		close(actuationSocket);
+		actuationSocket = -1;
+		return 1;
+	}
+
+	// A lost datagram shows up as a missed actuation rather than a hang
+	struct timeval receiveTimeout = {0, 100000};
+	setsockopt(actuationSocket, SOL_SOCKET, SO_RCVTIMEO, &receiveTimeout, sizeof(receiveTimeout));
+
+	return 0;
+}
+
+void CloseLoopbackSocket()
+{
+	if(actuationSocket != -1)
+		close(actuationSocket);
+
+	actuationSocket = -1;
+}
+
+heepByte AddActuationVertex(heepByte txControlID, heepByte rxControlID)
+{
+	struct Vertex_Byte newVertex;
+	CreateBenchmarkNetworkDeviceID(newVertex.txID, ACTUATION_SENDER);
+	CreateBenchmarkNetworkDeviceID(newVertex.rxID, ACTUATION_RECEIVER);
+	newVertex.txControlID = txControlID;
+	newVertex.rxControlID = rxControlID;
+	newVertex.rxIPAddress = CreateBenchmarkNetworkIP(ACTUATION_RECEIVER);
+	return AddVertex(newVertex);
+}
+
+// User memory fills the device without adding vertices that would be scanned
+void PadActuationMemory(int percentFull)
+{
+	heepByte pad [ACTUATION_PAD_SIZE];
+	memset(pad, 0, ACTUATION_PAD_SIZE);
+
+	unsigned int targetMemory = (MAX_MEMORY * percentFull) / 100;
+
+	while(curFilledMemory + ACTUATION_PAD_SIZE + ID_SIZE + 2 <= targetMemory)
+	{
+		if(AddUserMemory(0, pad, ACTUATION_PAD_SIZE) != 0)
+			break;
+	}
+}
+
+void SetupActuationDevice(int device)
+{
+	heepByte deviceID [STANDARD_ID_SIZE];
+	CreateBenchmarkNetworkDeviceID(deviceID, device);
+
+	SelectVirtualDevice(AddVirtualDevice(deviceID, CreateBenchmarkNetworkIP(device)));
+	ClearVertices();
+	ClearDeviceMemory();
+	ClearControls();
+	SetDeviceName("Actuation");
+	SetIPInMemory_Byte(CreateBenchmarkNetworkIP(device), deviceIDByte);
+}
+
+// The sender's switch has one vertex to the light. Every other vertex hangs
+// off a spare control, so it is scanned on each send but never fires
+void CreateActuationNetwork(int numberOfVertices, int fillPercent)
+{
+	CreateVirtualNetwork(2, 1);
+
+	SetupActuationDevice(ACTUATION_SENDER);
+	AddOnOffControl("Switch", HEEP_OUTPUT, 0);
+	AddOnOffControl("Spare", HEEP_OUTPUT, 0);
+
+	for(int i = 1; i < numberOfVertices; i++)
+	{
+		AddActuationVertex(ACTUATION_SPARE_ID, i);
+	}
+
+	AddActuationVertex(ACTUATION_SWITCH_ID, ACTUATION_LIGHT_ID);
+
+	SetupActuationDevice(ACTUATION_RECEIVER);
+	AddOnOffControl("Light", HEEP_INPUT, 0);
+
+	for(int i = 0; i < GetNumberOfVirtualDevices(); i++)
+	{
+		SelectVirtualDevice(i);
+		PadActuationMemory(fillPercent);
+		FillVertexListFromMemory();
+
+		curNumberOfTasks = 0;
+		curTaskCounter = 0;
+		lastMillis = 0;
+		SetupHeepTasks();
+	}
+
+	SetSimulationClockMode(ManualClock);
+	SetSimulationClock(0);
+
+	actuationLoadAccumulator = 0;
+	actuationValue = 0;
+}
+
+// Untimed: let the sender swallow the last reply, then decide whether the
+// receiver has a task due when the next actuation lands
+void SetupActuationOperation()
+{
+	RunVirtualNetworkUntilIdle(4);
+
+	actuationLoadAccumulator += actuationSchedulerLoad;
+	if(actuationLoadAccumulator >= 100)
+	{
+		actuationLoadAccumulator -= 100;
+		AdvanceSimulationClock(taskInterval + 1);
+	}
+
+	actuationValue = !actuationValue;
+}
+
+// One pass of the receiver's main loop: scheduled tasks, then the input
+void BenchmarkActuationOperation()
+{
+	SelectVirtualDevice(ACTUATION_SENDER);
+	SetControlValueByName("Switch", actuationValue);
+
+	SelectVirtualDevice(ACTUATION_RECEIVER);
+	PerformHeepTasks();
+	ProcessNextVirtualDatagram();
+}
+
+// Run the same actuations untimed and count the ones the light missed
+void AddActuationMetrics(int actuations)
+{
+	unsigned long missedActuations = 0;
+
+	for(int i = 0; i < actuations; i++)
+	{
+		SetupActuationOperation();
+		BenchmarkActuationOperation();
+
+		if(GetControlValueByID(ACTUATION_LIGHT_ID) != actuationValue)
+			missedActuations++;
+	}
+
+	AddBenchmarkMetric("missed_actuations", missedActuations);
+}
+
+void BenchmarkActuationTransport(std::string benchmarkName, VirtualTransport transport)
+{
+	for(int i = 0; i < NUM_ACTUATION_VERTEX_COUNTS; i++)
+	{
+		for(int j = 0; j < NUM_ACTUATION_FILL_LEVELS; j++)
+		{
+			for(int k = 0; k < NUM_ACTUATION_SCHEDULER_LOADS; k++)
+			{
+				CreateActuationNetwork(actuationVertexCounts[i], actuationFillLevels[j]);
+				SetVirtualNetworkTransport(transport);
+				actuationSchedulerLoad = actuationSchedulerLoads[k];
+
+				AddActuationMetrics(100);
+
+				BenchmarkParameter parameterList [3];
+				parameterList[0].parameterName = "vertices";
+				parameterList[0].value = actuationVertexCounts[i];
+				parameterList[1].parameterName = "fill_percent";
+				parameterList[1].value = actuationFillLevels[j];
+				parameterList[2].parameterName = "scheduler_load_percent";
+				parameterList[2].value = actuationSchedulerLoads[k];
+
+				RunLatencyBenchmark(benchmarkName, parameterList, 3, SetupActuationOperation, BenchmarkActuationOperation);
+
+				DestroyVirtualNetwork();
+			}
+		}
+	}
+
+	ResetSimulationClock();
+}
+
+void BenchmarkActuation()
+{
+	BenchmarkActuationTransport("ActuationLatencySimulation", 0);
+
+	if(OpenLoopbackSocket() == 0)
+	{
+		BenchmarkActuationTransport("ActuationLatencyLoopbackSocket", SendOverLoopbackSocket);
+		CloseLoopbackSocket();
+	}
+}
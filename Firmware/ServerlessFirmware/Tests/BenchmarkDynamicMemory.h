@@ -0,0 +1,242 @@
+#include "BenchmarkSystem.h"
+#include "../ActionAndResponseOpCodes.h"
+#include "../DeviceMemory.h"
+#include "../MemoryUtilities.h"
+#include "../AutoGeneratedInfo.h"
+#include "../DeviceSpecificMemory.h"
+#include "../Device.h"
+#include "../Heep_API.h"
+#include <string.h>
+
+#define NUM_FILL_LEVELS 5
+int fillLevels [NUM_FILL_LEVELS] = {0, 25, 50, 75, 90}; // Percent of MAX_MEMORY
+
+heepByte snapshotMemory [MAX_MEMORY];
+unsigned int snapshotFilledMemory = 0;
+unsigned int snapshotFragmentedMemory = 0;
+unsigned int snapshotVertexPointers [NUM_VERTICES];
+unsigned int snapshotNumberOfVertices = 0;
+struct VertexIndexEntry snapshotVertexIndex [VERTEX_INDEX_SIZE];
+
+void TakeMemorySnapshot()
+{
+	memcpy(snapshotMemory, deviceMemory, curFilledMemory);
+	snapshotFilledMemory = curFilledMemory;
+	snapshotFragmentedMemory = fragmentedMemory;
+	memcpy(snapshotVertexPointers, vertexPointerList, numberOfVertices * sizeof(unsigned int));
+	snapshotNumberOfVertices = numberOfVertices;
+	memcpy(snapshotVertexIndex, vertexIndex, sizeof(snapshotVertexIndex));
+}
+
+void RestoreMemorySnapshot()
+{
+	memcpy(deviceMemory, snapshotMemory, snapshotFilledMemory);
+	curFilledMemory = snapshotFilledMemory;
+	fragmentedMemory = snapshotFragmentedMemory;
+	memcpy(vertexPointerList, snapshotVertexPointers, snapshotNumberOfVertices * sizeof(unsigned int));
+	numberOfVertices = snapshotNumberOfVertices;
+	memcpy(vertexIndex, snapshotVertexIndex, sizeof(snapshotVertexIndex));
+
+	// Fragmenting unindexes MOPs, so the index no longer matches the restored
+	// memory. It is rebuilt here so that the operation does not pay for it
+	InvalidateMOPIndex();
+	UpdateMOPIndex();
+}
+
+void CreateBenchmarkDeviceID(heepByte* deviceID, int deviceNumber)
+{
+	deviceID[0] = 0xB0;
+	deviceID[1] = (deviceNumber >> 16)%256;
+	deviceID[2] = (deviceNumber >> 8)%256;
+	deviceID[3] = deviceNumber%256;
+}
+
+// Vertex from this device to a remote device. Each remote device is new, so
+// indexed builds also pay for a Local Device ID MOP per vertex
+heepByte AddBenchmarkVertex(int remoteDeviceNumber, heepByte txControlID)
+{
+	struct Vertex_Byte newVertex;
+	CopyDeviceID(deviceIDByte, newVertex.txID);
+	CreateBenchmarkDeviceID(newVertex.rxID, remoteDeviceNumber);
+	newVertex.txControlID = txControlID;
+	newVertex.rxControlID = 1;
+	newVertex.rxIPAddress.Octet4 = 10;
+	newVertex.rxIPAddress.Octet3 = 0;
+	newVertex.rxIPAddress.Octet2 = (remoteDeviceNumber >> 8)%256;
+	newVertex.rxIPAddress.Octet1 = remoteDeviceNumber%256;
+
+	return AddVertex(newVertex);
+}
+
+// Start from a fresh device and add vertices to new remote devices until
+// the requested percentage of device memory is filled
+void FillMemoryToLevel(int percentFull)
+{
+	ClearVertices();
+	ClearDeviceMemory();
+	SetDeviceName("Benchmark");
+
+	unsigned int targetMemory = (MAX_MEMORY * percentFull) / 100;
+
+	int remoteDeviceNumber = 1;
+	while(curFilledMemory < targetMemory)
+	{
+		if(AddBenchmarkVertex(remoteDeviceNumber, 0) != 0)
+			break;
+
+		remoteDeviceNumber++;
+	}
+
+	FillVertexListFromMemory();
+}
+
+int GetNumberOfBenchmarkRemoteDevices()
+{
+	return numberOfVertices;
+}
+
+void SetupFragmentedMemory()
+{
+	RestoreMemorySnapshot();
+}
+
+void BenchmarkDefragmentMemoryOperation()
+{
+	DefragmentMemory();
+}
+
+void BenchmarkDefragmentMemory()
+{
+	for(int i = 0; i < NUM_FILL_LEVELS; i++)
+	{
+		FillMemoryToLevel(fillLevels[i]);
+
+		// Fragment every other vertex so that the defragmenter has to move memory
+		for(int j = 0; j < numberOfVertices; j += 2)
+		{
+			DeleteVertexAtPointer(vertexPointerList[j]);
+		}
+
+		TakeMemorySnapshot();
+
+		BenchmarkParameter parameterList [2];
+		parameterList[0].parameterName = "fill_percent";
+		parameterList[0].value = fillLevels[i];
+		parameterList[1].parameterName = "filled_bytes";
+		parameterList[1].value = curFilledMemory;
+
+		RunBenchmark("DefragmentMemory", parameterList, 2, SetupFragmentedMemory, BenchmarkDefragmentMemoryOperation);
+	}
+}
+
+void BenchmarkGetIndexedDeviceIDOperation()
+{
+	heepByte lookupID [STANDARD_ID_SIZE];
+	CreateBenchmarkDeviceID(lookupID, benchmarkParameter);
+	GetIndexedDeviceID_Byte(lookupID);
+}
+
+void BenchmarkGetIndexedDeviceID()
+{
+	for(int i = 0; i < NUM_FILL_LEVELS; i++)
+	{
+		FillMemoryToLevel(fillLevels[i]);
+
+		// Look up the most recently indexed device. This is the worst case for the memory scan
+		benchmarkParameter = GetNumberOfBenchmarkRemoteDevices();
+
+		BenchmarkParameter parameterList [2];
+		parameterList[0].parameterName = "fill_percent";
+		parameterList[0].value = fillLevels[i];
+		parameterList[1].parameterName = "filled_bytes";
+		parameterList[1].value = curFilledMemory;
+
+		RunBenchmark("GetIndexedDeviceID_Byte", parameterList, 2, 0, BenchmarkGetIndexedDeviceIDOperation);
+	}
+}
+
+unsigned int foundMOPPointers [MAX_MEMORY];
+
+void BenchmarkFindMOPsWithOpCodeOperation()
+{
+	FindMOPsWithOpCode(DeviceNameOpCode, foundMOPPointers, MAX_MEMORY);
+}
+
+// The walk FindMOPsWithOpCode replaces on host builds
+void BenchmarkMOPWalkOperation()
+{
+	unsigned int numberFound = 0;
+	unsigned int pointer = 0;
+	unsigned int counter = 0;
+	while(GetMOPPointer(DeviceNameOpCode, &pointer, &counter) == 0)
+	{
+		foundMOPPointers[numberFound++] = pointer;
+	}
+}
+
+void BenchmarkFindMOPsWithOpCode()
+{
+	for(int i = 0; i < NUM_FILL_LEVELS; i++)
+	{
+		FillMemoryToLevel(fillLevels[i]);
+
+		BenchmarkParameter parameterList [2];
+		parameterList[0].parameterName = "fill_percent";
+		parameterList[0].value = fillLevels[i];
+		parameterList[1].parameterName = "filled_bytes";
+		parameterList[1].value = curFilledMemory;
+
+		RunBenchmark("FindMOPsWithOpCode", parameterList, 2, 0, BenchmarkFindMOPsWithOpCodeOperation);
+		RunBenchmark("GetMOPPointerWalk", parameterList, 2, 0, BenchmarkMOPWalkOperation);
+	}
+}
+
+heepByte missingUserMOP [ID_SIZE + 3];
+
+void BenchmarkDeleteMissingMOPOperation()
+{
+	DeleteMOPsEqualTo(missingUserMOP, sizeof(missingUserMOP));
+}
+
+// Memory full of the smallest user MOPs holds more MOPs than the MOP index
+// has slots for, so the fuller levels take the path for a full index.
+// Nothing is deleted, so every iteration sees the same memory
+void BenchmarkDeleteMOPsWithFullIndex()
+{
+	for(int i = 0; i < NUM_FILL_LEVELS; i++)
+	{
+		ClearVertices();
+		ClearDeviceMemory();
+
+		unsigned int numberOfMOPs = 0;
+		while(curFilledMemory + ID_SIZE + 3 <= (MAX_MEMORY * fillLevels[i]) / 100)
+		{
+			heepByte userData = numberOfMOPs % 0xFF;
+			AddUserMemory(0, &userData, 1);
+			numberOfMOPs++;
+		}
+
+		missingUserMOP[0] = USER_MOP_START_ID;
+		memset(&missingUserMOP[1], 0xFF, ID_SIZE);
+		missingUserMOP[ID_SIZE + 1] = 1;
+		missingUserMOP[ID_SIZE + 2] = 0xFF;
+
+		BenchmarkParameter parameterList [3];
+		parameterList[0].parameterName = "fill_percent";
+		parameterList[0].value = fillLevels[i];
+		parameterList[1].parameterName = "mops";
+		parameterList[1].value = numberOfMOPs;
+		parameterList[2].parameterName = "index_slots";
+		parameterList[2].value = MOP_INDEX_SIZE;
+
+		RunBenchmark("DeleteMOPsEqualTo", parameterList, 3, 0, BenchmarkDeleteMissingMOPOperation);
+	}
+}
+
+void BenchmarkDynamicMemory()
+{
+	BenchmarkDefragmentMemory();
+	BenchmarkGetIndexedDeviceID();
+	BenchmarkFindMOPsWithOpCode();
+	BenchmarkDeleteMOPsWithFullIndex();
+}
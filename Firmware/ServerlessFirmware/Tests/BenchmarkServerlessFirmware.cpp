@@ -0,0 +1,45 @@
+#include "BenchmarkDynamicMemory.h"
+#include "BenchmarkActionAndResponseOpCodes.h"
+#include "BenchmarkAPI.h"
+#include "BenchmarkVirtualNetwork.h"
+#include "BenchmarkUptime.h"
+#include "BenchmarkActuation.h"
+
+unsigned char clearMemory = 1;
+heepByte deviceIDByte [STANDARD_ID_SIZE] = {0x01, 0x02, 0x33, 0x04};
+uint8_t mac[6] = {0x01,0x02,0x03,0x04,0x45,0x06};
+heepByte base64DeviceIDByte [STANDARD_ID_SIZE_BASE_64];
+
+// Usage: Benchmark.app [label]
+// The label (usually a commit hash) is copied into the report so that
+// results from different commits can be compared
+int main(int argc, char* argv[])
+{
+#ifdef USE_INDEXED_IDS
+	std::string profile = "indexed";
+#else
+	std::string profile = "unindexed";
+#endif
+
+	// Builds with other sizes than DeviceSpecificMemory.h name their profile
+#ifdef HEEP_PROFILE_NAME
+	profile = profile + "-" + HEEP_PROFILE_NAME;
+#endif
+
+	std::string label = "";
+	if(argc > 1)
+		label = argv[1];
+
+	BeginBenchmarkReport(profile, label);
+
+	BenchmarkDynamicMemory();
+	BenchmarkActionAndResponseOpCodes();
+	BenchmarkHeepAPI();
+	BenchmarkVirtualNetwork();
+	BenchmarkUptime();
+	BenchmarkActuation();
+
+	EndBenchmarkReport();
+
+	return 0;
+}
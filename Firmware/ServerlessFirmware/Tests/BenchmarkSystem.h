@@ -0,0 +1,235 @@
+#ifndef BENCHMARK_SYSTEM_H
+#define BENCHMARK_SYSTEM_H
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <new>
+#include <algorithm>
+#include <stdlib.h>
+
+using namespace std;
+
+// Minimum wall time spent in each benchmark so that short operations
+// are averaged over enough iterations to be stable
+#define BENCHMARK_MIN_NANOSECONDS 20000000ULL
+#define BENCHMARK_MAX_ITERATIONS 10000000
+#define BENCHMARK_BATCH_SIZE 100
+
+// Latency benchmarks keep every sample so that the tail can be reported
+#define BENCHMARK_LATENCY_SAMPLES 20000
+#define BENCHMARK_LATENCY_WARMUP 200
+
+// The Heep core never allocates, so any heap use showing up here is a regression
+unsigned long benchmarkAllocations = 0;
+
+void* operator new(size_t size)
+{
+	benchmarkAllocations++;
+	void* memory = malloc(size);
+	if(memory == 0)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	benchmarkAllocations++;
+	void* memory = malloc(size);
+	if(memory == 0)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t size) noexcept { free(memory); }
+void operator delete[](void* memory, size_t size) noexcept { free(memory); }
+
+struct BenchmarkParameter
+{
+	std::string parameterName;
+	long value;
+};
+
+// Setup runs before every iteration and is excluded from the timing.
+// Parameters are handed to both functions through benchmarkParameter
+typedef void (*BenchmarkFunction)();
+
+long benchmarkParameter = 0;
+std::string benchmarkProfile = "";
+std::string benchmarkLabel = "";
+int numberOfBenchmarkResults = 0;
+
+// Extra per result measurements such as simulated time or datagram counts
+#define MAX_BENCHMARK_METRICS 8
+
+struct BenchmarkMetric
+{
+	std::string metricName;
+	double value;
+};
+
+BenchmarkMetric benchmarkMetrics [MAX_BENCHMARK_METRICS];
+int numberOfBenchmarkMetrics = 0;
+
+// Attach a metric to the next reported result
+void AddBenchmarkMetric(std::string metricName, double value)
+{
+	if(numberOfBenchmarkMetrics >= MAX_BENCHMARK_METRICS)
+		return;
+
+	benchmarkMetrics[numberOfBenchmarkMetrics].metricName = metricName;
+	benchmarkMetrics[numberOfBenchmarkMetrics].value = value;
+	numberOfBenchmarkMetrics++;
+}
+
+uint64_t GetBenchmarkNanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void BeginBenchmarkReport(std::string profile, std::string label)
+{
+	benchmarkProfile = profile;
+	benchmarkLabel = label;
+	numberOfBenchmarkResults = 0;
+
+	cout << "{" << endl;
+	cout << "  \"suite\": \"ServerlessFirmware\"," << endl;
+	cout << "  \"profile\": \"" << profile << "\"," << endl;
+	cout << "  \"label\": \"" << label << "\"," << endl;
+	cout << "  \"results\": [" << endl;
+}
+
+void EndBenchmarkReport()
+{
+	cout << endl << "  ]" << endl;
+	cout << "}" << endl;
+}
+
+void ReportBenchmark(std::string benchmarkName, BenchmarkParameter parameterList [], int numberOfParameters, unsigned long iterations, double nsPerOp, double allocationsPerOp)
+{
+	if(numberOfBenchmarkResults > 0)
+		cout << "," << endl;
+
+	cout << "    {\"name\": \"" << benchmarkName << "\", \"params\": {";
+
+	for(int i = 0; i < numberOfParameters; i++)
+	{
+		if(i > 0)
+			cout << ", ";
+
+		cout << "\"" << parameterList[i].parameterName << "\": " << parameterList[i].value;
+	}
+
+	cout << "}, \"iterations\": " << iterations;
+	cout << ", \"ns_per_op\": " << nsPerOp;
+	cout << ", \"allocs_per_op\": " << allocationsPerOp;
+
+	if(numberOfBenchmarkMetrics > 0)
+	{
+		cout << ", \"metrics\": {";
+
+		for(int i = 0; i < numberOfBenchmarkMetrics; i++)
+		{
+			if(i > 0)
+				cout << ", ";
+
+			cout << "\"" << benchmarkMetrics[i].metricName << "\": " << benchmarkMetrics[i].value;
+		}
+
+		cout << "}";
+	}
+
+	cout << "}";
+
+	numberOfBenchmarkResults++;
+	numberOfBenchmarkMetrics = 0;
+}
+
+// Operations without setup are timed in batches to keep clock overhead out of
+// the result. Otherwise every iteration is timed individually so that the
+// per iteration setup can be excluded
+void RunBenchmark(std::string benchmarkName, BenchmarkParameter parameterList [], int numberOfParameters, BenchmarkFunction setup, BenchmarkFunction operation)
+{
+	uint64_t timeInOperation = 0;
+	unsigned long allocationsInOperation = 0;
+	unsigned long iterations = 0;
+
+	int batchSize = 1;
+	if(setup == 0)
+		batchSize = BENCHMARK_BATCH_SIZE;
+
+	while(timeInOperation < BENCHMARK_MIN_NANOSECONDS && iterations < BENCHMARK_MAX_ITERATIONS)
+	{
+		if(setup != 0)
+			setup();
+
+		unsigned long allocationsBefore = benchmarkAllocations;
+		uint64_t startTime = GetBenchmarkNanoseconds();
+
+		for(int i = 0; i < batchSize; i++)
+		{
+			operation();
+		}
+
+		timeInOperation += GetBenchmarkNanoseconds() - startTime;
+		allocationsInOperation += benchmarkAllocations - allocationsBefore;
+		iterations += batchSize;
+	}
+
+	ReportBenchmark(benchmarkName, parameterList, numberOfParameters, iterations, (double)timeInOperation/iterations, (double)allocationsInOperation/iterations);
+}
+
+uint64_t benchmarkLatencySamples [BENCHMARK_LATENCY_SAMPLES];
+
+// Expects the samples to be sorted
+uint64_t GetBenchmarkLatencyPercentile(double percentile)
+{
+	unsigned long sample = (unsigned long)(percentile / 100.0 * (BENCHMARK_LATENCY_SAMPLES - 1) + 0.5);
+	return benchmarkLatencySamples[sample];
+}
+
+// Times a fixed number of iterations one by one and reports the latency
+// distribution as metrics next to the mean
+void RunLatencyBenchmark(std::string benchmarkName, BenchmarkParameter parameterList [], int numberOfParameters, BenchmarkFunction setup, BenchmarkFunction operation)
+{
+	for(int i = 0; i < BENCHMARK_LATENCY_WARMUP; i++)
+	{
+		if(setup != 0)
+			setup();
+
+		operation();
+	}
+
+	uint64_t timeInOperation = 0;
+	unsigned long allocationsInOperation = 0;
+
+	for(int i = 0; i < BENCHMARK_LATENCY_SAMPLES; i++)
+	{
+		if(setup != 0)
+			setup();
+
+		unsigned long allocationsBefore = benchmarkAllocations;
+		uint64_t startTime = GetBenchmarkNanoseconds();
+
+		operation();
+
+		benchmarkLatencySamples[i] = GetBenchmarkNanoseconds() - startTime;
+		timeInOperation += benchmarkLatencySamples[i];
+		allocationsInOperation += benchmarkAllocations - allocationsBefore;
+	}
+
+	std::sort(benchmarkLatencySamples, benchmarkLatencySamples + BENCHMARK_LATENCY_SAMPLES);
+
+	AddBenchmarkMetric("p50_ns", GetBenchmarkLatencyPercentile(50));
+	AddBenchmarkMetric("p90_ns", GetBenchmarkLatencyPercentile(90));
+	AddBenchmarkMetric("p99_ns", GetBenchmarkLatencyPercentile(99));
+	AddBenchmarkMetric("p99_9_ns", GetBenchmarkLatencyPercentile(99.9));
+	AddBenchmarkMetric("max_ns", benchmarkLatencySamples[BENCHMARK_LATENCY_SAMPLES - 1]);
+
+	ReportBenchmark(benchmarkName, parameterList, numberOfParameters, BENCHMARK_LATENCY_SAMPLES, (double)timeInOperation/BENCHMARK_LATENCY_SAMPLES, (double)allocationsInOperation/BENCHMARK_LATENCY_SAMPLES);
+}
+
+#endif
@@ -0,0 +1,119 @@
+#include "BenchmarkSystem.h"
+#include "../Heep_API.h"
+#include "../Device.h"
+#include "../DeviceMemory.h"
+#include "../Scheduler.h"
+#include "../Simulation_Timer.h"
+#include "../Simulation_VirtualNetwork.h"
+
+#define NUM_UPTIMES 3
+int uptimeHours [NUM_UPTIMES] = {1, 24, 168};
+
+#define UPTIME_SAMPLE_PERIOD 10000		// New sensor reading in ms. Captured when built with USE_ANALYTICS
+#define UPTIME_HEARTBEAT_PERIOD 5000	// Period passed to SendControlsOnHeartBeat in ms
+#define UPTIME_ANALYTICS_EPOCH 1500000000000ULL
+
+extern unsigned long lastHeartBeat;
+
+unsigned long uptimeMemoryCommits = 0;
+unsigned int uptimePeakFilledMemory = 0;
+
+void ObserveUptimeMemory()
+{
+	if(curFilledMemory > uptimePeakFilledMemory)
+		uptimePeakFilledMemory = curFilledMemory;
+}
+
+// A single device on a virtual network of its own, so that the IP check
+// task sees a stable address and nothing is read from the input buffer
+void SetupUptimeDevice()
+{
+	CreateVirtualNetwork(1, 1);
+
+	heepByte deviceID [STANDARD_ID_SIZE];
+	CreateBenchmarkDeviceID(deviceID, 0);
+
+	HeepIPAddress theIP = {10, 0, 0, 1};
+	SelectVirtualDevice(AddVirtualDevice(deviceID, theIP));
+
+	FillMemoryToLevel(25);
+	ClearControls();
+	AddRangeControl("Sensor", HEEP_OUTPUT, 100, 0, 0);
+
+	curNumberOfTasks = 0;
+	curTaskCounter = 0;
+	lastMillis = 0;
+	SetupHeepTasks();
+
+	SetSimulationClockMode(ManualClock);
+	SetSimulationClock(0);
+	SetAnalyticsTime(UPTIME_ANALYTICS_EPOCH);
+	lastHeartBeat = 0;
+
+	uptimeMemoryCommits = 0;
+	uptimePeakFilledMemory = curFilledMemory;
+}
+
+// Replay the main loop of a device, jumping from one deadline to the next
+void BenchmarkUptimeOperation()
+{
+	uint64_t endOfUptime = (uint64_t)benchmarkParameter * 3600000;
+	uint64_t nextSample = UPTIME_SAMPLE_PERIOD;
+
+	while(simMillis < endOfUptime)
+	{
+		uint64_t nextHeartBeat = (uint64_t)lastHeartBeat + UPTIME_HEARTBEAT_PERIOD + 1;
+
+		uint64_t maxMillis = endOfUptime;
+		if(nextSample < maxMillis)
+			maxMillis = nextSample;
+		if(nextHeartBeat < maxMillis)
+			maxMillis = nextHeartBeat;
+
+		RunVirtualNetworkToNextDeadline(maxMillis);
+
+		if(simMillis >= nextSample)
+		{
+			SendOutputByID(0, (simMillis / UPTIME_SAMPLE_PERIOD) % 101);
+			ObserveUptimeMemory();
+			nextSample += UPTIME_SAMPLE_PERIOD;
+		}
+
+		SendControlsOnHeartBeat(UPTIME_HEARTBEAT_PERIOD);
+		ObserveUptimeMemory();
+
+		unsigned char memoryChangedBeforeTasks = memoryChanged;
+		PerformHeepTasks();
+		ObserveUptimeMemory();
+
+		// Every commit is a write to non volatile memory on a real device
+		if(memoryChangedBeforeTasks && !memoryChanged)
+			uptimeMemoryCommits++;
+	}
+}
+
+void BenchmarkUptime()
+{
+	for(int i = 0; i < NUM_UPTIMES; i++)
+	{
+		benchmarkParameter = uptimeHours[i];
+
+		// The replay is deterministic, so the churn of one run describes them all
+		SetupUptimeDevice();
+		BenchmarkUptimeOperation();
+
+		AddBenchmarkMetric("memory_commits", uptimeMemoryCommits);
+		AddBenchmarkMetric("memory_commits_per_hour", (double)uptimeMemoryCommits / uptimeHours[i]);
+		AddBenchmarkMetric("peak_filled_bytes", uptimePeakFilledMemory);
+		AddBenchmarkMetric("final_filled_bytes", curFilledMemory);
+
+		BenchmarkParameter parameterList [1];
+		parameterList[0].parameterName = "simulated_hours";
+		parameterList[0].value = uptimeHours[i];
+
+		RunBenchmark("LongUptimeReplay", parameterList, 1, SetupUptimeDevice, BenchmarkUptimeOperation);
+	}
+
+	DestroyVirtualNetwork();
+	ResetSimulationClock();
+}
@@ -0,0 +1,169 @@
+#include "BenchmarkSystem.h"
+#include "../Heep_API.h"
+#include "../Device.h"
+#include "../DeviceMemory.h"
+#include "../Simulation_VirtualNetwork.h"
+
+#define NUM_NETWORK_SIZES 3
+int networkSizes [NUM_NETWORK_SIZES] = {100, 1000, 10000};
+
+HeepIPAddress CreateBenchmarkNetworkIP(int deviceNumber)
+{
+	HeepIPAddress theIP;
+	theIP.Octet4 = 10;
+	theIP.Octet3 = (deviceNumber >> 16)%256;
+	theIP.Octet2 = (deviceNumber >> 8)%256;
+	theIP.Octet1 = deviceNumber%256;
+	return theIP;
+}
+
+void CreateBenchmarkNetworkDeviceID(heepByte* deviceID, int deviceNumber)
+{
+	deviceID[0] = 0xC0;
+	deviceID[1] = (deviceNumber >> 16)%256;
+	deviceID[2] = (deviceNumber >> 8)%256;
+	deviceID[3] = deviceNumber%256;
+}
+
+void CreateBenchmarkNetwork(int numberOfDevices)
+{
+	CreateVirtualNetwork(numberOfDevices, 1);
+
+	for(int i = 0; i < numberOfDevices; i++)
+	{
+		heepByte deviceID [STANDARD_ID_SIZE];
+		CreateBenchmarkNetworkDeviceID(deviceID, i);
+
+		SelectVirtualDevice(AddVirtualDevice(deviceID, CreateBenchmarkNetworkIP(i)));
+		ClearVertices();
+		ClearDeviceMemory();
+		ClearControls();
+		SetDeviceName("Virtual");
+		AddOnOffControl("Light", HEEP_OUTPUT, 0);
+	}
+}
+
+void ConnectBenchmarkNetworkDevices(int txDevice, int rxDevice)
+{
+	SelectVirtualDevice(txDevice);
+
+	struct Vertex_Byte newVertex;
+	CreateBenchmarkNetworkDeviceID(newVertex.txID, txDevice);
+	CreateBenchmarkNetworkDeviceID(newVertex.rxID, rxDevice);
+	newVertex.txControlID = 0;
+	newVertex.rxControlID = 0;
+	newVertex.rxIPAddress = CreateBenchmarkNetworkIP(rxDevice);
+	AddVertex(newVertex);
+}
+
+// The network is deterministic, so the simulated cost of one operation is
+// measured once up front and reported alongside the wall time
+void AddVirtualNetworkMetrics(BenchmarkFunction operation)
+{
+	VirtualNetworkStats statsBefore;
+	VirtualNetworkStats statsAfter;
+	uint64_t timeBefore = virtualNetworkTimeMicros;
+
+	GetVirtualNetworkStats(&statsBefore);
+	operation();
+	GetVirtualNetworkStats(&statsAfter);
+
+	AddBenchmarkMetric("simulated_micros", virtualNetworkTimeMicros - timeBefore);
+	AddBenchmarkMetric("datagrams_delivered", statsAfter.datagramsDelivered - statsBefore.datagramsDelivered);
+	AddBenchmarkMetric("bytes_sent", statsAfter.bytesSent - statsBefore.bytesSent);
+}
+
+// Each propagation is long enough to be timed on its own, so give the runner
+// a setup to keep it from batching thousands of devices worth of work
+void SetupVirtualNetworkOperation()
+{
+	SelectVirtualDevice(0);
+}
+
+void BenchmarkChainPropagationOperation()
+{
+	SelectVirtualDevice(0);
+	SetControlValueByName("Light", benchmarkParameter);
+	RunVirtualNetworkUntilIdle(4*GetNumberOfVirtualDevices());
+
+	benchmarkParameter = !benchmarkParameter;
+}
+
+void BenchmarkChainPropagation()
+{
+	for(int i = 0; i < NUM_NETWORK_SIZES; i++)
+	{
+		CreateBenchmarkNetwork(networkSizes[i]);
+
+		for(int j = 0; j < networkSizes[i] - 1; j++)
+		{
+			ConnectBenchmarkNetworkDevices(j, j + 1);
+		}
+
+		VirtualLink hopLink = {1000, 100, 0, 0};
+		SetDefaultVirtualLink(hopLink);
+
+		benchmarkParameter = 1;
+		AddVirtualNetworkMetrics(BenchmarkChainPropagationOperation);
+
+		BenchmarkParameter parameterList [1];
+		parameterList[0].parameterName = "devices";
+		parameterList[0].value = networkSizes[i];
+
+		RunBenchmark("VirtualNetworkChainPropagation", parameterList, 1, SetupVirtualNetworkOperation, BenchmarkChainPropagationOperation);
+
+		DestroyVirtualNetwork();
+	}
+}
+
+void BenchmarkIPChangeBroadcastOperation()
+{
+	SelectVirtualDevice(0);
+	SetVirtualDeviceIP(0, CreateBenchmarkNetworkIP(GetNumberOfVirtualDevices() + benchmarkParameter));
+	HandleIPChanges();
+	RunVirtualNetworkUntilIdle(8*GetNumberOfVirtualDevices());
+
+	// The scheduled tasks on a real device clean up the old IP before the next check
+	SelectVirtualDevice(0);
+	DefragmentMemory();
+	CommitMemory();
+
+	benchmarkParameter = !benchmarkParameter;
+}
+
+// One device changes its IP while every other device holds a vertex to it
+void BenchmarkIPChangeBroadcast()
+{
+	for(int i = 0; i < NUM_NETWORK_SIZES; i++)
+	{
+		CreateBenchmarkNetwork(networkSizes[i]);
+
+		for(int j = 1; j < networkSizes[i]; j++)
+		{
+			ConnectBenchmarkNetworkDevices(j, 0);
+		}
+
+		SelectVirtualDevice(0);
+		SetIPInMemory_Byte(CreateBenchmarkNetworkIP(0), deviceIDByte);
+
+		VirtualLink lanLink = {500, 200, 0, 0};
+		SetDefaultVirtualLink(lanLink);
+
+		benchmarkParameter = 0;
+		AddVirtualNetworkMetrics(BenchmarkIPChangeBroadcastOperation);
+
+		BenchmarkParameter parameterList [1];
+		parameterList[0].parameterName = "devices";
+		parameterList[0].value = networkSizes[i];
+
+		RunBenchmark("VirtualNetworkIPChangeBroadcast", parameterList, 1, SetupVirtualNetworkOperation, BenchmarkIPChangeBroadcastOperation);
+
+		DestroyVirtualNetwork();
+	}
+}
+
+void BenchmarkVirtualNetwork()
+{
+	BenchmarkChainPropagation();
+	BenchmarkIPChangeBroadcast();
+}
@@ -0,0 +1,16 @@
+make benchmarks
+
+# Label each report with the current commit so that runs can be compared
+LABEL=$(git rev-parse --short HEAD 2>/dev/null)
+
+echo "Run UnIndexed Benchmarks"
+./BenchmarkUnIndexed.app $LABEL > BenchmarkUnIndexed.json
+
+echo "Run Indexed Benchmarks"
+./BenchmarkIndexing.app $LABEL > BenchmarkIndexing.json
+
+echo "Run Small Device Benchmarks"
+./BenchmarkSmallUnIndexed.app $LABEL > BenchmarkSmallUnIndexed.json
+./BenchmarkSmallIndexing.app $LABEL > BenchmarkSmallIndexing.json
+
+echo "Results written to BenchmarkUnIndexed.json, BenchmarkIndexing.json, BenchmarkSmallUnIndexed.json and BenchmarkSmallIndexing.json"
@@ -1,4 +1,7 @@
 #include "../Heep_API.h"
+#include "../Device.h"
+#include "../Simulation_Timer.h"
+#include <stdio.h>
 #include "UnitTestSystem.h"
 
 void TestSchedulerRolloverProtection()
@@ -121,6 +124,51 @@ void TestAddBufferToBuffer64Bit()
 	CheckResults(TestName, valueList, 8);
 }
 
+void TestDeviceIDPrimitives()
+{
+	std::string TestName = "Test Device ID Primitives";
+
+	// Offset by one byte so that the IDs are not word aligned
+	heepByte myBuffer[2*STANDARD_ID_SIZE + 2];
+	heepByte otherID[STANDARD_ID_SIZE];
+	for(int i = 0; i < STANDARD_ID_SIZE; i++)
+		otherID[i] = i + 10;
+
+	unsigned long counter = AddDeviceIDToBuffer_Byte(myBuffer, otherID, 1);
+	counter = AddDeviceIDToBuffer_Byte(myBuffer, otherID, counter);
+	myBuffer[counter - 1]++;
+
+	heepByte readID[STANDARD_ID_SIZE];
+	unsigned long readCounter = GetFullDeviceIDFromBuffer(myBuffer, readID, 1);
+
+	ExpectedValue valueList [6];
+	valueList[0].valueName = "Counter After IDs";
+	valueList[0].expectedValue = 2*STANDARD_ID_SIZE + 1;
+	valueList[0].actualValue = counter;
+
+	valueList[1].valueName = "Read Counter";
+	valueList[1].expectedValue = STANDARD_ID_SIZE + 1;
+	valueList[1].actualValue = readCounter;
+
+	valueList[2].valueName = "Read ID Equal";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = CheckDeviceIDEquality(readID, otherID);
+
+	valueList[3].valueName = "Last Byte Differs";
+	valueList[3].expectedValue = 0;
+	valueList[3].actualValue = CheckDeviceIDEquality(&myBuffer[STANDARD_ID_SIZE + 1], otherID);
+
+	valueList[4].valueName = "Shorter Prefix Equal";
+	valueList[4].expectedValue = 1;
+	valueList[4].actualValue = CheckBufferEquality(&myBuffer[STANDARD_ID_SIZE + 1], otherID, STANDARD_ID_SIZE - 1);
+
+	valueList[5].valueName = "Longer Buffer Differs";
+	valueList[5].expectedValue = 0;
+	valueList[5].actualValue = CheckBufferEquality(&myBuffer[1], &myBuffer[STANDARD_ID_SIZE + 1], STANDARD_ID_SIZE + 1);
+
+	CheckResults(TestName, valueList, 6);
+}
+
 void TestCaptureAnalyticsToggle()
 {
 #ifdef USE_ANALYTICS
@@ -298,14 +346,482 @@ void TestMomentaryOutputs()
 	CheckResults(TestName, valueList, 1);
 }
 
+char testControlNames [NUM_CONTROLS][16];
+
+void TestControlLookup()
+{
+	std::string TestName = "Test Control Lookup";
+
+	ClearDeviceMemory();
+	ClearControls();
+
+	// Enough names to collide in the name table
+	for(int i = 0; i < NUM_CONTROLS; i++)
+	{
+		sprintf(testControlNames[i], "Control %d", i);
+		AddRangeControl(testControlNames[i], HEEP_INPUT, 100, 0, i%100);
+	}
+
+	int namesFound = 0;
+	int IDsFound = 0;
+	for(int i = 0; i < NUM_CONTROLS; i++)
+	{
+		if(GetControlIndexByName(testControlNames[i]) == i)
+			namesFound++;
+
+		if(GetControlIndexByID(i) == i)
+			IDsFound++;
+	}
+
+	int lastHandle = GetControlHandleByName(testControlNames[NUM_CONTROLS - 1]);
+	SetControlValueByHandle(lastHandle, 42);
+
+	ExpectedValue valueList [7];
+	valueList[0].valueName = "Names Found";
+	valueList[0].expectedValue = NUM_CONTROLS;
+	valueList[0].actualValue = namesFound;
+
+	valueList[1].valueName = "IDs Found";
+	valueList[1].expectedValue = NUM_CONTROLS;
+	valueList[1].actualValue = IDsFound;
+
+	valueList[2].valueName = "Unknown Name";
+	valueList[2].expectedValue = -1;
+	valueList[2].actualValue = GetControlHandleByName("Not A Control");
+
+	valueList[3].valueName = "Unknown ID";
+	valueList[3].expectedValue = -1;
+	valueList[3].actualValue = GetControlIndexByID(NUM_CONTROLS);
+
+	valueList[4].valueName = "Value By Handle";
+	valueList[4].expectedValue = 42;
+	valueList[4].actualValue = GetControlValueByName(testControlNames[NUM_CONTROLS - 1]);
+
+	valueList[5].valueName = "Value By ID";
+	valueList[5].expectedValue = 42;
+	valueList[5].actualValue = GetControlValueByID(NUM_CONTROLS - 1);
+
+	ClearControls();
+
+	valueList[6].valueName = "Cleared";
+	valueList[6].expectedValue = -1;
+	valueList[6].actualValue = GetControlIndexByName(testControlNames[0]);
+
+	CheckResults(TestName, valueList, 7);
+}
+
+void TestDuplicateControlNames()
+{
+	std::string TestName = "Test Duplicate Control Names";
+
+	ClearDeviceMemory();
+	ClearControls();
+	AddOnOffControl("Light", HEEP_OUTPUT, 0);
+	AddOnOffControl("Light", HEEP_OUTPUT, 1);
+
+	SetControlValueByName("Light", 1);
+
+	ExpectedValue valueList [2];
+	valueList[0].valueName = "First Control Set";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = controlList[0].curValue;
+
+	valueList[1].valueName = "Name Resolves To First";
+	valueList[1].expectedValue = 0;
+	valueList[1].actualValue = GetControlIndexByName("Light");
+
+	CheckResults(TestName, valueList, 2);
+}
+
+void TestControlDaemonPendingControls()
+{
+	std::string TestName = "Test Control Daemon Pending Controls";
+
+	ClearDeviceMemory();
+	ClearVertices();
+	ClearControls();
+	AddOnOffControl("Switch", HEEP_OUTPUT, 0);
+	AddOnOffControl("Other", HEEP_OUTPUT, 0);
+	AddOnOffControl("Light", HEEP_INPUT, 0);
+
+	// Forward the switch to the light on this same device
+	struct Vertex_Byte localVertex;
+	CopyDeviceID(deviceIDByte, localVertex.txID);
+	CopyDeviceID(deviceIDByte, localVertex.rxID);
+	localVertex.txControlID = 0;
+	localVertex.rxControlID = 2;
+	localVertex.rxIPAddress.Octet4 = 192;
+	localVertex.rxIPAddress.Octet3 = 168;
+	localVertex.rxIPAddress.Octet2 = 1;
+	localVertex.rxIPAddress.Octet1 = 2;
+	AddVertex(localVertex);
+
+	// Flags other than send must survive the daemon
+	controlList[1].controlFlags |= 0x02;
+
+	SetControlValueByIDFromNetwork(0, 1);
+	SetControlValueByIDFromNetwork(1, 1);
+	SetControlValueByIDFromNetwork(1, 0);
+
+	ControlDaemon();
+
+	ExpectedValue valueList [5];
+	valueList[0].valueName = "Light Forwarded";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = controlList[2].curValue;
+
+	valueList[1].valueName = "Switch Flags";
+	valueList[1].expectedValue = 0;
+	valueList[1].actualValue = controlList[0].controlFlags;
+
+	valueList[2].valueName = "Other Flags";
+	valueList[2].expectedValue = 0x02;
+	valueList[2].actualValue = controlList[1].controlFlags;
+
+	valueList[3].valueName = "Light Flags";
+	valueList[3].expectedValue = 0;
+	valueList[3].actualValue = controlList[2].controlFlags;
+
+	valueList[4].valueName = "Nothing Pending";
+	valueList[4].expectedValue = -1;
+	valueList[4].actualValue = TakeNextPendingControl();
+
+	CheckResults(TestName, valueList, 5);
+
+	ClearVertices();
+	ClearDeviceMemory();
+}
+
+int controlCallbackCalls = 0;
+int controlCallbackID = -1;
+int controlCallbackPreviousValue = -1;
+int controlCallbackNewValue = -1;
+
+void RecordControlCallback(unsigned char controlID, int previousValue, int newValue)
+{
+	controlCallbackCalls++;
+	controlCallbackID = controlID;
+	controlCallbackPreviousValue = previousValue;
+	controlCallbackNewValue = newValue;
+}
+
+void TestControlCallbacks()
+{
+	std::string TestName = "Test Control Callbacks";
+
+	ClearDeviceMemory();
+	ClearVertices();
+	ClearControls();
+	AddOnOffControl("Switch", HEEP_INPUT, 0);
+	AddRangeControl("Dimmer", HEEP_INPUT, 100, 0, 10);
+
+	controlCallbackCalls = 0;
+	heepByte missingControl = SetControlCallbackByName("Not A Control", RecordControlCallback);
+	SetControlCallbackByName("Dimmer", RecordControlCallback);
+
+	// Two writes before the daemon runs are reported once
+	SetControlValueByIDFromNetwork(1, 50);
+	SetControlValueByIDFromNetwork(1, 75);
+	SetControlValueByIDFromNetwork(0, 1);
+	int callsBeforeDaemon = controlCallbackCalls;
+	ControlDaemon();
+
+	ExpectedValue valueList [7];
+	valueList[0].valueName = "Missing Control";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = missingControl;
+
+	valueList[1].valueName = "Calls Before Daemon";
+	valueList[1].expectedValue = 0;
+	valueList[1].actualValue = callsBeforeDaemon;
+
+	valueList[2].valueName = "Calls After Daemon";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = controlCallbackCalls;
+
+	valueList[3].valueName = "Control ID";
+	valueList[3].expectedValue = 1;
+	valueList[3].actualValue = controlCallbackID;
+
+	valueList[4].valueName = "Previous Value";
+	valueList[4].expectedValue = 10;
+	valueList[4].actualValue = controlCallbackPreviousValue;
+
+	valueList[5].valueName = "New Value";
+	valueList[5].expectedValue = 75;
+	valueList[5].actualValue = controlCallbackNewValue;
+
+	// Removed callbacks are not called
+	SetControlCallbackByName("Dimmer", 0);
+	SetControlValueByIDFromNetwork(1, 80);
+	ControlDaemon();
+
+	valueList[6].valueName = "Calls After Removal";
+	valueList[6].expectedValue = 1;
+	valueList[6].actualValue = controlCallbackCalls;
+
+	CheckResults(TestName, valueList, 7);
+}
+
+void TestDoubleBufferedControls()
+{
+	std::string TestName = "Test Double Buffered Controls";
+
+	ClearDeviceMemory();
+	ClearVertices();
+	ClearControls();
+
+	heepByte frameFront [4] = {0, 0, 0, 0};
+	heepByte frameBack [4] = {0, 0, 0, 0};
+	heepByte mirrorFront [4] = {0, 0, 0, 0};
+	heepByte mirrorBack [4] = {0, 0, 0, 0};
+	AddDoubleBufferedControl("Frame", HEEP_OUTPUT, frameFront, frameBack, 4);
+	AddDoubleBufferedControl("Mirror", HEEP_INPUT, mirrorFront, mirrorBack, 4);
+
+	// Frame feeds Mirror on the same device
+	struct Vertex_Byte selfVertex;
+	CopyDeviceID(deviceIDByte, selfVertex.txID);
+	CopyDeviceID(deviceIDByte, selfVertex.rxID);
+	selfVertex.txControlID = 0;
+	selfVertex.rxControlID = 1;
+	HeepIPAddress selfIP = {127, 0, 0, 1};
+	selfVertex.rxIPAddress = selfIP;
+	AddVertex(selfVertex);
+
+	heepByte networkFrame [6] = {9, 1, 2, 3, 9, 9};
+	SetControlValueByIDFromNetworkBuffer(1, networkFrame, 1, 3);
+	heepByte tooLong = SetControlValueByIDFromNetworkBuffer(1, networkFrame, 0, 5);
+
+	ExpectedValue valueList [10];
+	valueList[0].valueName = "Network Write Swapped In";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = controlList[1].controlBuffer == mirrorBack;
+
+	valueList[1].valueName = "Network Write Length";
+	valueList[1].expectedValue = 3;
+	valueList[1].actualValue = controlList[1].curValue;
+
+	valueList[2].valueName = "Network Write Contents";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = controlList[1].controlBuffer[0] == 1 && controlList[1].controlBuffer[2] == 3;
+
+	valueList[3].valueName = "Front Buffer Untouched";
+	valueList[3].expectedValue = 0;
+	valueList[3].actualValue = mirrorFront[0];
+
+	valueList[4].valueName = "Oversized Write Rejected";
+	valueList[4].expectedValue = 1;
+	valueList[4].actualValue = tooLong;
+
+	int frameHandle = GetControlHandleByName("Frame");
+	heepByte* nextFrame = GetControlBackBuffer(frameHandle);
+	nextFrame[0] = 4;
+	nextFrame[1] = 5;
+	nextFrame[2] = 6;
+	nextFrame[3] = 7;
+	heepByte sent = SwapAndSendControlBuffer(frameHandle, 4);
+
+	valueList[5].valueName = "Swap And Send";
+	valueList[5].expectedValue = 0;
+	valueList[5].actualValue = sent;
+
+	valueList[6].valueName = "Sent Frame Swapped In";
+	valueList[6].expectedValue = 1;
+	valueList[6].actualValue = controlList[0].controlBuffer == frameBack && GetControlBackBuffer(frameHandle) == frameFront;
+
+	valueList[7].valueName = "Sent Frame Received";
+	valueList[7].expectedValue = 1;
+	valueList[7].actualValue = controlList[1].curValue == 4 && controlList[1].controlBuffer[3] == 7;
+
+	valueList[8].valueName = "Oversized Send Rejected";
+	valueList[8].expectedValue = 1;
+	valueList[8].actualValue = SwapAndSendControlBuffer(frameHandle, 5);
+
+	AddRangeControl("Single", HEEP_OUTPUT, 10, 0, 0);
+	valueList[9].valueName = "Single Buffered Send Rejected";
+	valueList[9].expectedValue = 1;
+	valueList[9].actualValue = SwapAndSendControlBuffer(GetControlHandleByName("Single"), 1);
+
+	CheckResults(TestName, valueList, 10);
+}
+
+void TestDoubleBufferedControlSizes()
+{
+	std::string TestName = "Test Double Buffered Control Sizes";
+
+	ClearControls();
+
+	heepByte front [255];
+	heepByte back [255];
+	AddDoubleBufferedControl("Empty", HEEP_OUTPUT, front, back, 0);
+	AddDoubleBufferedControl("Huge", HEEP_OUTPUT, front, back, 255);
+	unsigned int controlsAfterRejects = numberOfControls;
+	AddDoubleBufferedControl("Largest", HEEP_OUTPUT, front, back, 254);
+
+	ExpectedValue valueList [3];
+	valueList[0].valueName = "Bad Sizes Rejected";
+	valueList[0].expectedValue = 0;
+	valueList[0].actualValue = controlsAfterRejects;
+
+	valueList[1].valueName = "Largest Size Added";
+	valueList[1].expectedValue = 1;
+	valueList[1].actualValue = numberOfControls;
+
+	valueList[2].valueName = "Largest Size High Value";
+	valueList[2].expectedValue = 253;
+	valueList[2].actualValue = controlList[0].highValue;
+
+	CheckResults(TestName, valueList, 3);
+}
+
+void TestControlSendLimits()
+{
+	std::string TestName = "Test Control Send Limits";
+
+	ClearDeviceMemory();
+	ClearVertices();
+	ClearControls();
+	AddRangeControl("Knob", HEEP_OUTPUT, 100, 0, 0);
+	AddRangeControl("Mirror", HEEP_INPUT, 100, 0, 0);
+
+	// Knob feeds Mirror on the same device, so every send shows up in Mirror
+	struct Vertex_Byte selfVertex;
+	CopyDeviceID(deviceIDByte, selfVertex.txID);
+	CopyDeviceID(deviceIDByte, selfVertex.rxID);
+	selfVertex.txControlID = 0;
+	selfVertex.rxControlID = 1;
+	HeepIPAddress selfIP = {127, 0, 0, 1};
+	selfVertex.rxIPAddress = selfIP;
+	AddVertex(selfVertex);
+
+	SetSimulationClockMode(ManualClock);
+	SetSimulationClock(1000);
+
+	int knob = GetControlHandleByName("Knob");
+	ExpectedValue valueList [8];
+	valueList[0].valueName = "Missing Control";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = SetControlSendLimitByName("Not A Control", 100, 0);
+
+	SetControlSendLimitByHandle(knob, 100, 0);
+
+	SetControlValueByHandle(knob, 10);
+	valueList[1].valueName = "First Value Sent";
+	valueList[1].expectedValue = 10;
+	valueList[1].actualValue = controlList[1].curValue;
+
+	SetSimulationClock(1010);
+	SetControlValueByHandle(knob, 20);
+	SetControlValueByHandle(knob, 30);
+	SetSimulationClock(1050);
+	FlushHeldOutputs();
+	valueList[2].valueName = "Values Held Within Interval";
+	valueList[2].expectedValue = 10;
+	valueList[2].actualValue = controlList[1].curValue;
+
+	SetSimulationClock(1100);
+	FlushHeldOutputs();
+	valueList[3].valueName = "Latest Held Value Sent";
+	valueList[3].expectedValue = 30;
+	valueList[3].actualValue = controlList[1].curValue;
+
+	SetControlSendLimitByHandle(knob, 100, 5);
+
+	SetSimulationClock(1300);
+	SetControlValueByHandle(knob, 32);
+	SetSimulationClock(1350);
+	FlushHeldOutputs();
+	valueList[4].valueName = "Change In Deadband Held";
+	valueList[4].expectedValue = 30;
+	valueList[4].actualValue = controlList[1].curValue;
+
+	SetSimulationClock(1400);
+	FlushHeldOutputs();
+	valueList[5].valueName = "Settled Change In Deadband Sent";
+	valueList[5].expectedValue = 32;
+	valueList[5].actualValue = controlList[1].curValue;
+
+	SetSimulationClock(1500);
+	SetControlValueByHandle(knob, 40);
+	valueList[6].valueName = "Change Past Deadband Sent";
+	valueList[6].expectedValue = 40;
+	valueList[6].actualValue = controlList[1].curValue;
+
+	valueList[7].valueName = "Nothing Held";
+	valueList[7].expectedValue = 0;
+	valueList[7].actualValue = numberOfHeldControls;
+
+	ResetSimulationClock();
+
+	CheckResults(TestName, valueList, 8);
+}
+
+void TestControlTable()
+{
+	std::string TestName = "Test Control Table";
+
+	static const struct ControlDeclaration controlTable [] =
+	{
+		{"Power", HEEP_ONOFF, HEEP_INPUT, 1, 0, 1},
+		{"Dimmer", HEEP_RANGE, HEEP_OUTPUT, 100, 0, 50}
+	};
+
+	ClearDeviceMemory();
+	ClearVertices();
+	ClearControls();
+	AddControlTable(controlTable, 2);
+	AddOnOffControl("Fan", HEEP_INPUT, 0);
+
+	ClearOutputBuffer();
+	FillOutputBufferWithControlData();
+
+	ExpectedValue valueList [6];
+	valueList[0].valueName = "Number of Controls";
+	valueList[0].expectedValue = 3;
+	valueList[0].actualValue = numberOfControls;
+
+	valueList[1].valueName = "Dimmer ID";
+	valueList[1].expectedValue = 1;
+	valueList[1].actualValue = controlList[GetControlIndexByName("Dimmer")].controlID;
+
+	valueList[2].valueName = "Dimmer Starting Value";
+	valueList[2].expectedValue = 50;
+	valueList[2].actualValue = GetControlValueByName("Dimmer");
+
+	valueList[3].valueName = "Fan ID";
+	valueList[3].expectedValue = 2;
+	valueList[3].actualValue = controlList[2].controlID;
+
+	valueList[4].valueName = "Control Data Size";
+	valueList[4].expectedValue = 3*12 + 5 + 6 + 3;
+	valueList[4].actualValue = CalculateControlDataSize();
+
+	valueList[5].valueName = "Control Data Written";
+	valueList[5].expectedValue = CalculateControlDataSize() + 3*(ID_SIZE - STANDARD_ID_SIZE);
+	valueList[5].actualValue = outputBufferLastByte;
+
+	ClearControls();
+
+	CheckResults(TestName, valueList, 6);
+}
+
 void TestHeepAPI()
 {
 	TestSchedulerRolloverProtection();
 	TestBufferControlType();
 	TestAnalyticsMillisecondsBytes();
 	TestAddBufferToBuffer64Bit();
+	TestDeviceIDPrimitives();
 	TestCaptureAnalyticsToggle();
 	TestBase64Encode();
 	TestMomentaryInputs();
 	TestMomentaryOutputs();
+	TestControlLookup();
+	TestDuplicateControlNames();
+	TestControlDaemonPendingControls();
+	TestControlCallbacks();
+	TestDoubleBufferedControls();
+	TestDoubleBufferedControlSizes();
+	TestControlSendLimits();
+	TestControlTable();
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "../Device.h"
 #include "../Heep_API.h"
 #include "../Scheduler.h"
+#include "../ReliableDelivery.h"
 #include "UnitTestSystem.h"
 
 void PrintOutputBuffer()
@@ -87,6 +88,129 @@ void TestMemoryDumpROP()
 	CheckResults(TestName, valueList, 5);
 }
 
+void TestMemoryDumpOverflow()
+{
+	std::string TestName = "Memory Dump Overflow";
+
+	ClearDeviceMemory();
+	SetDeviceName("Jacob");
+	FillOutputBufferWithMemoryDump();
+	unsigned int bytesBeforeMemory = outputBufferLastByte - curFilledMemory;
+	heepByte smallDumpOverflowed = outputBufferOverflowed;
+
+	heepByte userData [20];
+	memset(userData, 0, sizeof(userData));
+	while(WillMemoryOverflow(30) == 0)
+	{
+		AddUserMemory(0, userData, sizeof(userData));
+	}
+
+	FillOutputBufferWithMemoryDump();
+	heepByte fullDumpOverflowed = outputBufferOverflowed;
+
+	// The dump must end on a MOP boundary
+	unsigned int memoryBytesSent = outputBufferLastByte - bytesBeforeMemory;
+	unsigned int counter = 0;
+	while(counter < memoryBytesSent)
+	{
+		counter = SkipOpCode(counter);
+	}
+
+	// An append that does not fit writes nothing
+	ClearOutputBuffer();
+	AddBufferToOutputBuffer(deviceMemory, OUTPUT_BUFFER_SIZE - 1);
+	AddNumberToOutputBuffer(0x0102, 2);
+	unsigned int bytesAfterTooLarge = outputBufferLastByte;
+	heepByte tooLargeOverflowed = outputBufferOverflowed;
+	AddNewCharToOutputBuffer(1);
+	unsigned int bytesAfterFilling = outputBufferLastByte;
+	ClearOutputBuffer();
+
+	ExpectedValue valueList [8];
+	valueList[0].valueName = "Small Dump Overflowed";
+	valueList[0].expectedValue = 0;
+	valueList[0].actualValue = smallDumpOverflowed;
+
+	valueList[1].valueName = "Full Dump Overflowed";
+	valueList[1].expectedValue = 1;
+	valueList[1].actualValue = fullDumpOverflowed && memoryBytesSent < curFilledMemory;
+
+	valueList[2].valueName = "Dump Ends on MOP";
+	valueList[2].expectedValue = memoryBytesSent;
+	valueList[2].actualValue = counter;
+
+	valueList[3].valueName = "Dump Within Buffer";
+	valueList[3].expectedValue = 1;
+	valueList[3].actualValue = memoryBytesSent + bytesBeforeMemory <= OUTPUT_BUFFER_SIZE;
+
+	valueList[4].valueName = "Bytes After Too Large";
+	valueList[4].expectedValue = OUTPUT_BUFFER_SIZE - 1;
+	valueList[4].actualValue = bytesAfterTooLarge;
+
+	valueList[5].valueName = "Too Large Overflowed";
+	valueList[5].expectedValue = 1;
+	valueList[5].actualValue = tooLargeOverflowed;
+
+	valueList[6].valueName = "Bytes After Filling";
+	valueList[6].expectedValue = OUTPUT_BUFFER_SIZE;
+	valueList[6].actualValue = bytesAfterFilling;
+
+	valueList[7].valueName = "Overflow Cleared";
+	valueList[7].expectedValue = 0;
+	valueList[7].actualValue = outputBufferOverflowed;
+
+	CheckResults(TestName, valueList, 8);
+}
+
+void TestMessageROP()
+{
+	std::string TestName = "Message ROP";
+
+	// Only stringLength bytes of the message are sent
+	char message [] = "Value Set. Ignored";
+	FillOutputBufferWithSuccess(message, 9);
+	unsigned int successBytes = outputBufferLastByte;
+	unsigned char successOpCode = outputBuffer[0];
+	unsigned char successDeviceID = outputBuffer[STANDARD_ID_SIZE];
+	unsigned char successLength = outputBuffer[STANDARD_ID_SIZE + 1];
+	unsigned char lastCharacter = outputBuffer[successBytes - 1];
+
+	char longMessage [300];
+	memset(longMessage, 'a', sizeof(longMessage));
+	FillOutputBufferWithError(longMessage, sizeof(longMessage));
+
+	ExpectedValue valueList [7];
+	valueList[0].valueName = "Success Bytes";
+	valueList[0].expectedValue = STANDARD_ID_SIZE + 2 + 9;
+	valueList[0].actualValue = successBytes;
+
+	valueList[1].valueName = "Success Op Code";
+	valueList[1].expectedValue = SuccessOpCode;
+	valueList[1].actualValue = successOpCode;
+
+	valueList[2].valueName = "Device ID";
+	valueList[2].expectedValue = deviceIDByte[STANDARD_ID_SIZE - 1];
+	valueList[2].actualValue = successDeviceID;
+
+	valueList[3].valueName = "Message Length";
+	valueList[3].expectedValue = 9;
+	valueList[3].actualValue = successLength;
+
+	valueList[4].valueName = "Last Character";
+	valueList[4].expectedValue = 't';
+	valueList[4].actualValue = lastCharacter;
+
+	valueList[5].valueName = "Long Message Bytes";
+	valueList[5].expectedValue = 0;
+	valueList[5].actualValue = outputBufferLastByte;
+
+	valueList[6].valueName = "Long Message Overflowed";
+	valueList[6].expectedValue = 1;
+	valueList[6].actualValue = outputBufferOverflowed;
+
+	CheckResults(TestName, valueList, 7);
+}
+
 void TestHeepDeviceCOP()
 {
 	std::string TestName = "Is Heep Device COP";
@@ -461,6 +585,197 @@ void TestDeleteMOPOpCode()
 	CheckResults(TestName, valueList, 2);
 }
 
+void FillInputBufferWithDeleteMOPCOP(heepByte opCode, heepByte* deviceID, heepByte* data, heepByte dataLength)
+{
+	ClearInputBuffer();
+	unsigned int counter = 0;
+	counter = AddCharToBuffer(inputBuffer, counter, DeleteMOPOpCode);
+	counter = AddCharToBuffer(inputBuffer, counter, STANDARD_ID_SIZE + 2 + dataLength);
+	counter = AddCharToBuffer(inputBuffer, counter, opCode);
+	memcpy(&inputBuffer[counter], deviceID, STANDARD_ID_SIZE);
+	counter += STANDARD_ID_SIZE;
+	counter = AddCharToBuffer(inputBuffer, counter, dataLength);
+	memcpy(&inputBuffer[counter], data, dataLength);
+}
+
+void AddRawMOPToMemory(heepByte opCode, heepByte* deviceID, heepByte* data, heepByte dataLength)
+{
+	PerformPreOpCodeProcessing_Byte(deviceID);
+	AddNewCharToMemory(opCode);
+	AddIndexOrDeviceIDToMemory_Byte(deviceID);
+	AddNewCharToMemory(dataLength);
+	AddBufferToMemory(data, dataLength);
+}
+
+int CountMOPsInMemory()
+{
+	int numberOfMOPs = 0;
+	unsigned int counter = 0;
+	while(counter < curFilledMemory)
+	{
+		counter = SkipOpCode(counter);
+		numberOfMOPs++;
+	}
+
+	if(counter != curFilledMemory)
+		return -1;
+
+	return numberOfMOPs;
+}
+
+void TestIndexingWhenMemoryIsFull()
+{
+	std::string TestName = "Test Indexing When Memory Is Full";
+
+	ClearVertices();
+	ClearDeviceMemory();
+
+	// Too little room is left for a Local Device ID MOP
+	heepByte userData = 0x33;
+	while(WillMemoryOverflow(4) == 0)
+	{
+		AddUserMemory(3, &userData, 1);
+	}
+	unsigned int filledBefore = curFilledMemory;
+
+	heepByte newID [STANDARD_ID_SIZE];
+	CreateFakeDeviceID(newID, 20);
+
+	heepByte indexedID [STANDARD_ID_SIZE];
+	CopyDeviceID(newID, indexedID);
+	heepByte indexedSize = GetIndexedDeviceID_Byte(indexedID);
+
+	// Neither a delete nor a read may index the device
+	heepByte iconID = 1;
+	FillInputBufferWithDeleteMOPCOP(IconIDOpCode, newID, &iconID, 1);
+	ExecuteControlOpCodes();
+
+	int x = 0; int y = 0;
+	unsigned int XYMemPosition = 0;
+	heepByte readID [STANDARD_ID_SIZE];
+	CopyDeviceID(newID, readID);
+	unsigned int XYFound = GetXYFromMemory_Byte(&x, &y, readID, &XYMemPosition);
+
+	ExpectedValue valueList [3];
+	valueList[0].valueName = "Indexed Size";
+#ifdef USE_INDEXED_IDS
+	valueList[0].expectedValue = 0;
+#else
+	valueList[0].expectedValue = STANDARD_ID_SIZE;
+#endif
+	valueList[0].actualValue = indexedSize;
+
+	valueList[1].valueName = "XY Not Found";
+	valueList[1].expectedValue = 1;
+	valueList[1].actualValue = XYFound;
+
+	valueList[2].valueName = "Memory Unchanged";
+	valueList[2].expectedValue = filledBefore;
+	valueList[2].actualValue = curFilledMemory;
+
+	CheckResults(TestName, valueList, 3);
+}
+
+void TestDeleteMOPIndex()
+{
+	std::string TestName = "Test Delete MOP Index";
+
+	heepByte firstID [STANDARD_ID_SIZE];
+	heepByte secondID [STANDARD_ID_SIZE];
+	CreateFakeDeviceID(firstID, 30);
+	CreateFakeDeviceID(secondID, 40);
+	heepByte name [] = {'D', 'u', 'p'};
+
+	ClearDeviceMemory();
+	AddRawMOPToMemory(DeviceNameOpCode, firstID, name, 3);
+	AddRawMOPToMemory(DeviceNameOpCode, secondID, name, 3);
+	AddRawMOPToMemory(DeviceNameOpCode, firstID, name, 3);
+	SetXYInMemory_Byte(10, 20, secondID);
+	int MOPsBefore = CountMOPsInMemory();
+
+	// Both copies go, and the fragments can still be stepped over
+	FillInputBufferWithDeleteMOPCOP(DeviceNameOpCode, firstID, name, 3);
+	ExecuteControlOpCodes();
+	heepByte duplicateROP = outputBuffer[0];
+	int fragmentsAfterDuplicates = 0;
+	unsigned int counter = 0;
+	while(counter < curFilledMemory)
+	{
+		if(deviceMemory[counter] == FragmentOpCode)
+			fragmentsAfterDuplicates++;
+
+		counter = SkipOpCode(counter);
+	}
+	int MOPsAfterDuplicates = CountMOPsInMemory();
+
+	// A position moved in place is found at its new value, not its old one
+	UpdateXYInMemory_Byte(0x0102, 0x0304, secondID);
+	heepByte oldPosition [] = {0, 10, 0, 20};
+	FillInputBufferWithDeleteMOPCOP(FrontEndPositionOpCode, secondID, oldPosition, 4);
+	ExecuteControlOpCodes();
+	heepByte oldPositionROP = outputBuffer[0];
+
+	heepByte newPosition [] = {0x01, 0x02, 0x03, 0x04};
+	FillInputBufferWithDeleteMOPCOP(FrontEndPositionOpCode, secondID, newPosition, 4);
+	ExecuteControlOpCodes();
+	heepByte newPositionROP = outputBuffer[0];
+
+	// Defragmenting moves the remaining name
+	DefragmentMemory();
+	FillInputBufferWithDeleteMOPCOP(DeviceNameOpCode, secondID, name, 3);
+	ExecuteControlOpCodes();
+	heepByte movedROP = outputBuffer[0];
+
+	// The length sent must agree with the MOP's own length
+	FillInputBufferWithDeleteMOPCOP(DeviceNameOpCode, secondID, name, 3);
+	inputBuffer[1]++;
+	ExecuteControlOpCodes();
+	heepByte badLengthROP = outputBuffer[0];
+
+	ExpectedValue valueList [9];
+	valueList[0].valueName = "MOPs Before";
+#ifdef USE_INDEXED_IDS
+	valueList[0].expectedValue = 6; // Plus a Local Device ID MOP for each device
+#else
+	valueList[0].expectedValue = 4;
+#endif
+	valueList[0].actualValue = MOPsBefore;
+
+	valueList[1].valueName = "Duplicate ROP";
+	valueList[1].expectedValue = SuccessOpCode;
+	valueList[1].actualValue = duplicateROP;
+
+	valueList[2].valueName = "Fragments";
+	valueList[2].expectedValue = 2;
+	valueList[2].actualValue = fragmentsAfterDuplicates;
+
+	valueList[3].valueName = "MOPs After Duplicates";
+	valueList[3].expectedValue = MOPsBefore;
+	valueList[3].actualValue = MOPsAfterDuplicates;
+
+	valueList[4].valueName = "Old Position ROP";
+	valueList[4].expectedValue = ErrorOpCode;
+	valueList[4].actualValue = oldPositionROP;
+
+	valueList[5].valueName = "New Position ROP";
+	valueList[5].expectedValue = SuccessOpCode;
+	valueList[5].actualValue = newPositionROP;
+
+	valueList[6].valueName = "Moved ROP";
+	valueList[6].expectedValue = SuccessOpCode;
+	valueList[6].actualValue = movedROP;
+
+	valueList[7].valueName = "Bad Length ROP";
+	valueList[7].expectedValue = ErrorOpCode;
+	valueList[7].actualValue = badLengthROP;
+
+	valueList[8].valueName = "Memory Walks";
+	valueList[8].expectedValue = 1;
+	valueList[8].actualValue = CountMOPsInMemory() >= 0;
+
+	CheckResults(TestName, valueList, 9);
+}
+
 void TestGetAnalyticsString()
 {
 #ifdef USE_ANALYTICS
@@ -620,6 +935,9 @@ void TestSetVertexOverflow()
 	heepByte firstROP = outputBuffer[0];
 	for(int i = 0; i < 20000; i++)
 	{
+		// Repeated vertices are not stored, so each one differs
+		inputBuffer[10] = i%256;
+		inputBuffer[11] = (i/256)%256;
 		ExecuteControlOpCodes();
 	}
 	heepByte lastROP = outputBuffer[0];
@@ -753,12 +1071,22 @@ void TestWiFiOverflowDetection()
 	inputBuffer[17] = (unsigned char)'e';
 	inputBuffer[18] = (unsigned char)'t';
 
-	for(int i =0; i<20000;i++)
+	// Replacing the same setting reuses the space of the old one
+	for(int i =0; i<200;i++)
 		ExecuteControlOpCodes();
 
+	heepByte replacementCode = outputBuffer[0];
+
+	// Settings at different priorities all stay
+	for(int i =0; i<256;i++)
+	{
+		inputBuffer[2] = i;
+		ExecuteControlOpCodes();
+	}
+
 	heepByte shouldbeFailureCode = outputBuffer[0];
 
-	ExpectedValue valueList [3];
+	ExpectedValue valueList [4];
 	valueList[0].valueName = "Less than max memory";
 	valueList[0].expectedValue = 1;
 	valueList[0].actualValue = curFilledMemory <= MAX_MEMORY;
@@ -771,7 +1099,11 @@ void TestWiFiOverflowDetection()
 	valueList[2].expectedValue = SuccessOpCode;
 	valueList[2].actualValue = shouldBeSuccessCode;
 
-	CheckResults(TestName, valueList, 3);
+	valueList[3].valueName = "Replacement ROP Should be Success";
+	valueList[3].expectedValue = SuccessOpCode;
+	valueList[3].actualValue = replacementCode;
+
+	CheckResults(TestName, valueList, 4);
 }
 
 void TestNameOverflowDetection()
@@ -922,10 +1254,1036 @@ void TestMyIPChangedCOP()
 	CheckResults(TestName, valueList, 8);
 }
 
+void TestIPDirectory()
+{
+#ifdef USE_IP_DIRECTORY
+	std::string TestName = "Test IP Directory";
+
+	ClearVertices();
+	ClearDeviceMemory();
+	ClearInputBuffer();
+	ClearOutputBuffer();
+
+	heepByte firstRxID [STANDARD_ID_SIZE] = {0xA1, 0xA2, 0xA3, 0xA4};
+	heepByte secondRxID [STANDARD_ID_SIZE] = {0xB1, 0xB2, 0xB3, 0xB4};
+
+	struct Vertex_Byte newVertex;
+	CopyDeviceID(deviceIDByte, newVertex.txID);
+	CopyDeviceID(firstRxID, newVertex.rxID);
+	newVertex.rxIPAddress.Octet4 = 10;
+	newVertex.rxIPAddress.Octet3 = 0;
+	newVertex.rxIPAddress.Octet2 = 0;
+	newVertex.rxIPAddress.Octet1 = 5;
+
+	for(int i = 0; i < 3; i++)
+	{
+		newVertex.txControlID = i;
+		newVertex.rxControlID = i;
+		AddVertex(newVertex);
+	}
+
+	// The directory entry and indexed IDs exist now, so this is just the vertex
+	unsigned int filledBeforeVertex = curFilledMemory;
+	newVertex.txControlID = 3;
+	newVertex.rxControlID = 3;
+	AddVertex(newVertex);
+	unsigned int vertexBytes = curFilledMemory - filledBeforeVertex;
+
+	CopyDeviceID(secondRxID, newVertex.rxID);
+	newVertex.rxIPAddress.Octet1 = 6;
+	AddVertex(newVertex);
+
+	memoryChanged = 0;
+	inputBuffer[0] = MyIPChangedOpCode;
+	inputBuffer[1] = STANDARD_ID_SIZE + 4;
+	for(int i = 0; i < STANDARD_ID_SIZE; i++)
+	{
+		inputBuffer[2 + i] = firstRxID[i];
+	}
+	inputBuffer[2 + STANDARD_ID_SIZE] = 192;
+	inputBuffer[3 + STANDARD_ID_SIZE] = 168;
+	inputBuffer[4 + STANDARD_ID_SIZE] = 1;
+	inputBuffer[5 + STANDARD_ID_SIZE] = 100;
+	ExecuteControlOpCodes();
+
+	int changedVertices = 0;
+	for(int i = 0; i < 4; i++)
+	{
+		struct Vertex_Byte storedVertex;
+		GetVertexAtPointer_Byte(vertexPointerList[i], &storedVertex);
+		if(storedVertex.rxIPAddress.Octet4 == 192 && storedVertex.rxIPAddress.Octet1 == 100)
+			changedVertices++;
+	}
+
+	struct Vertex_Byte secondVertex;
+	GetVertexAtPointer_Byte(vertexPointerList[4], &secondVertex);
+
+	// Entries must follow their MOPs when memory is defragmented
+	DeleteVertexAtPointer(vertexPointerList[0]);
+	DefragmentMemory();
+	FillVertexListFromMemory();
+
+	struct Vertex_Byte movedVertex;
+	GetVertexAtPointer_Byte(vertexPointerList[0], &movedVertex);
+
+	ExpectedValue valueList [6];
+	valueList[0].valueName = "Vertex Bytes";
+	valueList[0].expectedValue = 2*ID_SIZE + 4;
+	valueList[0].actualValue = vertexBytes;
+
+	valueList[1].valueName = "Changed Vertices";
+	valueList[1].expectedValue = 4;
+	valueList[1].actualValue = changedVertices;
+
+	valueList[2].valueName = "Memory Changed";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = memoryChanged;
+
+	valueList[3].valueName = "Other Device IP";
+	valueList[3].expectedValue = 6;
+	valueList[3].actualValue = secondVertex.rxIPAddress.Octet1;
+
+	valueList[4].valueName = "IP After Defragment";
+	valueList[4].expectedValue = 100;
+	valueList[4].actualValue = movedVertex.rxIPAddress.Octet1;
+
+	valueList[5].valueName = "Control After Defragment";
+	valueList[5].expectedValue = 1;
+	valueList[5].actualValue = movedVertex.txControlID;
+
+	CheckResults(TestName, valueList, 6);
+#endif
+}
+
+void TestIPDirectoryCleanup()
+{
+#ifdef USE_IP_DIRECTORY
+	std::string TestName = "Test IP Directory Cleanup";
+
+	ClearVertices();
+	ClearDeviceMemory();
+
+	heepByte firstRxID [STANDARD_ID_SIZE] = {0xA1, 0xA2, 0xA3, 0xA4};
+	heepByte secondRxID [STANDARD_ID_SIZE] = {0xB1, 0xB2, 0xB3, 0xB4};
+
+	struct Vertex_Byte firstVertex;
+	CopyDeviceID(deviceIDByte, firstVertex.txID);
+	CopyDeviceID(firstRxID, firstVertex.rxID);
+	firstVertex.txControlID = 0;
+	firstVertex.rxControlID = 0;
+	firstVertex.rxIPAddress.Octet4 = 10;
+	firstVertex.rxIPAddress.Octet3 = 0;
+	firstVertex.rxIPAddress.Octet2 = 0;
+	firstVertex.rxIPAddress.Octet1 = 5;
+	AddVertex(firstVertex);
+
+	struct Vertex_Byte secondVertex = firstVertex;
+	secondVertex.txControlID = 1;
+	secondVertex.rxControlID = 1;
+	AddVertex(secondVertex);
+
+	struct Vertex_Byte otherDeviceVertex = firstVertex;
+	CopyDeviceID(secondRxID, otherDeviceVertex.rxID);
+	otherDeviceVertex.rxIPAddress.Octet1 = 6;
+	AddVertex(otherDeviceVertex);
+
+	unsigned int pointers [4];
+	unsigned int entriesBefore = FindMOPsWithOpCode(RemoteDeviceIPOpCode, pointers, 4);
+
+	// Another vertex still goes to the device
+	DeleteVertex(firstVertex);
+	unsigned int entriesAfterFirst = FindMOPsWithOpCode(RemoteDeviceIPOpCode, pointers, 4);
+
+	struct HeepIPAddress theIP;
+	DeleteVertex(secondVertex);
+	unsigned int entriesAfterLast = FindMOPsWithOpCode(RemoteDeviceIPOpCode, pointers, 4);
+	heepByte removedIPFound = GetIPFromDirectory(firstRxID, &theIP) == 0;
+
+	GetIPFromDirectory(secondRxID, &theIP);
+	unsigned char otherDeviceIP = theIP.Octet1;
+
+	// The device gets a new entry with the IP it is added with next
+	firstVertex.rxIPAddress.Octet1 = 7;
+	AddVertex(firstVertex);
+	GetIPFromDirectory(firstRxID, &theIP);
+	unsigned char readdedIP = theIP.Octet1;
+
+	ExpectedValue valueList [6];
+	valueList[0].valueName = "Entries Before Deletion";
+	valueList[0].expectedValue = 2;
+	valueList[0].actualValue = entriesBefore;
+
+	valueList[1].valueName = "Entry Kept For Remaining Vertex";
+	valueList[1].expectedValue = 2;
+	valueList[1].actualValue = entriesAfterFirst;
+
+	valueList[2].valueName = "Entry Deleted With Last Vertex";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = entriesAfterLast;
+
+	valueList[3].valueName = "Deleted Entry Not Found";
+	valueList[3].expectedValue = 0;
+	valueList[3].actualValue = removedIPFound;
+
+	valueList[4].valueName = "Other Device IP";
+	valueList[4].expectedValue = 6;
+	valueList[4].actualValue = otherDeviceIP;
+
+	valueList[5].valueName = "IP Of Readded Device";
+	valueList[5].expectedValue = 7;
+	valueList[5].actualValue = readdedIP;
+
+	CheckResults(TestName, valueList, 6);
+#endif
+}
+
+void TestIPDirectoryWithFailedVertex()
+{
+#ifdef USE_IP_DIRECTORY
+	std::string TestName = "Test IP Directory With Failed Vertex";
+
+	ClearVertices();
+	ClearDeviceMemory();
+
+	// Raw MOPs leave no fragments for compaction to reclaim
+	heepByte userData = 0x33;
+	AddRawMOPToMemory(USER_MOP_START_ID, deviceIDByte, &userData, 1);
+	unsigned int userMOPBytes = 1 + ID_SIZE + 2;
+
+	// Leave room for the device's index and directory MOP, but not the vertex
+	unsigned int roomWithoutVertex = 1 + ID_SIZE + 1 + 4;
+#ifdef USE_INDEXED_IDS
+	roomWithoutVertex += 1 + ID_SIZE + 1 + STANDARD_ID_SIZE;
+#endif
+	while(WillMemoryOverflow(roomWithoutVertex + userMOPBytes) == 0)
+	{
+		AddRawMOPToMemory(USER_MOP_START_ID, deviceIDByte, &userData, 1);
+	}
+	unsigned int filledBefore = curFilledMemory;
+
+	struct Vertex_Byte theVertex;
+	CopyDeviceID(deviceIDByte, theVertex.txID);
+	CreateFakeDeviceID(theVertex.rxID, 30);
+	theVertex.txControlID = 0;
+	theVertex.rxControlID = 0;
+	theVertex.rxIPAddress.Octet4 = 10;
+	theVertex.rxIPAddress.Octet3 = 0;
+	theVertex.rxIPAddress.Octet2 = 0;
+	theVertex.rxIPAddress.Octet1 = 5;
+
+	unsigned int vertexPointer = 0;
+	heepByte vertexSet = SetVertexInMemory_Byte(theVertex, &vertexPointer);
+
+	struct HeepIPAddress theIP;
+	heepByte IPFound = GetIPFromDirectory(theVertex.rxID, &theIP) == 0;
+
+	ExpectedValue valueList [3];
+	valueList[0].valueName = "Vertex Rejected";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = vertexSet;
+
+	valueList[1].valueName = "Memory Unchanged";
+	valueList[1].expectedValue = filledBefore;
+	valueList[1].actualValue = curFilledMemory;
+
+	valueList[2].valueName = "No Directory Entry";
+	valueList[2].expectedValue = 0;
+	valueList[2].actualValue = IPFound;
+
+	CheckResults(TestName, valueList, 3);
+#endif
+}
+
+void TestIPDirectoryBatch()
+{
+#ifdef USE_IP_DIRECTORY
+	std::string TestName = "Test IP Directory Batch";
+
+	ClearVertices();
+	ClearDeviceMemory();
+
+	// Both vertices go to one device, which keeps the last IP
+	struct Vertex_Byte vertices [2];
+	for(int i = 0; i < 2; i++)
+	{
+		CopyDeviceID(deviceIDByte, vertices[i].txID);
+		CreateFakeDeviceID(vertices[i].rxID, 30);
+		vertices[i].txControlID = i;
+		vertices[i].rxControlID = 0;
+		vertices[i].rxIPAddress.Octet4 = 10;
+		vertices[i].rxIPAddress.Octet3 = 0;
+		vertices[i].rxIPAddress.Octet2 = 0;
+		vertices[i].rxIPAddress.Octet1 = 5 + i;
+	}
+
+	unsigned int vertexPointers [2];
+	heepByte verticesSet = SetVerticesInMemory_Byte(vertices, 2, vertexPointers);
+
+	struct HeepIPAddress theIP;
+	theIP.Octet1 = 0;
+	GetIPFromDirectory(vertices[0].rxID, &theIP);
+
+	struct Vertex_Byte firstVertex;
+	GetVertexAtPointer_Byte(vertexPointers[0], &firstVertex);
+
+	ExpectedValue valueList [4];
+	valueList[0].valueName = "Batch Set";
+	valueList[0].expectedValue = 0;
+	valueList[0].actualValue = verticesSet;
+
+	valueList[1].valueName = "Directory IP";
+	valueList[1].expectedValue = 6;
+	valueList[1].actualValue = theIP.Octet1;
+
+	valueList[2].valueName = "First Vertex IP";
+	valueList[2].expectedValue = 6;
+	valueList[2].actualValue = firstVertex.rxIPAddress.Octet1;
+
+	valueList[3].valueName = "IP Left Out Of Vertex";
+	valueList[3].expectedValue = ID_SIZE + 2;
+	valueList[3].actualValue = deviceMemory[vertexPointers[0] + 1 + ID_SIZE];
+
+	CheckResults(TestName, valueList, 4);
+#endif
+}
+
+void TestIPDirectoryWithFailedBatch()
+{
+#ifdef USE_IP_DIRECTORY
+	std::string TestName = "Test IP Directory With Failed Batch";
+
+	ClearVertices();
+	ClearDeviceMemory();
+
+	heepByte userData = 0x33;
+	AddRawMOPToMemory(USER_MOP_START_ID, deviceIDByte, &userData, 1);
+	unsigned int userMOPBytes = 1 + ID_SIZE + 2;
+
+	// Leave room for the first vertex and its directory MOP, but not the second
+	unsigned int roomForOneVertex = (1 + ID_SIZE + 1 + 4) + (1 + ID_SIZE + 1 + ID_SIZE + 2);
+#ifdef USE_INDEXED_IDS
+	roomForOneVertex += 1 + ID_SIZE + 1 + STANDARD_ID_SIZE;
+#endif
+	while(WillMemoryOverflow(roomForOneVertex + userMOPBytes) == 0)
+	{
+		AddRawMOPToMemory(USER_MOP_START_ID, deviceIDByte, &userData, 1);
+	}
+	unsigned int filledBefore = curFilledMemory;
+
+	struct Vertex_Byte vertices [2];
+	for(int i = 0; i < 2; i++)
+	{
+		CopyDeviceID(deviceIDByte, vertices[i].txID);
+		CreateFakeDeviceID(vertices[i].rxID, 30 + i);
+		vertices[i].txControlID = 0;
+		vertices[i].rxControlID = 0;
+		vertices[i].rxIPAddress.Octet4 = 10;
+		vertices[i].rxIPAddress.Octet3 = 0;
+		vertices[i].rxIPAddress.Octet2 = 0;
+		vertices[i].rxIPAddress.Octet1 = 5 + i;
+	}
+
+	unsigned int vertexPointers [2];
+	heepByte verticesSet = SetVerticesInMemory_Byte(vertices, 2, vertexPointers);
+
+	struct HeepIPAddress theIP;
+	heepByte IPFound = GetIPFromDirectory(vertices[0].rxID, &theIP) == 0;
+
+	ExpectedValue valueList [3];
+	valueList[0].valueName = "Batch Rejected";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = verticesSet;
+
+	valueList[1].valueName = "Memory Unchanged";
+	valueList[1].expectedValue = filledBefore;
+	valueList[1].actualValue = curFilledMemory;
+
+	valueList[2].valueName = "No Directory Entry";
+	valueList[2].expectedValue = 0;
+	valueList[2].actualValue = IPFound;
+
+	CheckResults(TestName, valueList, 3);
+#endif
+}
+
+void FillInputBufferWithVertexCOP(heepByte opCode, heepByte* rxID, heepByte txControlID, heepByte rxControlID)
+{
+	unsigned int counter = 0;
+	counter = AddCharToBuffer(inputBuffer, counter, opCode);
+	counter = AddCharToBuffer(inputBuffer, counter, 2*STANDARD_ID_SIZE + 6);
+	counter = AddDeviceIDToBuffer_Byte(inputBuffer, deviceIDByte, counter);
+	counter = AddDeviceIDToBuffer_Byte(inputBuffer, rxID, counter);
+	counter = AddCharToBuffer(inputBuffer, counter, txControlID);
+	counter = AddCharToBuffer(inputBuffer, counter, rxControlID);
+	counter = AddCharToBuffer(inputBuffer, counter, 10);
+	counter = AddCharToBuffer(inputBuffer, counter, 0);
+	counter = AddCharToBuffer(inputBuffer, counter, 0);
+	counter = AddCharToBuffer(inputBuffer, counter, 1);
+}
+
+void TestDuplicateVertices()
+{
+	std::string TestName = "Test Duplicate Vertices";
+
+	ClearVertices();
+	ClearDeviceMemory();
+	ClearInputBuffer();
+	ClearOutputBuffer();
+
+	heepByte rxID [STANDARD_ID_SIZE];
+	CreateFakeDeviceID(rxID, 1);
+
+	FillInputBufferWithVertexCOP(SetVertexOpCode, rxID, 1, 2);
+	ExecuteControlOpCodes();
+	unsigned int filledAfterFirst = curFilledMemory;
+
+	ExecuteControlOpCodes();
+	heepByte resendROP = outputBuffer[0];
+	unsigned int filledAfterResend = curFilledMemory;
+	unsigned int verticesAfterResend = numberOfVertices;
+
+	// Enough vertices that deleting some has to move others in the index
+	for(int i = 0; i < 60; i++)
+	{
+		FillInputBufferWithVertexCOP(SetVertexOpCode, rxID, i, 3);
+		ExecuteControlOpCodes();
+	}
+
+	for(int i = 0; i < 60; i += 3)
+	{
+		FillInputBufferWithVertexCOP(DeleteVertexOpCode, rxID, i, 3);
+		ExecuteControlOpCodes();
+	}
+
+	FillInputBufferWithVertexCOP(DeleteVertexOpCode, rxID, 0, 3);
+	ExecuteControlOpCodes();
+	heepByte deleteAgainROP = outputBuffer[0];
+
+	int verticesFound = 0;
+	for(int i = 0; i < 60; i++)
+	{
+		struct Vertex_Byte vertex;
+		CopyDeviceID(deviceIDByte, vertex.txID);
+		CopyDeviceID(rxID, vertex.rxID);
+		vertex.txControlID = i;
+		vertex.rxControlID = 3;
+
+		unsigned int filledBefore = curFilledMemory;
+		AddVertex(vertex);
+		if(curFilledMemory == filledBefore)
+			verticesFound++;
+	}
+
+	ExpectedValue valueList [6];
+	valueList[0].valueName = "Resend ROP";
+	valueList[0].expectedValue = SuccessOpCode;
+	valueList[0].actualValue = resendROP;
+
+	valueList[1].valueName = "Memory After Resend";
+	valueList[1].expectedValue = filledAfterFirst;
+	valueList[1].actualValue = filledAfterResend;
+
+	valueList[2].valueName = "Vertices After Resend";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = verticesAfterResend;
+
+	valueList[3].valueName = "Delete Again ROP";
+	valueList[3].expectedValue = ErrorOpCode;
+	valueList[3].actualValue = deleteAgainROP;
+
+	valueList[4].valueName = "Vertices Still Found";
+	valueList[4].expectedValue = 40;
+	valueList[4].actualValue = verticesFound;
+
+	valueList[5].valueName = "Vertices";
+	valueList[5].expectedValue = 61;
+	valueList[5].actualValue = numberOfVertices;
+
+	CheckResults(TestName, valueList, 6);
+}
+
+unsigned int AddVertexToSetVerticesCOP(unsigned int counter, heepByte* rxID, heepByte controlID)
+{
+	counter = AddDeviceIDToBuffer_Byte(inputBuffer, deviceIDByte, counter);
+	counter = AddDeviceIDToBuffer_Byte(inputBuffer, rxID, counter);
+	counter = AddCharToBuffer(inputBuffer, counter, controlID);
+	counter = AddCharToBuffer(inputBuffer, counter, controlID);
+	counter = AddCharToBuffer(inputBuffer, counter, 10);
+	counter = AddCharToBuffer(inputBuffer, counter, 0);
+	counter = AddCharToBuffer(inputBuffer, counter, 0);
+	counter = AddCharToBuffer(inputBuffer, counter, controlID);
+	return counter;
+}
+
+// Three new vertices, one already stored and one repeated in the batch
+void FillInputBufferWithSetVerticesCOP(heepByte* firstRxID, heepByte* secondRxID, heepByte* thirdRxID)
+{
+	unsigned int counter = 0;
+	counter = AddCharToBuffer(inputBuffer, counter, SetVerticesOpCode);
+	counter = AddCharToBuffer(inputBuffer, counter, 5*(2*STANDARD_ID_SIZE + 6));
+	counter = AddVertexToSetVerticesCOP(counter, firstRxID, 0);
+	counter = AddVertexToSetVerticesCOP(counter, firstRxID, 1);
+	counter = AddVertexToSetVerticesCOP(counter, secondRxID, 2);
+	counter = AddVertexToSetVerticesCOP(counter, firstRxID, 1);
+	counter = AddVertexToSetVerticesCOP(counter, thirdRxID, 3);
+}
+
+void AddTestVertex(heepByte* rxID, heepByte controlID)
+{
+	struct Vertex_Byte vertex;
+	CopyDeviceID(deviceIDByte, vertex.txID);
+	CopyDeviceID(rxID, vertex.rxID);
+	vertex.txControlID = controlID;
+	vertex.rxControlID = controlID;
+	vertex.rxIPAddress.Octet4 = 10;
+	vertex.rxIPAddress.Octet3 = 0;
+	vertex.rxIPAddress.Octet2 = 0;
+	vertex.rxIPAddress.Octet1 = controlID;
+	AddVertex(vertex);
+}
+
+void TestSetVerticesCOP()
+{
+	std::string TestName = "Test Set Vertices COP";
+
+	heepByte firstRxID [STANDARD_ID_SIZE];
+	heepByte secondRxID [STANDARD_ID_SIZE];
+	heepByte thirdRxID [STANDARD_ID_SIZE];
+	CreateFakeDeviceID(firstRxID, 1);
+	CreateFakeDeviceID(secondRxID, 2);
+	CreateFakeDeviceID(thirdRxID, 3);
+
+	// The same vertices added one at a time
+	ClearVertices();
+	ClearDeviceMemory();
+	AddTestVertex(firstRxID, 0);
+	AddTestVertex(firstRxID, 1);
+	AddTestVertex(secondRxID, 2);
+	AddTestVertex(thirdRxID, 3);
+	unsigned int filledOneAtATime = curFilledMemory;
+
+	ClearVertices();
+	ClearDeviceMemory();
+	ClearInputBuffer();
+	ClearOutputBuffer();
+	AddTestVertex(firstRxID, 0);
+
+	FillInputBufferWithSetVerticesCOP(firstRxID, secondRxID, thirdRxID);
+	ExecuteControlOpCodes();
+	unsigned int filledByBatch = curFilledMemory;
+
+	char expectedMessage [] = "3 of 5 Vertices Set";
+	int messageStart = 2 + STANDARD_ID_SIZE;
+	int messageMatches = strncmp((char*)&outputBuffer[messageStart], expectedMessage, strlen(expectedMessage)) == 0;
+
+	struct Vertex_Byte lastVertex;
+	GetVertexAtPointer_Byte(vertexPointerList[3], &lastVertex);
+
+	// Too little space for the batch stores none of it
+	ClearVertices();
+	ClearDeviceMemory();
+	heepByte userData [200];
+	memset(userData, 0, sizeof(userData));
+	while(WillMemoryOverflow(250) == 0)
+	{
+		AddUserMemory(0, userData, 200);
+	}
+	while(WillMemoryOverflow(3*(2*ID_SIZE + 7)) == 0)
+	{
+		AddUserMemory(0, userData, 1);
+	}
+	unsigned int filledBeforeOverflow = curFilledMemory;
+
+	FillInputBufferWithSetVerticesCOP(firstRxID, secondRxID, thirdRxID);
+	ExecuteControlOpCodes();
+
+	ExpectedValue valueList [8];
+	valueList[0].valueName = "Message";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = messageMatches;
+
+	valueList[1].valueName = "Memory Matches One At A Time";
+	valueList[1].expectedValue = filledOneAtATime;
+	valueList[1].actualValue = filledByBatch;
+
+	valueList[2].valueName = "Last RX ID";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = CheckBufferEquality(lastVertex.rxID, thirdRxID, STANDARD_ID_SIZE);
+
+	valueList[3].valueName = "Last Control";
+	valueList[3].expectedValue = 3;
+	valueList[3].actualValue = lastVertex.txControlID;
+
+	valueList[4].valueName = "Last IP";
+	valueList[4].expectedValue = 3;
+	valueList[4].actualValue = lastVertex.rxIPAddress.Octet1;
+
+	valueList[5].valueName = "Overflow ROP";
+	valueList[5].expectedValue = ErrorOpCode;
+	valueList[5].actualValue = outputBuffer[0];
+
+	valueList[6].valueName = "Memory After Overflow";
+	valueList[6].expectedValue = filledBeforeOverflow;
+	valueList[6].actualValue = curFilledMemory;
+
+	valueList[7].valueName = "Vertices After Overflow";
+	valueList[7].expectedValue = 0;
+	valueList[7].actualValue = numberOfVertices;
+
+	CheckResults(TestName, valueList, 8);
+}
+
+heepByte exportedImage [MAX_MEMORY];
+
+// Exports the whole memory image through Export Memory Image COPs
+unsigned int ExportMemoryImage(unsigned short* checksum)
+{
+	unsigned int imageSize = 0;
+	unsigned int offset = 0;
+
+	do
+	{
+		ClearInputBuffer();
+		unsigned int counter = 0;
+		counter = AddCharToBuffer(inputBuffer, counter, ExportMemoryImageOpCode);
+		counter = AddCharToBuffer(inputBuffer, counter, 2);
+		AddNumberToBufferWithSpecifiedBytes(inputBuffer, offset, counter, 2);
+		ExecuteControlOpCodes();
+
+		unsigned int ROPCounter = 1 + STANDARD_ID_SIZE;
+		unsigned int chunkLength = GetNumberFromBuffer(outputBuffer, &ROPCounter, 1) - 7;
+		ROPCounter++;
+		imageSize = GetNumberFromBuffer(outputBuffer, &ROPCounter, 2);
+		*checksum = GetNumberFromBuffer(outputBuffer, &ROPCounter, 2);
+		ROPCounter += 2;
+
+		memcpy(&exportedImage[offset], &outputBuffer[ROPCounter], chunkLength);
+		offset += chunkLength;
+	} while(offset < imageSize);
+
+	return imageSize;
+}
+
+void FillInputBufferWithImportMemoryImageCOP(unsigned char imageControlRegister, heepByte* sourceID, unsigned int imageSize, unsigned short checksum, unsigned int offset, unsigned int chunkLength)
+{
+	ClearInputBuffer();
+	unsigned int counter = 0;
+	counter = AddCharToBuffer(inputBuffer, counter, ImportMemoryImageOpCode);
+	counter = AddCharToBuffer(inputBuffer, counter, 1 + STANDARD_ID_SIZE + 6 + chunkLength);
+	counter = AddCharToBuffer(inputBuffer, counter, imageControlRegister);
+	memcpy(&inputBuffer[counter], sourceID, STANDARD_ID_SIZE);
+	counter += STANDARD_ID_SIZE;
+	counter = AddNumberToBufferWithSpecifiedBytes(inputBuffer, imageSize, counter, 2);
+	counter = AddNumberToBufferWithSpecifiedBytes(inputBuffer, checksum, counter, 2);
+	counter = AddNumberToBufferWithSpecifiedBytes(inputBuffer, offset, counter, 2);
+	memcpy(&inputBuffer[counter], &exportedImage[offset], chunkLength);
+}
+
+void ImportMemoryImage(unsigned char imageControlRegister, heepByte* sourceID, unsigned int imageSize, unsigned short checksum)
+{
+	for(unsigned int offset = 0; offset < imageSize; offset += MEMORY_IMAGE_CHUNK_SIZE)
+	{
+		unsigned int chunkLength = imageSize - offset;
+		if(chunkLength > MEMORY_IMAGE_CHUNK_SIZE)
+			chunkLength = MEMORY_IMAGE_CHUNK_SIZE;
+
+		FillInputBufferWithImportMemoryImageCOP(imageControlRegister, sourceID, imageSize, checksum, offset, chunkLength);
+		ExecuteControlOpCodes();
+	}
+}
+
+void TestMemoryImageCOPs()
+{
+#ifdef USE_MEMORY_IMAGE_IMPORT
+	std::string TestName = "Test Memory Image COPs";
+
+	heepByte sourceID [STANDARD_ID_SIZE];
+	heepByte replacementID [STANDARD_ID_SIZE];
+	heepByte rxID [STANDARD_ID_SIZE];
+	CopyDeviceID(deviceIDByte, sourceID);
+	CreateFakeDeviceID(replacementID, 20);
+	CreateFakeDeviceID(rxID, 1);
+
+	ClearVertices();
+	ClearDeviceMemory();
+	SetXYInMemory_Byte(0x0102, 0x0304, deviceIDByte);
+	AddTestVertex(rxID, 1);
+	heepByte userData [200];
+	memset(userData, 0x42, sizeof(userData));
+	AddUserMemory(0, userData, 200);
+	unsigned int sourceFilledMemory = curFilledMemory;
+
+	unsigned short checksum = 0;
+	unsigned int imageSize = ExportMemoryImage(&checksum);
+
+	// Restore the image onto a replacement device
+	CopyDeviceID(replacementID, deviceIDByte);
+	ClearVertices();
+	ClearDeviceMemory();
+	memoryChanged = 0;
+	ImportMemoryImage(controlRegister, sourceID, imageSize, checksum);
+
+	heepByte restoredROP = outputBuffer[0];
+	unsigned int restoredFilledMemory = curFilledMemory;
+	heepByte restoredMemoryChanged = memoryChanged;
+	int restoredVertices = numberOfVertices;
+	struct Vertex_Byte restoredVertex;
+	GetVertexAtPointer_Byte(vertexPointerList[0], &restoredVertex);
+	int x = 0; int y = 0; unsigned int xyMemPosition = 0;
+	GetXYFromMemory_Byte(&x, &y, deviceIDByte, &xyMemPosition);
+
+	heepByte memorySnapshot [MAX_MEMORY];
+	memcpy(memorySnapshot, deviceMemory, curFilledMemory);
+
+	// An image laid out for other ID settings is refused
+	FillInputBufferWithImportMemoryImageCOP(controlRegister + 1, sourceID, imageSize, checksum, 0, MEMORY_IMAGE_CHUNK_SIZE);
+	ExecuteControlOpCodes();
+	heepByte formatROP = outputBuffer[0];
+
+	// So is one that does not match its checksum
+	ImportMemoryImage(controlRegister, sourceID, imageSize, checksum + 1);
+	heepByte checksumROP = outputBuffer[0];
+
+	// And one whose MOPs run past its end
+	exportedImage[ID_SIZE + 1] = 0xFF;
+	ImportMemoryImage(controlRegister, sourceID, imageSize, CalculateMemoryImageChecksum(exportedImage, imageSize));
+	heepByte corruptROP = outputBuffer[0];
+
+	int memoryUnchanged = curFilledMemory == restoredFilledMemory && memcmp(memorySnapshot, deviceMemory, curFilledMemory) == 0;
+
+	CopyDeviceID(sourceID, deviceIDByte);
+
+	ExpectedValue valueList [11];
+	valueList[0].valueName = "Restored ROP";
+	valueList[0].expectedValue = SuccessOpCode;
+	valueList[0].actualValue = restoredROP;
+
+	valueList[1].valueName = "Filled Memory";
+	valueList[1].expectedValue = sourceFilledMemory;
+	valueList[1].actualValue = restoredFilledMemory;
+
+	valueList[2].valueName = "Memory Changed";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = restoredMemoryChanged;
+
+	valueList[3].valueName = "Vertices";
+	valueList[3].expectedValue = 1;
+	valueList[3].actualValue = restoredVertices;
+
+	valueList[4].valueName = "Vertex TX ID";
+	valueList[4].expectedValue = 1;
+	valueList[4].actualValue = CheckBufferEquality(restoredVertex.txID, replacementID, STANDARD_ID_SIZE);
+
+	valueList[5].valueName = "Vertex RX ID";
+	valueList[5].expectedValue = 1;
+	valueList[5].actualValue = CheckBufferEquality(restoredVertex.rxID, rxID, STANDARD_ID_SIZE);
+
+	valueList[6].valueName = "x";
+	valueList[6].expectedValue = 0x0102;
+	valueList[6].actualValue = x;
+
+	valueList[7].valueName = "Format ROP";
+	valueList[7].expectedValue = ErrorOpCode;
+	valueList[7].actualValue = formatROP;
+
+	valueList[8].valueName = "Checksum ROP";
+	valueList[8].expectedValue = ErrorOpCode;
+	valueList[8].actualValue = checksumROP;
+
+	valueList[9].valueName = "Corrupt ROP";
+	valueList[9].expectedValue = ErrorOpCode;
+	valueList[9].actualValue = corruptROP;
+
+	valueList[10].valueName = "Memory Unchanged";
+	valueList[10].expectedValue = 1;
+	valueList[10].actualValue = memoryUnchanged;
+
+	CheckResults(TestName, valueList, 11);
+#endif
+}
+
+void TestAddMOPOverflow()
+{
+	std::string TestName = "Test Add MOP Overflow Detection";
+
+	ClearVertices();
+	ClearDeviceMemory();
+
+	heepByte firstROP = 0;
+	for(int i = 0; i < 2000; i++)
+	{
+		// Indexed builds restructure the MOP in place, so rebuild it every time
+		ClearInputBuffer();
+		inputBuffer[0] = AddMOPOpCode;
+		inputBuffer[1] = 0x0B;
+		inputBuffer[2] = DeviceNameOpCode;
+		inputBuffer[3] = 0x01;
+		inputBuffer[4] = 0x02;
+		inputBuffer[5] = 0x03;
+		inputBuffer[6] = 0x04;
+		inputBuffer[7] = 0x05;
+		inputBuffer[8] = 'J';
+		inputBuffer[9] = 'a';
+		inputBuffer[10] = 'm';
+		inputBuffer[11] = 'e';
+		inputBuffer[12] = 's';
+
+		ExecuteControlOpCodes();
+
+		if(i == 0)
+			firstROP = outputBuffer[0];
+	}
+	heepByte lastROP = outputBuffer[0];
+
+	ExpectedValue valueList [3];
+	valueList[0].valueName = "Less than max memory";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = curFilledMemory <= MAX_MEMORY;
+
+	valueList[1].valueName = "ROP Should be Failure";
+	valueList[1].expectedValue = ErrorOpCode;
+	valueList[1].actualValue = lastROP;
+
+	valueList[2].valueName = "ROP Should be Success";
+	valueList[2].expectedValue = SuccessOpCode;
+	valueList[2].actualValue = firstROP;
+
+	CheckResults(TestName, valueList, 3);
+}
+
+void FillInputBufferWithReliableSetVal(unsigned short sequenceNumber, unsigned char value)
+{
+	ClearInputBuffer();
+	inputBuffer[0] = ReliableSetValueOpCode;
+	inputBuffer[1] = STANDARD_ID_SIZE + 4;
+	inputBuffer[2] = 0x0A;
+	inputBuffer[3] = 0x0B;
+	inputBuffer[4] = 0x0C;
+	inputBuffer[5] = 0x0D;
+	inputBuffer[6] = sequenceNumber >> 8;
+	inputBuffer[7] = sequenceNumber & 0xFF;
+	inputBuffer[8] = 0;
+	inputBuffer[9] = value;
+}
+
+// The ack holds the sequence number received, then the last one applied
+unsigned short GetReliableAckNumber(int position)
+{
+	unsigned int counter = 1 + STANDARD_ID_SIZE + 1 + 2*position;
+	return GetNumberFromBuffer(outputBuffer, &counter, 2);
+}
+
+void TestReliableSetValCOP()
+{
+	std::string TestName = "Test Reliable SetVal COP";
+
+	ClearControls();
+	ClearReliableDelivery();
+	AddRangeControl("Dimmer", HEEP_INPUT, 100, 0, 0);
+
+	FillInputBufferWithReliableSetVal(0xFFFE, 10);
+	ExecuteControlOpCodes();
+
+	ExpectedValue valueList [9];
+	valueList[0].valueName = "First Value Applied";
+	valueList[0].expectedValue = 10;
+	valueList[0].actualValue = controlList[0].curValue;
+
+	valueList[1].valueName = "Ack ROP";
+	valueList[1].expectedValue = ReliableAckOpCode;
+	valueList[1].actualValue = outputBuffer[0];
+
+	valueList[2].valueName = "Ack Applied";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = GetReliableAckNumber(0) == 0xFFFE && GetReliableAckNumber(1) == 0xFFFE;
+
+	// A duplicate is acked again but not applied twice
+	controlList[0].curValue = 0;
+	FillInputBufferWithReliableSetVal(0xFFFE, 10);
+	ExecuteControlOpCodes();
+
+	valueList[3].valueName = "Duplicate Not Applied";
+	valueList[3].expectedValue = 0;
+	valueList[3].actualValue = controlList[0].curValue;
+
+	valueList[4].valueName = "Duplicate Acked";
+	valueList[4].expectedValue = 0xFFFE;
+	valueList[4].actualValue = GetReliableAckNumber(0);
+
+	// Sequence numbers wrap
+	FillInputBufferWithReliableSetVal(0x0001, 20);
+	ExecuteControlOpCodes();
+
+	valueList[5].valueName = "Wrapped Value Applied";
+	valueList[5].expectedValue = 20;
+	valueList[5].actualValue = controlList[0].curValue;
+
+	// A late arrival must not overwrite a newer value
+	FillInputBufferWithReliableSetVal(0xFFFF, 30);
+	ExecuteControlOpCodes();
+
+	valueList[6].valueName = "Late Value Not Applied";
+	valueList[6].expectedValue = 20;
+	valueList[6].actualValue = controlList[0].curValue;
+
+	valueList[7].valueName = "Late Value Ack Received";
+	valueList[7].expectedValue = 0xFFFF;
+	valueList[7].actualValue = GetReliableAckNumber(0);
+
+	valueList[8].valueName = "Late Value Ack Last Applied";
+	valueList[8].expectedValue = 0x0001;
+	valueList[8].actualValue = GetReliableAckNumber(1);
+
+	CheckResults(TestName, valueList, 9);
+}
+
+void TestReliableCOPsFromUnknownDevices()
+{
+	std::string TestName = "Test Reliable COPs From Unknown Devices";
+
+	ClearControls();
+	ClearReliableDelivery();
+	AddRangeControl("Dimmer", HEEP_INPUT, 100, 0, 0);
+
+	FillInputBufferWithReliableSetVal(0x0001, 10);
+	inputBuffer[1] = STANDARD_ID_SIZE + 3;
+	ExecuteControlOpCodes();
+
+	ExpectedValue valueList [5];
+	valueList[0].valueName = "Bad Length Rejected";
+	valueList[0].expectedValue = ErrorOpCode;
+	valueList[0].actualValue = outputBuffer[0];
+
+	valueList[1].valueName = "Bad Length Not Applied";
+	valueList[1].expectedValue = 0;
+	valueList[1].actualValue = controlList[0].curValue;
+
+	valueList[2].valueName = "Bad Length Adds No Peer";
+	valueList[2].expectedValue = 0;
+	valueList[2].actualValue = reliableDelivery.peers[0].inUse;
+
+	// An ack from a device we never sent to must not take a destination
+	ClearInputBuffer();
+	inputBuffer[0] = ReliableAckOpCode;
+	inputBuffer[1] = 0x0A;
+	inputBuffer[2] = 0x0B;
+	inputBuffer[3] = 0x0C;
+	inputBuffer[4] = 0x0D;
+	inputBuffer[5] = 4;
+	inputBuffer[7] = 1;
+	inputBuffer[9] = 1;
+	ExecuteReliableAckOpCode();
+
+	int destinationsInUse = 0;
+	for(int i = 0; i < RELIABLE_DESTINATIONS; i++)
+		destinationsInUse += reliableDelivery.destinations[i].inUse;
+
+	valueList[3].valueName = "Unknown Ack Adds No Destination";
+	valueList[3].expectedValue = 0;
+	valueList[3].actualValue = destinationsInUse;
+
+	heepByte unknownID [STANDARD_ID_SIZE] = {0x0A, 0x0B, 0x0C, 0x0D};
+	valueList[4].valueName = "Unknown Device Timeout";
+	valueList[4].expectedValue = RELIABLE_INITIAL_TIMEOUT;
+	valueList[4].actualValue = GetReliableRetransmissionTimeout(unknownID);
+
+	CheckResults(TestName, valueList, 5);
+}
+
+void FillInputBufferWithStaleControlsROP(heepByte* rxID, unsigned char numberOfStaleControls, unsigned char controlID)
+{
+	unsigned int counter = 0;
+	counter = AddCharToBuffer(inputBuffer, counter, StaleControlsOpCode);
+	counter = AddDeviceIDToBuffer_Byte(inputBuffer, rxID, counter);
+	counter = AddCharToBuffer(inputBuffer, counter, numberOfStaleControls);
+	counter = AddCharToBuffer(inputBuffer, counter, controlID);
+}
+
+void TestControlSummaryBounds()
+{
+	std::string TestName = "Test Control Summary Bounds";
+
+	// A summary never outgrows the receiver's input buffer
+	FillOutputBufferWithControlSummaryHeader();
+	int controlsAdded = 0;
+	while(AddControlToControlSummaryCOP(controlsAdded, 0) == 0)
+		controlsAdded++;
+
+	ClearInputBuffer();
+	inputBuffer[0] = ControlSummaryOpCode;
+	inputBuffer[1] = 255;
+	ExecuteControlSummaryOpCode();
+	unsigned char oversizedSummaryReply = outputBuffer[0];
+
+	ClearVertices();
+	ClearDeviceMemory();
+	ClearControls();
+	AddOnOffControl("Switch", HEEP_OUTPUT, 1);
+
+	Vertex_Byte theVertex;
+	CopyDeviceID(deviceIDByte, theVertex.txID);
+	CreateFakeDeviceID(theVertex.rxID, 10);
+	theVertex.txControlID = 0;
+	theVertex.rxControlID = 5;
+	theVertex.rxIPAddress.Octet4 = 10;
+	theVertex.rxIPAddress.Octet3 = 0;
+	theVertex.rxIPAddress.Octet2 = 0;
+	theVertex.rxIPAddress.Octet1 = 2;
+	AddVertex(theVertex);
+	SetReliableDelivery(0);
+
+	ClearOutputBuffer();
+	FillInputBufferWithStaleControlsROP(theVertex.rxID, 1, 5);
+	ExecuteStaleControlsOpCode();
+	unsigned char staleControlResent = outputBuffer[0] == SetValueOpCode;
+
+	ClearOutputBuffer();
+	FillInputBufferWithStaleControlsROP(theVertex.rxID, 250, 5);
+	ExecuteStaleControlsOpCode();
+	unsigned int oversizedStaleBytes = outputBufferLastByte;
+
+	// The count claims more controls than the datagram held
+	ClearOutputBuffer();
+	FillInputBufferWithStaleControlsROP(theVertex.rxID, 2, 5);
+	inputBufferLastByte = STANDARD_ID_SIZE + 3;
+	ExecuteStaleControlsOpCode();
+	unsigned int truncatedStaleBytes = outputBufferLastByte;
+	ClearInputBuffer();
+
+	ExpectedValue valueList [6];
+	valueList[0].valueName = "Controls In One Summary";
+	valueList[0].expectedValue = (INPUT_BUFFER_SIZE - 2) / 2;
+	valueList[0].actualValue = controlsAdded;
+
+	valueList[1].valueName = "Summary Fits Input Buffer";
+	valueList[1].expectedValue = 1;
+	valueList[1].actualValue = outputBuffer[1] + 2 <= INPUT_BUFFER_SIZE;
+
+	valueList[2].valueName = "Oversized Summary Rejected";
+	valueList[2].expectedValue = ErrorOpCode;
+	valueList[2].actualValue = oversizedSummaryReply;
+
+	valueList[3].valueName = "Stale Control Resent";
+	valueList[3].expectedValue = 1;
+	valueList[3].actualValue = staleControlResent;
+
+	valueList[4].valueName = "Oversized Stale Controls Dropped";
+	valueList[4].expectedValue = 0;
+	valueList[4].actualValue = oversizedStaleBytes;
+
+	valueList[5].valueName = "Truncated Stale Controls Dropped";
+	valueList[5].expectedValue = 0;
+	valueList[5].actualValue = truncatedStaleBytes;
+
+	CheckResults(TestName, valueList, 6);
+}
+
 void TestActionAndResponseOpCodes()
 {
 	TestClearOutputBufferAndAddChar();
 	TestMemoryDumpROP();
+	TestMemoryDumpOverflow();
+	TestMessageROP();
 	TestHeepDeviceCOP();
 	TestNumberFromBuffer();
 	TestSetValSuccess();
@@ -933,13 +2291,27 @@ void TestActionAndResponseOpCodes()
 	TestSetPositionOpCode();
 	TestSetVertxCOP();
 	TestAddMOPOpCode();
+	TestAddMOPOverflow();
 	TestDeleteMOPOpCode();
+	TestIndexingWhenMemoryIsFull();
+	TestDeleteMOPIndex();
 	TestGetAnalyticsString();
 	TestAddWiFiCOP();
 	TestDeviceNameCOP();
 	TestSetVertexOverflow();
+	TestDuplicateVertices();
+	TestSetVerticesCOP();
+	TestMemoryImageCOPs();
 	CheckSetPositionOverflowHandling();
 	TestWiFiOverflowDetection();
 	TestNameOverflowDetection();
 	TestMyIPChangedCOP();
+	TestIPDirectory();
+	TestIPDirectoryCleanup();
+	TestIPDirectoryWithFailedVertex();
+	TestIPDirectoryBatch();
+	TestIPDirectoryWithFailedBatch();
+	TestReliableSetValCOP();
+	TestReliableCOPsFromUnknownDevices();
+	TestControlSummaryBounds();
 }
\ No newline at end of file
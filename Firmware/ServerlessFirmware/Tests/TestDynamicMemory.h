@@ -35,6 +35,29 @@ int GetMemCounterStart()
 #endif
 }
 
+// Bytes a vertex to a new receiving device adds, not counting local IDs.
+// With the IP directory the receiver's IP is a MOP of its own
+int GetNewVertexBytes()
+{
+#ifdef USE_IP_DIRECTORY
+	return (ID_SIZE + 2 + ID_SIZE + 2) + (ID_SIZE + 2 + 4);
+#else
+	return ID_SIZE + 2 + ID_SIZE + 6;
+#endif
+}
+
+// Where the vertex's receiver IP is stored
+unsigned int GetVertexIPPointer(unsigned int vertexPointer)
+{
+#ifdef USE_IP_DIRECTORY
+	unsigned int directoryPointer = 0;
+	FindMOPsWithOpCode(RemoteDeviceIPOpCode, &directoryPointer, 1);
+	return directoryPointer + ID_SIZE + 2;
+#else
+	return vertexPointer + ID_SIZE + ID_SIZE + 4;
+#endif
+}
+
 void TestAddCharToBuffer()
 {
 	std::string TestName = "Add Char to Buffer";
@@ -200,13 +223,13 @@ void TestDefragmentDeviceMemory()
 	ExpectedValue valueList [3];
 	unsigned int beforeDeletionMemory = curFilledMemory;
 	valueList[0].valueName = "Memory Filled Before Deletion";
-	valueList[0].expectedValue = ID_SIZE+2+ID_SIZE+6 + memCheckStart;
+	valueList[0].expectedValue = GetNewVertexBytes() + memCheckStart;
 	valueList[0].actualValue = beforeDeletionMemory;
 
-	DeleteVertexAtPointer(memCheckStart);
+	DeleteVertexAtPointer(pointer);
 	unsigned int afterDeletionMemory = curFilledMemory;
 	valueList[1].valueName = "Memory Filled After Deletion";
-	valueList[1].expectedValue = ID_SIZE+2+ID_SIZE+6 + memCheckStart;
+	valueList[1].expectedValue = GetNewVertexBytes() + memCheckStart;
 	valueList[1].actualValue = afterDeletionMemory;
 
 	DefragmentMemory();
@@ -243,16 +266,10 @@ void TestDefragmentDeviceMemoryAtEnd()
 	SetDeviceNameInMemory_Byte("Crowbar", 7, deviceID1);
 	SetIPInMemory_Byte(theIP, deviceID1);
 
-	int vertexPointer = curFilledMemory;
-
-#ifdef USE_INDEXED_IDS
-	vertexPointer += ID_SIZE+STANDARD_ID_SIZE+2;
-#endif
-
 	unsigned int pointer = 0;
 	SetVertexInMemory_Byte(theVertex, &pointer);
 	unsigned int beforeDeletionMemory = curFilledMemory;
-	DeleteVertexAtPointer(vertexPointer);
+	DeleteVertexAtPointer(pointer);
 	unsigned int afterDeletionMemory = curFilledMemory;
 
 	ExpectedValue valueList [2];
@@ -263,7 +280,7 @@ void TestDefragmentDeviceMemoryAtEnd()
 
 	DefragmentMemory();
 	valueList[1].valueName = "Memory Filled after Defragmentation";
-	valueList[1].expectedValue = afterDeletionMemory - (ID_SIZE + 2 + ID_SIZE + 6);
+	valueList[1].expectedValue = afterDeletionMemory - GetNewVertexBytes();
 	valueList[1].actualValue = curFilledMemory;
 
 	CheckResults(TestName, valueList, 2);
@@ -292,15 +309,13 @@ void TestDefragmentDeviceMemoryDeviceAtFront()
 	theIP.Octet1 = 150;
 	theVertex.rxIPAddress = theIP;
 
-	int memCheckStart = GetMemCounterStart()*2;
-
 	unsigned int pointer = 0;
 	SetVertexInMemory_Byte(theVertex, &pointer);
 	SetDeviceNameInMemory_Byte("Crowbar", 7, deviceID1);
 	SetIPInMemory_Byte(theIP, deviceID2);
 	ExpectedValue valueList [2];
 	unsigned int beforeDeletionMemory = curFilledMemory;
-	DeleteVertexAtPointer(memCheckStart);
+	DeleteVertexAtPointer(pointer);
 	unsigned int afterDeletionMemory = curFilledMemory;
 
 	valueList[0].valueName = "Memory Filled Before and after Deletion";
@@ -309,7 +324,7 @@ void TestDefragmentDeviceMemoryDeviceAtFront()
 
 	DefragmentMemory();
 	valueList[1].valueName = "Memory Filled after Defragmentation";
-	valueList[1].expectedValue = afterDeletionMemory - (ID_SIZE + 2 + ID_SIZE + 6);
+	valueList[1].expectedValue = afterDeletionMemory - GetNewVertexBytes();
 	valueList[1].actualValue = curFilledMemory;
 
 	CheckResults(TestName, valueList, 2);
@@ -341,17 +356,11 @@ void TestDefragmentDeviceMemoryInMiddle()
 
 	SetDeviceNameInMemory_Byte("Crowbar", 7, deviceID2);
 
-	int vertexPointer = curFilledMemory;
-
-#ifdef USE_INDEXED_IDS
-	vertexPointer += ID_SIZE+STANDARD_ID_SIZE+2;
-#endif
-
 	unsigned int pointer = 0;
 	SetVertexInMemory_Byte(theVertex, &pointer);
 	SetIPInMemory_Byte(theIP, deviceID2);
 	unsigned int beforeDeletionMemory = curFilledMemory;
-	DeleteVertexAtPointer(vertexPointer);
+	DeleteVertexAtPointer(pointer);
 	unsigned int afterDeletionMemory = curFilledMemory;
 
 	ExpectedValue valueList [2];
@@ -361,7 +370,7 @@ void TestDefragmentDeviceMemoryInMiddle()
 
 	DefragmentMemory();
 	valueList[1].valueName = "Memory Filled after Defragmentation";
-	valueList[1].expectedValue = afterDeletionMemory - (ID_SIZE + 2 + ID_SIZE + 6);
+	valueList[1].expectedValue = afterDeletionMemory - GetNewVertexBytes();
 	valueList[1].actualValue = curFilledMemory;
 	CheckResults(TestName, valueList, 2);
 }
@@ -1113,7 +1122,8 @@ void TestSetVertexOpCode_Byte()
 	unsigned int pointer = 0;
 	SetVertexInMemory_Byte(myVertex, &pointer);
 
-	int memCheckStart = GetMemCounterStart()*2;
+	unsigned int memCheckStart = pointer;
+	unsigned int ipCheckStart = GetVertexIPPointer(pointer);
 
 	ExpectedValue valueList [8];
 	valueList[0].valueName = "Vertex OpCode";
@@ -1121,7 +1131,11 @@ void TestSetVertexOpCode_Byte()
 	valueList[0].actualValue = deviceMemory[memCheckStart];
 
 	valueList[1].valueName = "Num Bytes";
+#ifdef USE_IP_DIRECTORY
+	valueList[1].expectedValue = ID_SIZE + 2;
+#else
 	valueList[1].expectedValue = ID_SIZE + 6;
+#endif
 	valueList[1].actualValue = deviceMemory[memCheckStart + ID_SIZE + 1];
 
 	valueList[2].valueName = "Tx Control ID";
@@ -1134,19 +1148,19 @@ void TestSetVertexOpCode_Byte()
 
 	valueList[4].valueName = "IP Octet 4";
 	valueList[4].expectedValue = 192;
-	valueList[4].actualValue = deviceMemory[memCheckStart + ID_SIZE + ID_SIZE + 4];
+	valueList[4].actualValue = deviceMemory[ipCheckStart + 0];
 
 	valueList[5].valueName = "IP Octet 3";
 	valueList[5].expectedValue = 168;
-	valueList[5].actualValue = deviceMemory[memCheckStart + ID_SIZE + ID_SIZE + 5];
+	valueList[5].actualValue = deviceMemory[ipCheckStart + 1];
 
 	valueList[6].valueName = "IP Octet 2";
 	valueList[6].expectedValue = 1;
-	valueList[6].actualValue = deviceMemory[memCheckStart + ID_SIZE + ID_SIZE + 6];
+	valueList[6].actualValue = deviceMemory[ipCheckStart + 2];
 
 	valueList[7].valueName = "IP Octet 1";
 	valueList[7].expectedValue = 100;
-	valueList[7].actualValue = deviceMemory[memCheckStart + ID_SIZE + ID_SIZE + 7];
+	valueList[7].actualValue = deviceMemory[ipCheckStart + 3];
 
 	CheckResults(TestName, valueList, 8);
 }
@@ -1175,10 +1189,8 @@ void TestGetVertex_Byte()
 	unsigned int pointer = 0;
 	SetVertexInMemory_Byte(myVertex, &pointer);
 
-	int memCheckStart = GetMemCounterStart()*2;
-
 	Vertex_Byte newVertex;
-	int success = GetVertexAtPointer_Byte(memCheckStart, &newVertex);
+	int success = GetVertexAtPointer_Byte(pointer, &newVertex);
 
 	PrintDeviceMemory();
 
@@ -1608,6 +1620,393 @@ void TestGetIPFromMemory()
 	CheckResults(TestName, valueList, 4);
 }
 
+void TestLazyDefragmentation()
+{
+	std::string TestName = "Test Lazy Defragmentation";
+
+	ClearVertices();
+	ClearDeviceMemory();
+
+	heepByte userData [100];
+	memset(userData, 0, sizeof(userData));
+	AddUserMemory(0, userData, 10);
+	unsigned int smallMOP = GetMemCounterStart();
+	unsigned int largeMOP = curFilledMemory;
+	AddUserMemory(1, userData, 100);
+	AddUserMemory(2, userData, 100);
+
+	// A small fragment is left alone until the threshold allows it
+	FragmentMOPAtPointer(smallMOP);
+	unsigned int smallFragment = fragmentedMemory;
+	unsigned long defragmentationsBefore = numberOfDefragmentations;
+	SetDefragmentThreshold(50);
+	DefragmentMemoryIfFragmented();
+	unsigned long defragmentationsAboveThreshold = numberOfDefragmentations;
+
+	SetDefragmentThreshold(0);
+	DefragmentMemoryIfFragmented();
+	unsigned long defragmentationsAtThreshold = numberOfDefragmentations;
+	unsigned int fragmentsAfterDefragmenting = fragmentedMemory;
+	SetDefragmentThreshold(DEFRAGMENT_THRESHOLD_PERCENT);
+
+	// An allocation compacts memory only if the fragments make the room
+	largeMOP -= smallFragment;
+	Vertex_Byte theVertex;
+	CopyDeviceID(deviceIDByte, theVertex.txID);
+	CreateFakeDeviceID(theVertex.rxID, 1);
+	theVertex.txControlID = 1;
+	theVertex.rxControlID = 2;
+	theVertex.rxIPAddress.Octet4 = 10;
+	theVertex.rxIPAddress.Octet3 = 0;
+	theVertex.rxIPAddress.Octet2 = 0;
+	theVertex.rxIPAddress.Octet1 = 2;
+	AddVertex(theVertex);
+
+	while(WillMemoryOverflow(100) == 0)
+	{
+		AddUserMemory(3, userData, 1);
+	}
+	FragmentMOPAtPointer(largeMOP);
+
+	unsigned long defragmentationsBeforeAllocation = numberOfDefragmentations;
+	heepByte tooLarge = MakeRoomInMemory(300);
+	unsigned long defragmentationsAfterTooLarge = numberOfDefragmentations;
+	heepByte overflowsBeforeCompaction = WillMemoryOverflow(150);
+	unsigned long defragmentationsAfterCheck = numberOfDefragmentations;
+	heepByte fits = MakeRoomInMemory(150);
+
+	ExpectedValue valueList [10];
+	valueList[0].valueName = "Small Fragment";
+	valueList[0].expectedValue = ID_SIZE + 12;
+	valueList[0].actualValue = smallFragment;
+
+	valueList[1].valueName = "Above Threshold";
+	valueList[1].expectedValue = defragmentationsBefore;
+	valueList[1].actualValue = defragmentationsAboveThreshold;
+
+	valueList[2].valueName = "At Threshold";
+	valueList[2].expectedValue = defragmentationsBefore + 1;
+	valueList[2].actualValue = defragmentationsAtThreshold;
+
+	valueList[3].valueName = "Fragments After Defragmenting";
+	valueList[3].expectedValue = 0;
+	valueList[3].actualValue = fragmentsAfterDefragmenting;
+
+	valueList[4].valueName = "Too Large";
+	valueList[4].expectedValue = 1;
+	valueList[4].actualValue = tooLarge;
+
+	valueList[5].valueName = "No Compaction When Too Large";
+	valueList[5].expectedValue = defragmentationsBeforeAllocation;
+	valueList[5].actualValue = defragmentationsAfterTooLarge;
+
+	valueList[6].valueName = "Fits After Compaction";
+	valueList[6].expectedValue = 0;
+	valueList[6].actualValue = fits;
+
+	valueList[7].valueName = "Vertex Pointer Follows";
+	valueList[7].expectedValue = VertexOpCode;
+	valueList[7].actualValue = deviceMemory[vertexPointerList[0]];
+
+	// Only MakeRoomInMemory moves memory
+	valueList[8].valueName = "Overflows Before Compaction";
+	valueList[8].expectedValue = 1;
+	valueList[8].actualValue = overflowsBeforeCompaction;
+
+	valueList[9].valueName = "No Compaction When Checking";
+	valueList[9].expectedValue = defragmentationsAfterTooLarge;
+	valueList[9].actualValue = defragmentationsAfterCheck;
+
+
+	CheckResults(TestName, valueList, 10);
+}
+
+void TestMOPBuilder()
+{
+	std::string TestName = "Test MOP Builder";
+
+	ClearVertices();
+	ClearDeviceMemory();
+
+	heepByte userData [100];
+	memset(userData, 0x33, sizeof(userData));
+	AddUserMemory(0, userData, 100);
+	unsigned int largeMOP = GetMemCounterStart();
+
+	while(WillMemoryOverflow(60) == 0)
+	{
+		AddUserMemory(3, userData, 1);
+	}
+
+	// Writers that never checked for room now leave memory alone
+	unsigned int filledBeforeIcon = curFilledMemory;
+	char iconData [80];
+	memset(iconData, 0, sizeof(iconData));
+	heepByte iconAdded = SetIconDataInMemory_Byte(iconData, sizeof(iconData), deviceIDByte);
+	unsigned int filledAfterIcon = curFilledMemory;
+
+	// Nothing is committed if any reservation fails or is left unwritten
+	struct MOPBuilder builder;
+	StartMOPs(&builder);
+	ReserveMOP(&builder, IconIDOpCode, deviceIDByte, 1);
+	AddByteToMOP(&builder, 1);
+	heepByte tooLargeReserved = ReserveMOPBytes(&builder, MAX_MEMORY);
+	heepByte tooLargeCommitted = CommitMOPs(&builder);
+
+	StartMOPs(&builder);
+	ReserveMOP(&builder, IconIDOpCode, deviceIDByte, 2);
+	AddByteToMOP(&builder, 1);
+	heepByte unwrittenCommitted = CommitMOPs(&builder);
+	unsigned int filledAfterFailures = curFilledMemory;
+
+	// A reservation that compacts memory takes the pending MOPs with it
+	FragmentMOPAtPointer(largeMOP);
+	unsigned long defragmentationsBefore = numberOfDefragmentations;
+
+	heepByte localID [STANDARD_ID_SIZE];
+	StartMOPs(&builder);
+	ReserveLocalDeviceID(&builder, deviceIDByte, localID);
+	ReserveMOPWithLocalID(&builder, USER_MOP_START_ID + 1, localID, 10);
+	AddBytesToMOP(&builder, userData, 10);
+	ReserveMOPWithLocalID(&builder, USER_MOP_START_ID + 2, localID, 50);
+	AddBytesToMOP(&builder, userData, 50);
+	heepByte compactedCommitted = CommitMOPs(&builder);
+	unsigned int firstMOP = builder.start;
+	heepByte lastPendingByte = deviceMemory[curFilledMemory - 1];
+
+	// Devices indexed by the builder are found before they are committed
+	ClearDeviceMemory();
+	heepByte newID [STANDARD_ID_SIZE];
+	CreateFakeDeviceID(newID, 7);
+	StartMOPs(&builder);
+	ReserveMOP(&builder, IconIDOpCode, newID, 1);
+	AddByteToMOP(&builder, 1);
+	ReserveMOP(&builder, FrontEndPositionOpCode, newID, 4);
+	AddNumberToMOP(&builder, 0x01020304, 4);
+	CommitMOPs(&builder);
+
+	unsigned int expectedSize = 1 + ID_SIZE + 2 + 1 + ID_SIZE + 5;
+#ifdef USE_INDEXED_IDS
+	expectedSize += 1 + ID_SIZE + 1 + STANDARD_ID_SIZE;
+#endif
+
+	ExpectedValue valueList [12];
+	valueList[0].valueName = "Icon Data Rejected";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = iconAdded;
+
+	valueList[1].valueName = "Memory After Icon Data";
+	valueList[1].expectedValue = filledBeforeIcon;
+	valueList[1].actualValue = filledAfterIcon;
+
+	valueList[2].valueName = "Too Large Reserved";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = tooLargeReserved;
+
+	valueList[3].valueName = "Too Large Committed";
+	valueList[3].expectedValue = 1;
+	valueList[3].actualValue = tooLargeCommitted;
+
+	valueList[4].valueName = "Unwritten Committed";
+	valueList[4].expectedValue = 1;
+	valueList[4].actualValue = unwrittenCommitted;
+
+	valueList[5].valueName = "Memory After Failures";
+	valueList[5].expectedValue = filledBeforeIcon;
+	valueList[5].actualValue = filledAfterFailures;
+
+	valueList[6].valueName = "Compacted Committed";
+	valueList[6].expectedValue = 0;
+	valueList[6].actualValue = compactedCommitted;
+
+	valueList[7].valueName = "Compacted";
+	valueList[7].expectedValue = defragmentationsBefore + 1;
+	valueList[7].actualValue = numberOfDefragmentations;
+
+	valueList[8].valueName = "First Pending MOP Moved";
+	valueList[8].expectedValue = USER_MOP_START_ID + 1;
+	valueList[8].actualValue = deviceMemory[firstMOP];
+
+	valueList[9].valueName = "Second Pending MOP Moved";
+	valueList[9].expectedValue = USER_MOP_START_ID + 2;
+	valueList[9].actualValue = deviceMemory[firstMOP + ID_SIZE + 12];
+
+	valueList[10].valueName = "Pending Data Moved";
+	valueList[10].expectedValue = 0x33;
+	valueList[10].actualValue = lastPendingByte;
+
+	valueList[11].valueName = "Indexed Once";
+	valueList[11].expectedValue = expectedSize;
+	valueList[11].actualValue = curFilledMemory;
+
+	CheckResults(TestName, valueList, 12);
+}
+
+// Compares FindMOPsWithOpCode with a walk of memory. Returns how many were found
+int CheckFoundMOPs(heepByte opCode, heepByte* allFound)
+{
+	unsigned int pointers [MAX_MEMORY];
+	unsigned int numberFound = FindMOPsWithOpCode(opCode, pointers, MAX_MEMORY);
+
+	*allFound = 1;
+	unsigned int pointer = 0;
+	unsigned int counter = 0;
+	for(unsigned int i = 0; i < numberFound; i++)
+	{
+		if(GetMOPPointer(opCode, &pointer, &counter) != 0 || pointer != pointers[i])
+			*allFound = 0;
+	}
+
+	if(GetMOPPointer(opCode, &pointer, &counter) == 0)
+		*allFound = 0;
+
+	return numberFound;
+}
+
+void TestFindMOPsWithOpCode()
+{
+	std::string TestName = "Test Find MOPs With Op Code";
+
+	ClearVertices();
+	ClearDeviceMemory();
+
+	heepByte userData [4];
+	memset(userData, 0, sizeof(userData));
+	for(int i = 0; i < 40; i++)
+	{
+		AddUserMemory(i % 2, userData, 1 + i % 4);
+	}
+
+	heepByte userOpCode = USER_MOP_START_ID;
+	heepByte allFound [5];
+	int foundAtFirst = CheckFoundMOPs(userOpCode, &allFound[0]);
+
+	// A MOP added after the table was last used
+	AddUserMemory(0, userData, 2);
+	int foundAfterAdding = CheckFoundMOPs(userOpCode, &allFound[1]);
+
+	unsigned int pointers [3];
+	unsigned int foundWithLimit = FindMOPsWithOpCode(userOpCode, pointers, 3);
+	FragmentMOPAtPointer(pointers[2]);
+	int foundAfterFragmenting = CheckFoundMOPs(userOpCode, &allFound[2]);
+
+	FragmentAllOfMOP(USER_MOP_START_ID + 1);
+	int otherFoundAfterFragmentingAll = CheckFoundMOPs(USER_MOP_START_ID + 1, &allFound[3]);
+
+	DefragmentMemory();
+	int foundAfterDefragmenting = CheckFoundMOPs(userOpCode, &allFound[4]);
+
+	ExpectedValue valueList [11];
+	valueList[0].valueName = "Found At First";
+	valueList[0].expectedValue = 20;
+	valueList[0].actualValue = foundAtFirst;
+
+	valueList[1].valueName = "Found After Adding";
+	valueList[1].expectedValue = 21;
+	valueList[1].actualValue = foundAfterAdding;
+
+	valueList[2].valueName = "Found With Limit";
+	valueList[2].expectedValue = 3;
+	valueList[2].actualValue = foundWithLimit;
+
+	valueList[3].valueName = "Found After Fragmenting";
+	valueList[3].expectedValue = 20;
+	valueList[3].actualValue = foundAfterFragmenting;
+
+	valueList[4].valueName = "Other Found After Fragmenting All";
+	valueList[4].expectedValue = 0;
+	valueList[4].actualValue = otherFoundAfterFragmentingAll;
+
+	valueList[5].valueName = "Found After Defragmenting";
+	valueList[5].expectedValue = 20;
+	valueList[5].actualValue = foundAfterDefragmenting;
+
+	for(int i = 0; i < 5; i++)
+	{
+		valueList[6 + i].valueName = std::string("Walk Agrees ") + std::to_string(i);
+		valueList[6 + i].expectedValue = 1;
+		valueList[6 + i].actualValue = allFound[i];
+	}
+
+	CheckResults(TestName, valueList, 11);
+}
+
+// Copies the first MOP with the opcode out of memory
+unsigned int CopyFirstMOPWithOpCode(heepByte opCode, heepByte* MOP)
+{
+	unsigned int pointer = 0;
+	if(FindMOPsWithOpCode(opCode, &pointer, 1) == 0)
+		return 0;
+
+	unsigned int numBytes = SkipOpCode(pointer) - pointer;
+	memcpy(MOP, &deviceMemory[pointer], numBytes);
+	return numBytes;
+}
+
+void TestMOPIndexChurn()
+{
+	std::string TestName = "Test MOP Index Churn";
+
+	ClearVertices();
+	ClearDeviceMemory();
+	SetDefragmentThreshold(101);
+
+	heepByte userData [2] = {1, 2};
+	AddUserMemory(0, userData, 2);
+	AddUserMemory(0, userData, 2);
+	AddUserMemory(1, userData, 2);
+
+	heepByte MOP [20];
+	unsigned int numBytes = CopyFirstMOPWithOpCode(USER_MOP_START_ID, MOP);
+	unsigned int equalDeleted = DeleteMOPsEqualTo(MOP, numBytes);
+	unsigned int deletedAgain = DeleteMOPsEqualTo(MOP, numBytes);
+
+	// Each MOP is deleted before the next is added, so the index never holds
+	// more than a few of them
+	unsigned int churnDeleted = 0;
+	for(int i = 0; i < 2*MOP_INDEX_SIZE; i++)
+	{
+		userData[0] = i;
+		userData[1] = i >> 8;
+		AddUserMemory(2, userData, 2);
+		numBytes = CopyFirstMOPWithOpCode(USER_MOP_START_ID + 2, MOP);
+		churnDeleted += DeleteMOPsEqualTo(MOP, numBytes);
+	}
+
+	SetXYInMemory_Byte(10, 20, deviceIDByte);
+	heepByte oldXY [20];
+	unsigned int XYBytes = CopyFirstMOPWithOpCode(FrontEndPositionOpCode, oldXY);
+	UpdateXYInMemory_Byte(30, 40, deviceIDByte);
+	unsigned int oldXYDeleted = DeleteMOPsEqualTo(oldXY, XYBytes);
+	CopyFirstMOPWithOpCode(FrontEndPositionOpCode, MOP);
+	unsigned int newXYDeleted = DeleteMOPsEqualTo(MOP, XYBytes);
+
+	SetDefragmentThreshold(DEFRAGMENT_THRESHOLD_PERCENT);
+
+	ExpectedValue valueList [5];
+	valueList[0].valueName = "Equal MOPs Deleted";
+	valueList[0].expectedValue = 2;
+	valueList[0].actualValue = equalDeleted;
+
+	valueList[1].valueName = "Deleted Again";
+	valueList[1].expectedValue = 0;
+	valueList[1].actualValue = deletedAgain;
+
+	valueList[2].valueName = "Churned MOPs Deleted";
+	valueList[2].expectedValue = 2*MOP_INDEX_SIZE;
+	valueList[2].actualValue = churnDeleted;
+
+	valueList[3].valueName = "Rewritten MOP Old Bytes";
+	valueList[3].expectedValue = 0;
+	valueList[3].actualValue = oldXYDeleted;
+
+	valueList[4].valueName = "Rewritten MOP New Bytes";
+	valueList[4].expectedValue = 1;
+	valueList[4].actualValue = newXYDeleted;
+
+	CheckResults(TestName, valueList, 5);
+}
+
 void TestDynamicMemory()
 {	
 	TestAddIPToDeviceMemory();
@@ -1648,4 +2047,8 @@ void TestDynamicMemory()
  	TestUserMOP();
 	TestGetNumBytesFromMOP();
 	TestGetIPFromMemory();
+	TestLazyDefragmentation();
+	TestMOPBuilder();
+	TestFindMOPsWithOpCode();
+	TestMOPIndexChurn();
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "TestDynamicMemory.h"
 #include "TestActionAndResponseOpCodes.h"
 #include "TestAPI.h"
+#include "TestVirtualNetwork.h"
+#include "TestSimulationTimer.h"
 
 unsigned char clearMemory = 1;
 heepByte deviceIDByte [STANDARD_ID_SIZE] = {0x01, 0x02, 0x33, 0x04};
@@ -14,6 +16,8 @@ int main(void)
 	TestDynamicMemory();
 	TestActionAndResponseOpCodes();
 	TestHeepAPI();
+	TestVirtualNetwork();
+	TestSimulationTimer();
 
 	return 0;
 }
\ No newline at end of file
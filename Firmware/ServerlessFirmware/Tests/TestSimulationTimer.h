@@ -0,0 +1,195 @@
+#include "../Heep_API.h"
+#include "../Scheduler.h"
+#include "../Simulation_Timer.h"
+#include "../Simulation_VirtualNetwork.h"
+#include "UnitTestSystem.h"
+#include <unistd.h>
+
+void ScheduleTestTasks(int numberOfTasks)
+{
+	curNumberOfTasks = 0;
+	curTaskCounter = 0;
+	lastMillis = 0;
+
+	for(int i = 0; i < numberOfTasks; i++)
+	{
+		ScheduleTask(i);
+	}
+}
+
+void TestManualSimulationClock()
+{
+	std::string TestName = "Test Manual Simulation Clock";
+
+	SetSimulationClockMode(ManualClock);
+	SetSimulationClock(100);
+
+	unsigned long firstRead = GetMillis();
+	unsigned long secondRead = GetMillis();
+
+	AdvanceSimulationClock(250);
+	unsigned long advancedRead = GetMillis();
+
+	ExpectedValue valueList [3];
+	valueList[0].valueName = "First Read";
+	valueList[0].expectedValue = 100;
+	valueList[0].actualValue = firstRead;
+
+	valueList[1].valueName = "Reading Does Not Advance";
+	valueList[1].expectedValue = 100;
+	valueList[1].actualValue = secondRead;
+
+	valueList[2].valueName = "Advanced Read";
+	valueList[2].expectedValue = 350;
+	valueList[2].actualValue = advancedRead;
+
+	CheckResults(TestName, valueList, 3);
+
+	ResetSimulationClock();
+}
+
+void TestJumpToSchedulerDeadline()
+{
+	std::string TestName = "Test Jump To Scheduler Deadline";
+
+	SetSimulationClockMode(ManualClock);
+	ScheduleTestTasks(2);
+
+	unsigned char taskTimeBeforeJump = IsTaskTime();
+	uint64_t firstDeadline = JumpToNextSimulationDeadline(100000);
+	unsigned char taskTimeAfterJump = IsTaskTime();
+	uint64_t secondDeadline = JumpToNextSimulationDeadline(100000);
+	IsTaskTime();
+	uint64_t cappedDeadline = JumpToNextSimulationDeadline(secondDeadline + 10);
+
+	ExpectedValue valueList [5];
+	valueList[0].valueName = "Task Time Before Jump";
+	valueList[0].expectedValue = 0;
+	valueList[0].actualValue = taskTimeBeforeJump;
+
+	valueList[1].valueName = "First Deadline";
+	valueList[1].expectedValue = taskInterval + 1;
+	valueList[1].actualValue = firstDeadline;
+
+	valueList[2].valueName = "Task Time After Jump";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = taskTimeAfterJump;
+
+	valueList[3].valueName = "Second Deadline";
+	valueList[3].expectedValue = 2*(taskInterval + 1);
+	valueList[3].actualValue = secondDeadline;
+
+	valueList[4].valueName = "Deadline Capped By Max";
+	valueList[4].expectedValue = secondDeadline + 10;
+	valueList[4].actualValue = cappedDeadline;
+
+	CheckResults(TestName, valueList, 5);
+
+	ScheduleTestTasks(0);
+	ResetSimulationClock();
+}
+
+void TestJumpToVirtualDatagramDeadline()
+{
+	std::string TestName = "Test Jump To Virtual Datagram Deadline";
+
+	SetSimulationClockMode(ManualClock);
+	ScheduleTestTasks(0);
+
+	CreateVirtualNetwork(2, 1);
+	int sender = CreateVirtualTestDevice(0);
+	int receiver = CreateVirtualTestDevice(1);
+	ConnectVirtualTestDevices(sender, receiver);
+
+	VirtualLink slowLink = {200000, 0, 0, 0};
+	SetDefaultVirtualLink(slowLink);
+
+	// Datagrams leave from wherever the clock has been moved to
+	AdvanceSimulationClock(1000);
+	SelectVirtualDevice(sender);
+	SetControlValueByName("Light", 1);
+
+	uint64_t deliveryDeadline = RunVirtualNetworkToNextDeadline(100000);
+	int receiverValue = GetVirtualTestDeviceValue(receiver);
+
+	ExpectedValue valueList [2];
+	valueList[0].valueName = "Delivery Deadline";
+	valueList[0].expectedValue = 1200;
+	valueList[0].actualValue = deliveryDeadline;
+
+	valueList[1].valueName = "Receiver Value";
+	valueList[1].expectedValue = 1;
+	valueList[1].actualValue = receiverValue;
+
+	CheckResults(TestName, valueList, 2);
+
+	DestroyVirtualNetwork();
+	ResetSimulationClock();
+}
+
+void TestSimulationAnalyticsTime()
+{
+	std::string TestName = "Test Simulation Analytics Time";
+
+	SetSimulationClockMode(ManualClock);
+	SetSimulationClock(500);
+
+	heepByte absoluteBeforeEpoch = IsAbsoluteTime();
+	uint64_t relativeTime = GetAnalyticsTime();
+
+	uint64_t epoch = 1500000000000ULL;
+	SetAnalyticsTime(epoch);
+	AdvanceSimulationClock(5000);
+
+	ExpectedValue valueList [4];
+	valueList[0].valueName = "Absolute Before Epoch";
+	valueList[0].expectedValue = 0;
+	valueList[0].actualValue = absoluteBeforeEpoch;
+
+	valueList[1].valueName = "Relative Time";
+	valueList[1].expectedValue = 500;
+	valueList[1].actualValue = relativeTime;
+
+	valueList[2].valueName = "Absolute After Epoch";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = IsAbsoluteTime();
+
+	valueList[3].valueName = "Time Since Epoch";
+	valueList[3].expectedValue = 5000;
+	valueList[3].actualValue = GetAnalyticsTime() - epoch;
+
+	CheckResults(TestName, valueList, 4);
+
+	ResetSimulationClock();
+}
+
+void TestRealTimeRatioClock()
+{
+	std::string TestName = "Test Real Time Ratio Clock";
+
+	SetSimulationClock(0);
+	SetSimulationClockRatio(1000);
+	SetSimulationClockMode(RealTimeRatioClock);
+
+	// Two real milliseconds are at least two simulated seconds
+	usleep(2000);
+	unsigned long scaledTime = GetMillis();
+
+	ExpectedValue valueList [1];
+	valueList[0].valueName = "At Least 2 Simulated Seconds";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = scaledTime >= 2000;
+
+	CheckResults(TestName, valueList, 1);
+
+	ResetSimulationClock();
+}
+
+void TestSimulationTimer()
+{
+	TestManualSimulationClock();
+	TestJumpToSchedulerDeadline();
+	TestJumpToVirtualDatagramDeadline();
+	TestSimulationAnalyticsTime();
+	TestRealTimeRatioClock();
+}
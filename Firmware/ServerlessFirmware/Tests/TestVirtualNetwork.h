@@ -0,0 +1,617 @@
+#include "../Heep_API.h"
+#include "../Device.h"
+#include "../DeviceMemory.h"
+#include "../MemoryUtilities.h"
+#include "../Simulation_VirtualNetwork.h"
+#include "../Simulation_Timer.h"
+#include "../ReliableDelivery.h"
+#include "UnitTestSystem.h"
+
+HeepIPAddress CreateVirtualTestIP(int deviceNumber)
+{
+	HeepIPAddress theIP;
+	theIP.Octet4 = 10;
+	theIP.Octet3 = 0;
+	theIP.Octet2 = 0;
+	theIP.Octet1 = deviceNumber + 1;
+	return theIP;
+}
+
+void CreateVirtualTestDeviceID(heepByte* deviceID, int deviceNumber)
+{
+	deviceID[0] = 0xA0;
+	deviceID[1] = 0x00;
+	deviceID[2] = 0x00;
+	deviceID[3] = deviceNumber + 1;
+}
+
+// Every test device has a single control that forwards whatever it receives
+int CreateVirtualTestDevice(int deviceNumber)
+{
+	heepByte deviceID [STANDARD_ID_SIZE];
+	CreateVirtualTestDeviceID(deviceID, deviceNumber);
+
+	int device = AddVirtualDevice(deviceID, CreateVirtualTestIP(deviceNumber));
+	SelectVirtualDevice(device);
+
+	ClearVertices();
+	ClearDeviceMemory();
+	ClearControls();
+	SetDeviceName("Virtual");
+	AddOnOffControl("Light", HEEP_OUTPUT, 0);
+
+	return device;
+}
+
+void ConnectVirtualTestDevices(int txDevice, int rxDevice)
+{
+	SelectVirtualDevice(txDevice);
+
+	struct Vertex_Byte newVertex;
+	CreateVirtualTestDeviceID(newVertex.txID, txDevice);
+	CreateVirtualTestDeviceID(newVertex.rxID, rxDevice);
+	newVertex.txControlID = 0;
+	newVertex.rxControlID = 0;
+	newVertex.rxIPAddress = CreateVirtualTestIP(rxDevice);
+	AddVertex(newVertex);
+}
+
+int GetVirtualTestDeviceValue(int device)
+{
+	SelectVirtualDevice(device);
+	return controlList[0].curValue;
+}
+
+void TestVirtualNetworkDelivery()
+{
+	std::string TestName = "Test Virtual Network Delivery";
+
+	CreateVirtualNetwork(2, 1);
+	int sender = CreateVirtualTestDevice(0);
+	int receiver = CreateVirtualTestDevice(1);
+	ConnectVirtualTestDevices(sender, receiver);
+
+	SelectVirtualDevice(sender);
+	SetControlValueByName("Light", 1);
+
+	int valueBeforeDelivery = GetVirtualTestDeviceValue(receiver);
+	unsigned long datagramsProcessed = RunVirtualNetworkUntilIdle(100);
+	int valueAfterDelivery = GetVirtualTestDeviceValue(receiver);
+
+	VirtualNetworkStats stats;
+	GetVirtualNetworkStats(&stats);
+
+	ExpectedValue valueList [4];
+	valueList[0].valueName = "Value Before Delivery";
+	valueList[0].expectedValue = 0;
+	valueList[0].actualValue = valueBeforeDelivery;
+
+	valueList[1].valueName = "Value After Delivery";
+	valueList[1].expectedValue = 1;
+	valueList[1].actualValue = valueAfterDelivery;
+
+	valueList[2].valueName = "SetVal and Success ROP Processed";
+	valueList[2].expectedValue = 2;
+	valueList[2].actualValue = datagramsProcessed;
+
+	valueList[3].valueName = "Datagrams Delivered";
+	valueList[3].expectedValue = 2;
+	valueList[3].actualValue = stats.datagramsDelivered;
+
+	CheckResults(TestName, valueList, 4);
+
+	DestroyVirtualNetwork();
+}
+
+void TestVirtualNetworkLatency()
+{
+	std::string TestName = "Test Virtual Network Latency";
+
+	CreateVirtualNetwork(2, 1);
+	int sender = CreateVirtualTestDevice(0);
+	int receiver = CreateVirtualTestDevice(1);
+	ConnectVirtualTestDevices(sender, receiver);
+
+	VirtualLink slowLink = {5000, 0, 0, 0};
+	SetVirtualLink(sender, receiver, slowLink);
+
+	SelectVirtualDevice(sender);
+	SetControlValueByName("Light", 1);
+
+	RunVirtualNetworkUntil(4999);
+	int valueBeforeLatency = GetVirtualTestDeviceValue(receiver);
+
+	RunVirtualNetworkUntil(5000);
+	int valueAtLatency = GetVirtualTestDeviceValue(receiver);
+
+	ExpectedValue valueList [3];
+	valueList[0].valueName = "Value Before Latency Elapsed";
+	valueList[0].expectedValue = 0;
+	valueList[0].actualValue = valueBeforeLatency;
+
+	valueList[1].valueName = "Value After Latency Elapsed";
+	valueList[1].expectedValue = 1;
+	valueList[1].actualValue = valueAtLatency;
+
+	valueList[2].valueName = "Simulated Millis";
+	valueList[2].expectedValue = 5;
+	valueList[2].actualValue = simMillis;
+
+	CheckResults(TestName, valueList, 3);
+
+	DestroyVirtualNetwork();
+}
+
+void TestVirtualNetworkLoss()
+{
+	std::string TestName = "Test Virtual Network Loss";
+
+	CreateVirtualNetwork(2, 1);
+	int sender = CreateVirtualTestDevice(0);
+	int receiver = CreateVirtualTestDevice(1);
+	ConnectVirtualTestDevices(sender, receiver);
+
+	VirtualLink deadLink = {0, 0, 1000000, 0};
+	SetDefaultVirtualLink(deadLink);
+
+	SelectVirtualDevice(sender);
+	SetControlValueByName("Light", 1);
+	RunVirtualNetworkUntilIdle(100);
+
+	VirtualNetworkStats stats;
+	GetVirtualNetworkStats(&stats);
+
+	ExpectedValue valueList [2];
+	valueList[0].valueName = "Receiver Value";
+	valueList[0].expectedValue = 0;
+	valueList[0].actualValue = GetVirtualTestDeviceValue(receiver);
+
+	valueList[1].valueName = "Datagrams Lost";
+	valueList[1].expectedValue = 1;
+	valueList[1].actualValue = stats.datagramsLost;
+
+	CheckResults(TestName, valueList, 2);
+
+	DestroyVirtualNetwork();
+}
+
+unsigned long virtualTestTransportCalls = 0;
+
+// Carries COPs and drops every ROP
+heepByte VirtualTestTransport(heepByte* payload, unsigned int length)
+{
+	virtualTestTransportCalls++;
+
+	if(payload[0] == SuccessOpCode || payload[0] == ErrorOpCode)
+		return 1;
+
+	return 0;
+}
+
+void TestVirtualNetworkTransport()
+{
+	std::string TestName = "Test Virtual Network Transport";
+
+	CreateVirtualNetwork(2, 1);
+	int sender = CreateVirtualTestDevice(0);
+	int receiver = CreateVirtualTestDevice(1);
+	ConnectVirtualTestDevices(sender, receiver);
+
+	virtualTestTransportCalls = 0;
+	SetVirtualNetworkTransport(VirtualTestTransport);
+
+	SelectVirtualDevice(sender);
+	SetControlValueByName("Light", 1);
+	unsigned long datagramsProcessed = RunVirtualNetworkUntilIdle(100);
+
+	VirtualNetworkStats stats;
+	GetVirtualNetworkStats(&stats);
+
+	ExpectedValue valueList [4];
+	valueList[0].valueName = "Receiver Value";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = GetVirtualTestDeviceValue(receiver);
+
+	valueList[1].valueName = "Transport Calls";
+	valueList[1].expectedValue = 2;
+	valueList[1].actualValue = virtualTestTransportCalls;
+
+	valueList[2].valueName = "Datagrams Processed";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = datagramsProcessed;
+
+	valueList[3].valueName = "Reply Dropped";
+	valueList[3].expectedValue = 1;
+	valueList[3].actualValue = stats.datagramsLost;
+
+	CheckResults(TestName, valueList, 4);
+
+	DestroyVirtualNetwork();
+}
+
+void TestVirtualNetworkChain()
+{
+	std::string TestName = "Test Virtual Network Chain Propagation";
+
+	const int chainLength = 5;
+	CreateVirtualNetwork(chainLength, 1);
+
+	for(int i = 0; i < chainLength; i++)
+	{
+		CreateVirtualTestDevice(i);
+	}
+
+	for(int i = 0; i < chainLength - 1; i++)
+	{
+		ConnectVirtualTestDevices(i, i + 1);
+	}
+
+	VirtualLink hopLink = {1000, 0, 0, 0};
+	SetDefaultVirtualLink(hopLink);
+
+	SelectVirtualDevice(0);
+	SetControlValueByName("Light", 1);
+
+	uint64_t lastSetValTime = 0;
+	while(GetNextVirtualDatagramTime(&lastSetValTime) == 0 && GetVirtualTestDeviceValue(chainLength - 1) == 0)
+	{
+		ProcessNextVirtualDatagram();
+	}
+
+	ExpectedValue valueList [2];
+	valueList[0].valueName = "Tail Value";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = GetVirtualTestDeviceValue(chainLength - 1);
+
+	valueList[1].valueName = "Propagation Time";
+	valueList[1].expectedValue = 1000 * (chainLength - 1);
+	valueList[1].actualValue = virtualNetworkTimeMicros;
+
+	CheckResults(TestName, valueList, 2);
+
+	DestroyVirtualNetwork();
+}
+
+void TestVirtualNetworkIPChangeBroadcast()
+{
+	std::string TestName = "Test Virtual Network IP Change Broadcast";
+
+	CreateVirtualNetwork(3, 1);
+	int changingDevice = CreateVirtualTestDevice(0);
+	int listener = CreateVirtualTestDevice(1);
+	CreateVirtualTestDevice(2);
+	ConnectVirtualTestDevices(listener, changingDevice);
+
+	SelectVirtualDevice(changingDevice);
+	SetIPInMemory_Byte(CreateVirtualTestIP(changingDevice), deviceIDByte);
+
+	HeepIPAddress newIP = CreateVirtualTestIP(50);
+	SetVirtualDeviceIP(changingDevice, newIP);
+	HandleIPChanges();
+
+	RunVirtualNetworkUntilIdle(100);
+
+	SelectVirtualDevice(listener);
+	struct Vertex_Byte listenerVertex;
+	GetVertexAtPointer_Byte(vertexPointerList[0], &listenerVertex);
+
+	VirtualNetworkStats stats;
+	GetVirtualNetworkStats(&stats);
+
+	ExpectedValue valueList [2];
+	valueList[0].valueName = "Vertex IP Updated";
+	valueList[0].expectedValue = newIP.Octet1;
+	valueList[0].actualValue = listenerVertex.rxIPAddress.Octet1;
+
+	// 3 broadcasts to 2 devices, each answered with a ROP
+	valueList[1].valueName = "Datagrams Delivered";
+	valueList[1].expectedValue = 12;
+	valueList[1].actualValue = stats.datagramsDelivered;
+
+	CheckResults(TestName, valueList, 2);
+
+	DestroyVirtualNetwork();
+}
+
+void TestVirtualNetworkControlSummaries()
+{
+	std::string TestName = "Test Virtual Network Control Summaries";
+
+	CreateVirtualNetwork(2, 1);
+	int sender = CreateVirtualTestDevice(0);
+	int receiver = CreateVirtualTestDevice(1);
+	ConnectVirtualTestDevices(sender, receiver);
+
+	SelectVirtualDevice(sender);
+	SetControlValueByName("Light", 1);
+	RunVirtualNetworkUntilIdle(100);
+
+	// Nothing is stale, so only the summary and its success ROP are sent
+	ClearVirtualNetworkStats();
+	SelectVirtualDevice(sender);
+	SendControlSummaries();
+	RunVirtualNetworkUntilIdle(100);
+
+	VirtualNetworkStats steadyStats;
+	GetVirtualNetworkStats(&steadyStats);
+
+	// The receiver misses a value, so the summary brings a resend
+	SelectVirtualDevice(receiver);
+	controlList[0].curValue = 0;
+
+	ClearVirtualNetworkStats();
+	SelectVirtualDevice(sender);
+	SendControlSummaries();
+	RunVirtualNetworkUntilIdle(100);
+
+	VirtualNetworkStats staleStats;
+	GetVirtualNetworkStats(&staleStats);
+
+	ExpectedValue valueList [3];
+	valueList[0].valueName = "Steady State Datagrams";
+	valueList[0].expectedValue = 2;
+	valueList[0].actualValue = steadyStats.datagramsDelivered;
+
+	valueList[1].valueName = "Stale Value Resent";
+	valueList[1].expectedValue = 1;
+	valueList[1].actualValue = GetVirtualTestDeviceValue(receiver);
+
+	// Summary, stale controls ROP, SetVal and its success ROP
+	valueList[2].valueName = "Stale Datagrams";
+	valueList[2].expectedValue = 4;
+	valueList[2].actualValue = staleStats.datagramsDelivered;
+
+	CheckResults(TestName, valueList, 3);
+
+	DestroyVirtualNetwork();
+}
+
+// More destinations than one pass gathers, so the summaries take several
+void TestVirtualNetworkControlSummaryPasses()
+{
+	std::string TestName = "Test Virtual Network Control Summary Passes";
+
+	int numberOfReceivers = SUMMARY_DESTINATIONS_PER_PASS + 3;
+
+	CreateVirtualNetwork(numberOfReceivers + 1, 1);
+	int sender = CreateVirtualTestDevice(0);
+	for(int i = 1; i <= numberOfReceivers; i++)
+	{
+		CreateVirtualTestDevice(i);
+		ConnectVirtualTestDevices(sender, i);
+	}
+
+	SelectVirtualDevice(sender);
+	SetControlValueByName("Light", 1);
+	RunVirtualNetworkUntilIdle(100);
+
+	ClearVirtualNetworkStats();
+	SelectVirtualDevice(sender);
+	SendControlSummaries();
+	RunVirtualNetworkUntilIdle(100);
+
+	VirtualNetworkStats steadyStats;
+	GetVirtualNetworkStats(&steadyStats);
+
+	for(int i = 1; i <= numberOfReceivers; i++)
+	{
+		SelectVirtualDevice(i);
+		controlList[0].curValue = 0;
+	}
+
+	SelectVirtualDevice(sender);
+	SendControlSummaries();
+	RunVirtualNetworkUntilIdle(100);
+
+	int receiversResent = 0;
+	for(int i = 1; i <= numberOfReceivers; i++)
+	{
+		if(GetVirtualTestDeviceValue(i) == 1)
+			receiversResent++;
+	}
+
+	ExpectedValue valueList [2];
+	valueList[0].valueName = "One Summary Per Destination";
+	valueList[0].expectedValue = 2*numberOfReceivers;
+	valueList[0].actualValue = steadyStats.datagramsDelivered;
+
+	valueList[1].valueName = "Every Destination Resent";
+	valueList[1].expectedValue = numberOfReceivers;
+	valueList[1].actualValue = receiversResent;
+
+	CheckResults(TestName, valueList, 2);
+
+	DestroyVirtualNetwork();
+}
+
+// Two devices importing at once each keep their own partial image
+void TestVirtualNetworkMemoryImageImports()
+{
+#ifdef USE_MEMORY_IMAGE_IMPORT
+	std::string TestName = "Test Virtual Network Memory Image Imports";
+
+	CreateVirtualNetwork(3, 1);
+	int source = CreateVirtualTestDevice(0);
+	int firstImporter = CreateVirtualTestDevice(1);
+	int secondImporter = CreateVirtualTestDevice(2);
+
+	SelectVirtualDevice(source);
+	heepByte userData [200];
+	memset(userData, 0x42, sizeof(userData));
+	AddUserMemory(0, userData, sizeof(userData));
+
+	heepByte sourceID [STANDARD_ID_SIZE];
+	CopyDeviceID(deviceIDByte, sourceID);
+	unsigned short checksum = 0;
+	unsigned int imageSize = ExportMemoryImage(&checksum);
+
+	SelectVirtualDevice(firstImporter);
+	FillInputBufferWithImportMemoryImageCOP(controlRegister, sourceID, imageSize, checksum, 0, MEMORY_IMAGE_CHUNK_SIZE);
+	ExecuteControlOpCodes();
+
+	// Starts an image of its own with another checksum
+	SelectVirtualDevice(secondImporter);
+	FillInputBufferWithImportMemoryImageCOP(controlRegister, sourceID, imageSize, checksum + 1, 0, MEMORY_IMAGE_CHUNK_SIZE);
+	ExecuteControlOpCodes();
+
+	SelectVirtualDevice(firstImporter);
+	for(unsigned int offset = MEMORY_IMAGE_CHUNK_SIZE; offset < imageSize; offset += MEMORY_IMAGE_CHUNK_SIZE)
+	{
+		unsigned int chunkLength = imageSize - offset;
+		if(chunkLength > MEMORY_IMAGE_CHUNK_SIZE)
+			chunkLength = MEMORY_IMAGE_CHUNK_SIZE;
+
+		FillInputBufferWithImportMemoryImageCOP(controlRegister, sourceID, imageSize, checksum, offset, chunkLength);
+		ExecuteControlOpCodes();
+	}
+
+	heepByte restoredROP = outputBuffer[0];
+	unsigned int restoredFilledMemory = curFilledMemory;
+
+	ExpectedValue valueList [3];
+	valueList[0].valueName = "Image Spans Chunks";
+	valueList[0].expectedValue = 1;
+	valueList[0].actualValue = imageSize > MEMORY_IMAGE_CHUNK_SIZE;
+
+	valueList[1].valueName = "Restored ROP";
+	valueList[1].expectedValue = SuccessOpCode;
+	valueList[1].actualValue = restoredROP;
+
+	valueList[2].valueName = "Filled Memory";
+	valueList[2].expectedValue = imageSize;
+	valueList[2].actualValue = restoredFilledMemory;
+
+	CheckResults(TestName, valueList, 3);
+
+	DestroyVirtualNetwork();
+#endif
+}
+
+// Runs the network and the sender's retransmissions until nothing waits
+void RunReliableDelivery(int sender, int maxSteps)
+{
+	for(int i = 0; i < maxSteps; i++)
+	{
+		RunVirtualNetworkUntilIdle(100);
+
+		SelectVirtualDevice(sender);
+		if(GetNumberOfWaitingSetVals() == 0)
+			return;
+
+		AdvanceSimulationClock(10);
+		RetransmitReliableSetVals();
+	}
+}
+
+void TestVirtualNetworkReliableDelivery()
+{
+	std::string TestName = "Test Virtual Network Reliable Delivery";
+
+	CreateVirtualNetwork(2, 1);
+	int sender = CreateVirtualTestDevice(0);
+	int receiver = CreateVirtualTestDevice(1);
+	ConnectVirtualTestDevices(sender, receiver);
+
+	SetSimulationClockMode(ManualClock);
+	SetSimulationClock(0);
+
+	SelectVirtualDevice(sender);
+	SetReliableDelivery(1);
+
+	// Lossless, so no retransmissions
+	SetControlValueByName("Light", 1);
+	RunReliableDelivery(sender, 100);
+
+	SelectVirtualDevice(sender);
+	unsigned long losslessRetransmissions = reliableDelivery.retransmissions;
+
+	// One datagram in five is lost in each direction
+	VirtualLink lossyLink = {0, 0, 200000, 0};
+	SetDefaultVirtualLink(lossyLink);
+
+	int deliveredValues = 0;
+	for(int value = 2; value < 40; value++)
+	{
+		SelectVirtualDevice(sender);
+		SetControlValueByName("Light", value);
+		RunReliableDelivery(sender, 1000);
+
+		if(GetVirtualTestDeviceValue(receiver) == value)
+			deliveredValues++;
+	}
+
+	SelectVirtualDevice(sender);
+
+	ExpectedValue valueList [5];
+	valueList[0].valueName = "Lossless Retransmissions";
+	valueList[0].expectedValue = 0;
+	valueList[0].actualValue = losslessRetransmissions;
+
+	valueList[1].valueName = "Values Delivered Over Loss";
+	valueList[1].expectedValue = 38;
+	valueList[1].actualValue = deliveredValues;
+
+	valueList[2].valueName = "Retransmitted Over Loss";
+	valueList[2].expectedValue = 1;
+	valueList[2].actualValue = reliableDelivery.retransmissions > 0;
+
+	valueList[3].valueName = "Nothing Abandoned";
+	valueList[3].expectedValue = 0;
+	valueList[3].actualValue = reliableDelivery.abandonedSetVals;
+
+	valueList[4].valueName = "Nothing Waiting";
+	valueList[4].expectedValue = 0;
+	valueList[4].actualValue = GetNumberOfWaitingSetVals();
+
+	CheckResults(TestName, valueList, 5);
+
+	DestroyVirtualNetwork();
+	ResetSimulationClock();
+}
+
+void TestVirtualNetworkDefragmentThreshold()
+{
+	std::string TestName = "Test Virtual Network Defragment Threshold";
+
+	CreateVirtualNetwork(2, 1);
+	int first = CreateVirtualTestDevice(0);
+	int second = CreateVirtualTestDevice(1);
+
+	SelectVirtualDevice(first);
+	SetDefragmentThreshold(0);
+
+	SelectVirtualDevice(second);
+	unsigned char secondThreshold = defragmentThreshold;
+
+	SelectVirtualDevice(first);
+	unsigned char firstThreshold = defragmentThreshold;
+
+	ExpectedValue valueList [2];
+	valueList[0].valueName = "New Device Default";
+	valueList[0].expectedValue = DEFRAGMENT_THRESHOLD_PERCENT;
+	valueList[0].actualValue = secondThreshold;
+
+	valueList[1].valueName = "Kept Per Device";
+	valueList[1].expectedValue = 0;
+	valueList[1].actualValue = firstThreshold;
+
+	CheckResults(TestName, valueList, 2);
+
+	DestroyVirtualNetwork();
+	SetDefragmentThreshold(DEFRAGMENT_THRESHOLD_PERCENT);
+}
+
+void TestVirtualNetwork()
+{
+	TestVirtualNetworkDelivery();
+	TestVirtualNetworkLatency();
+	TestVirtualNetworkLoss();
+	TestVirtualNetworkTransport();
+	TestVirtualNetworkChain();
+	TestVirtualNetworkIPChangeBroadcast();
+	TestVirtualNetworkControlSummaries();
+	TestVirtualNetworkControlSummaryPasses();
+	TestVirtualNetworkMemoryImageImports();
+	TestVirtualNetworkReliableDelivery();
+	TestVirtualNetworkDefragmentThreshold();
+}